@@ -6,6 +6,7 @@
 #include "src/adapt_parops.h"
 #include "src/hex2tet.h"
 #include "src/adapt_boundary.h"
+#include "src/adapt_parmmg.h"
 //#include "src/adapt_blshell.h"
 #include <iomanip>
 
@@ -18,7 +19,9 @@ int mpi_size, mpi_rank;
 
 int main(int argc, char** argv) {
     
-    MPI_Init(NULL, NULL);
+    // Only the master thread of each rank makes MPI calls.
+    int provided;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
    
     MPI_Comm comm = MPI_COMM_WORLD;
     MPI_Info info = MPI_INFO_NULL;
@@ -28,6 +31,15 @@ int main(int argc, char** argv) {
     int world_rank;
     MPI_Comm_rank(comm, &world_rank);
     
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    if(world_rank == 0)
+    {
+        std::cout << "Running on " << world_size << " ranks x " << nthreads << " threads." << std::endl;
+    }
+    
     int debug = 0;
 //    if(world_rank == 0)
 //    {
@@ -46,6 +58,13 @@ int main(int argc, char** argv) {
     const char* fn_grid;
     const char* fn_conn;
     const char* fn_data;
+    // --mode=parmmg adapts the mesh with ParMMG on all ranks and --mode=subdomain with MMG3D
+    // on every partition in two passes; by default MMG3D runs on rank 0.
+    int remesh_mode = 0;
+    // --deflate=N compresses the output grid with deflate level N (1-9); 0 writes it uncompressed.
+    int deflate_level = 0;
+    // --wall=3,5 lists the boundary references of the walls that carry the boundary layer mesh.
+    std::set<int> wall_ids;
     std::map<int,const char*> fnames;
     for(int i = 1;i<argc;i++)
     {
@@ -77,8 +96,75 @@ int main(int argc, char** argv) {
             fn_data = fn_data_n;
             fnames[i]=fn_data;
         }
+        else if (str.compare(0,6,"--mode") == 0)
+        {
+            if(str == "--mode=parmmg")
+            {
+                remesh_mode = 1;
+            }
+            else if(str == "--mode=subdomain")
+            {
+                remesh_mode = 2;
+            }
+            else
+            {
+                if(world_rank == 0)
+                {
+                    std::cout << "Error :: " << str << " is not valid, use --mode=parmmg or --mode=subdomain." << std::endl;
+                }
+                MPI_Abort(comm, 1);
+            }
+        }
+        else if (str.compare(0,9,"--deflate") == 0)
+        {
+            char* end = NULL;
+            if(str.size() > 10 && str[9] == '=')
+            {
+                deflate_level = strtol(str.c_str()+10, &end, 10);
+            }
+            if(end == NULL || *end != '\0' || deflate_level < 0 || deflate_level > 9)
+            {
+                if(world_rank == 0)
+                {
+                    std::cout << "Error :: " << str << " is not valid, use --deflate=N with N from 0 to 9." << std::endl;
+                }
+                MPI_Abort(comm, 1);
+            }
+        }
+        else if (str.compare(0,6,"--wall") == 0)
+        {
+            int valid = (str.size() > 7 && str[6] == '=' && str[str.size()-1] != ',');
+            if(valid)
+            {
+                std::stringstream ss(str.substr(7));
+                std::string id;
+                while(std::getline(ss,id,','))
+                {
+                    char* end = NULL;
+                    long ref  = strtol(id.c_str(), &end, 10);
+                    if(id.empty() || *end != '\0' || ref <= 0 || ref > INT_MAX)
+                    {
+                        valid = 0;
+                        break;
+                    }
+                    wall_ids.insert(int(ref));
+                }
+            }
+            if(!valid)
+            {
+                if(world_rank == 0)
+                {
+                    std::cout << "Error :: " << str << " is not valid, use --wall=id[,id...] with positive boundary references." << std::endl;
+                }
+                MPI_Abort(comm, 1);
+            }
+        }
         
         
+    }
+    if(wall_ids.empty())
+    {
+        wall_ids.insert(3);
     }
     if(fnames.size()!=3)
     {
@@ -102,7 +188,7 @@ int main(int argc, char** argv) {
         int varia = 4;
         
         int ReadFromStats = 0;
-        if(metric_inputs.size()==6)
+        if(metric_inputs.size()>=6)
         {
             ReadFromStats=metric_inputs[5];
         }
@@ -134,6 +220,24 @@ int main(int argc, char** argv) {
             Uivar->setVal(i,0,MState);
         }
         
+        // Additional sensors for the metric are the columns of the interior state listed
+        // in metric.inp after the target number of vertices; the Mach number is always
+        // the first sensor.
+        std::vector<int> sensor_cols;
+        for(int i=7;i<metric_inputs.size();i++)
+        {
+            sensor_cols.push_back(int(metric_inputs[i]));
+        }
+        int nsens = sensor_cols.size()+1;
+        Array<double>* Usens = new Array<double>(Nel_part,nsens-1);
+        for(int i=0;i<Nel_part;i++)
+        {
+            for(int s=0;s<nsens-1;s++)
+            {
+                Usens->setVal(i,s,us3d->interior->getVal(i,sensor_cols[s]));
+            }
+        }
+        
         delete us3d->interior;
 
         
@@ -175,7 +279,11 @@ int main(int argc, char** argv) {
             Uvaria_map[gid] = Uarr;
         }
         
-        Mesh_Topology* meshTopo = new Mesh_Topology(P,comm);
+        // Element/face geometry of the partition shared by the reconstruction,
+        // the topology and the metric computation.
+        Mesh_Geometry* geom = new Mesh_Geometry(P,comm);
+        
+        Mesh_Topology* meshTopo = new Mesh_Topology(P,geom,comm);
         
         std::map<int,double> Volumes = meshTopo->getVol();
         
@@ -183,13 +291,63 @@ int main(int argc, char** argv) {
 
         P->AddStateVecForAdjacentElements(Uvaria_map,1,comm);
         
-        std::map<int,Array<double>* > var_vmap = P->ReduceStateVecToAllVertices(Uvaria_map,1);
-        std::map<int,Array<double>* >::iterator vm;
-        for(vm=var_vmap.begin();vm!=var_vmap.end();vm++)
+        std::map<int,Array<double>* > Usens_map = Uvaria_map;
+        if(nsens > 1)
+        {
+            // The additional sensors are scaled to the magnitude of the Mach number so
+            // that a single scaling factor f applies to all of them.
+            Array<double>* Usens_p = GetElementDataOnPartition(ien_pstate, Usens, LocElem, comm);
+            std::vector<double> umax(nsens,0.0);
+            std::vector<double> umax_glob(nsens,0.0);
+            for(int i=0;i<LocElem.size();i++)
+            {
+                umax[0] = std::max(umax[0],fabs(Uvaria[i]));
+                for(int s=1;s<nsens;s++)
+                {
+                    umax[s] = std::max(umax[s],fabs(Usens_p->getVal(i,s-1)));
+                }
+            }
+            MPI_Allreduce(&umax[0], &umax_glob[0], nsens, MPI_DOUBLE, MPI_MAX, comm);
+            
+            Usens_map.clear();
+            for(int i=0;i<LocElem.size();i++)
+            {
+                Array<double>* Us = new Array<double>(nsens,1);
+                Us->setVal(0,0,Uvaria[i]);
+                for(int s=1;s<nsens;s++)
+                {
+                    Us->setVal(s,0,Usens_p->getVal(i,s-1)*umax_glob[0]/std::max(umax_glob[s],1.0e-30));
+                }
+                Usens_map[LocElem[i]] = Us;
+            }
+            P->AddStateVecForAdjacentElements(Usens_map,nsens,comm);
+            delete Usens_p;
+            
+            if(world_rank == 0)
+            {
+                std::cout << "Computing the metric from " << nsens << " sensors." << std::endl;
+            }
+        }
+        delete Usens;
+        
+        // Vertex data is reduced by the owner of each vertex, so that it does not depend
+        // on the number of ranks. All vertex arrays below follow the ordering of vgid.
+        std::map<int,std::vector<int> >::iterator itv;
+        std::vector<int> vgid;
+        for(itv=P->getPartitionDomain()->vert2elem.begin();itv!=P->getPartitionDomain()->vert2elem.end();itv++)
+        {
+            vgid.push_back(itv->first);
+        }
+        int nvert = vgid.size();
+        SharedVertexMap* svm = ComputeSharedVertexMap(P->getXcnParallelState(), &vgid[0], nvert, comm);
+        
+        double* var_v = new double[nvert];
+        ReduceElementDataToVertices(P, svm, nvert, &vgid[0], Uvaria_map, 0, 1, NULL, var_v, comm);
+        for(int i=0;i<nvert;i++)
         {
-            if(vm->second->getVal(0,0)<0.0)
+            if(var_v[i]<0.0)
             {
-                std::cout << "Mach vert " << vm->first << " " << vm->second->getVal(0,0) << std::endl;
+                std::cout << "Mach vert " << vgid[i] << " " << var_v[i] << std::endl;
             }
             
         }
@@ -221,307 +379,194 @@ int main(int argc, char** argv) {
         t = clock();
         if(world_rank == 0)
         {
-            std::cout << "Started reconstructing the gradient... " << std::endl;
+            std::cout << "Started reconstructing the gradient and Hessian... " << std::endl;
         }
         
-        std::map<int,Array<double>* > dUdXi = ComputedUdx_LSQ_US3D(P,Uvaria_map,gB,comm);
+        // Gradient and Hessian come from a single quadratic fit over the vertex
+        // patch of each element; dUdXi[gid] holds [dU/dx,dU/dy,dU/dz,Hxx,Hxy,Hxz,Hyy,Hyz,Hzz]
+        // for each sensor.
+        // The former approach differentiated the LSQ gradient a second time:
+        //      dUdXi = ComputedUdx_LSQ_US3D(P,Uvaria_map,gB,comm);
+        //      P->AddStateVecForAdjacentElements(dUdXi,3,comm);
+        //      dU2dXi2 = ComputedUdx_LSQ_US3D_Vec(P,geom,dUdXi,3,gB,comm);
+        std::map<int,Array<double>* > dUdXi = ComputeHessian_LSQ_US3D(P,geom,Usens_map,nsens,gB,comm);
         
         double Gtiming = ( std::clock() - t) / (double) CLOCKS_PER_SEC;
         double Gmax_time = 0.0;
         MPI_Allreduce(&Gtiming, &Gmax_time, 1, MPI_DOUBLE, MPI_MAX, comm);
         if(world_rank == 0)
         {
-            std::cout << "Finished reconstructing the gradient... " << std::endl;
-            std::cout << "Timing gradient reconstruction... " << Gmax_time << std::endl;
+            std::cout << "Finished reconstructing the gradient and Hessian... " << std::endl;
+            std::cout << "Timing gradient and Hessian reconstruction... " << Gmax_time << std::endl;
         }
         
-        P->AddStateVecForAdjacentElements(dUdXi,3,comm);
+        std::map<int,Array<double>* >::iterator itgg;
+        double po = 6.0;
         
-        std::map<int,Array<double>* >::iterator grit;
-        std::map<int,Array<double>* > dUidxi_map;
-        std::map<int,Array<double>* > dUidyi_map;
-        std::map<int,Array<double>* > dUidzi_map;
-        std::map<int,Array<double>* > dUidXi_map;
-        for(grit=dUdXi.begin();grit!=dUdXi.end();grit++)
+        // Vertex Hessians/metric are kept in one packed buffer per sensor up to the gather on rank 0.
+        std::vector<TensorField*> hess_vfs(nsens);
+        for(int s=0;s<nsens;s++)
         {
-            
-            Array<double>* dUdx_E = new Array<double>(1,1);
-            dUdx_E->setVal(0,0,grit->second->getVal(0,0));
-            Array<double>* dUdy_E = new Array<double>(1,1);
-            dUdy_E->setVal(0,0,grit->second->getVal(1,0));
-            Array<double>* dUdz_E = new Array<double>(1,1);
-            dUdz_E->setVal(0,0,grit->second->getVal(2,0));
-            
-            dUidxi_map[grit->first]=dUdx_E;
-            dUidyi_map[grit->first]=dUdy_E;
-            dUidzi_map[grit->first]=dUdz_E;
-            
-            delete grit->second;
-            
-            //si++;
+            hess_vfs[s] = new TensorField(nvert);
+            std::copy(vgid.begin(),vgid.end(),hess_vfs[s]->gid);
+            ReduceElementDataToVertices(P, svm, nvert, &vgid[0], dUdXi, 9*s+3, 6, NULL, hess_vfs[s]->data, comm);
         }
-
-
-        //std::cout << "second gradient "<<std::endl;
-        std::map<int,Array<double>* > dU2dXi2 = ComputedUdx_LSQ_US3D(P,dUidxi_map,gB,comm);
-        std::map<int,Array<double>* > dU2dYi2 = ComputedUdx_LSQ_US3D(P,dUidyi_map,gB,comm);
-        std::map<int,Array<double>* > dU2dZi2 = ComputedUdx_LSQ_US3D(P,dUidzi_map,gB,comm);
-
-//      Array<double>* dU2dXi2 = ComputedUdx_MGG(P,dUdxauxNew,meshTopo,gB,comm);
-//      Array<double>* dU2dYi2 = ComputedUdx_MGG(P,dUdyauxNew,meshTopo,gB,comm);
-//      Array<double>* dU2dZi2 = ComputedUdx_MGG(P,dUdzauxNew,meshTopo,gB,comm);
-                
-        std::map<int,Array<double>*> Hess_map;
-        //std::cout << "second gradient 2"<<std::endl;
-
-        std::map<int,Array<double>* >::iterator itgg;
-        int te = 0;
         
-        for(itgg=dU2dXi2.begin();itgg!=dU2dXi2.end();itgg++)
+        for(itgg=dUdXi.begin();itgg!=dUdXi.end();itgg++)
         {
-            int gid = itgg->first;
-            
-            Array<double>* Hess = new Array<double>(6,1);
-            
-            Hess->setVal(0,0,dU2dXi2[gid]->getVal(0,0));
-            Hess->setVal(1,0,dU2dXi2[gid]->getVal(1,0));
-            Hess->setVal(2,0,dU2dXi2[gid]->getVal(2,0));
-
-            Hess->setVal(3,0,dU2dYi2[gid]->getVal(1,0));
-            Hess->setVal(4,0,dU2dYi2[gid]->getVal(2,0));
-            Hess->setVal(5,0,dU2dZi2[gid]->getVal(2,0));
-            
-            Hess_map[gid] = Hess;
-            
-            delete dU2dXi2[gid];
-            delete dU2dYi2[gid];
-            delete dU2dZi2[gid];
-            
-            t++;
+            delete itgg->second;
         }
+        dUdXi.clear();
         
-        dU2dXi2.clear();
-        dU2dYi2.clear();
-        dU2dZi2.clear();
+        // An optional 7th entry in metric.inp sets the target number of vertices, in which
+        // case ComputeMetric determines the scaling factor f itself.
+        double Ntarget = 0.0;
+        if(metric_inputs.size()>=7)
+        {
+            Ntarget = metric_inputs[6];
+        }
+        if(world_rank == 0 && Ntarget > 0.0)
+        {
+            std::cout << "Target number of vertices = " << Ntarget << " (current mesh " << Nve << ")" << std::endl;
+        }
+        // The gradation (hgrad = metric_inputs[0]) is applied to the partitioned metric
+        // in ComputeMetric, so MMG3D on rank 0 does not need to grade it again.
+        ComputeMetric(P, geom, metric_inputs, comm, var_v, hess_vfs, 1.0, po, Ntarget, svm, metric_inputs[0]);
+        for(int s=1;s<nsens;s++)
+        {
+            delete hess_vfs[s];
+        }
+        TensorField* hess_vf = hess_vfs[0];
         
+        delete[] var_v;
+        delete svm;
         
-        double* Hessie = new double[9];
-        double * WRn = new double[3];
-        Array<double>* DR  = new Array<double>(3,3);
-        Array<double>* UR  = new Array<double>(3,3);
-        //+++++++++++++++++++++++++++++++++++++++++++
-        //++++  Scaling eigenvalues/eigenvectors ++++
-        double hmin         = metric_inputs[1];
-        double hmax         = metric_inputs[2];
-        double f            = metric_inputs[3];
-        //+++++++++++++++++++++++++++++++++++++++++++
-        //+++++++++++++++++++++++++++++++++++++++++++
-        double cmplxty = 0.0;
-        double cmplxty2 = 0.0;
-        double Volu=0.0,cmplxty_red=0.0,cmplxty_tmp=0.0,cmplxty_tmp2=0.0;
-        double po = 6.0;
-        for(int j=0;j<3;j++)
+        if(remesh_mode != 0)
         {
-            for(int k=0;k<3;k++)
+            int nLayer = metric_inputs[4];
+            BLShellInfo* BLshell = NULL;
+            Mesh_Topology_BL* mesh_topo_bl = NULL;
+            std::set<int> shell_faces;
+            if(nLayer>0)
             {
-                DR->setVal(j,k,0.0);
+                BLshell = FindOuterShellBoundaryLayerMesh(wall_ids, nLayer, P, geom, comm);
+                std::vector<std::vector<int> > u_tris = TriangulateShellFaces(BLshell);
+                mesh_topo_bl = ExtractBoundaryLayerMeshFromShell(u_tris, BLshell, nLayer, comm);
+                shell_faces  = GetShellFacesOfOuterVolume(P, BLshell, comm);
+            }
+            else
+            {
+                BLshell = new BLShellInfo;
+                mesh_topo_bl = new Mesh_Topology_BL;
+                mesh_topo_bl->Nprisms = 0;
             }
-        }
-        for(itgg=Hess_map.begin();itgg!=Hess_map.end();itgg++)
-        {
-            Hessie[0] = itgg->second->getVal(0,0);
-            Hessie[1] = itgg->second->getVal(1,0);
-            Hessie[2] = itgg->second->getVal(2,0);
-            
-            Hessie[3] = itgg->second->getVal(1,0);
-            Hessie[4] = itgg->second->getVal(3,0);
-            Hessie[5] = itgg->second->getVal(4,0);
-            
-            Hessie[6] = itgg->second->getVal(2,0);
-            Hessie[7] = itgg->second->getVal(4,0);
-            Hessie[8] = itgg->second->getVal(5,0);
             
-            Eig* eig = ComputeEigenDecomp(3, Hessie);
+            DistributedMesh* dm = NULL;
+            if(remesh_mode == 1)
+            {
+                PMMG_pParMesh parmesh = InitParMMGMeshOnPartition(P, geom, hess_vf, BLshell, shell_faces, comm);
             
-            WRn[0] = std::min(std::max(f*fabs(eig->Dre[0]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
-            WRn[1] = std::min(std::max(f*fabs(eig->Dre[1]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
-            WRn[2] = std::min(std::max(f*fabs(eig->Dre[2]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
+                // The metric is already graded by GradateMetric.
+                if ( PMMG_Set_dparameter(parmesh, PMMG_DPARAM_hgrad, -1) != 1 )    exit(EXIT_FAILURE);
+                if ( PMMG_Set_dparameter(parmesh, PMMG_DPARAM_hgradreq, -1) != 1 )    exit(EXIT_FAILURE);
+                if ( PMMG_Set_iparameter(parmesh, PMMG_IPARAM_globalNum, 1) != 1 )    exit(EXIT_FAILURE);
             
-            DR->setVal(0,0,WRn[0]);DR->setVal(0,1,0.0);DR->setVal(0,1,0.0);
-            DR->setVal(1,0,0.0);DR->setVal(1,1,WRn[1]);DR->setVal(1,2,0.0);
-            DR->setVal(2,0,0.0);DR->setVal(2,1,0.0);DR->setVal(2,2,WRn[2]);
+                if(world_rank == 0)
+                {
+                    std::cout << "Started adapting the mesh with ParMMG..." << std::endl;
+                }
+                int ier = PMMG_parmmglib_distributed(parmesh);
+                if(ier == PMMG_STRONGFAILURE)
+                {
+                    std::cout << "Error :: ParMMG failed on rank " << world_rank << "." << std::endl;
+                    MPI_Abort(comm, EXIT_FAILURE);
+                }
             
-            UR->setVal(0,0,eig->V[0]);UR->setVal(0,1,eig->V[1]);UR->setVal(0,2,eig->V[2]);
-            UR->setVal(1,0,eig->V[3]);UR->setVal(1,1,eig->V[4]);UR->setVal(1,2,eig->V[5]);
-            UR->setVal(2,0,eig->V[6]);UR->setVal(2,1,eig->V[7]);UR->setVal(2,2,eig->V[8]);
-
-            Array<double>* iVR = MatInv(UR);
-            Array<double>* Rs = MatMul(UR,DR);
-            Array<double>* Rf = MatMul(Rs,iVR);
-            double detRf = sqrt( Rf->getVal(0,0)*(Rf->getVal(1,1)*Rf->getVal(2,2)-Rf->getVal(2,1)*Rf->getVal(1,2))
-                                -Rf->getVal(0,1)*(Rf->getVal(1,0)*Rf->getVal(2,2)-Rf->getVal(2,0)*Rf->getVal(1,2))
-                                +Rf->getVal(0,2)*(Rf->getVal(1,0)*Rf->getVal(2,1)-Rf->getVal(2,0)*Rf->getVal(1,1)));
+                dm = GetDistributedMeshFromParMMG(parmesh, mesh_topo_bl, BLshell, xcn_pstate, comm);
+                        
+                PMMG_Free_all(PMMG_ARG_start,
+                              PMMG_ARG_ppParMesh,&parmesh,
+                              PMMG_ARG_end);
+            }
+            else
+            {
+                // The partitions are remeshed with their interfaces frozen, then the tetrahedra
+                // around the interfaces are moved to the neighbouring rank and the former
+                // interfaces are remeshed in a second pass.
+                int nShift = 2;
+                if(world_rank == 0)
+                {
+                    std::cout << "Started adapting the partitions with MMG3D..." << std::endl;
+                }
+                SubdomainMesh* sm = BuildSubdomainMeshOnPartition(P, geom, hess_vf, BLshell, shell_faces, 1, comm);
+                RemeshSubdomainWithMMG3D(sm, comm);
+                int ngid = NumberNewSubdomainVertices(sm, us3d->xcn->getNglob(), comm);
+                
+                SubdomainMesh* sm_shift = ShiftSubdomainInterfaces(sm, ngid, nShift, comm);
+                delete sm;
+                if(world_rank == 0)
+                {
+                    std::cout << "Started adapting the former partition interfaces with MMG3D..." << std::endl;
+                }
+                RemeshSubdomainWithMMG3D(sm_shift, comm);
+                ngid = NumberNewSubdomainVertices(sm_shift, ngid, comm);
+                
+                std::vector<int> owned;
+                std::vector<int> shell_gid;
+                int nglo = NumberSubdomainVertices(sm_shift, ngid, owned, shell_gid, comm);
+                dm = GetDistributedMeshFromSubdomain(sm_shift, owned, shell_gid, nglo, mesh_topo_bl, BLshell, xcn_pstate, comm);
+                delete sm_shift;
+            }
+            WriteUS3DGridInParallel(dm, us3d, deflate_level, comm);
             
-            Volu = Volumes[itgg->first];
-            cmplxty_tmp = detRf;
-            cmplxty_tmp2 = Volu;
-            //std::pow(cmplxty_tmp,(po+1.0)/(2.0*po+3.0));
-            cmplxty = cmplxty + cmplxty_tmp;
-            cmplxty2 = cmplxty2 + cmplxty_tmp2;
-            delete iVR;
-            delete Rs;
-            delete Rf;
-        }
-        
-
-        MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
-        //cmplxty_red = std::pow(cmplxty_red,(po+1)/(2.0*po+3.0));
-        
-        P->AddStateVecForAdjacentElements(Hess_map,6,comm);
-
-        std::map<int,Array<double>* > hess_vmap = P->ReduceStateVecToAllVertices(Hess_map,6);
-	if(world_rank == 0)
-	{
-        std::cout << "complexity = " << cmplxty_red << " " << Nve << std::endl;
-	}
-        cmplxty_red = Nve/cmplxty_red;
-        
-        if(world_rank == 0)
-	{
-        std::cout << "complexity = " << cmplxty_red << std::endl;
-        }
-        ComputeMetric(P, metric_inputs, comm, var_vmap, hess_vmap, 1.0, po);
-        
-        if(world_rank==0)
-        {
-            std::cout << "Started gathering metric data on rank 0..." <<std::endl;
-        }
-        Array<double>* mv_g = GetOptimizedMMG3DMeshOnRoot(P, us3d, hess_vmap, comm);
-        
-        hess_vmap.clear();
-        
-        
-        if(world_rank==0)
-        {
-            std::cout << "Finished gathering metric data on rank 0..." <<std::endl;
+            delete dm;
+            delete mesh_topo_bl;
+            delete BLshell;
+            delete hess_vf;
+            delete geom;
+            delete P;
+            MPI_Finalize();
+            return 0;
         }
         
-        Array<double>*  xcn_g;
-        Array<int>*     ief_g;
-        Array<int>*     ien_g;
-        Array<int>*     ifn_g;
-        Array<int>*     if_ref_g;
-        Array<int>*     ife_g;
+        int nLayer  = metric_inputs[4];
         
-        if(world_rank == 0)
-        {
-            xcn_g       = new Array<double>(us3d->xcn->getNglob(),3);
-            ief_g       = new Array<int>(us3d->ief->getNglob(),6);
-            ien_g       = new Array<int>(us3d->ien->getNglob(),8);
-            if_ref_g    = new Array<int>(us3d->ifn->getNglob(),1);
-            ifn_g       = new Array<int>(us3d->ifn->getNglob(),4);
-            ife_g       = new Array<int>(us3d->ifn->getNglob(),2);
-        }
-        else
-        {
-            xcn_g    = new Array<double>(1,1);
-            ief_g    = new Array<int>(1,1);
-            ien_g    = new Array<int>(1,1);
-            if_ref_g = new Array<int>(1,1);
-            ifn_g    = new Array<int>(1,1);
-            ife_g    = new Array<int>(1,1);
-        }
-
-        int* ien_nlocs      = new int[world_size];
-        int* ien_offsets    = new int[world_size];
-        int* ief_nlocs      = new int[world_size];
-        int* ief_offsets    = new int[world_size];
-        int* xcn_nlocs      = new int[world_size];
-        int* xcn_offsets    = new int[world_size];
-        int* ifn_nlocs      = new int[world_size];
-        int* ifn_offsets    = new int[world_size];
-        int* if_ref_nlocs   = new int[world_size];
-        int* if_ref_offsets = new int[world_size];
-        int* ife_nlocs      = new int[world_size];
-        int* ife_offsets    = new int[world_size];
+        // Only the boundary faces, the outer-volume elements and the vertices of the BL
+        // elements are gathered on rank 0. The boundary layer mesh is extracted on the partitions.
+        BoundaryMap* bmap = GatherBoundaryMapOnRoot(us3d->ifn, us3d->if_ref, comm);
         
-        for(int i=0;i<world_size;i++)
+        BLShellInfo* BLshell   = NULL;
+        BLShellInfo* BLshell_g = NULL;
+        MMG5_pMesh mmgMesh_TET = NULL;
+        MMG5_pSol mmgSol_TET   = NULL;
+        std::map<int,int> lv2gv_tet_mesh;
+        std::map<int,std::vector<double> > bl_verts;
+        int* hexTabNew = NULL;
+        int nbHexsNew  = 0;
+        if(nLayer>0)
         {
-            xcn_nlocs[i]   = xcn_pstate->getNlocs()[i]  *3;
-            xcn_offsets[i] = xcn_pstate->getOffsets()[i]*3;
-
-            ief_nlocs[i]   = ien_pstate->getNlocs()[i]  *6;
-            ief_offsets[i] = ien_pstate->getOffsets()[i]*6;
-
-            ien_nlocs[i]   = ien_pstate->getNlocs()[i]  *8;
-            ien_offsets[i] = ien_pstate->getOffsets()[i]*8;
-            
-            ifn_nlocs[i]   = ife_pstate->getNlocs()[i]  *4;
-            ifn_offsets[i] = ife_pstate->getOffsets()[i]*4;
+            BLshell   = FindOuterShellBoundaryLayerMesh(wall_ids, nLayer, P, geom, comm);
+            BLshell_g = GatherOuterShellOnRoot(BLshell, us3d->xcn->getNglob(), bmap->getNodeRefMap(), comm);
             
-            if_ref_nlocs[i]   = ife_pstate->getNlocs()[i]  *1;
-            if_ref_offsets[i] = ife_pstate->getOffsets()[i]*1;
-            
-            ife_nlocs[i]   = ife_pstate->getNlocs()[i]  *2;
-            ife_offsets[i] = ife_pstate->getOffsets()[i]*2;
+            // The outer volume goes straight into the MMG3D mesh on rank 0 in chunks of
+            // at most 1<<20 records.
+            if(world_rank == 0)
+            {
+                MMG3D_Init_mesh(MMG5_ARG_start,
+                MMG5_ARG_ppMesh,&mmgMesh_TET,MMG5_ARG_ppMet,&mmgSol_TET,
+                MMG5_ARG_end);
+            }
+            nbHexsNew = StreamOuterVolumeToMMG3DOnRoot(P, BLshell, hess_vf, mmgMesh_TET, mmgSol_TET,
+                                                       hexTabNew, lv2gv_tet_mesh, 1<<20, comm);
+            bl_verts  = StreamBoundaryLayerVerticesToRoot(P, BLshell, hess_vf, 1<<20, comm);
         }
-
-        MPI_Gatherv(&us3d->xcn->data[0],
-                    us3d->xcn->getNrow()*3,
-                    MPI_DOUBLE,
-                    &xcn_g->data[0],
-                    xcn_nlocs,
-                    xcn_offsets,
-                    MPI_DOUBLE, 0, comm);
-
-        MPI_Gatherv(&us3d->ief->data[0],
-                    us3d->ief->getNrow()*6,
-                    MPI_INT,
-                    &ief_g->data[0],
-                    ief_nlocs,
-                    ief_offsets,
-                    MPI_INT, 0, comm);
-
-        MPI_Gatherv(&us3d->ien->data[0],
-                    us3d->ien->getNrow()*8,
-                    MPI_INT,
-                    &ien_g->data[0],
-                    ien_nlocs,
-                    ien_offsets,
-                    MPI_INT, 0, comm);
-
-        MPI_Gatherv(&us3d->ifn->data[0],
-                    us3d->ifn->getNrow()*4,
-                    MPI_INT,
-                    &ifn_g->data[0],
-                    ifn_nlocs,
-                    ifn_offsets,
-                    MPI_INT, 0, comm);
-        
-        MPI_Gatherv(&us3d->if_ref->data[0],
-                    us3d->if_ref->getNrow()*1,
-                    MPI_INT,
-                    &if_ref_g->data[0],
-                    if_ref_nlocs,
-                    if_ref_offsets,
-                    MPI_INT, 0, comm);
-
-        MPI_Gatherv(&us3d->ife->data[0],
-                    us3d->ife->getNrow()*2,
-                    MPI_INT,
-                    &ife_g->data[0],
-                    ife_nlocs,
-                    ife_offsets,
-                    MPI_INT, 0, comm);
         
+        delete hess_vf;
+        delete geom;
         delete P;
         
         dUdXi.clear();
         
-        dUidxi_map.clear();
-        dUidyi_map.clear();
-        dUidzi_map.clear();
-        
         delete us3d->ien;
         delete us3d->ief;
         delete us3d->iee;
@@ -534,186 +579,70 @@ int main(int argc, char** argv) {
         delete us3d->ie_Nv;
         delete us3d->ie_Nf;
         
-         
-        if(world_rank == 0)
+        if(nLayer>0)
         {
-            BoundaryMap* bmap = new BoundaryMap(ifn_g, if_ref_g);
-            int wall_id = 3;
-            int nLayer  = metric_inputs[4];
-            if(nLayer>0)
+            std::map<int,std::vector<int> >& bnd_face_map = bmap->getBfaceMap();
+            TriKeyMap& tria_ref_map                       = bmap->getTriaRefMap();
+            QuadKeyMap& quad_ref_map                      = bmap->getQuadRefMap();
+            
+            std::vector<std::vector<int> > u_tris;
+            int nbPrisms = 0;
+            int nel_tets = 0;
+            int cshell   = 0;
+            
+            if(world_rank == 0)
             {
-                int counter = 0;
-                
-                std::map<int,std::vector<int> > bnd_face_map = bmap->getBfaceMap();
-                std::map<std::set<int>,int> tria_ref_map = bmap->getTriaRefMap();
-                std::map<std::set<int>,int> quad_ref_map = bmap->getQuadRefMap();
-                std::map<int,int> vert_ref_map = bmap->getNodeRefMap();
-                
-                BLShellInfo* BLshell = FindOuterShellBoundaryLayerMesh(wall_id, nLayer,xcn_g,ien_g,ief_g,ife_g,ifn_g,xcn_pstate,ien_pstate,bnd_face_map,vert_ref_map,comm);
-                
-//                BLShell* bl_shell = new BLShell(wall_id, nLayer,xcn_g,ien_g,ief_g,ife_g,ifn_g,xcn_pstate,ien_pstate,bnd_face_map,vert_ref_map,comm);
-//                
-//                delete bl_shell;
-                
-                //========================================================================
-                //========================================================================
-                //            struct BLShellInfo
-                //            {
-                //                std::map<int,int> ShellFace2BFace;
-                //                std::map<std::set<int>,int> ShellTri2FaceID;
-                //                std::map<std::set<int>,std::vector<int> > ShellFaceID2TriID
-                //                std::map<int,int> FaceID2TopoType;
-                //                std::map<int,std::map<int,int> > ShellFace2ShellVert2OppositeBoundaryVerts;
-                //                Array<int>* ShellRef;
-                //            };
-                //========================================================================
-                //========================================================================
-                
-                int nbHex       =  ien_g->getNrow();
-                int nbPrisms    =  bnd_face_map[wall_id].size()*(nLayer)*2;
-                //int nbTets      = (nbHex-bnd_face_map[wall_id].size()*(nLayer))*6;
-                int nbHexsNew   = (nbHex-bnd_face_map[wall_id].size()*(nLayer));
-                
-                
-			
-                int ith = 0;
-                std::set<int> u_tet_vert;
-                std::map<int,int> lv2gv_tet_mesh;
-                std::map<int,int> gv2lv_tet_mesh;
-                std::map<int,double*> metric_hex2tet;
-                Array<int>* ien_hex2tet = new Array<int>(nbHexsNew,8);
-                int sv = 0;
-                std::vector<int> locTet_verts;
-                for(int i=0;i<ien_g->getNrow();i++)
+                for(std::set<int>::iterator itw=wall_ids.begin();itw!=wall_ids.end();itw++)
                 {
-                    if(BLshell->elements_set.find(i)==BLshell->elements_set.end())
-                    {
-                        for(int j=0;j<8;j++)
-                        {
-                            int val = ien_g->getVal(i,j);
-                            
-                            if(u_tet_vert.find(val)==u_tet_vert.end())
-                            {
-                                u_tet_vert.insert(val);
-                                locTet_verts.push_back(val);
-                                gv2lv_tet_mesh[val]=sv;
-                                lv2gv_tet_mesh[sv]=val;
-                                ien_hex2tet->setVal(ith,j,sv);
-                                double* met = new double[6];
-                                
-                                met[0] = mv_g->getVal(val,0);
-                                met[1] = mv_g->getVal(val,1);
-                                met[2] = mv_g->getVal(val,2);
-                                met[3] = mv_g->getVal(val,3);
-                                met[4] = mv_g->getVal(val,4);
-                                met[5] = mv_g->getVal(val,5);
-                                
-                                
-                                metric_hex2tet[val]=met;
-                                sv++;
-                            }
-                            else
-                            {
-                                int lv = gv2lv_tet_mesh[val];
-                                ien_hex2tet->setVal(ith,j,lv);
-                            }
-                        }
-                        ith++;
-                    }
+                    nbPrisms = nbPrisms+bnd_face_map[*itw].size()*(nLayer)*2;
                 }
-   		
-                MMG5_pMesh mmgMesh_TET = NULL;
-                MMG5_pSol mmgSol_TET   = NULL;
+                int nbVerts_TET =  mmgMesh_TET->np;
                 
-                MMG3D_Init_mesh(MMG5_ARG_start,
-                MMG5_ARG_ppMesh,&mmgMesh_TET,MMG5_ARG_ppMet,&mmgSol_TET,
-                MMG5_ARG_end);
-                
-                int nbVerts_TET=locTet_verts.size();
-
-                if ( MMG3D_Set_meshSize(mmgMesh_TET,nbVerts_TET,nbHexsNew*6,0,0,0,0) != 1 )  exit(EXIT_FAILURE);
-                
-                if ( MMG3D_Set_solSize(mmgMesh_TET,mmgSol_TET,MMG5_Vertex,mmgMesh_TET->np,MMG5_Tensor) != 1 ) exit(EXIT_FAILURE);
-                
-                
-                int cshell = 0;
+                cshell     = 0;
                 int nshell = 0;
                 
                 for(int i=0;i<nbVerts_TET;i++)
                 {
                     int gv=lv2gv_tet_mesh[i];
                     
-                    mmgMesh_TET->point[i+1].c[0] = xcn_g->getVal(gv,0);
-                    mmgMesh_TET->point[i+1].c[1] = xcn_g->getVal(gv,1);
-                    mmgMesh_TET->point[i+1].c[2] = xcn_g->getVal(gv,2);
+                    mmgMesh_TET->point[i+1].ref  = BLshell_g->ShellRef->getVal(gv,0);
                     
-                    mmgMesh_TET->point[i+1].ref  = BLshell->ShellRef->getVal(gv,0);
-                    
-                    if(BLshell->ShellRef->getVal(gv,0)==0)
+                    if(BLshell_g->ShellRef->getVal(gv,0)==0)
                     {
-                        std::cout << i << " " << gv << " " << xcn_g->getNrow() << " zero here already" <<std::endl;
+                        std::cout << i << " " << gv << " zero here already" <<std::endl;
                     }
-                    if(BLshell->ShellRef->getVal(gv,0)==-1)
+                    if(BLshell_g->ShellRef->getVal(gv,0)==-1)
                     {
                         cshell++;
                     }
-                    if(BLshell->ShellRef->getVal(gv,0)==-3)
+                    if(BLshell_g->ShellRef->getVal(gv,0)==-3)
                     {
                         nshell++;
                     }
-                    
-                    double m11 = mv_g->getVal(gv,0);
-                    double m12 = mv_g->getVal(gv,1);
-                    double m13 = mv_g->getVal(gv,2);
-                    double m22 = mv_g->getVal(gv,3);
-                    double m23 = mv_g->getVal(gv,4);
-                    double m33 = mv_g->getVal(gv,5);
-                    
-                    if ( MMG3D_Set_tensorSol(mmgSol_TET, m11,m12,m13,m22,m23,m33,i+1) != 1 ) exit(EXIT_FAILURE);
                 }
-                int ref = 20;
                 
-                int* hexTabNew = new int[9*(nbHexsNew+1)];
-                for(int i=0;i<nbHexsNew;i++)
-                {
-                    int hexTabPosition = 9*(i+1);
-                    for(int j=0;j<8;j++)
-                    {
-                        int val = ien_hex2tet->getVal(i,j)+1;
-                        hexTabNew[hexTabPosition+j] = val;
-                    }
-                    hexTabNew[hexTabPosition+8] = ref;
-                }
                 std::cout << "Check the orientation and modify when necessary so that we can cut each hex up into 6 tetrahedra..."<<std::endl;
-                int num = H2T_chkorient(mmgMesh_TET,hexTabNew,nbHexsNew);
-                int* adjahexNew = NULL;
-                adjahexNew = (int*)calloc(6*nbHexsNew+7,sizeof(int));
-                assert(adjahexNew);
-                 
-                if(!H2T_hashHexa(hexTabNew,adjahexNew,nbHexsNew))
-                {
-                    std::cout << "Error :: setting up the new adjacency for the hexes after reorientation." << std::endl;
-                }
+                H2T_chkorient(mmgMesh_TET,hexTabNew,nbHexsNew);
                 
-                Hedge       hed22;
-                hed22.size  = 6*nbHexsNew;
-                hed22.hnxt  = 6*nbHexsNew;
-                hed22.nhmax = (int)(16*6*nbHexsNew);
-                hed22.item  = NULL;
-                hed22.item  = (hedge*)calloc(hed22.nhmax+1,sizeof(hedge));
-
-                for (int k=6*nbHexsNew; k<hed22.nhmax; k++)
+                // Each hex is cut at its lowest global vertex id, so the cut needs no hex
+                // adjacency or edge hash and the shell faces are split as by SplitQuadAtLowestVertex.
+                std::vector<int> vgid_tet(nbVerts_TET+1,0);
+                for(int i=0;i<nbVerts_TET;i++)
                 {
-                    hed22.item[k].nxt = k+1;
+                    vgid_tet[i+1] = lv2gv_tet_mesh[i];
                 }
                 
                 std::cout << "Cut each hexahedral up into 6 tetrahedra..."<<std::endl;
                 //we need to do this in order to determine the orientation of the triangles at the shell interface and trace back how we need to tesselate the wall boundary into triangles so that they match eachothers orientation.
-                int ret = H2T_cuthex(mmgMesh_TET, &hed22, hexTabNew, adjahexNew, nbHexsNew);
-                int nel_tets = mmgMesh_TET->ne;
+                if(!H2T_cuthexAtLowestVertex(mmgMesh_TET, hexTabNew, &vgid_tet[0], nbHexsNew))
+                {
+                    std::cout << "Error :: cutting the hexes of the outer volume into tetrahedra." << std::endl;
+                    MPI_Abort(comm, 1);
+                }
+                nel_tets = mmgMesh_TET->ne;
                 std::map<int,std::vector<int> > unique_shell_tri_map;
                 
-                std::set<std::set<int> > unique_shell_tris;
+                TriKeySet unique_shell_tris;
                 int shell_T_id=0;
                 int shell_T_id2 = 0;
                 int tellertOr = 0;
@@ -725,10 +654,7 @@ int main(int argc, char** argv) {
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[1]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[2]].ref==-1 )
                         {
-                            std::set<int> shell_tri;
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1]);
+                            TriKey shell_tri = MakeTriKey(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1]);
                             std::vector<int> tri(3);
                             tri[0] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1];
                             tri[1] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1];
@@ -741,17 +667,13 @@ int main(int argc, char** argv) {
                                 shell_T_id++;
                             }
                             shell_T_id2++;
-                            shell_tri.clear();
                             
                         }
                         if(   mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[1]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[2]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[3]].ref==-1 )
                         {
-                            std::set<int> shell_tri;
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1]);
+                            TriKey shell_tri = MakeTriKey(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1]);
                             std::vector<int> tri(3);
                             tri[0] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1];
                             tri[1] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1];
@@ -763,16 +685,12 @@ int main(int argc, char** argv) {
                                 shell_T_id++;
                             }
                             shell_T_id2++;
-                            shell_tri.clear();
                         }
                         if(   mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[2]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[3]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[0]].ref==-1 )
                         {
-                            std::set<int> shell_tri;
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1]);
+                            TriKey shell_tri = MakeTriKey(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1]);
                             std::vector<int> tri(3);
                             tri[0] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[2]-1];
                             tri[1] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1];
@@ -784,16 +702,12 @@ int main(int argc, char** argv) {
                                 shell_T_id++;
                             }
                             shell_T_id2++;
-                            shell_tri.clear();
                         }
                         if( mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[3]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[0]].ref==-1
                            && mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[1]].ref==-1 )
                         {
-                            std::set<int> shell_tri;
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1]);
-                            shell_tri.insert(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1]);
+                            TriKey shell_tri = MakeTriKey(lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1],lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[1]-1]);
                             std::vector<int> tri(3);
                             tri[0] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[3]-1];
                             tri[1] = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[0]-1];
@@ -805,7 +719,6 @@ int main(int argc, char** argv) {
                                 shell_T_id++;
                             }
                             shell_T_id2++;
-                            shell_tri.clear();
                         }
                         
                         tellertOr++;
@@ -814,11 +727,17 @@ int main(int argc, char** argv) {
                 
                 // {1,2,3}, {0,3,2}, {0,1,3}, {0,2,1}
                 
-                std::map<std::set<int>,int > shelltri2fid=BLshell->ShellTri2FaceID;
-                std::map<int,int> shellFace2bFace=BLshell->ShellFace2BFace;
-                std::set<std::set<int> >::iterator itset;
+                TriKeyMap& shelltri2fid=BLshell_g->ShellTri2FaceID;
+                std::map<int,int> shellFace2bFace=BLshell_g->ShellFace2BFace;
+                // The shell triangles are numbered in the sorted order of their keys.
+                std::vector<TriKey> sorted_shell_tris;
+                sorted_shell_tris.reserve(unique_shell_tris.size());
+                for(TriKeySet::iterator itset=unique_shell_tris.begin();itset!=unique_shell_tris.end();itset++)
+                {
+                    sorted_shell_tris.push_back(itset->first);
+                }
+                std::sort(sorted_shell_tris.begin(),sorted_shell_tris.end());
                 std::map<int,std::vector<int> > TriID2ShellFaceID;
-                std::vector<std::vector<int> > u_tris;
                 std::vector<std::vector<int> > u_tris_loc;
                 int teller=0;
                 std::set<int> unique_shell_vert;
@@ -826,10 +745,10 @@ int main(int argc, char** argv) {
                 std::map<int,int> glob2loc_shell_vert;
                 std::map<int,int> loc2glob_shell_vert;
                 int loc_s_v=0;
-                for(itset=unique_shell_tris.begin();itset!=unique_shell_tris.end();itset++)
+                for(int st=0;st<sorted_shell_tris.size();st++)
                 {
-                    std::set<int> shell_tri = *itset;
-                    std::set<int>::iterator itsh;
+                    TriKey& shell_tri = sorted_shell_tris[st];
+                    TriKey::iterator itsh;
                     std::vector<int> u_tri_vec(3);
                     std::vector<int> u_tri_vec_loc(3);
                     int bb = 0;
@@ -860,15 +779,28 @@ int main(int argc, char** argv) {
                     
                     int shell_faceid        = shelltri2fid[shell_tri];
                     int bfaceID             = shellFace2bFace[shell_faceid];
-                    std::map<int,int> v2v   = BLshell->ShellFace2ShellVert2OppositeBoundaryVerts[shell_faceid];
                     TriID2ShellFaceID[teller].push_back(shell_faceid);
-                    BLshell->ShellFaceID2TriID[shell_faceid].push_back(teller);
+                    BLshell_g->ShellFaceID2TriID[shell_faceid].push_back(teller);
                     teller++;
                 }
                 
+            }
+            
+            // The prisms are extracted by the ranks that hold the BL columns, using the
+            // triangulation of the outer shell that follows from the hex split above.
+            std::vector<std::vector<int> > u_tris_part = DistributeShellTriangles(BLshell_g, u_tris, BLshell, comm);
+            if(world_rank == 0)
+            {
                 std::cout << "Extracting the prismatic boundary layer mesh..." <<std::endl;
-                Mesh_Topology_BL* mesh_topo_bl2 =  ExtractBoundaryLayerMeshFromShell(u_tris, BLshell, wall_id, nLayer, xcn_g, ien_g, ief_g, ife_g, ifn_g, xcn_pstate, ien_pstate, bnd_face_map, tria_ref_map, quad_ref_map, comm);
+            }
+            Mesh_Topology_BL* mesh_topo_bl_part = ExtractBoundaryLayerMeshFromShell(u_tris_part, BLshell, nLayer, comm);
+            Mesh_Topology_BL* mesh_topo_bl2     = GatherBoundaryLayerMeshOnRoot(mesh_topo_bl_part, comm);
+            delete mesh_topo_bl_part;
             
+            MMG5_pMesh mmgMesh_hyb = NULL;
+            MMG5_pSol mmgSol_hyb   = NULL;
+            if(world_rank == 0)
+            {
                 // counting the number of boundary triangles and quads in the BL mesh.
                 int nTriangles_BL  = 0;
                 int nQuads_BL      = 0;
@@ -923,8 +855,6 @@ int main(int argc, char** argv) {
                 std::map<int,int> loc2glob_hyb;
                 std::map<int,int> glob2loc_hyb;
                 
-                std::map<int,std::set<int> > newvert2elem;
-                std::map<int,std::vector<int> > newvert2vert;
                 std::map<int,int*> bndtrisVol;
                 std::map<int,int> bndtrisVolRef;
                 int tra = 0;
@@ -949,30 +879,12 @@ int main(int argc, char** argv) {
                 {
                     if(mmgMesh_TET->tetra[i].ref != 0)
                     {
-                        // Determine the vertices that are newly introduced by the tesselation of the hexes into tets.
-                        //std::vector<int> which;
-                        //std::vector<int> indexes;
                         vxc=0;vyc=0;vzc=0;
                         for(int s=0;s<4;s++)
                         {
                             vxc = vxc+mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[s]].c[0];
                             vyc = vyc+mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[s]].c[1];
                             vzc = vzc+mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[s]].c[2];
-                            
-                            if(mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[s]].ref == 0)
-                            {
-                                newvert2elem[mmgMesh_TET->tetra[i].v[s]].insert(i);
-                                
-                                for(int t=0;t<4;t++)
-                                {
-                                    if(mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[t]].ref != 0
-                                    && mmgMesh_TET->tetra[i].v[t]!=mmgMesh_TET->tetra[i].v[s])
-                                    {
-                                        newvert2vert[mmgMesh_TET->tetra[i].v[s]].push_back(mmgMesh_TET->tetra[i].v[t]);
-                                    }
-                                }
-                            }
-                            
                         }
                         
                         //===========================================================================
@@ -1009,11 +921,8 @@ int main(int argc, char** argv) {
                         
                         std::set<int> bface;
                         
-                        std::set<int> tria0;
                         
-                        tria0.insert(v0);
-                        tria0.insert(v2);
-                        tria0.insert(v1);
+                        TriKey tria0 = MakeTriKey(v0,v2,v1);
                         //
                         
                         if(tria_ref_map.find(tria0)!=tria_ref_map.end())
@@ -1029,11 +938,8 @@ int main(int argc, char** argv) {
                             bndtrisVolRef[tra]  = refer;
                             tra++;
                         }
-                        std::set<int> tria1;
                             
-                        tria1.insert(v1);
-                        tria1.insert(v2);
-                        tria1.insert(v3);
+                        TriKey tria1 = MakeTriKey(v1,v2,v3);
                             
                         if(tria_ref_map.find(tria1)!=tria_ref_map.end())
                         {
@@ -1050,11 +956,8 @@ int main(int argc, char** argv) {
                             tra++;
                         }
                         
-                        std::set<int> tria2;
                         
-                        tria2.insert(v0);
-                        tria2.insert(v3);
-                        tria2.insert(v2);
+                        TriKey tria2 = MakeTriKey(v0,v3,v2);
                         
                         if(tria_ref_map.find(tria2)!=tria_ref_map.end())
                         {
@@ -1071,11 +974,8 @@ int main(int argc, char** argv) {
                             tra++;
                         }
                         
-                        std::set<int> tria3;
                                                    
-                        tria3.insert(v0);
-                        tria3.insert(v1);
-                        tria3.insert(v3);
+                        TriKey tria3 = MakeTriKey(v0,v1,v3);
                        
                         if(tria_ref_map.find(tria3)!=tria_ref_map.end())
                         {
@@ -1091,10 +991,6 @@ int main(int argc, char** argv) {
                            tra++;
                         }
                         
-                        tria0.clear();
-                        tria1.clear();
-                        tria2.clear();
-                        tria3.clear();
                         delete[] tetras;
                         tellert++;
                     }
@@ -1111,46 +1007,6 @@ int main(int argc, char** argv) {
                 }
                 
                 
-                std::map<int,std::vector<int> >::iterator nve;
-                double m11n=0.0;double m12n=0.0;double m13n=0.0;
-                double m22n=0.0;double m23n=0.0;
-                double m33n=0.0;
-                int vgg=0;
-                std::map<int,double*> newvert2metric;
-                for(nve=newvert2vert.begin();nve!=newvert2vert.end();nve++)
-                {
-                    m11n=0.0;m12n=0.0;m13n=0.0;
-                    m22n=0.0;m23n=0.0;
-                    m33n=0.0;
-
-                    for(int q=0;q<nve->second.size();q++)
-                    {
-                        vgg  = lv2gv_tet_mesh[nve->second[q]-1];
-
-                        m11n = m11n + mv_g->getVal(vgg,0);
-                        m12n = m12n + mv_g->getVal(vgg,1);
-                        m13n = m13n + mv_g->getVal(vgg,2);
-                        m22n = m22n + mv_g->getVal(vgg,3);
-                        m23n = m23n + mv_g->getVal(vgg,4);
-                        m33n = m33n + mv_g->getVal(vgg,5);
-                    }
-                    
-                    m11n = m11n/nve->second.size();
-                    m12n = m12n/nve->second.size();
-                    m13n = m13n/nve->second.size();
-                    m22n = m22n/nve->second.size();
-                    m23n = m23n/nve->second.size();
-                    m33n = m33n/nve->second.size();
-                    
-                    double* newM = new double[6];
-                    
-                    newM[0] = m11n;newM[1] = m12n;newM[2] = m13n;
-                    newM[3] = m22n;newM[4] = m23n;newM[5] = m33n;
-                    
-                    newvert2metric[nve->first]=newM;
-                }
-                
-
                 //====================================================================
                 //====================================================================
                 //====================================================================
@@ -1161,9 +1017,6 @@ int main(int argc, char** argv) {
                 //====================================================================
                 //====================================================================
                 
-                MMG5_pMesh mmgMesh_hyb = NULL;
-                MMG5_pSol mmgSol_hyb   = NULL;
-                
                 MMG3D_Init_mesh(MMG5_ARG_start,
                 MMG5_ARG_ppMesh,&mmgMesh_hyb,MMG5_ARG_ppMet,&mmgSol_hyb,
                 MMG5_ARG_end);
@@ -1190,70 +1043,16 @@ int main(int argc, char** argv) {
                         std::vector<int> prism = iter->second[p];
 
                         mmgMesh_hyb->prism[i+1].v[0] = prism[0]+1;
-                        m11 = mv_g->getVal(prism[0],0);
-                        m12 = mv_g->getVal(prism[0],1);
-                        m13 = mv_g->getVal(prism[0],2);
-                        m22 = mv_g->getVal(prism[0],3);
-                        m23 = mv_g->getVal(prism[0],4);
-                        m33 = mv_g->getVal(prism[0],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[0]+1) != 1 ) exit(EXIT_FAILURE);
-                        
                         mmgMesh_hyb->prism[i+1].v[1] = prism[1]+1;
-                        m11 = mv_g->getVal(prism[1],0);
-                        m12 = mv_g->getVal(prism[1],1);
-                        m13 = mv_g->getVal(prism[1],2);
-                        m22 = mv_g->getVal(prism[1],3);
-                        m23 = mv_g->getVal(prism[1],4);
-                        m33 = mv_g->getVal(prism[1],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[1]+1) != 1 ) exit(EXIT_FAILURE);
-                        
                         mmgMesh_hyb->prism[i+1].v[2] = prism[2]+1;
-                        m11 = mv_g->getVal(prism[2],0);
-                        m12 = mv_g->getVal(prism[2],1);
-                        m13 = mv_g->getVal(prism[2],2);
-                        m22 = mv_g->getVal(prism[2],3);
-                        m23 = mv_g->getVal(prism[2],4);
-                        m33 = mv_g->getVal(prism[2],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[2]+1) != 1 ) exit(EXIT_FAILURE);
-                        
                         mmgMesh_hyb->prism[i+1].v[3] = prism[3]+1;
-                        m11 = mv_g->getVal(prism[3],0);
-                        m12 = mv_g->getVal(prism[3],1);
-                        m13 = mv_g->getVal(prism[3],2);
-                        m22 = mv_g->getVal(prism[3],3);
-                        m23 = mv_g->getVal(prism[3],4);
-                        m33 = mv_g->getVal(prism[3],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[3]+1) != 1 ) exit(EXIT_FAILURE);
-                        
                         mmgMesh_hyb->prism[i+1].v[4] = prism[4]+1;
-                        m11 = mv_g->getVal(prism[4],0);
-                        m12 = mv_g->getVal(prism[4],1);
-                        m13 = mv_g->getVal(prism[4],2);
-                        m22 = mv_g->getVal(prism[4],3);
-                        m23 = mv_g->getVal(prism[4],4);
-                        m33 = mv_g->getVal(prism[4],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[4]+1) != 1 ) exit(EXIT_FAILURE);
-                        
                         mmgMesh_hyb->prism[i+1].v[5] = prism[5]+1;
-                        m11 = mv_g->getVal(prism[5],0);
-                        m12 = mv_g->getVal(prism[5],1);
-                        m13 = mv_g->getVal(prism[5],2);
-                        m22 = mv_g->getVal(prism[5],3);
-                        m23 = mv_g->getVal(prism[5],4);
-                        m33 = mv_g->getVal(prism[5],5);
-                        if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,prism[5]+1) != 1 ) exit(EXIT_FAILURE);
                         
                         mmgMesh_hyb->prism[i+1].ref  = 0;
 
-                        std::set<int> tria0;
-                        std::set<int> tria1;
-                        std::set<int> quad0;
-                        std::set<int> quad1;
-                        std::set<int> quad2;
                         
-                        tria0.insert(prism[0]);
-                        tria0.insert(prism[1]);
-                        tria0.insert(prism[2]);
+                        TriKey tria0 = MakeTriKey(prism[0],prism[1],prism[2]);
                         
                         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
                         if(tria_ref_map.find(tria0)!=tria_ref_map.end())
@@ -1265,9 +1064,7 @@ int main(int argc, char** argv) {
                             mmgMesh_hyb->tria[tt].ref  = refer;
                             tt++;
                         }
-                        tria1.insert(prism[3]);
-                        tria1.insert(prism[4]);
-                        tria1.insert(prism[5]);
+                        TriKey tria1 = MakeTriKey(prism[3],prism[4],prism[5]);
 
                         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
                         if(tria_ref_map.find(tria1)!=tria_ref_map.end())
@@ -1280,10 +1077,7 @@ int main(int argc, char** argv) {
                             tt++;
                         }
                         
-                        quad0.insert(prism[0]);
-                        quad0.insert(prism[2]);
-                        quad0.insert(prism[4]);
-                        quad0.insert(prism[3]);
+                        QuadKey quad0 = MakeQuadKey(prism[0],prism[2],prism[4],prism[3]);
                        
                         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
                         if(quad_ref_map.find(quad0)!=quad_ref_map.end())
@@ -1296,10 +1090,7 @@ int main(int argc, char** argv) {
                             mmgMesh_hyb->quadra[qt].ref  = refer;
                             qt++;
                         }
-                        quad1.insert(prism[1]);
-                        quad1.insert(prism[5]);
-                        quad1.insert(prism[4]);
-                        quad1.insert(prism[2]);
+                        QuadKey quad1 = MakeQuadKey(prism[1],prism[5],prism[4],prism[2]);
                         
                         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
                         if(quad_ref_map.find(quad1)!=quad_ref_map.end())
@@ -1312,10 +1103,7 @@ int main(int argc, char** argv) {
                             mmgMesh_hyb->quadra[qt].ref  = refer;
                             qt++;
                         }
-                        quad2.insert(prism[0]);
-                        quad2.insert(prism[3]);
-                        quad2.insert(prism[5]);
-                        quad2.insert(prism[1]);
+                        QuadKey quad2 = MakeQuadKey(prism[0],prism[3],prism[5],prism[1]);
                         
                         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
                         if(quad_ref_map.find(quad2)!=quad_ref_map.end())
@@ -1329,11 +1117,6 @@ int main(int argc, char** argv) {
                             qt++;
                         }
                        
-                        tria0.clear();
-                        tria1.clear();
-                        quad0.clear();
-                        quad1.clear();
-                        quad2.clear();
                         i++;
                     }
                 }
@@ -1357,46 +1140,30 @@ int main(int argc, char** argv) {
                 int tet   = 0;
                 int off_v = 0;
                 int www   = 0;
-                int nbVertices = xcn_g->getNrow();
-                for(int i=0;i<nbVertices;i++)
+                // The hybrid mesh is numbered by global vertex id. The outer-volume vertices
+                // come from the MMG3D mesh and the BL-only ones from bl_verts.
+                for(int i=0;i<mmgMesh_TET->np;i++)
                 {
-                    mmgMesh_hyb->point[i+1].c[0] = xcn_g->getVal(i,0);
-                    mmgMesh_hyb->point[i+1].c[1] = xcn_g->getVal(i,1);
-                    mmgMesh_hyb->point[i+1].c[2] = xcn_g->getVal(i,2);
-                    
-                    m11 = mv_g->getVal(i,0);
-                    m12 = mv_g->getVal(i,1);
-                    m13 = mv_g->getVal(i,2);
-                    m22 = mv_g->getVal(i,3);
-                    m23 = mv_g->getVal(i,4);
-                    m33 = mv_g->getVal(i,5);
+                    int vg = lv2gv_tet_mesh[i];
+                    mmgMesh_hyb->point[vg+1].c[0] = mmgMesh_TET->point[i+1].c[0];
+                    mmgMesh_hyb->point[vg+1].c[1] = mmgMesh_TET->point[i+1].c[1];
+                    mmgMesh_hyb->point[vg+1].c[2] = mmgMesh_TET->point[i+1].c[2];
                     
-                    if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,i+1) != 1 ) exit(EXIT_FAILURE);
+                    if ( MMG3D_Get_tensorSol(mmgSol_TET, &m11,&m12,&m13,&m22,&m23,&m33) != 1 ) exit(EXIT_FAILURE);
+                    if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,vg+1) != 1 ) exit(EXIT_FAILURE);
                 }
-                
-                std::map<int,double*>::iterator v2m;
-                //std::map<int,int> locNew2globNew;
-                std::map<int,int> globNew2locNew;
-                int p = 0;
-                for(v2m=newvert2metric.begin();v2m!=newvert2metric.end();v2m++)
+                std::map<int,std::vector<double> >::iterator itbl;
+                for(itbl=bl_verts.begin();itbl!=bl_verts.end();itbl++)
                 {
-                    mmgMesh_hyb->point[nbVertices+p+1].c[0] = mmgMesh_TET->point[v2m->first].c[0];
-                    mmgMesh_hyb->point[nbVertices+p+1].c[1] = mmgMesh_TET->point[v2m->first].c[1];
-                    mmgMesh_hyb->point[nbVertices+p+1].c[2] = mmgMesh_TET->point[v2m->first].c[2];
-                    
-                    m11 = v2m->second[0];
-                    m12 = v2m->second[1];
-                    m13 = v2m->second[2];
-                    m22 = v2m->second[3];
-                    m23 = v2m->second[4];
-                    m33 = v2m->second[5];
+                    int vg = itbl->first;
+                    const std::vector<double>& R = itbl->second;
+                    mmgMesh_hyb->point[vg+1].c[0] = R[0];
+                    mmgMesh_hyb->point[vg+1].c[1] = R[1];
+                    mmgMesh_hyb->point[vg+1].c[2] = R[2];
                     
-                    //locNew2globNew[nbVertices+p+1] = v2m->first;
-                    globNew2locNew[v2m->first]     = nbVertices+p+1;
-                    if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,nbVertices+p+1) != 1 ) exit(EXIT_FAILURE);
-
-                    p++;
+                    if ( MMG3D_Set_tensorSol(mmgSol_hyb, R[3],R[4],R[5],R[6],R[7],R[8],vg+1) != 1 ) exit(EXIT_FAILURE);
                 }
+                bl_verts.clear();
                 
 //
                 std::cout << "Set the tetrahedra in the mmgMesh..."<<std::endl;
@@ -1409,61 +1176,22 @@ int main(int argc, char** argv) {
                         
                         for(int s=0;s<4;s++)
                         {
-                            if(mmgMesh_TET->point[mmgMesh_TET->tetra[i].v[s]].ref == 0)
-                            {
-                                m11 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][0];
-                                m12 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][1];
-                                m13 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][2];
-                                m22 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][3];
-                                m23 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][4];
-                                m33 = newvert2metric[mmgMesh_TET->tetra[i].v[s]][5];
-                                
-                                int locNew = globNew2locNew[mmgMesh_TET->tetra[i].v[s]];
-
-                                mmgMesh_hyb->tetra[tet].v[s] = locNew;
-
-                                if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,locNew) != 1 ) exit(EXIT_FAILURE);
-                                
-                                //here++;
-                            }
-                            else
-                            {
-                                int vg = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[s]-1];
-                                mmgMesh_hyb->tetra[tet].v[s] = vg+1;
-
-                                m11 = mv_g->getVal(vg,0);
-                                m12 = mv_g->getVal(vg,1);
-                                m13 = mv_g->getVal(vg,2);
-                                m22 = mv_g->getVal(vg,3);
-                                m23 = mv_g->getVal(vg,4);
-                                m33 = mv_g->getVal(vg,5);
-                                
-                                if ( MMG3D_Set_tensorSol(mmgSol_hyb, m11,m12,m13,m22,m23,m33,vg+1) != 1 ) exit(EXIT_FAILURE);
-                            }
+                            int vg = lv2gv_tet_mesh[mmgMesh_TET->tetra[i].v[s]-1];
+                            mmgMesh_hyb->tetra[tet].v[s] = vg+1;
                         }
                     }
                 }
                 
-                delete xcn_g;
-                delete ien_g;
-                delete ifn_g;
-                delete ife_g;
-                delete if_ref_g;
-                delete ief_g;
-                delete mv_g;
                   
                 lv2gv_tet_mesh.clear(); 
-                globNew2locNew.clear();
-                newvert2elem.clear();
-                newvert2vert.clear();
-                newvert2metric.clear();
                 
                 MMG3D_Free_all(MMG5_ARG_start,
                                MMG5_ARG_ppMesh,&mmgMesh_TET,MMG5_ARG_ppSols,&mmgSol_TET,
                                MMG5_ARG_end);
              
                 //MMG3D_Set_handGivenMesh(mmgMesh_hyb);
-                if ( MMG3D_Set_dparameter(mmgMesh_hyb,mmgSol_hyb,MMG3D_DPARAM_hgrad, metric_inputs[0]) != 1 )    exit(EXIT_FAILURE);
+                // The metric is already graded by GradateMetric.
+                if ( MMG3D_Set_dparameter(mmgMesh_hyb,mmgSol_hyb,MMG3D_DPARAM_hgrad, -1) != 1 )    exit(EXIT_FAILURE);
 
                 //MMG3D_Set_iparameter ( mmgMesh_hyb,  mmgSol_hyb,  MMG3D_IPARAM_nosizreq , 1 );
                 MMG3D_Set_dparameter( mmgMesh_hyb,  mmgSol_hyb,  MMG3D_DPARAM_hgradreq , -1 );
@@ -1505,8 +1233,6 @@ int main(int argc, char** argv) {
                 OutputMesh_MMG_Slice(mmgMesh_TETCOPY,0,mmgMesh_TETCOPY->ne,"OuterVolume.dat");
                 std::cout<<"Finished writing the adapted tetrahedra mesh in ---> OuterVolume.dat"<<std::endl;
                 
-                delete bmap;
-
                 MMG3D_Free_all(MMG5_ARG_start,
                                MMG5_ARG_ppMesh,&mmgMesh_TETCOPY,MMG5_ARG_ppSols,&mmgSol_TETCOPY,
                                MMG5_ARG_end);
@@ -1517,13 +1243,23 @@ int main(int argc, char** argv) {
 //                               MMG5_ARG_end);
                 
                 std::cout<<"Started writing the adapted hybrid mesh in US3D format..."<<std::endl;
-                //WriteUS3DGridFromMMG_it0(mmgMesh_hyb, us3d, bnd_face_map);
-                WriteUS3DGridFromMMG_it0(mmgMesh_hyb, mmgSol_hyb, us3d);
-                std::cout<<"Finished writing the adapted hybrid mesh in US3D format..."<<std::endl;
-                //
             }
-            else
+            
+            WriteUS3DGridFromMMG(mmgMesh_hyb, us3d, 0, deflate_level, comm);
+            if(world_rank == 0)
             {
+                std::cout<<"Finished writing the adapted hybrid mesh in US3D format..."<<std::endl;
+                MMG3D_Free_all(MMG5_ARG_start,
+                               MMG5_ARG_ppMesh,&mmgMesh_hyb,MMG5_ARG_ppSols,&mmgSol_hyb,
+                               MMG5_ARG_end);
+            }
+            
+            delete BLshell_g->ShellRef;
+            delete BLshell_g;
+            delete BLshell;
+        }
+        else
+        {
 //                MMG5_pMesh mmgMesh = NULL;
 //                MMG5_pSol mmgSol   = NULL;
 //
@@ -1680,9 +1416,10 @@ int main(int argc, char** argv) {
 //                 WriteUS3DGridFromMMG(mmgMesh, us3d);
                  
                 
-            }
         }
         
+        delete bmap;
+        
         /**/
         MPI_Finalize();
         
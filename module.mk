@@ -5,8 +5,11 @@ MPICH_HOME = /Users/dekelsch/Software/mpich-3.3.1/mpich-3.1.1-install
 PARMMG_HOME = /Users/dekelsch/Software/parmmg/build
 MMG_HOME = /Users/dekelsch/Software/parmmg/build/Mmg-prefix/src/Mmg-build
 
-CXXFLAGS += -std=c++11 -I$(MMG_HOME)/include -I$(PARMMG_HOME)/include -I$(PARMETIS_HOME)/include -I$(MPICH_HOME)/include -I$(HDF5_HOME)/include -I$(METIS_HOME)/include
-LDFLAGS += -L$(MMG_HOME)/lib -L$(PARMMG_HOME)/lib -L$(PARMETIS_HOME)/lib -L$(METIS_HOME)/lib -L$(MPICH_HOME)/lib -L$(HDF5_HOME)/lib
+# Set OPENMP_FLAGS to empty to build without threading.
+OPENMP_FLAGS = -fopenmp
+
+CXXFLAGS += -std=c++11 $(OPENMP_FLAGS) -I$(MMG_HOME)/include -I$(PARMMG_HOME)/include -I$(PARMETIS_HOME)/include -I$(MPICH_HOME)/include -I$(HDF5_HOME)/include -I$(METIS_HOME)/include
+LDFLAGS += $(OPENMP_FLAGS) -L$(MMG_HOME)/lib -L$(PARMMG_HOME)/lib -L$(PARMETIS_HOME)/lib -L$(METIS_HOME)/lib -L$(MPICH_HOME)/lib -L$(HDF5_HOME)/lib
 LDLIBS += -lmetis -lparmetis -lhdf5 -lmpi -llapack -lblas -lmmg -lparmmg
 
 CC = /Users/dekelsch/Software/mpich-3.3.1/mpich-3.1.1-install/bin/mpic++
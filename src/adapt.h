@@ -13,15 +13,20 @@
 #include <ctime>
 // c++ specific tools.
 #include <algorithm>
+#include <limits>
 #include <string.h>
 #include <assert.h>
 #include <iostream>
 #include <stdlib.h>
 #include <fstream>
 #include <iomanip>      // std::setprecision
+#include <stdint.h>
 
 // external libraries.
 #include <mpi.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <parmetis.h>
 #include <hdf5.h>
 
@@ -29,4 +34,10 @@
 #include "mmg/mmg3d/libmmg3d.h"
 #include "parmmg/libparmmg.h"
 
+// Type of the global counts and flat offsets into the mesh tables (row*ncol). The ids
+// themselves fit an int, their products with the number of columns do not: the ien
+// offsets overflow above ~268M cells. It matches idx_t of a 64-bit ParMETIS and hsize_t.
+typedef int64_t gidx_t;
+#define MPI_GIDX MPI_INT64_T
+
 #endif
@@ -19,11 +19,11 @@ template <typename T> class Array {
     
         void setVal(int i, int j, T val)
         {
-            data[i*ncol+j] = val;
+            data[gidx_t(i)*ncol+j] = val;
         }
         T getVal(int i, int j)
         {
-            return  data[i*ncol+j];
+            return  data[gidx_t(i)*ncol+j];
         }
         int getNrow( void )
         {
@@ -37,7 +37,7 @@ template <typename T> class Array {
         {
             nrow = r;
             ncol = c;
-            int length = nrow*ncol;
+            gidx_t length = gidx_t(nrow)*ncol;
             data = new T[length];
         }
         int* getDim()
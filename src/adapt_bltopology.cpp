@@ -1,384 +1,975 @@
 #include "adapt_bltopology.h"
 
 
-BLShellInfo* FindOuterShellBoundaryLayerMesh(int wall_id, int nLayer,
-                            Array<double>* xcn_g, Array<int>* ien_g,
-                            Array<int>* ief_g, Array<int>* ife_g, Array<int>* ifn_g,
-                            ParallelState* xcn_pstate, ParallelState* ien_pstate,
-                            std::map<int,std::vector<int> > bnd_face_map,
-                            std::map<int,int> vert_ref_map, MPI_Comm comm)
+// Number of ints and doubles stored per element of a BL column:
+// [elid, 8 nodes, 6 faces, 6x4 face nodes, 6 face refs] and the 8x3 node coordinates.
+static const int BL_COL_NI = 45;
+static const int BL_COL_ND = 24;
+// Header of a walk that is handed off to another rank:
+// [bfaceid, c, elid, bvid, conn0, conn1, 4 wall face nodes, ncol] and the normal nbf.
+static const int BL_WALK_NI = 11;
+static const int BL_WALK_ND = 3;
+
+// State of the walk from a wall face through the nLayer elements on top of it.
+struct BLWalk
 {
-    BLShellInfo* BLinfo = new BLShellInfo;
-    BLinfo->ShellRef = new Array<int>(xcn_g->getNrow(),1);
-    int te1=0;
-    int te2=0;
-    int te3=0;
-    for(int i=0;i<xcn_g->getNrow();i++)
+    int bfaceid;
+    int c;
+    int elid;
+    int bvid;
+    int conn[2];
+    int bv_b[4];
+    double nbf[3];
+    int shell_fid;
+    int opposite[8];
+    std::vector<int> col_i;
+    std::vector<double> col_d;
+};
+
+
+// Stores the column and the outer shell face of a finished walk.
+static void FinishBoundaryLayerWalk(BLWalk& w, BLShellInfo* BLinfo)
+{
+    int ncol = w.col_i.size()/BL_COL_NI;
+    std::vector<int> layer(ncol);
+    for(int e=0;e<ncol;e++)
     {
-        if(vert_ref_map.find(i)!=vert_ref_map.end())
+        int* ci    = &w.col_i[e*BL_COL_NI];
+        double* cd = &w.col_d[e*BL_COL_ND];
+        int elid   = ci[0];
+        layer[e]   = elid;
+        
+        std::vector<int> en(ci+1,ci+9);
+        std::vector<int> ef(ci+9,ci+15);
+        BLinfo->ColumnIEN[elid] = en;
+        BLinfo->ColumnIEF[elid] = ef;
+        for(int k=0;k<8;k++)
         {
-            BLinfo->ShellRef->setVal(i,0,100+vert_ref_map[i]);
+            std::vector<double> xyz(cd+k*3,cd+k*3+3);
+            BLinfo->ColumnXCN[en[k]] = xyz;
         }
-        else
+        for(int k=0;k<6;k++)
         {
-            BLinfo->ShellRef->setVal(i,0,-3);
+            std::vector<int> fv(ci+15+k*4,ci+15+k*4+4);
+            BLinfo->ColumnIFN[ef[k]]   = fv;
+            BLinfo->ColumnIFRef[ef[k]] = ci[39+k];
         }
     }
+    BLinfo->BLlayers[w.bfaceid] = layer;
     
-    std::vector<std::vector<int> > outer_shell_elements;
+    int sf = w.shell_fid;
+    std::vector<int> sv = BLinfo->ColumnIFN[sf];
+    int tris[4][3] = {{0,1,3},{1,2,3},{0,1,2},{2,3,0}};
+    for(int t=0;t<4;t++)
+    {
+        TriKey ShellTri = MakeTriKey(sv[tris[t][0]],sv[tris[t][1]],sv[tris[t][2]]);
+        BLinfo->ShellTri2FaceID[ShellTri] = sf;
+    }
+    
+    std::map<int,int> opposite_verts;
+    for(int r=0;r<4;r++)
+    {
+        opposite_verts[w.opposite[r*2]] = w.opposite[r*2+1];
+    }
+    BLinfo->ShellFace2ShellVert2OppositeBoundaryVerts[sf] = opposite_verts;
+    BLinfo->ShellFace2BFace[sf]        = w.bfaceid;
+    BLinfo->BFace2ShellFace[w.bfaceid] = sf;
+}
+
+
+
+
+BLShellInfo* FindOuterShellBoundaryLayerMesh(std::set<int>& wall_ids, int nLayer, Partition* P, Mesh_Geometry* geom, MPI_Comm comm)
+{
     int world_size;
     MPI_Comm_size(comm, &world_size);
     // Get the rank of the process
     int world_rank;
     MPI_Comm_rank(comm, &world_rank);
-
-    std::vector<double> dp(6);
-    std::vector<Vec3D*> dpvec(6);
-    //std::cout << "Determining outer shell of BL mesh..." << std::endl;
+    
+    BLShellInfo* BLinfo = new BLShellInfo;
+    BLinfo->ShellRef    = NULL;
+    
+    std::vector<int> Loc_Elem               = P->getLocElem();
+    std::vector<Vert*> LocalVs              = P->getLocalVerts();
+    std::map<int,int> gV2lV                 = P->getGlobalVert2LocalVert();
+    std::map<int,std::vector<int> > gE2gV   = P->getGlobElem2GlobVerts();
+    i_part_map* iee_part_map    = P->getIEEpartmap();
+    i_part_map* ief_part_map    = P->getIEFpartmap();
+    i_part_map* ifn_part_map    = P->getIFNpartmap();
+    i_part_map* if_ref_part_map = P->getIFREFpartmap();
+    Array<int>* part_global     = P->getGlobalPartition();
+    int Nel                     = part_global->getNrow();
+    double* face_n              = geom->getFaceNormals();
+    int* face_offset            = geom->getFaceOffsets();
+    
     clock_t start;
     start = std::clock();
-    int* Pijk_id = new int[8];
-    double* Pijk = new double[8*3];
-    int elid_cur,elid_next;
-    int t=0;
-    int loc_vid;
-    int bvid,opposite_bvid;
-    int bvid_b;
-    int fv1_b;
-    int fv2_b;
-    int fv3_b;
-    int glob_el_id = 0;
-    Vert* Vface2  = new Vert;
-    Vec3D* r00 = new Vec3D;
-    Vec3D* v00 = new Vec3D;
-    Vec3D* v11 = new Vec3D;
-    Vert* Vface  = new Vert;
-    Vert* V  = new Vert;
-
-    for(int bf=0;bf<bnd_face_map[wall_id].size();bf++)
+    
+    std::set<int> loc_elem_set(Loc_Elem.begin(),Loc_Elem.end());
+    
+    // Every wall face belongs to one local element, so exactly one rank starts its walk.
+    std::vector<BLWalk> walks;
+    for(int i=0;i<Loc_Elem.size();i++)
     {
-        std::vector<int> layer;
-
-        int bfaceid = bnd_face_map[wall_id][bf];
-        int faceid  = bfaceid;
-        int elid0   = ife_g->getVal(faceid,0);
-        int elid1   = ife_g->getVal(faceid,1);
-
-        if(elid0<ien_g->getNrow())
+        int elid = Loc_Elem[i];
+        const std::vector<int>& faces = ief_part_map->i_map.at(elid);
+        for(int k=0;k<faces.size();k++)
         {
-            elid_cur = elid0;
+            if(wall_ids.find(if_ref_part_map->i_map.at(faces[k])[0]) == wall_ids.end())
+            {
+                continue;
+            }
+            const std::vector<int>& fv = ifn_part_map->i_map.at(faces[k]);
+            BLWalk w;
+            w.bfaceid = faces[k];
+            w.c       = 0;
+            w.elid    = elid;
+            w.bvid    = fv[0];
+            w.conn[0] = fv[1];
+            w.conn[1] = fv[3];
+            for(int r=0;r<4;r++)
+            {
+                w.bv_b[r] = fv[r];
+            }
+            // The outward normal of the wall face.
+            int ef = face_offset[i]+k;
+            w.nbf[0] = face_n[ef*3+0];
+            w.nbf[1] = face_n[ef*3+1];
+            w.nbf[2] = face_n[ef*3+2];
+            walks.push_back(w);
         }
-        else
+    }
+    
+    int nwalk      = walks.size();
+    int nwalk_glob = 0;
+    MPI_Allreduce(&nwalk, &nwalk_glob, 1, MPI_INT, MPI_SUM, comm);
+    
+    // March the walks through the local elements. A walk that steps into an element
+    // of another rank is handed to that rank together with the column collected so far.
+    // The walks are independent, so they march in parallel and only the bookkeeping in
+    // BLinfo and the send buffers is done afterwards.
+    while(nwalk_glob > 0)
+    {
+        std::vector<std::vector<int> > send_i(world_size);
+        std::vector<std::vector<double> > send_d(world_size);
+        
+        int nw = walks.size();
+        std::vector<int> ncol0(nw);
+        for(int q=0;q<nw;q++)
         {
-            elid_cur = elid1;
+            ncol0[q] = walks[q].col_i.size()/BL_COL_NI;
         }
         
-        layer.push_back(elid_cur);
-        std::set<int> local_faces;
-
-        for(int k=0;k<8;k++)
+#pragma omp parallel for schedule(dynamic,64)
+        for(int q=0;q<nw;q++)
         {
-           loc_vid     = ien_g->getVal(elid_cur,k);
-           Pijk_id[k]  = loc_vid;
-           Pijk[k*3+0] = xcn_g->getVal(loc_vid,0);
-           Pijk[k*3+1] = xcn_g->getVal(loc_vid,1);
-           Pijk[k*3+2] = xcn_g->getVal(loc_vid,2);
+            BLWalk& w = walks[q];
+            
+            while(w.c < nLayer)
+            {
+                int elid = w.elid;
+                int ei   = geom->getElemIndex(elid);
+                const std::vector<int>& faces = ief_part_map->i_map.at(elid);
+                const std::vector<int>& en    = gE2gV.at(elid);
+                
+                w.col_i.push_back(elid);
+                for(int k=0;k<8;k++)
+                {
+                    w.col_i.push_back(en[k]);
+                    Vert* V = LocalVs[gV2lV.at(en[k])];
+                    w.col_d.push_back(V->x);
+                    w.col_d.push_back(V->y);
+                    w.col_d.push_back(V->z);
+                }
+                for(int k=0;k<6;k++)
+                {
+                    w.col_i.push_back(faces[k]);
+                }
+                
+                // The vertex of the element on top of bvid is its neighbour that is not
+                // in the current layer.
+                const int* fvs[6];
+                double dp[6];
+                int opposite_bvid = -1;
+                for(int k=0;k<6;k++)
+                {
+                    fvs[k] = &ifn_part_map->i_map.at(faces[k])[0];
+                    for(int r=0;r<4;r++)
+                    {
+                        w.col_i.push_back(fvs[k][r]);
+                        if(fvs[k][r] != w.bvid)
+                        {
+                            continue;
+                        }
+                        int nb[2] = {fvs[k][(r+1)%4],fvs[k][(r+3)%4]};
+                        for(int s=0;s<2;s++)
+                        {
+                            if(nb[s] != w.conn[0] && nb[s] != w.conn[1])
+                            {
+                                opposite_bvid = std::max(opposite_bvid,nb[s]);
+                            }
+                        }
+                    }
+                    double* n00 = &face_n[(face_offset[ei]+k)*3];
+                    dp[k] = w.nbf[0]*n00[0]+w.nbf[1]*n00[1]+w.nbf[2]*n00[2];
+                }
+                for(int k=0;k<6;k++)
+                {
+                    w.col_i.push_back(if_ref_part_map->i_map.at(faces[k])[0]);
+                }
+                
+                // The face whose outward normal opposes the wall normal the most is crossed next.
+                int min_index = std::min_element(dp,dp+6)-dp;
+                int fid_new   = faces[min_index];
+                double* nnew  = &face_n[(face_offset[ei]+min_index)*3];
+                w.nbf[0] = -nnew[0];
+                w.nbf[1] = -nnew[1];
+                w.nbf[2] = -nnew[2];
+                
+                // opposite_bvid and its two neighbours (in increasing id) on the crossed face.
+                int opposite_tri[3] = {opposite_bvid,0,0};
+                int opposite_diag   = 0;
+                for(int r=0;r<4;r++)
+                {
+                    if(fvs[min_index][r] == opposite_bvid)
+                    {
+                        opposite_tri[1] = std::min(fvs[min_index][(r+1)%4],fvs[min_index][(r+3)%4]);
+                        opposite_tri[2] = std::max(fvs[min_index][(r+1)%4],fvs[min_index][(r+3)%4]);
+                        opposite_diag   = fvs[min_index][(r+2)%4];
+                    }
+                }
+                
+                if(w.c == nLayer-1)
+                {
+                    w.shell_fid   = fid_new;
+                    w.opposite[0] = opposite_bvid;
+                    w.opposite[1] = w.bv_b[0];
+                    w.opposite[2] = opposite_tri[1];
+                    w.opposite[3] = w.bv_b[1];
+                    w.opposite[4] = opposite_tri[2];
+                    w.opposite[5] = w.bv_b[3];
+                    w.opposite[6] = opposite_diag;
+                    w.opposite[7] = w.bv_b[2];
+                }
+                
+                w.bvid    = opposite_tri[0];
+                w.conn[0] = opposite_tri[1];
+                w.conn[1] = opposite_tri[2];
+                w.elid    = iee_part_map->i_map.at(elid)[min_index];
+                w.c       = w.c+1;
+                
+                if(w.c < nLayer && loc_elem_set.find(w.elid)==loc_elem_set.end())
+                {
+                    break;
+                }
+            }
         }
         
-        Vert* Vijk = ComputeCenterCoord(Pijk, 8);
-        
-        std::vector<Vert*> face;
-        std::vector<Vert*> face_turned(4);
-        std::vector<Vert*> face_turned2(4);
-        std::set<int> conn_bvid;
-        
-        Vface->x = 0.0;
-        Vface->y = 0.0;
-        Vface->z = 0.0;
-        
-        for(int r=0;r<4;r++)
+        for(int q=0;q<nw;q++)
         {
-            int vid  = ifn_g->getVal(faceid,r);
-            if(r==0)
+            BLWalk& w = walks[q];
+            int ncol  = w.col_i.size()/BL_COL_NI;
+            for(int e=ncol0[q];e<ncol;e++)
             {
-                bvid = vid;
+                BLinfo->elements_set.insert(w.col_i[e*BL_COL_NI]);
+            }
+            
+            if(w.c == nLayer)
+            {
+                FinishBoundaryLayerWalk(w, BLinfo);
+            }
+            else if(w.elid >= Nel)
+            {
+                std::cout << "Error :: the boundary layer walk from wall face " << w.bfaceid << " left the mesh after " << w.c << " layers." << std::endl;
+            }
+            else
+            {
+                int dest = part_global->getVal(w.elid,0);
+                send_i[dest].push_back(w.bfaceid);
+                send_i[dest].push_back(w.c);
+                send_i[dest].push_back(w.elid);
+                send_i[dest].push_back(w.bvid);
+                send_i[dest].push_back(w.conn[0]);
+                send_i[dest].push_back(w.conn[1]);
+                for(int r=0;r<4;r++)
+                {
+                    send_i[dest].push_back(w.bv_b[r]);
+                }
+                send_i[dest].push_back(w.col_i.size()/BL_COL_NI);
+                send_i[dest].insert(send_i[dest].end(),w.col_i.begin(),w.col_i.end());
+                send_d[dest].push_back(w.nbf[0]);
+                send_d[dest].push_back(w.nbf[1]);
+                send_d[dest].push_back(w.nbf[2]);
+                send_d[dest].insert(send_d[dest].end(),w.col_d.begin(),w.col_d.end());
             }
-            V->x     = xcn_g->getVal(vid,0);
-            V->y     = xcn_g->getVal(vid,1);
-            V->z     = xcn_g->getVal(vid,2);
-            Vface->x = Vface->x+V->x;
-            Vface->y = Vface->y+V->y;
-            Vface->z = Vface->z+V->z;
-            face.push_back(V);
         }
+        walks.clear();
         
-        conn_bvid.insert(ifn_g->getVal(faceid,1));
-        conn_bvid.insert(ifn_g->getVal(faceid,3));
-        bvid_b = bvid;
-        fv1_b = ifn_g->getVal(faceid,1);
-        fv2_b = ifn_g->getVal(faceid,2);
-        fv3_b = ifn_g->getVal(faceid,3);
-        
-        
-        Vface->x = Vface->x/4.0;
-        Vface->y = Vface->y/4.0;
-        Vface->z = Vface->z/4.0;
-                        
-        Vec3D* r0 = new Vec3D;
-        r0->c0 = (Vface->x-Vijk->x);
-        r0->c1 = (Vface->y-Vijk->y);
-        r0->c2 = (Vface->z-Vijk->z);
-        Vec3D* v0 = new Vec3D;
-        v0->c0 = face[1]->x-face[0]->x;
-        v0->c1 = face[1]->y-face[0]->y;
-        v0->c2 = face[1]->z-face[0]->z;
-        Vec3D* v1 = new Vec3D;
-        v1->c0 = face[3]->x-face[0]->x;
-        v1->c1 = face[3]->y-face[0]->y;
-        v1->c2 = face[3]->z-face[0]->z;
-        
-        Vec3D* nbf     = ComputeSurfaceNormal(v0,v1);
-        double orient0 = DotVec3D(r0,nbf);
-        
-        if(orient0<0.0)
+        std::vector<int> scnt_i(world_size), scnt_d(world_size), rcnt_i(world_size), rcnt_d(world_size);
+        std::vector<int> soff_i(world_size), soff_d(world_size), roff_i(world_size), roff_d(world_size);
+        std::vector<int> sbuf_i, rbuf_i;
+        std::vector<double> sbuf_d, rbuf_d;
+        for(int i=0;i<world_size;i++)
         {
-            NegateVec3D(nbf);
+            scnt_i[i] = send_i[i].size();
+            scnt_d[i] = send_d[i].size();
+            soff_i[i] = sbuf_i.size();
+            soff_d[i] = sbuf_d.size();
+            sbuf_i.insert(sbuf_i.end(),send_i[i].begin(),send_i[i].end());
+            sbuf_d.insert(sbuf_d.end(),send_d[i].begin(),send_d[i].end());
         }
-        face.clear();
+        MPI_Alltoall(&scnt_i[0], 1, MPI_INT, &rcnt_i[0], 1, MPI_INT, comm);
+        MPI_Alltoall(&scnt_d[0], 1, MPI_INT, &rcnt_d[0], 1, MPI_INT, comm);
+        int nrecv_i = 0;
+        int nrecv_d = 0;
+        for(int i=0;i<world_size;i++)
+        {
+            roff_i[i] = nrecv_i;
+            roff_d[i] = nrecv_d;
+            nrecv_i   = nrecv_i+rcnt_i[i];
+            nrecv_d   = nrecv_d+rcnt_d[i];
+        }
+        sbuf_i.push_back(0);
+        sbuf_d.push_back(0.0);
+        rbuf_i.resize(nrecv_i+1);
+        rbuf_d.resize(nrecv_d+1);
+        MPI_Alltoallv(&sbuf_i[0], &scnt_i[0], &soff_i[0], MPI_INT,
+                      &rbuf_i[0], &rcnt_i[0], &roff_i[0], MPI_INT, comm);
+        MPI_Alltoallv(&sbuf_d[0], &scnt_d[0], &soff_d[0], MPI_DOUBLE,
+                      &rbuf_d[0], &rcnt_d[0], &roff_d[0], MPI_DOUBLE, comm);
         
-        std::vector<std::map<int,std::set<int> > > layer_locN2NEl;
-        for(int c=0;c<nLayer;c++)
+        int pi = 0;
+        int pd = 0;
+        while(pi < nrecv_i)
         {
-            for(int k=0;k<8;k++)
+            BLWalk w;
+            w.bfaceid = rbuf_i[pi+0];
+            w.c       = rbuf_i[pi+1];
+            w.elid    = rbuf_i[pi+2];
+            w.bvid    = rbuf_i[pi+3];
+            w.conn[0] = rbuf_i[pi+4];
+            w.conn[1] = rbuf_i[pi+5];
+            for(int r=0;r<4;r++)
             {
-               loc_vid     = ien_g->getVal(elid_cur,k);
-               Pijk[k*3+0] = xcn_g->getVal(loc_vid,0);
-               Pijk[k*3+1] = xcn_g->getVal(loc_vid,1);
-               Pijk[k*3+2] = xcn_g->getVal(loc_vid,2);
+                w.bv_b[r] = rbuf_i[pi+6+r];
             }
+            int ncol = rbuf_i[pi+10];
+            w.col_i.assign(rbuf_i.begin()+pi+BL_WALK_NI,rbuf_i.begin()+pi+BL_WALK_NI+ncol*BL_COL_NI);
+            w.nbf[0] = rbuf_d[pd+0];
+            w.nbf[1] = rbuf_d[pd+1];
+            w.nbf[2] = rbuf_d[pd+2];
+            w.col_d.assign(rbuf_d.begin()+pd+BL_WALK_ND,rbuf_d.begin()+pd+BL_WALK_ND+ncol*BL_COL_ND);
+            pi = pi+BL_WALK_NI+ncol*BL_COL_NI;
+            pd = pd+BL_WALK_ND+ncol*BL_COL_ND;
+            walks.push_back(w);
+        }
         
-            Vert* Vijk_i = ComputeCenterCoord(Pijk, 8);
-            std::vector<std::vector<int> > face_id_stored(6);
-            std::vector<std::vector<Vert*> > face_stored(6);
-            std::map<int,std::set<int> > local_node2node_element;
-            std::vector<std::map<int,std::set<int> > > local_node2node_face(6);
-            std::vector<std::map<int,int> > local_node2opponode_face(6);
-            for(int k=0;k<6;k++)
-            {
-                int fid = ief_g->getVal(elid_cur,k);
-                
-                Vface2->x = 0.0;
-                Vface2->y = 0.0;
-                Vface2->z = 0.0;
-                std::vector<int> faceVert_IDs(4);
-                std::vector<Vert*> face2;
-                for(int r=0;r<4;r++)
-                {
-                    int vid  = ifn_g->getVal(fid,r);
-                    
-                    Vert* V  = new Vert;
-                    V->x     = xcn_g->getVal(vid,0);
-                    V->y     = xcn_g->getVal(vid,1);
-                    V->z     = xcn_g->getVal(vid,2);
-                    Vface2->x = Vface2->x+V->x;
-                    Vface2->y = Vface2->y+V->y;
-                    Vface2->z = Vface2->z+V->z;
-                    face2.push_back(V);
-                    
-                    faceVert_IDs[r] = vid;
-                }
-                
-                local_node2node_element[ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,1));
-                local_node2node_element[ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,3));
-                local_node2node_element[ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,0));
-                local_node2node_element[ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,2));
-                local_node2node_element[ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,1));
-                local_node2node_element[ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,3));
-                local_node2node_element[ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,2));
-                local_node2node_element[ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,0));
-                
-                local_node2node_face[k][ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,1));
-                local_node2node_face[k][ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,3));
-                local_node2node_face[k][ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,0));
-                local_node2node_face[k][ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,2));
-                local_node2node_face[k][ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,1));
-                local_node2node_face[k][ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,3));
-                local_node2node_face[k][ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,2));
-                local_node2node_face[k][ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,0));
-                
-                local_node2opponode_face[k][ifn_g->getVal(fid,0)]=ifn_g->getVal(fid,2);
-                local_node2opponode_face[k][ifn_g->getVal(fid,1)]=ifn_g->getVal(fid,3);
-                local_node2opponode_face[k][ifn_g->getVal(fid,2)]=ifn_g->getVal(fid,0);
-                local_node2opponode_face[k][ifn_g->getVal(fid,3)]=ifn_g->getVal(fid,1);
-                //layer_locN2NEl.push_back(local_node2node_element);
-                Vface2->x = Vface2->x/4.0;
-                Vface2->y = Vface2->y/4.0;
-                Vface2->z = Vface2->z/4.0;
-                                
-                r00->c0 = (Vface2->x-Vijk_i->x);
-                r00->c1 = (Vface2->y-Vijk_i->y);
-                r00->c2 = (Vface2->z-Vijk_i->z);
+        nwalk = walks.size();
+        MPI_Allreduce(&nwalk, &nwalk_glob, 1, MPI_INT, MPI_SUM, comm);
+    }
+    
+    double duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
+    if(world_rank == 0)
+    {
+        std::cout << "Timing extracting outer shell BL mesh = " << duration << std::endl;
+    }
+    
+    return BLinfo;
+}
 
-                v00->c0 = face2[1]->x-face2[0]->x;
-                v00->c1 = face2[1]->y-face2[0]->y;
-                v00->c2 = face2[1]->z-face2[0]->z;
 
-                v11->c0 = face2[3]->x-face2[0]->x;
-                v11->c1 = face2[3]->y-face2[0]->y;
-                v11->c2 = face2[3]->z-face2[0]->z;
-                
-                Vec3D* n00        = ComputeSurfaceNormal(v00,v11);
-                double orient00   = DotVec3D(r00,n00);
-                
-                if(orient00<0.0)
-                {
-                    NegateVec3D(n00);
-                }
-                
-                dp[k]               =   DotVec3D(nbf,n00);
-                dpvec[k]            =   n00;
-                face2.clear();
-                faceVert_IDs.clear();
+
+
+BLShellInfo* GatherOuterShellOnRoot(BLShellInfo* BLshell, int nVerts, std::map<int,int> vert_ref_map, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    // [shell face, wall face, 4 shell face nodes] for every column that ended on this rank.
+    std::vector<int> sbuf;
+    std::map<int,int>::iterator its;
+    for(its=BLshell->ShellFace2BFace.begin();its!=BLshell->ShellFace2BFace.end();its++)
+    {
+        sbuf.push_back(its->first);
+        sbuf.push_back(its->second);
+        std::vector<int> sv = BLshell->ColumnIFN[its->first];
+        sbuf.insert(sbuf.end(),sv.begin(),sv.end());
+    }
+    
+    int nsend = sbuf.size();
+    std::vector<int> nlocs(world_size), offsets(world_size);
+    MPI_Gather(&nsend, 1, MPI_INT, &nlocs[0], 1, MPI_INT, 0, comm);
+    int nrecv = 0;
+    for(int i=0;i<world_size;i++)
+    {
+        offsets[i] = nrecv;
+        nrecv      = nrecv+nlocs[i];
+    }
+    if(world_rank != 0)
+    {
+        nrecv = 0;
+    }
+    sbuf.push_back(0);
+    std::vector<int> rbuf(nrecv+1);
+    GatherRowsOnRoot(&sbuf[0], nsend, 1, &rbuf[0], &nlocs[0], &offsets[0], comm);
+    
+    BLShellInfo* BLshell_g = new BLShellInfo;
+    BLshell_g->ShellRef    = NULL;
+    if(world_rank != 0)
+    {
+        return BLshell_g;
+    }
+    
+    BLshell_g->ShellRef = new Array<int>(nVerts,1);
+    for(int i=0;i<nVerts;i++)
+    {
+        if(vert_ref_map.find(i)!=vert_ref_map.end())
+        {
+            BLshell_g->ShellRef->setVal(i,0,100+vert_ref_map[i]);
+        }
+        else
+        {
+            BLshell_g->ShellRef->setVal(i,0,-3);
+        }
+    }
+    
+    int tris[4][3] = {{0,1,3},{1,2,3},{0,1,2},{2,3,0}};
+    for(int p=0;p<world_size;p++)
+    {
+        for(int k=offsets[p];k<offsets[p]+nlocs[p];k+=6)
+        {
+            int sf = rbuf[k];
+            BLshell_g->ShellFace2BFace[sf]         = rbuf[k+1];
+            BLshell_g->BFace2ShellFace[rbuf[k+1]]  = sf;
+            BLshell_g->ShellFace2Rank[sf]          = p;
+            for(int r=0;r<4;r++)
+            {
+                BLshell_g->ShellRef->setVal(rbuf[k+2+r],0,-1);
             }
-            
-            std::set<int>::iterator its;
-            for(its=local_node2node_element[bvid].begin();its!=local_node2node_element[bvid].end();its++)
+            for(int t=0;t<4;t++)
+            {
+                TriKey ShellTri = MakeTriKey(rbuf[k+2+tris[t][0]],rbuf[k+2+tris[t][1]],rbuf[k+2+tris[t][2]]);
+                BLshell_g->ShellTri2FaceID[ShellTri] = sf;
+            }
+        }
+    }
+    
+    return BLshell_g;
+}
+
+
+
+
+std::vector<std::vector<int> > DistributeShellTriangles(BLShellInfo* BLshell_g, std::vector<std::vector<int> > u_tris_g, BLShellInfo* BLshell, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    // [shell face, tri0, tri1] is sent to the rank that holds the column of the shell face.
+    std::vector<std::vector<int> > send(world_size);
+    std::map<int,std::vector<int> >::iterator itf;
+    for(itf=BLshell_g->ShellFaceID2TriID.begin();itf!=BLshell_g->ShellFaceID2TriID.end();itf++)
+    {
+        if(itf->second.size() < 2 || BLshell_g->ShellFace2Rank.find(itf->first)==BLshell_g->ShellFace2Rank.end())
+        {
+            continue;
+        }
+        int dest = BLshell_g->ShellFace2Rank[itf->first];
+        send[dest].push_back(itf->first);
+        for(int t=0;t<2;t++)
+        {
+            std::vector<int> tri = u_tris_g[itf->second[t]];
+            send[dest].insert(send[dest].end(),tri.begin(),tri.end());
+        }
+    }
+    
+    std::vector<int> scnt(world_size), soff(world_size);
+    std::vector<int> sbuf;
+    for(int i=0;i<world_size;i++)
+    {
+        scnt[i] = send[i].size();
+        soff[i] = sbuf.size();
+        sbuf.insert(sbuf.end(),send[i].begin(),send[i].end());
+    }
+    sbuf.push_back(0);
+    int nrecv = 0;
+    MPI_Scatter(&scnt[0], 1, MPI_INT, &nrecv, 1, MPI_INT, 0, comm);
+    std::vector<int> rbuf(nrecv+1);
+    MPI_Scatterv(&sbuf[0], &scnt[0], &soff[0], MPI_INT,
+                 &rbuf[0], nrecv, MPI_INT, 0, comm);
+    
+    std::vector<std::vector<int> > u_tris;
+    for(int k=0;k<nrecv;k+=7)
+    {
+        int sf = rbuf[k];
+        for(int t=0;t<2;t++)
+        {
+            std::vector<int> tri(rbuf.begin()+k+1+t*3,rbuf.begin()+k+4+t*3);
+            BLshell->ShellFaceID2TriID[sf].push_back(u_tris.size());
+            u_tris.push_back(tri);
+        }
+    }
+    
+    return u_tris;
+}
+
+
+
+
+void SplitQuadAtLowestVertex(const int* q, int tris[2][3])
+{
+    int imin = 0;
+    for(int k=1;k<4;k++)
+    {
+        if(q[k]<q[imin])
+        {
+            imin = k;
+        }
+    }
+    if(imin%2 == 0)
+    {
+        tris[0][0] = q[0]; tris[0][1] = q[1]; tris[0][2] = q[2];
+        tris[1][0] = q[0]; tris[1][1] = q[2]; tris[1][2] = q[3];
+    }
+    else
+    {
+        tris[0][0] = q[0]; tris[0][1] = q[1]; tris[0][2] = q[3];
+        tris[1][0] = q[1]; tris[1][1] = q[2]; tris[1][2] = q[3];
+    }
+}
+
+
+
+
+std::vector<std::vector<int> > TriangulateShellFaces(BLShellInfo* BLshell)
+{
+    std::vector<std::vector<int> > u_tris;
+    std::map<int,int>::iterator its;
+    for(its=BLshell->ShellFace2BFace.begin();its!=BLshell->ShellFace2BFace.end();its++)
+    {
+        int sf = its->first;
+        int tris[2][3];
+        SplitQuadAtLowestVertex(&BLshell->ColumnIFN[sf][0], tris);
+        BLshell->ShellFaceID2TriID[sf].clear();
+        for(int t=0;t<2;t++)
+        {
+            std::vector<int> tri(tris[t],tris[t]+3);
+            std::sort(tri.begin(),tri.end());
+            BLshell->ShellFaceID2TriID[sf].push_back(u_tris.size());
+            u_tris.push_back(tri);
+        }
+    }
+    return u_tris;
+}
+
+
+
+
+std::set<int> GetShellFacesOfOuterVolume(Partition* P, BLShellInfo* BLshell, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    i_part_map* iee_part_map = P->getIEEpartmap();
+    i_part_map* ief_part_map = P->getIEFpartmap();
+    Array<int>* part_global  = P->getGlobalPartition();
+    int Nel                  = part_global->getNrow();
+    
+    // The last element of a column is owned by this rank; the shell face is sent to the
+    // owner of the element on the other side of it.
+    std::vector<int> scnt(world_size,0);
+    std::vector<std::vector<int> > send(world_size);
+    std::map<int,std::vector<int> >::iterator itl;
+    for(itl=BLshell->BLlayers.begin();itl!=BLshell->BLlayers.end();itl++)
+    {
+        int sf   = BLshell->BFace2ShellFace[itl->first];
+        int elid = itl->second.back();
+        const std::vector<int>& faces = ief_part_map->i_map.at(elid);
+        for(int k=0;k<faces.size();k++)
+        {
+            if(faces[k] == sf)
             {
-                if(conn_bvid.find(*its)==conn_bvid.end())
+                int adj = iee_part_map->i_map.at(elid)[k];
+                if(adj<Nel)
                 {
-                    opposite_bvid = *its;
+                    send[part_global->getVal(adj,0)].push_back(sf);
                 }
             }
-        
-            int min_index  = std::min_element(dp.begin(),dp.end())-dp.begin();
-            //double min_val = *std::min_element(dp.begin(),dp.end());
-            int fid_new    = ief_g->getVal(elid_cur,min_index);
-            nbf            = dpvec[min_index];
-            
-            std::map<int,std::set<int> > node2node_face = local_node2node_face[min_index];
-            std::set<int>::iterator itu;
-            std::vector<int>opposite_tri(3);
-            opposite_tri[0] = opposite_bvid;
-            int l = 1;
-            for(itu=node2node_face[opposite_bvid].begin();itu!=node2node_face[opposite_bvid].end();itu++)
-            {
-                opposite_tri[l] = *itu;
-                l++;
-            }
+        }
+    }
+    
+    std::vector<int> soff(world_size,0);
+    std::vector<int> sbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        scnt[r] = send[r].size();
+        soff[r] = sbuf.size();
+        sbuf.insert(sbuf.end(),send[r].begin(),send[r].end());
+    }
+    sbuf.push_back(0);
+    std::vector<int> rcnt(world_size,0);
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    std::vector<int> roff(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    std::vector<int> rbuf(roff[world_size-1]+rcnt[world_size-1]+1);
+    MPI_Alltoallv(&sbuf[0], &scnt[0], &soff[0], MPI_INT,
+                  &rbuf[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    
+    std::set<int> shell_faces(rbuf.begin(),rbuf.begin()+roff[world_size-1]+rcnt[world_size-1]);
+    return shell_faces;
+}
 
-            NegateVec3D(nbf);
 
-            int gEl0=ife_g->getVal(fid_new,0);
-            int gEl1=ife_g->getVal(fid_new,1);
 
-            if(gEl0==elid_cur)
-            {
-                elid_next = gEl1;
-            }
-            else if(gEl1==elid_cur)
+
+// Sends the n records of rec_size values in recs to rank 0 in chunks of at most chunk
+// records. Rank 0 calls process(records,count) for every chunk, its own first and then
+// those of the other ranks in rank order, while the next chunk is already being received.
+template<typename T, typename F>
+static void StreamRecordsToRoot(std::vector<T>& recs, int rec_size, int chunk, MPI_Datatype type, F process, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    int n = recs.size()/rec_size;
+    std::vector<int> nrecs(world_size,0);
+    MPI_Gather(&n, 1, MPI_INT, &nrecs[0], 1, MPI_INT, 0, comm);
+    
+    MPI_Datatype rec_type;
+    MPI_Type_contiguous(rec_size, type, &rec_type);
+    MPI_Type_commit(&rec_type);
+    
+    if(world_rank == 0)
+    {
+        for(int c=0;c<n;c+=chunk)
+        {
+            process(&recs[gidx_t(c)*rec_size],std::min(chunk,n-c));
+        }
+        std::vector<T> buf[2];
+        buf[0].resize(gidx_t(chunk)*rec_size);
+        buf[1].resize(gidx_t(chunk)*rec_size);
+        MPI_Request req[2];
+        for(int r=1;r<world_size;r++)
+        {
+            int nchunk = (nrecs[r]+chunk-1)/chunk;
+            if(nchunk == 0)
             {
-                elid_next = gEl0;
+                continue;
             }
-            if(c<nLayer-1)
+            MPI_Irecv(&buf[0][0], std::min(chunk,nrecs[r]), rec_type, r, 0, comm, &req[0]);
+            for(int c=0;c<nchunk;c++)
             {
-                layer.push_back(elid_next);
+                MPI_Wait(&req[c%2], MPI_STATUS_IGNORE);
+                if(c+1<nchunk)
+                {
+                    int nnext = std::min(chunk,nrecs[r]-(c+1)*chunk);
+                    MPI_Irecv(&buf[(c+1)%2][0], nnext, rec_type, r, 0, comm, &req[(c+1)%2]);
+                }
+                process(&buf[c%2][0],std::min(chunk,nrecs[r]-c*chunk));
             }
-            
-            //int changed = ChkHexorient(Pijk,Pijk_id);
-            
-            if(c==nLayer-1)
+        }
+    }
+    else
+    {
+        for(int c=0;c<n;c+=chunk)
+        {
+            MPI_Send(&recs[gidx_t(c)*rec_size], std::min(chunk,n-c), rec_type, 0, 0, comm);
+        }
+    }
+    
+    MPI_Type_free(&rec_type);
+}
+
+
+
+
+int StreamOuterVolumeToMMG3DOnRoot(Partition* P, BLShellInfo* BLshell, TensorField* mv,
+                                   MMG5_pMesh mmgMesh, MMG5_pSol mmgSol, int*& hexTab,
+                                   std::map<int,int>& lv2gv, int chunk, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    std::vector<int> Loc_Elem             = P->getLocElem();
+    std::map<int,std::vector<int> > gE2gV = P->getGlobElem2GlobVerts();
+    std::vector<Vert*> LocalVs            = P->getLocalVerts();
+    std::map<int,int> gV2lV               = P->getGlobalVert2LocalVert();
+    gidx_t* xcn_offsets                   = P->getXcnParallelState()->getOffsets();
+    
+    std::vector<int> hexes;
+    std::set<int> u_verts;
+    for(int i=0;i<Loc_Elem.size();i++)
+    {
+        if(BLshell->elements_set.find(Loc_Elem[i])==BLshell->elements_set.end())
+        {
+            const std::vector<int>& en = gE2gV.at(Loc_Elem[i]);
+            hexes.insert(hexes.end(),en.begin(),en.begin()+8);
+            u_verts.insert(en.begin(),en.begin()+8);
+        }
+    }
+    
+    // The xcn owner of a vertex numbers the outer-volume vertices of its block and picks the
+    // lowest rank that has a vertex to send its coordinates and metric.
+    std::vector<int> verts(u_verts.begin(),u_verts.end());
+    std::vector<int> scnt(world_size,0), soff(world_size,0), rcnt(world_size), roff(world_size,0);
+    for(int i=0;i<verts.size();i++)
+    {
+        int dest = std::upper_bound(xcn_offsets,xcn_offsets+world_size,verts[i])-xcn_offsets-1;
+        scnt[dest]++;
+    }
+    for(int r=1;r<world_size;r++)
+    {
+        soff[r] = soff[r-1]+scnt[r-1];
+    }
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nq = roff[world_size-1]+rcnt[world_size-1];
+    verts.push_back(0);
+    std::vector<int> rq(nq+1);
+    MPI_Alltoallv(&verts[0], &scnt[0], &soff[0], MPI_INT,
+                  &rq[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    verts.pop_back();
+    
+    std::map<int,int> block_ids;
+    for(int k=0;k<nq;k++)
+    {
+        block_ids[rq[k]] = 0;
+    }
+    int nblock = block_ids.size();
+    int offset = 0;
+    MPI_Exscan(&nblock, &offset, 1, MPI_INT, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        offset = 0;
+    }
+    int np = 0;
+    MPI_Allreduce(&nblock, &np, 1, MPI_INT, MPI_SUM, comm);
+    std::map<int,int>::iterator itb;
+    int b = offset;
+    for(itb=block_ids.begin();itb!=block_ids.end();itb++)
+    {
+        itb->second = b;
+        b++;
+    }
+    // The ids are returned negated (-id-1) to all but the first rank that asked.
+    std::set<int> picked;
+    std::vector<int> ans(nq+1);
+    for(int k=0;k<nq;k++)
+    {
+        ans[k] = block_ids[rq[k]];
+        if(picked.find(rq[k])!=picked.end())
+        {
+            ans[k] = -ans[k]-1;
+        }
+        picked.insert(rq[k]);
+    }
+    std::vector<int> rans(verts.size()+1);
+    MPI_Alltoallv(&ans[0], &rcnt[0], &roff[0], MPI_INT,
+                  &rans[0], &scnt[0], &soff[0], MPI_INT, comm);
+    
+    std::map<int,int> gv2mv;
+    for(int i=0;i<mv->n;i++)
+    {
+        gv2mv[mv->gid[i]] = i;
+    }
+    // Vertex records [id, global id, x, y, z, metric(6)].
+    std::map<int,int> gv2id;
+    std::vector<double> vrecs;
+    for(int i=0;i<verts.size();i++)
+    {
+        int id = rans[i];
+        if(id >= 0)
+        {
+            Vert* V   = LocalVs[gV2lV[verts[i]]];
+            double* M = mv->getTensor(gv2mv.at(verts[i]));
+            vrecs.push_back(id);
+            vrecs.push_back(verts[i]);
+            vrecs.push_back(V->x);
+            vrecs.push_back(V->y);
+            vrecs.push_back(V->z);
+            vrecs.insert(vrecs.end(),M,M+6);
+        }
+        else
+        {
+            id = -id-1;
+        }
+        gv2id[verts[i]] = id;
+    }
+    for(int k=0;k<hexes.size();k++)
+    {
+        hexes[k] = gv2id[hexes[k]]+1;
+    }
+    
+    int nhex_loc = hexes.size()/8;
+    int nhex     = 0;
+    MPI_Reduce(&nhex_loc, &nhex, 1, MPI_INT, MPI_SUM, 0, comm);
+    
+    if(world_rank == 0)
+    {
+        if ( MMG3D_Set_meshSize(mmgMesh,np,nhex*6,0,0,0,0) != 1 )  exit(EXIT_FAILURE);
+        if ( MMG3D_Set_solSize(mmgMesh,mmgSol,MMG5_Vertex,np,MMG5_Tensor) != 1 ) exit(EXIT_FAILURE);
+        hexTab = new int[9*(nhex+1)];
+    }
+    
+    StreamRecordsToRoot(vrecs, 11, chunk, MPI_DOUBLE, [&](double* rec, int n)
+    {
+        for(int k=0;k<n;k++)
+        {
+            double* R = rec+k*11;
+            int id    = int(R[0]);
+            lv2gv[id] = int(R[1]);
+            mmgMesh->point[id+1].c[0] = R[2];
+            mmgMesh->point[id+1].c[1] = R[3];
+            mmgMesh->point[id+1].c[2] = R[4];
+            if ( MMG3D_Set_tensorSol(mmgSol,R[5],R[6],R[7],R[8],R[9],R[10],id+1) != 1 ) exit(EXIT_FAILURE);
+        }
+    }, comm);
+    std::vector<double>().swap(vrecs);
+    
+    // The hexes are numbered from 1 in the H2T table, with reference 20 for the outer volume.
+    int h = 1;
+    StreamRecordsToRoot(hexes, 8, chunk, MPI_INT, [&](int* rec, int n)
+    {
+        for(int k=0;k<n;k++)
+        {
+            for(int j=0;j<8;j++)
             {
-                BLinfo->ShellRef->setVal(ifn_g->getVal(fid_new,0),0,-1);
-                BLinfo->ShellRef->setVal(ifn_g->getVal(fid_new,1),0,-1);
-                BLinfo->ShellRef->setVal(ifn_g->getVal(fid_new,2),0,-1);
-                BLinfo->ShellRef->setVal(ifn_g->getVal(fid_new,3),0,-1);
-                std::set<int> ShellTri0;
-                ShellTri0.insert(ifn_g->getVal(fid_new,0));
-                ShellTri0.insert(ifn_g->getVal(fid_new,1));
-                ShellTri0.insert(ifn_g->getVal(fid_new,3));
-                BLinfo->ShellTri2FaceID[ShellTri0] = fid_new;
-                std::set<int> ShellTri1;
-                ShellTri1.insert(ifn_g->getVal(fid_new,1));
-                ShellTri1.insert(ifn_g->getVal(fid_new,2));
-                ShellTri1.insert(ifn_g->getVal(fid_new,3));
-                BLinfo->ShellTri2FaceID[ShellTri1] = fid_new;
-                std::set<int> ShellTri2;
-                ShellTri2.insert(ifn_g->getVal(fid_new,0));
-                ShellTri2.insert(ifn_g->getVal(fid_new,1));
-                ShellTri2.insert(ifn_g->getVal(fid_new,2));
-                BLinfo->ShellTri2FaceID[ShellTri2] = fid_new;
-                std::set<int> ShellTri3;
-                ShellTri3.insert(ifn_g->getVal(fid_new,2));
-                ShellTri3.insert(ifn_g->getVal(fid_new,3));
-                ShellTri3.insert(ifn_g->getVal(fid_new,0));
-                BLinfo->ShellTri2FaceID[ShellTri3] = fid_new;
-                
-                //            bvid > opposite_bvid
-                //            fv1 > opposite_tri[1];
-                //            fv3 > opposite_tri[2];
-                //            fv2 > local_node2opponode_face[min_index][opposite_bvid]
-                std::map<int,int> opposite_verts;
-                
-//                opposite_verts[bvid_b] = opposite_bvid;
-//                opposite_verts[fv1_b]  = opposite_tri[1];
-//                opposite_verts[fv3_b]  = opposite_tri[2];
-//                opposite_verts[fv2_b]  = local_node2opponode_face[min_index][opposite_bvid];
-                
-                opposite_verts[opposite_bvid]    = bvid_b;
-                opposite_verts[opposite_tri[1]]  = fv1_b;
-                opposite_verts[opposite_tri[2]]  = fv3_b;
-                opposite_verts[local_node2opponode_face[min_index][opposite_bvid]]  = fv2_b;
-                
-                BLinfo->ShellFace2ShellVert2OppositeBoundaryVerts[fid_new] = opposite_verts;
-                BLinfo->ShellFace2BFace[fid_new] = bfaceid;
-                BLinfo->BFace2ShellFace[bfaceid] = fid_new;
-                std::vector<int> fe(2);
-                fe[0] = elid_cur;
-                fe[1] = elid_next;
-                outer_shell_elements.push_back(fe);
-                opposite_verts.clear();
+                hexTab[9*h+j] = rec[k*8+j];
             }
-            
-            conn_bvid.clear();
-            bvid = opposite_tri[0];
-            conn_bvid.insert(opposite_tri[1]);
-            conn_bvid.insert(opposite_tri[2]);
-            
-            elid_cur = elid_next;
-            BLinfo->BLlayers[bfaceid]=layer;
+            hexTab[9*h+8] = 20;
+            h++;
+        }
+    }, comm);
+    
+    return nhex;
+}
+
 
-            delete Vijk_i;
+
+
+
+std::map<int,std::vector<double> > StreamBoundaryLayerVerticesToRoot(Partition* P, BLShellInfo* BLshell, TensorField* mv,
+                                                                     int chunk, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    std::vector<int> Loc_Elem             = P->getLocElem();
+    std::map<int,std::vector<int> > gE2gV = P->getGlobElem2GlobVerts();
+    std::vector<Vert*> LocalVs            = P->getLocalVerts();
+    std::map<int,int> gV2lV               = P->getGlobalVert2LocalVert();
+    gidx_t* xcn_offsets                   = P->getXcnParallelState()->getOffsets();
+    
+    // 1 for the vertices of the outer volume and 0 for those of the BL elements only.
+    std::map<int,int> vflag;
+    for(int i=0;i<Loc_Elem.size();i++)
+    {
+        int outer = (BLshell->elements_set.find(Loc_Elem[i])==BLshell->elements_set.end());
+        const std::vector<int>& en = gE2gV.at(Loc_Elem[i]);
+        for(int j=0;j<8;j++)
+        {
+            vflag[en[j]] = std::max(vflag[en[j]],outer);
         }
-        
-        
     }
-    delete[] Pijk;
-    delete[] Pijk_id;
     
-    delete r00;
-    delete v00;
-    delete v11;
-    delete Vface2;
-    delete Vface;
-    delete V;
+    // The xcn owner of a vertex decides whether it is BL-only and picks the first rank that
+    // has it to send its coordinates and metric.
+    std::vector<std::vector<int> > send(world_size);
+    std::map<int,int>::iterator itv;
+    for(itv=vflag.begin();itv!=vflag.end();itv++)
+    {
+        int dest = std::upper_bound(xcn_offsets,xcn_offsets+world_size,itv->first)-xcn_offsets-1;
+        send[dest].push_back(itv->first);
+        send[dest].push_back(itv->second);
+        send[dest].push_back(world_rank);
+    }
+    std::vector<int> recv = ExchangeVectors(send, MPI_INT, comm);
     
-    double duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
-    std::cout << "Timing extracting outer shell BL mesh = " << duration << std::endl;
-    std::map<int,std::vector<int> >::iterator itt;
-    for(itt=BLinfo->BLlayers.begin();itt!=BLinfo->BLlayers.end();itt++)
+    std::map<int,int> outer;
+    std::map<int,int> sender;
+    for(int k=0;k<recv.size();k+=3)
     {
-        for(int q=0;q<itt->second.size();q++)
+        outer[recv[k]] = std::max(outer[recv[k]],recv[k+1]);
+        if(sender.find(recv[k])==sender.end())
         {
-            BLinfo->elements_set.insert(itt->second[q]);
+            sender[recv[k]] = recv[k+2];
         }
     }
-
-    return BLinfo;
+    for(int r=0;r<world_size;r++)
+    {
+        send[r].clear();
+    }
+    std::map<int,int>::iterator its;
+    for(its=sender.begin();its!=sender.end();its++)
+    {
+        if(outer[its->first] == 0)
+        {
+            send[its->second].push_back(its->first);
+        }
+    }
+    recv = ExchangeVectors(send, MPI_INT, comm);
+    
+    std::map<int,int> gv2mv;
+    for(int i=0;i<mv->n;i++)
+    {
+        gv2mv[mv->gid[i]] = i;
+    }
+    // Vertex records [global id, x, y, z, metric(6)].
+    std::vector<double> vrecs;
+    for(int k=0;k<recv.size();k++)
+    {
+        Vert* V   = LocalVs[gV2lV[recv[k]]];
+        double* M = mv->getTensor(gv2mv.at(recv[k]));
+        vrecs.push_back(recv[k]);
+        vrecs.push_back(V->x);
+        vrecs.push_back(V->y);
+        vrecs.push_back(V->z);
+        vrecs.insert(vrecs.end(),M,M+6);
+    }
+    
+    std::map<int,std::vector<double> > bl_verts;
+    StreamRecordsToRoot(vrecs, 10, chunk, MPI_DOUBLE, [&](double* rec, int n)
+    {
+        for(int k=0;k<n;k++)
+        {
+            double* R = rec+k*10;
+            bl_verts[int(R[0])].assign(R+1,R+10);
+        }
+    }, comm);
+    
+    return bl_verts;
 }
 
 
 
-Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int> > u_tris, BLShellInfo* BLshell, int wall_id, int nLayer, Array<double>* xcn_g, Array<int>* ien_g, Array<int>* ief_g, Array<int>* ife_g, Array<int>* ifn_g, ParallelState* xcn_pstate, ParallelState* ien_pstate, std::map<int,std::vector<int> > bnd_face_map, std::map<std::set<int>,int> tria_ref_map, std::map<std::set<int>,int> quad_ref_map,  MPI_Comm comm)
+
+
+Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int> > u_tris, BLShellInfo* BLshell, int nLayer, MPI_Comm comm)
 {
     Mesh_Topology_BL* mesh_topology_bl = new Mesh_Topology_BL;
     int world_size;
@@ -400,11 +991,11 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
     //std::vector<Vert*> face_c;
     std::map<int,std::vector<Vert*> > prisms;
     
-    std::set<int> tria0;
-    std::set<int> tria1;
-    std::set<int> quad0;
-    std::set<int> quad1;
-    std::set<int> quad2;
+    TriKey tria0;
+    TriKey tria1;
+    QuadKey quad0;
+    QuadKey quad1;
+    QuadKey quad2;
     
     int or0 = 0;
 
@@ -421,7 +1012,6 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
     mesh_topology_bl->Nprisms = 0;
     int glob_el_id = 0;
     std::map<int,int> bface2shellface = BLshell->BFace2ShellFace;
-    std::map<std::set<int>,int> shelltri2shellface = BLshell->ShellTri2FaceID;
     std::map<int,std::vector<int> > shellfaceID2triID =  BLshell->ShellFaceID2TriID;
     int opposite_p00,opposite_p01,opposite_p02,opposite_p10,opposite_p11,opposite_p12;
     int cnt_turn = 0;
@@ -441,14 +1031,32 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
     Vec3D* v00 = new Vec3D;
     Vec3D* v11 = new Vec3D;
     
+    // The columns that ended on this rank carry all the connectivity and coordinates
+    // that are needed; the boundary references come from the faces of the columns.
+    std::map<int,std::vector<int> >& ien_c    = BLshell->ColumnIEN;
+    std::map<int,std::vector<int> >& ief_c    = BLshell->ColumnIEF;
+    std::map<int,std::vector<int> >& ifn_c    = BLshell->ColumnIFN;
+    std::map<int,std::vector<double> >& xcn_c = BLshell->ColumnXCN;
+    BoundaryMap* cbmap = new BoundaryMap(BLshell->ColumnIFN, BLshell->ColumnIFRef);
+    TriKeyMap tria_ref_map;
+    QuadKeyMap quad_ref_map;
+    tria_ref_map.swap(cbmap->getTriaRefMap());
+    quad_ref_map.swap(cbmap->getQuadRefMap());
+    delete cbmap;
     
-    for(int bf=0;bf<bnd_face_map[wall_id].size();bf++)
+    std::map<int,std::vector<int> >::iterator itl;
+    for(itl=BLshell->BLlayers.begin();itl!=BLshell->BLlayers.end();itl++)
     {
         
         int bvid=-1,obvid_i=-1,opposite_bvid=-1;
         std::vector<int> layer;
-        int bfaceid      = bnd_face_map[wall_id][bf];
+        int bfaceid      = itl->first;
         int shell_faceid = BLshell->BFace2ShellFace[bfaceid];
+        if(shellfaceID2triID[shell_faceid].size() < 2)
+        {
+            std::cout << "Error :: no shell triangles were found for wall face " << bfaceid << std::endl;
+            continue;
+        }
         int triID0 = shellfaceID2triID[shell_faceid][0];
         int triID1 = shellfaceID2triID[shell_faceid][1];
         std::vector<int> tri_shell_0 = u_tris[triID0];
@@ -515,17 +1123,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
         facenew[3] = tri_0n[2];
         
         int faceid  = bfaceid;
-        int elid0   = ife_g->getVal(faceid,0);
-        int elid1   = ife_g->getVal(faceid,1);
-
-        if(elid0<ien_g->getNrow())
-        {
-            elid_cur = elid0;
-        }
-        else
-        {
-            elid_cur = elid1;
-        }
+        elid_cur    = itl->second[0];
         //layer.push_back(elid_cur);
         
         std::set<int> local_faces;
@@ -533,12 +1131,12 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
         //std::cout << "Element -> ";
         for(int k=0;k<8;k++)
         {
-           loc_vid     = ien_g->getVal(elid_cur,k);
+           loc_vid     = ien_c[elid_cur][k];
            // std::cout << loc_vid << " ";
            Pijk_id[k]  = loc_vid;
-           Pijk[k*3+0] = xcn_g->getVal(loc_vid,0);
-           Pijk[k*3+1] = xcn_g->getVal(loc_vid,1);
-           Pijk[k*3+2] = xcn_g->getVal(loc_vid,2);
+           Pijk[k*3+0] = xcn_c[loc_vid][0];
+           Pijk[k*3+1] = xcn_c[loc_vid][1];
+           Pijk[k*3+2] = xcn_c[loc_vid][2];
         }
         //std::cout << std::endl;
         //int changed = ChkHexorient(Pijk,Pijk_id);
@@ -553,12 +1151,12 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
         std::vector<Vert*> face_turned2(4);
         for(int r=0;r<4;r++)
         {
-            int vid  = ifn_g->getVal(faceid,r);
+            int vid  = ifn_c[faceid][r];
             
             Vert* V  = new Vert;
-            V->x     = xcn_g->getVal(vid,0);
-            V->y     = xcn_g->getVal(vid,1);
-            V->z     = xcn_g->getVal(vid,2);
+            V->x     = xcn_c[vid][0];
+            V->y     = xcn_c[vid][1];
+            V->z     = xcn_c[vid][2];
             Vface->x = Vface->x+V->x;
             Vface->y = Vface->y+V->y;
             Vface->z = Vface->z+V->z;
@@ -568,22 +1166,22 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
         std::vector<int> tri0(3);
         std::vector<int> tri1(3);
         
-        v_t0->c0 = xcn_g->getVal(tri_0n[1],0)-xcn_g->getVal(tri_0n[0],0);
-        v_t0->c1 = xcn_g->getVal(tri_0n[1],1)-xcn_g->getVal(tri_0n[0],1);
-        v_t0->c2 = xcn_g->getVal(tri_0n[1],2)-xcn_g->getVal(tri_0n[0],2);
+        v_t0->c0 = xcn_c[tri_0n[1]][0]-xcn_c[tri_0n[0]][0];
+        v_t0->c1 = xcn_c[tri_0n[1]][1]-xcn_c[tri_0n[0]][1];
+        v_t0->c2 = xcn_c[tri_0n[1]][2]-xcn_c[tri_0n[0]][2];
         
-        v_t1->c0 = xcn_g->getVal(tri_0n[2],0)-xcn_g->getVal(tri_0n[0],0);
-        v_t1->c1 = xcn_g->getVal(tri_0n[2],1)-xcn_g->getVal(tri_0n[0],1);
-        v_t1->c2 = xcn_g->getVal(tri_0n[2],2)-xcn_g->getVal(tri_0n[0],2);
+        v_t1->c0 = xcn_c[tri_0n[2]][0]-xcn_c[tri_0n[0]][0];
+        v_t1->c1 = xcn_c[tri_0n[2]][1]-xcn_c[tri_0n[0]][1];
+        v_t1->c2 = xcn_c[tri_0n[2]][2]-xcn_c[tri_0n[0]][2];
         Vec3D* n_t0        = ComputeSurfaceNormal(v_t0,v_t1);
         
-        v_t10->c0 = xcn_g->getVal(tri_1n[1],0)-xcn_g->getVal(tri_1n[0],0);
-        v_t10->c1 = xcn_g->getVal(tri_1n[1],1)-xcn_g->getVal(tri_1n[0],1);
-        v_t10->c2 = xcn_g->getVal(tri_1n[1],2)-xcn_g->getVal(tri_1n[0],2);
+        v_t10->c0 = xcn_c[tri_1n[1]][0]-xcn_c[tri_1n[0]][0];
+        v_t10->c1 = xcn_c[tri_1n[1]][1]-xcn_c[tri_1n[0]][1];
+        v_t10->c2 = xcn_c[tri_1n[1]][2]-xcn_c[tri_1n[0]][2];
         
-        v_t11->c0 = xcn_g->getVal(tri_1n[2],0)-xcn_g->getVal(tri_1n[0],0);
-        v_t11->c1 = xcn_g->getVal(tri_1n[2],1)-xcn_g->getVal(tri_1n[0],1);
-        v_t11->c2 = xcn_g->getVal(tri_1n[2],2)-xcn_g->getVal(tri_1n[0],2);
+        v_t11->c0 = xcn_c[tri_1n[2]][0]-xcn_c[tri_1n[0]][0];
+        v_t11->c1 = xcn_c[tri_1n[2]][1]-xcn_c[tri_1n[0]][1];
+        v_t11->c2 = xcn_c[tri_1n[2]][2]-xcn_c[tri_1n[0]][2];
         Vec3D* n_t10        = ComputeSurfaceNormal(v_t10,v_t11);
         
         tri0[0] = tri_0n[0];
@@ -656,23 +1254,23 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             NegateVec3D(n_t10);
         }
         
-        v_t0->c0 = xcn_g->getVal(tri_0n[1],0)-xcn_g->getVal(tri_0n[0],0);
-        v_t0->c1 = xcn_g->getVal(tri_0n[1],1)-xcn_g->getVal(tri_0n[0],1);
-        v_t0->c2 = xcn_g->getVal(tri_0n[1],2)-xcn_g->getVal(tri_0n[0],2);
+        v_t0->c0 = xcn_c[tri_0n[1]][0]-xcn_c[tri_0n[0]][0];
+        v_t0->c1 = xcn_c[tri_0n[1]][1]-xcn_c[tri_0n[0]][1];
+        v_t0->c2 = xcn_c[tri_0n[1]][2]-xcn_c[tri_0n[0]][2];
 
-        v_t1->c0 = xcn_g->getVal(tri_0n[2],0)-xcn_g->getVal(tri_0n[0],0);
-        v_t1->c1 = xcn_g->getVal(tri_0n[2],1)-xcn_g->getVal(tri_0n[0],1);
-        v_t1->c2 = xcn_g->getVal(tri_0n[2],2)-xcn_g->getVal(tri_0n[0],2);
+        v_t1->c0 = xcn_c[tri_0n[2]][0]-xcn_c[tri_0n[0]][0];
+        v_t1->c1 = xcn_c[tri_0n[2]][1]-xcn_c[tri_0n[0]][1];
+        v_t1->c2 = xcn_c[tri_0n[2]][2]-xcn_c[tri_0n[0]][2];
         //Vec3D* n_t0_v1 = ComputeSurfaceNormal(v_t0,v_t1);
         //double orient_t0_check = DotVec3D(r0,n_t0_v1);
         
-        v_t10->c0 = xcn_g->getVal(tri_1n[1],0)-xcn_g->getVal(tri_1n[0],0);
-        v_t10->c1 = xcn_g->getVal(tri_1n[1],1)-xcn_g->getVal(tri_1n[0],1);
-        v_t10->c2 = xcn_g->getVal(tri_1n[1],2)-xcn_g->getVal(tri_1n[0],2);
+        v_t10->c0 = xcn_c[tri_1n[1]][0]-xcn_c[tri_1n[0]][0];
+        v_t10->c1 = xcn_c[tri_1n[1]][1]-xcn_c[tri_1n[0]][1];
+        v_t10->c2 = xcn_c[tri_1n[1]][2]-xcn_c[tri_1n[0]][2];
 
-        v_t11->c0 = xcn_g->getVal(tri_1n[2],0)-xcn_g->getVal(tri_1n[0],0);
-        v_t11->c1 = xcn_g->getVal(tri_1n[2],1)-xcn_g->getVal(tri_1n[0],1);
-        v_t11->c2 = xcn_g->getVal(tri_1n[2],2)-xcn_g->getVal(tri_1n[0],2);
+        v_t11->c0 = xcn_c[tri_1n[2]][0]-xcn_c[tri_1n[0]][0];
+        v_t11->c1 = xcn_c[tri_1n[2]][1]-xcn_c[tri_1n[0]][1];
+        v_t11->c2 = xcn_c[tri_1n[2]][2]-xcn_c[tri_1n[0]][2];
         //Vec3D* n_t10_v1 = ComputeSurfaceNormal(v_t10,v_t11);
         //double orient_t1_check = DotVec3D(r0,n_t10_v1);
         
@@ -686,24 +1284,24 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
         prism1[1] = tri_1n[1];
         prism1[2] = tri_1n[2];
         
-        v_t0->c0 = xcn_g->getVal(prism0[1],0)-xcn_g->getVal(prism0[0],0);
-        v_t0->c1 = xcn_g->getVal(prism0[1],1)-xcn_g->getVal(prism0[0],1);
-        v_t0->c2 = xcn_g->getVal(prism0[1],2)-xcn_g->getVal(prism0[0],2);
+        v_t0->c0 = xcn_c[prism0[1]][0]-xcn_c[prism0[0]][0];
+        v_t0->c1 = xcn_c[prism0[1]][1]-xcn_c[prism0[0]][1];
+        v_t0->c2 = xcn_c[prism0[1]][2]-xcn_c[prism0[0]][2];
 
-        v_t1->c0 = xcn_g->getVal(prism0[2],0)-xcn_g->getVal(prism0[0],0);
-        v_t1->c1 = xcn_g->getVal(prism0[2],1)-xcn_g->getVal(prism0[0],1);
-        v_t1->c2 = xcn_g->getVal(prism0[2],2)-xcn_g->getVal(prism0[0],2);
+        v_t1->c0 = xcn_c[prism0[2]][0]-xcn_c[prism0[0]][0];
+        v_t1->c1 = xcn_c[prism0[2]][1]-xcn_c[prism0[0]][1];
+        v_t1->c2 = xcn_c[prism0[2]][2]-xcn_c[prism0[0]][2];
         Vec3D* n_t0_v2 = ComputeSurfaceNormal(v_t0,v_t1);
         //orient_t0_check = DotVec3D(r0,n_t0_v2);
 //
         //n_t0 = n_t0_v2;
-        v_t10->c0 = xcn_g->getVal(prism1[1],0)-xcn_g->getVal(prism1[0],0);
-        v_t10->c1 = xcn_g->getVal(prism1[1],1)-xcn_g->getVal(prism1[0],1);
-        v_t10->c2 = xcn_g->getVal(prism1[1],2)-xcn_g->getVal(prism1[0],2);
+        v_t10->c0 = xcn_c[prism1[1]][0]-xcn_c[prism1[0]][0];
+        v_t10->c1 = xcn_c[prism1[1]][1]-xcn_c[prism1[0]][1];
+        v_t10->c2 = xcn_c[prism1[1]][2]-xcn_c[prism1[0]][2];
 
-        v_t11->c0 = xcn_g->getVal(prism1[2],0)-xcn_g->getVal(prism1[0],0);
-        v_t11->c1 = xcn_g->getVal(prism1[2],1)-xcn_g->getVal(prism1[0],1);
-        v_t11->c2 = xcn_g->getVal(prism1[2],2)-xcn_g->getVal(prism1[0],2);
+        v_t11->c0 = xcn_c[prism1[2]][0]-xcn_c[prism1[0]][0];
+        v_t11->c1 = xcn_c[prism1[2]][1]-xcn_c[prism1[0]][1];
+        v_t11->c2 = xcn_c[prism1[2]][2]-xcn_c[prism1[0]][2];
         Vec3D* n_t10_v2 = ComputeSurfaceNormal(v_t10,v_t11);
 
         
@@ -729,10 +1327,10 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             
             for(int k=0;k<8;k++)
             {
-               loc_vid     = ien_g->getVal(elid_cur,k);
-               Pijk[k*3+0] = xcn_g->getVal(loc_vid,0);
-               Pijk[k*3+1] = xcn_g->getVal(loc_vid,1);
-               Pijk[k*3+2] = xcn_g->getVal(loc_vid,2);
+               loc_vid     = ien_c[elid_cur][k];
+               Pijk[k*3+0] = xcn_c[loc_vid][0];
+               Pijk[k*3+1] = xcn_c[loc_vid][1];
+               Pijk[k*3+2] = xcn_c[loc_vid][2];
             }
             
             //int changed = ChkHexorient(Pijk,Pijk_id);
@@ -745,7 +1343,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             std::vector<std::map<int,int> > local_node2opponode_face(6);
             for(int k=0;k<6;k++)
             {
-                int fid = ief_g->getVal(elid_cur,k);
+                int fid = ief_c[elid_cur][k];
                 Vface2->x = 0.0;
                 Vface2->y = 0.0;
                 Vface2->z = 0.0;
@@ -753,12 +1351,12 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
                 std::vector<Vert*> face2;
                 for(int r=0;r<4;r++)
                 {
-                    int vid  = ifn_g->getVal(fid,r);
+                    int vid  = ifn_c[fid][r];
                     
                     Vert* V  = new Vert;
-                    V->x     = xcn_g->getVal(vid,0);
-                    V->y     = xcn_g->getVal(vid,1);
-                    V->z     = xcn_g->getVal(vid,2);
+                    V->x     = xcn_c[vid][0];
+                    V->y     = xcn_c[vid][1];
+                    V->z     = xcn_c[vid][2];
                     Vface2->x = Vface2->x+V->x;
                     Vface2->y = Vface2->y+V->y;
                     Vface2->z = Vface2->z+V->z;
@@ -767,28 +1365,28 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
                     faceVert_IDs[r] = vid;
                 }
                 
-                local_node2node_element[ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,1));
-                local_node2node_element[ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,3));
-                local_node2node_element[ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,0));
-                local_node2node_element[ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,2));
-                local_node2node_element[ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,1));
-                local_node2node_element[ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,3));
-                local_node2node_element[ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,2));
-                local_node2node_element[ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,0));
+                local_node2node_element[ifn_c[fid][0]].insert(ifn_c[fid][1]);
+                local_node2node_element[ifn_c[fid][0]].insert(ifn_c[fid][3]);
+                local_node2node_element[ifn_c[fid][1]].insert(ifn_c[fid][0]);
+                local_node2node_element[ifn_c[fid][1]].insert(ifn_c[fid][2]);
+                local_node2node_element[ifn_c[fid][2]].insert(ifn_c[fid][1]);
+                local_node2node_element[ifn_c[fid][2]].insert(ifn_c[fid][3]);
+                local_node2node_element[ifn_c[fid][3]].insert(ifn_c[fid][2]);
+                local_node2node_element[ifn_c[fid][3]].insert(ifn_c[fid][0]);
                 
-                local_node2node_face[k][ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,1));
-                local_node2node_face[k][ifn_g->getVal(fid,0)].insert(ifn_g->getVal(fid,3));
-                local_node2node_face[k][ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,0));
-                local_node2node_face[k][ifn_g->getVal(fid,1)].insert(ifn_g->getVal(fid,2));
-                local_node2node_face[k][ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,1));
-                local_node2node_face[k][ifn_g->getVal(fid,2)].insert(ifn_g->getVal(fid,3));
-                local_node2node_face[k][ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,2));
-                local_node2node_face[k][ifn_g->getVal(fid,3)].insert(ifn_g->getVal(fid,0));
+                local_node2node_face[k][ifn_c[fid][0]].insert(ifn_c[fid][1]);
+                local_node2node_face[k][ifn_c[fid][0]].insert(ifn_c[fid][3]);
+                local_node2node_face[k][ifn_c[fid][1]].insert(ifn_c[fid][0]);
+                local_node2node_face[k][ifn_c[fid][1]].insert(ifn_c[fid][2]);
+                local_node2node_face[k][ifn_c[fid][2]].insert(ifn_c[fid][1]);
+                local_node2node_face[k][ifn_c[fid][2]].insert(ifn_c[fid][3]);
+                local_node2node_face[k][ifn_c[fid][3]].insert(ifn_c[fid][2]);
+                local_node2node_face[k][ifn_c[fid][3]].insert(ifn_c[fid][0]);
                 
-                local_node2opponode_face[k][ifn_g->getVal(fid,0)]=ifn_g->getVal(fid,2);
-                local_node2opponode_face[k][ifn_g->getVal(fid,1)]=ifn_g->getVal(fid,3);
-                local_node2opponode_face[k][ifn_g->getVal(fid,2)]=ifn_g->getVal(fid,0);
-                local_node2opponode_face[k][ifn_g->getVal(fid,3)]=ifn_g->getVal(fid,1);
+                local_node2opponode_face[k][ifn_c[fid][0]]=ifn_c[fid][2];
+                local_node2opponode_face[k][ifn_c[fid][1]]=ifn_c[fid][3];
+                local_node2opponode_face[k][ifn_c[fid][2]]=ifn_c[fid][0];
+                local_node2opponode_face[k][ifn_c[fid][3]]=ifn_c[fid][1];
 
                 Vface2->x = Vface2->x/4.0;
                 Vface2->y = Vface2->y/4.0;
@@ -847,7 +1445,6 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             int min_index  = std::min_element(dp.begin(),dp.end())-dp.begin();
             //double min_val = *std::min_element(dp.begin(),dp.end());
 
-            int fid_new                  = ief_g->getVal(elid_cur,min_index);
             nbf                          = dpvec[min_index];
             std::vector<int> faceVertIDs = face_id_stored[min_index];
             std::vector<Vert*> faceupdate = face_stored[min_index];
@@ -863,13 +1460,13 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
             
             Vec3D* v_toppo0 = new Vec3D;
-            v_toppo0->c0 = xcn_g->getVal(opposite_tri[1],0)-xcn_g->getVal(opposite_tri[0],0);
-            v_toppo0->c1 = xcn_g->getVal(opposite_tri[1],1)-xcn_g->getVal(opposite_tri[0],1);
-            v_toppo0->c2 = xcn_g->getVal(opposite_tri[1],2)-xcn_g->getVal(opposite_tri[0],2);
+            v_toppo0->c0 = xcn_c[opposite_tri[1]][0]-xcn_c[opposite_tri[0]][0];
+            v_toppo0->c1 = xcn_c[opposite_tri[1]][1]-xcn_c[opposite_tri[0]][1];
+            v_toppo0->c2 = xcn_c[opposite_tri[1]][2]-xcn_c[opposite_tri[0]][2];
             Vec3D* v_toppo1 = new Vec3D;
-            v_toppo1->c0 = xcn_g->getVal(opposite_tri[2],0)-xcn_g->getVal(opposite_tri[0],0);
-            v_toppo1->c1 = xcn_g->getVal(opposite_tri[2],1)-xcn_g->getVal(opposite_tri[0],1);
-            v_toppo1->c2 = xcn_g->getVal(opposite_tri[2],2)-xcn_g->getVal(opposite_tri[0],2);
+            v_toppo1->c0 = xcn_c[opposite_tri[2]][0]-xcn_c[opposite_tri[0]][0];
+            v_toppo1->c1 = xcn_c[opposite_tri[2]][1]-xcn_c[opposite_tri[0]][1];
+            v_toppo1->c2 = xcn_c[opposite_tri[2]][2]-xcn_c[opposite_tri[0]][2];
             
             Vec3D* n_toppo0        = ComputeSurfaceNormal(v_toppo0,v_toppo1);
             double orient0oppo0    = DotVec3D(n_t0_v2 ,n_toppo0 );
@@ -886,13 +1483,13 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
                 cnt_turn++;
             }
 
-            v_toppo0->c0 = xcn_g->getVal(opposite_tri[1],0)-xcn_g->getVal(opposite_tri[0],0);
-            v_toppo0->c1 = xcn_g->getVal(opposite_tri[1],1)-xcn_g->getVal(opposite_tri[0],1);
-            v_toppo0->c2 = xcn_g->getVal(opposite_tri[1],2)-xcn_g->getVal(opposite_tri[0],2);
+            v_toppo0->c0 = xcn_c[opposite_tri[1]][0]-xcn_c[opposite_tri[0]][0];
+            v_toppo0->c1 = xcn_c[opposite_tri[1]][1]-xcn_c[opposite_tri[0]][1];
+            v_toppo0->c2 = xcn_c[opposite_tri[1]][2]-xcn_c[opposite_tri[0]][2];
             
-            v_toppo1->c0 = xcn_g->getVal(opposite_tri[2],0)-xcn_g->getVal(opposite_tri[0],0);
-            v_toppo1->c1 = xcn_g->getVal(opposite_tri[2],1)-xcn_g->getVal(opposite_tri[0],1);
-            v_toppo1->c2 = xcn_g->getVal(opposite_tri[2],2)-xcn_g->getVal(opposite_tri[0],2);
+            v_toppo1->c0 = xcn_c[opposite_tri[2]][0]-xcn_c[opposite_tri[0]][0];
+            v_toppo1->c1 = xcn_c[opposite_tri[2]][1]-xcn_c[opposite_tri[0]][1];
+            v_toppo1->c2 = xcn_c[opposite_tri[2]][2]-xcn_c[opposite_tri[0]][2];
             n_toppo0        = ComputeSurfaceNormal(v_toppo0, v_toppo1);
             
             orient0oppo0    = DotVec3D(n_t0_v2 , n_toppo0 );
@@ -904,13 +1501,13 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             opposite_tri1[2] = opposite_tri[1];
             
             Vec3D* v_toppo10 = new Vec3D;
-            v_toppo10->c0 = xcn_g->getVal(opposite_tri1[1],0)-xcn_g->getVal(opposite_tri1[0],0);
-            v_toppo10->c1 = xcn_g->getVal(opposite_tri1[1],1)-xcn_g->getVal(opposite_tri1[0],1);
-            v_toppo10->c2 = xcn_g->getVal(opposite_tri1[1],2)-xcn_g->getVal(opposite_tri1[0],2);
+            v_toppo10->c0 = xcn_c[opposite_tri1[1]][0]-xcn_c[opposite_tri1[0]][0];
+            v_toppo10->c1 = xcn_c[opposite_tri1[1]][1]-xcn_c[opposite_tri1[0]][1];
+            v_toppo10->c2 = xcn_c[opposite_tri1[1]][2]-xcn_c[opposite_tri1[0]][2];
             Vec3D* v_toppo11 = new Vec3D;
-            v_toppo11->c0 = xcn_g->getVal(opposite_tri1[2],0)-xcn_g->getVal(opposite_tri1[0],0);
-            v_toppo11->c1 = xcn_g->getVal(opposite_tri1[2],1)-xcn_g->getVal(opposite_tri1[0],1);
-            v_toppo11->c2 = xcn_g->getVal(opposite_tri1[2],2)-xcn_g->getVal(opposite_tri1[0],2);
+            v_toppo11->c0 = xcn_c[opposite_tri1[2]][0]-xcn_c[opposite_tri1[0]][0];
+            v_toppo11->c1 = xcn_c[opposite_tri1[2]][1]-xcn_c[opposite_tri1[0]][1];
+            v_toppo11->c2 = xcn_c[opposite_tri1[2]][2]-xcn_c[opposite_tri1[0]][2];
             
             Vec3D* n_toppo10        = ComputeSurfaceNormal(v_toppo10,v_toppo11);
             double orient0oppo10    = DotVec3D(n_t10_v2 , n_toppo10 );
@@ -929,13 +1526,13 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
                 cnt_turn++;
             }
 
-            v_toppo10->c0 = xcn_g->getVal(opposite_tri1[1],0)-xcn_g->getVal(opposite_tri1[0],0);
-            v_toppo10->c1 = xcn_g->getVal(opposite_tri1[1],1)-xcn_g->getVal(opposite_tri1[0],1);
-            v_toppo10->c2 = xcn_g->getVal(opposite_tri1[1],2)-xcn_g->getVal(opposite_tri1[0],2);
+            v_toppo10->c0 = xcn_c[opposite_tri1[1]][0]-xcn_c[opposite_tri1[0]][0];
+            v_toppo10->c1 = xcn_c[opposite_tri1[1]][1]-xcn_c[opposite_tri1[0]][1];
+            v_toppo10->c2 = xcn_c[opposite_tri1[1]][2]-xcn_c[opposite_tri1[0]][2];
             
-            v_toppo11->c0 = xcn_g->getVal(opposite_tri1[2],0)-xcn_g->getVal(opposite_tri1[0],0);
-            v_toppo11->c1 = xcn_g->getVal(opposite_tri1[2],1)-xcn_g->getVal(opposite_tri1[0],1);
-            v_toppo11->c2 = xcn_g->getVal(opposite_tri1[2],2)-xcn_g->getVal(opposite_tri1[0],2);
+            v_toppo11->c0 = xcn_c[opposite_tri1[2]][0]-xcn_c[opposite_tri1[0]][0];
+            v_toppo11->c1 = xcn_c[opposite_tri1[2]][1]-xcn_c[opposite_tri1[0]][1];
+            v_toppo11->c2 = xcn_c[opposite_tri1[2]][2]-xcn_c[opposite_tri1[0]][2];
             n_toppo10        = ComputeSurfaceNormal(v_toppo10, v_toppo11);
             
             orient0oppo10    = DotVec3D(n_t10_v2 , n_toppo10 );
@@ -960,20 +1557,10 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
 
             NegateVec3D(nbf);
 
-            int gEl0=ife_g->getVal(fid_new,0);
-            int gEl1=ife_g->getVal(fid_new,1);
-
-            if(gEl0==elid_cur)
-            {
-                elid_next = gEl1;
-            }
-            else if(gEl1==elid_cur)
-            {
-                elid_next = gEl0;
-            }
-            
+            elid_next = -1;
             if(c<nLayer-1)
             {
+                elid_next = itl->second[c+1];
                 layer.push_back(elid_next);
             }
             
@@ -983,9 +1570,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             prismStored0[3] = prism0[3];prismStored0[4] = prism0[4];prismStored0[5] = prism0[5];
 
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            tria0.insert(prismStored0[0]);
-            tria0.insert(prismStored0[1]);
-            tria0.insert(prismStored0[2]);
+            tria0 = MakeTriKey(prismStored0[0],prismStored0[1],prismStored0[2]);
             if(tria_ref_map.find(tria0)!=tria_ref_map.end())
             {
                 int ref0 = tria_ref_map[tria0];
@@ -997,9 +1582,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
         
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            tria1.insert(prismStored0[3]);
-            tria1.insert(prismStored0[4]);
-            tria1.insert(prismStored0[5]);
+            tria1 = MakeTriKey(prismStored0[3],prismStored0[4],prismStored0[5]);
             if(tria_ref_map.find(tria1)!=tria_ref_map.end())
             {
                 int ref1 = tria_ref_map[tria1];
@@ -1011,10 +1594,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
             
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad0.insert(prismStored0[0]);
-            quad0.insert(prismStored0[2]);
-            quad0.insert(prismStored0[4]);
-            quad0.insert(prismStored0[3]);
+            quad0 = MakeQuadKey(prismStored0[0],prismStored0[2],prismStored0[4],prismStored0[3]);
             if(quad_ref_map.find(quad0)!=quad_ref_map.end())
             {
                 int ref0 = quad_ref_map[quad0];
@@ -1027,10 +1607,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
         
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad1.insert(prismStored0[1]);
-            quad1.insert(prismStored0[5]);
-            quad1.insert(prismStored0[4]);
-            quad1.insert(prismStored0[2]);
+            quad1 = MakeQuadKey(prismStored0[1],prismStored0[5],prismStored0[4],prismStored0[2]);
             
             if(quad_ref_map.find(quad1)!=quad_ref_map.end())
             {
@@ -1045,10 +1622,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
         
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad2.insert(prismStored0[0]);
-            quad2.insert(prismStored0[3]);
-            quad2.insert(prismStored0[5]);
-            quad2.insert(prismStored0[1]);
+            quad2 = MakeQuadKey(prismStored0[0],prismStored0[3],prismStored0[5],prismStored0[1]);
             if(quad_ref_map.find(quad2)!=quad_ref_map.end())
             {
                 int ref2 = quad_ref_map[quad2];
@@ -1060,11 +1634,6 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
                 mesh_topology_bl->bcQuad[ref2].push_back(bcquad);
             }
             
-            tria0.clear();
-            tria1.clear();
-            quad0.clear();
-            quad1.clear();
-            quad2.clear();
             
             glob_el_id = glob_el_id+1;
             
@@ -1075,9 +1644,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             
             
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            tria0.insert(prismStored1[0]);
-            tria0.insert(prismStored1[1]);
-            tria0.insert(prismStored1[2]);
+            tria0 = MakeTriKey(prismStored1[0],prismStored1[1],prismStored1[2]);
             if(tria_ref_map.find(tria0)!=tria_ref_map.end())
             {
                 int ref0 = tria_ref_map[tria0];
@@ -1089,9 +1656,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
             
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            tria1.insert(prismStored1[3]);
-            tria1.insert(prismStored1[4]);
-            tria1.insert(prismStored1[5]);
+            tria1 = MakeTriKey(prismStored1[3],prismStored1[4],prismStored1[5]);
             if(tria_ref_map.find(tria1)!=tria_ref_map.end())
             {
                 int ref1 = tria_ref_map[tria1];
@@ -1103,10 +1668,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
 
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad0.insert(prismStored1[0]);
-            quad0.insert(prismStored1[2]);
-            quad0.insert(prismStored1[4]);
-            quad0.insert(prismStored1[3]);
+            quad0 = MakeQuadKey(prismStored1[0],prismStored1[2],prismStored1[4],prismStored1[3]);
             if(quad_ref_map.find(quad0)!=quad_ref_map.end())
             {
                 int ref0 = quad_ref_map[quad0];
@@ -1120,10 +1682,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
 
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad1.insert(prismStored1[1]);
-            quad1.insert(prismStored1[5]);
-            quad1.insert(prismStored1[4]);
-            quad1.insert(prismStored1[2]);
+            quad1 = MakeQuadKey(prismStored1[1],prismStored1[5],prismStored1[4],prismStored1[2]);
             
             if(quad_ref_map.find(quad1)!=quad_ref_map.end())
             {
@@ -1138,10 +1697,7 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
             }
             
             // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-            quad2.insert(prismStored1[0]);
-            quad2.insert(prismStored1[3]);
-            quad2.insert(prismStored1[5]);
-            quad2.insert(prismStored1[1]);
+            quad2 = MakeQuadKey(prismStored1[0],prismStored1[3],prismStored1[5],prismStored1[1]);
             if(quad_ref_map.find(quad2)!=quad_ref_map.end())
             {
                 int ref2 = quad_ref_map[quad2];
@@ -1154,11 +1710,6 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
 
             }
             
-            tria0.clear();
-            tria1.clear();
-            quad0.clear();
-            quad1.clear();
-            quad2.clear();
             
             glob_el_id = glob_el_id+1;
 
@@ -1222,7 +1773,10 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
     delete v_t11;
     
     double duration = ( std::clock() - start ) / (double) CLOCKS_PER_SEC;
-    std::cout << "Timing for extracting BL mesh = " << duration << std::endl;
+    if(world_rank == 0)
+    {
+        std::cout << "Timing for extracting BL mesh = " << duration << std::endl;
+    }
 //    std::map<int,std::vector<int> >::iterator itt;
 //    std::vector<int> elements;
 //    for(itt=mesh_topology_bl->BLlayers.begin();itt!=mesh_topology_bl->BLlayers.end();itt++)
@@ -1236,3 +1790,117 @@ Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int>
        
     return mesh_topology_bl;
 }
+
+
+
+
+Mesh_Topology_BL* GatherBoundaryLayerMeshOnRoot(Mesh_Topology_BL* mesh_topo_bl, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    // [nwall, nwall x (wall face, nprism, nprism x 6 nodes),
+    //  ntria, ntria x (ref, 3 nodes), nquad, nquad x (ref, 4 nodes)]
+    std::vector<int> sbuf;
+    std::map<int,std::vector<std::vector<int> > >::iterator it;
+    sbuf.push_back(mesh_topo_bl->BLlayersPrisms.size());
+    for(it=mesh_topo_bl->BLlayersPrisms.begin();it!=mesh_topo_bl->BLlayersPrisms.end();it++)
+    {
+        sbuf.push_back(it->first);
+        sbuf.push_back(it->second.size());
+        for(int p=0;p<it->second.size();p++)
+        {
+            sbuf.insert(sbuf.end(),it->second[p].begin(),it->second[p].begin()+6);
+        }
+    }
+    int ntria = 0;
+    for(it=mesh_topo_bl->bcTria.begin();it!=mesh_topo_bl->bcTria.end();it++)
+    {
+        ntria = ntria+it->second.size();
+    }
+    sbuf.push_back(ntria);
+    for(it=mesh_topo_bl->bcTria.begin();it!=mesh_topo_bl->bcTria.end();it++)
+    {
+        for(int p=0;p<it->second.size();p++)
+        {
+            sbuf.push_back(it->first);
+            sbuf.insert(sbuf.end(),it->second[p].begin(),it->second[p].begin()+3);
+        }
+    }
+    int nquad = 0;
+    for(it=mesh_topo_bl->bcQuad.begin();it!=mesh_topo_bl->bcQuad.end();it++)
+    {
+        nquad = nquad+it->second.size();
+    }
+    sbuf.push_back(nquad);
+    for(it=mesh_topo_bl->bcQuad.begin();it!=mesh_topo_bl->bcQuad.end();it++)
+    {
+        for(int p=0;p<it->second.size();p++)
+        {
+            sbuf.push_back(it->first);
+            sbuf.insert(sbuf.end(),it->second[p].begin(),it->second[p].begin()+4);
+        }
+    }
+    
+    int nsend = sbuf.size();
+    std::vector<int> nlocs(world_size), offsets(world_size);
+    MPI_Gather(&nsend, 1, MPI_INT, &nlocs[0], 1, MPI_INT, 0, comm);
+    int nrecv = 0;
+    for(int i=0;i<world_size;i++)
+    {
+        offsets[i] = nrecv;
+        nrecv      = nrecv+nlocs[i];
+    }
+    if(world_rank != 0)
+    {
+        nrecv = 0;
+    }
+    sbuf.push_back(0);
+    std::vector<int> rbuf(nrecv+1);
+    GatherRowsOnRoot(&sbuf[0], nsend, 1, &rbuf[0], &nlocs[0], &offsets[0], comm);
+    
+    if(world_rank != 0)
+    {
+        return NULL;
+    }
+    
+    Mesh_Topology_BL* mesh_topo_bl_g = new Mesh_Topology_BL;
+    mesh_topo_bl_g->Nprisms = 0;
+    for(int r=0;r<world_size;r++)
+    {
+        int k = offsets[r];
+        int nwall = rbuf[k++];
+        for(int w=0;w<nwall;w++)
+        {
+            int bfaceid = rbuf[k++];
+            int nprism  = rbuf[k++];
+            std::vector<std::vector<int> > PPrisms(nprism);
+            for(int p=0;p<nprism;p++)
+            {
+                PPrisms[p].assign(rbuf.begin()+k,rbuf.begin()+k+6);
+                k = k+6;
+            }
+            mesh_topo_bl_g->BLlayersPrisms[bfaceid] = PPrisms;
+            mesh_topo_bl_g->Nprisms = mesh_topo_bl_g->Nprisms+nprism;
+        }
+        int nt = rbuf[k++];
+        for(int p=0;p<nt;p++)
+        {
+            std::vector<int> bctria(rbuf.begin()+k+1,rbuf.begin()+k+4);
+            mesh_topo_bl_g->bcTria[rbuf[k]].push_back(bctria);
+            k = k+4;
+        }
+        int nq = rbuf[k++];
+        for(int p=0;p<nq;p++)
+        {
+            std::vector<int> bcquad(rbuf.begin()+k+1,rbuf.begin()+k+5);
+            mesh_topo_bl_g->bcQuad[rbuf[k]].push_back(bcquad);
+            k = k+5;
+        }
+    }
+    
+    return mesh_topo_bl_g;
+}
@@ -6,23 +6,76 @@
 #include "adapt_geometry.h"
 #include "adapt_topology.h"
 #include "adapt_output.h"
+#include "adapt_boundary.h"
+#include "adapt_parops.h"
+
+#ifndef ADAPT_BLTOPOLOGY_H
+#define ADAPT_BLTOPOLOGY_H
+
 struct BLShellInfo{
   
     std::map<int,int> ShellFace2BFace;
     std::map<int,int> BFace2ShellFace;
-    std::map<std::set<int>,int> ShellTri2FaceID;
+    TriKeyMap ShellTri2FaceID;
     std::map<int,std::vector<int> > ShellFaceID2TriID;
     std::map<int,int> FaceID2TopoType;
     std::map<int,std::map<int,int> > ShellFace2ShellVert2OppositeBoundaryVerts;
     Array<int>* ShellRef;
     std::map<int,std::vector<int> > BLlayers;
     std::set<int> elements_set;
+    // The BL columns (the nLayer elements on top of a wall face) that ended on this
+    // rank, keyed by global element, face and vertex ids.
+    std::map<int,std::vector<int> > ColumnIEN;
+    std::map<int,std::vector<int> > ColumnIEF;
+    std::map<int,std::vector<int> > ColumnIFN;
+    std::map<int,int> ColumnIFRef;
+    std::map<int,std::vector<double> > ColumnXCN;
+    std::map<int,int> ShellFace2Rank;
 };
 
 
-BLShellInfo* FindOuterShellBoundaryLayerMesh(int wall_id, int nLayer,
-                                             Array<double>* xcn_g, Array<int>* ien_g, Array<int>* ief_g, Array<int>* ife_g, Array<int>* ifn_g,
-                                             ParallelState* xcn_pstate, ParallelState* ien_pstate, std::map<int,std::vector<int> > bnd_face_map, std::map<int,int> vert_ref_map, MPI_Comm comm);
+// Walks the nLayer elements on top of every face with a reference in wall_ids through the
+// partitioned mesh using iee and the face normals of geom. The walks on a rank march in
+// parallel threads. A walk that steps into an element of another rank is handed to the
+// owner of that element, so elements_set holds the BL elements owned by this rank and the
+// column data holds the columns that ended on this rank.
+BLShellInfo* FindOuterShellBoundaryLayerMesh(std::set<int>& wall_ids, int nLayer, Partition* P, Mesh_Geometry* geom, MPI_Comm comm);
+
+// Collects the outer shell faces on rank 0 together with ShellRef for all nVerts vertices.
+BLShellInfo* GatherOuterShellOnRoot(BLShellInfo* BLshell, int nVerts, std::map<int,int> vert_ref_map, MPI_Comm comm);
+
+// Sends the two triangles of every shell face from rank 0 to the rank that holds its column.
+std::vector<std::vector<int> > DistributeShellTriangles(BLShellInfo* BLshell_g, std::vector<std::vector<int> > u_tris_g, BLShellInfo* BLshell, MPI_Comm comm);
+
+// Sends the owned hexes that are not part of the BL mesh, their vertices and the metric mv
+// to rank 0 in chunks of at most chunk records, where they are written straight into
+// mmgMesh, mmgSol and the 1-based H2T table hexTab; no rank holds the whole outer volume in
+// between. lv2gv maps the MMG vertices (from 0) to global ids. Returns the number of hexes
+// on rank 0.
+int StreamOuterVolumeToMMG3DOnRoot(Partition* P, BLShellInfo* BLshell, TensorField* mv,
+                                   MMG5_pMesh mmgMesh, MMG5_pSol mmgSol, int*& hexTab,
+                                   std::map<int,int>& lv2gv, int chunk, MPI_Comm comm);
+
+// Sends the coordinates and the metric mv of the vertices that only belong to BL elements to
+// rank 0 in chunks of at most chunk records. Rank 0 gets [x,y,z,metric(6)] per global vertex
+// id; the other vertices are already in the outer-volume mesh of StreamOuterVolumeToMMG3DOnRoot.
+std::map<int,std::vector<double> > StreamBoundaryLayerVerticesToRoot(Partition* P, BLShellInfo* BLshell, TensorField* mv,
+                                                                     int chunk, MPI_Comm comm);
+
+// Splits the quad q into two triangles along the diagonal through its lowest vertex id, so
+// that the ranks on either side of a face split it in the same way.
+void SplitQuadAtLowestVertex(const int* q, int tris[2][3]);
+
+// Splits the shell faces of the columns on this rank with SplitQuadAtLowestVertex instead of
+// taking the split from the hex2tet cut on rank 0. Fills ShellFaceID2TriID.
+std::vector<std::vector<int> > TriangulateShellFaces(BLShellInfo* BLshell);
+
+// Returns the shell faces that bound an element owned by this rank outside of the BL mesh.
+std::set<int> GetShellFacesOfOuterVolume(Partition* P, BLShellInfo* BLshell, MPI_Comm comm);
+
+Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int> > u_tris, BLShellInfo* BLshell, int nLayer, MPI_Comm comm);
 
-Mesh_Topology_BL* ExtractBoundaryLayerMeshFromShell(std::vector<std::vector<int> > u_tris, BLShellInfo* BLshell, int wall_id, int nLayer, Array<double>* xcn_g, Array<int>* ien_g, Array<int>* ief_g, Array<int>* ife_g, Array<int>* ifn_g, ParallelState* xcn_pstate, ParallelState* ien_pstate, std::map<int,std::vector<int> > bnd_face_map, std::map<std::set<int>,int> tria_ref_map, std::map<std::set<int>,int> quad_ref_map,  MPI_Comm comm);
+// Returns the prisms and boundary faces of all ranks on rank 0 and NULL on the other ranks.
+Mesh_Topology_BL* GatherBoundaryLayerMeshOnRoot(Mesh_Topology_BL* mesh_topo_bl, MPI_Comm comm);
 
+#endif
@@ -1,115 +1,237 @@
 #include "adapt_boundary.h"
+#include "adapt_parops.h"
 
 BoundaryMap::BoundaryMap(Array<int>* ifn, Array<int>* if_ref)
 {
-
-    std::set<int> node_ref_set;
-    
-    std::set<int> tria0;
-    std::set<int> tria00;
-    std::set<int> tria1;
-    std::set<int> tria11;
-    
-    std::set<int> quad;
-    int faceid;
-    int nodeid;
     int nrow_ifn = ifn->getNrow();
-    //Array<int>* ifn_ref  = new Array<int>(nrow_ifn,1);
-    int ref;
+    int fv[4];
     
-    std::map<int,std::vector<int> >::iterator bmit;
-    
-    int r2=0;int r10=0;int r36=0;int r3=0;
     for(int i=0;i<nrow_ifn;i++)
     {
-        ref = if_ref->getVal(i,0);
-        //ifn_ref->setVal(i,0,ref);
-        
-        faceid = i;
-        if(ref != 2)
+        for(int j=0;j<4;j++)
         {
-            bnd_face_map[ref].push_back(faceid);
+            fv[j] = ifn->getVal(i,j); // This is actually node ID!!!!
         }
-        
+        AddFace(i, fv, if_ref->getVal(i,0));
+    }
+}
+
+
+
+
+BoundaryMap::BoundaryMap(ParArray<int>* ifn, ParArray<int>* if_ref, MPI_Comm comm)
+{
+    // Get the rank of the process
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    int foffset = ifn->getOffset(rank);
+    int fv[4];
+    
+    for(int i=0;i<ifn->getNrow();i++)
+    {
         for(int j=0;j<4;j++)
         {
-            nodeid = ifn->getVal(i,j); // This is actually node ID!!!!
-            //ifn_copy->setVal(i,j,ifn_g->getVal(i,j+1)-1);
-            
-            if(ref!=2)
-            {
-                if(node_ref_set.find(nodeid)==node_ref_set.end())
-                {
-                    node_ref_set.insert(nodeid);
-                    node_ref_map[nodeid] = if_ref->getVal(i,0);
-                }
-            }
+            fv[j] = ifn->getVal(i,j);
         }
-        
-        tria0.insert(ifn->getVal(i,0));
-        tria0.insert(ifn->getVal(i,1));
-        tria0.insert(ifn->getVal(i,2));
-        
-        tria00.insert(ifn->getVal(i,0));
-        tria00.insert(ifn->getVal(i,2));
-        tria00.insert(ifn->getVal(i,3));
-        
-        tria1.insert(ifn->getVal(i,0));
-        tria1.insert(ifn->getVal(i,1));
-        tria1.insert(ifn->getVal(i,3));
-        
-        tria11.insert(ifn->getVal(i,1));
-        tria11.insert(ifn->getVal(i,2));
-        tria11.insert(ifn->getVal(i,3));
-        
-        quad.insert(ifn->getVal(i,0));
-        quad.insert(ifn->getVal(i,1));
-        quad.insert(ifn->getVal(i,2));
-        quad.insert(ifn->getVal(i,3));
-        
-        if(tria_ref_map.find(tria0)==tria_ref_map.end() && ref!=2)
+        AddFace(foffset+i, fv, if_ref->getVal(i,0));
+    }
+}
+
+
+
+
+BoundaryMap::BoundaryMap(std::map<int,std::vector<int> > &ifn, std::map<int,int> &if_ref)
+{
+    int fv[4];
+    std::map<int,std::vector<int> >::iterator itf;
+    for(itf=ifn.begin();itf!=ifn.end();itf++)
+    {
+        for(int j=0;j<4;j++)
         {
-            tria_ref_map[tria0]  = ref;
-            tria_ref_map[tria00] = ref;
+            fv[j] = itf->second[j];
         }
-        if(tria_ref_map.find(tria1)==tria_ref_map.end() && ref!=2)
+        AddFace(itf->first, fv, if_ref[itf->first]);
+    }
+}
+
+
+
+
+void BoundaryMap::AddFace(int faceid, int* fv, int ref)
+{
+    if(ref == 2)
+    {
+        return;
+    }
+    
+    bnd_face_map[ref].push_back(faceid);
+    
+    for(int j=0;j<4;j++)
+    {
+        if(node_ref_map.find(fv[j])==node_ref_map.end())
         {
-            tria_ref_map[tria1]  = ref;
-            tria_ref_map[tria11] = ref;
+            node_ref_map[fv[j]] = ref;
         }
-        
-        if(quad_ref_map.find(quad)==quad_ref_map.end() && ref!=2)
+    }
+    
+    TriKey tria0  = MakeTriKey(fv[0],fv[1],fv[2]);
+    TriKey tria00 = MakeTriKey(fv[0],fv[2],fv[3]);
+    TriKey tria1  = MakeTriKey(fv[0],fv[1],fv[3]);
+    TriKey tria11 = MakeTriKey(fv[1],fv[2],fv[3]);
+    QuadKey quad  = MakeQuadKey(fv[0],fv[1],fv[2],fv[3]);
+    
+    if(tria_ref_map.find(tria0)==tria_ref_map.end())
+    {
+        tria_ref_map[tria0]  = ref;
+        tria_ref_map[tria00] = ref;
+    }
+    if(tria_ref_map.find(tria1)==tria_ref_map.end())
+    {
+        tria_ref_map[tria1]  = ref;
+        tria_ref_map[tria11] = ref;
+    }
+    
+    if(quad_ref_map.find(quad)==quad_ref_map.end())
+    {
+        quad_ref_map[quad] = ref;
+    }
+}
+
+
+
+
+// Gathers the nrow x ncol rows of sbuf of all ranks on rank 0 in rank order.
+static std::vector<int> GatherEntriesOnRoot(std::vector<int>& sbuf, int ncol, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    int nrow = sbuf.size()/ncol;
+    std::vector<int> nlocs(world_size,0), offsets(world_size,0);
+    MPI_Gather(&nrow, 1, MPI_INT, &nlocs[0], 1, MPI_INT, 0, comm);
+    int nrecv = 0;
+    for(int i=0;i<world_size && world_rank==0;i++)
+    {
+        offsets[i] = nrecv;
+        nrecv      = nrecv+nlocs[i];
+    }
+    sbuf.push_back(0);
+    std::vector<int> rbuf(nrecv*ncol+1);
+    GatherRowsOnRoot(&sbuf[0], nrow, ncol, &rbuf[0], &nlocs[0], &offsets[0], comm);
+    sbuf.pop_back();
+    rbuf.pop_back();
+    
+    return rbuf;
+}
+
+
+
+
+void BoundaryMap::MergeOnRoot(MPI_Comm comm)
+{
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    // [ref, face], [tri key, ref], [quad key, ref] and [node, ref] entries.
+    std::vector<int> sface, stri, squad, snode;
+    std::map<int,std::vector<int> >::iterator itb;
+    for(itb=bnd_face_map.begin();itb!=bnd_face_map.end();itb++)
+    {
+        for(int k=0;k<itb->second.size();k++)
         {
-            quad_ref_map[quad] = ref;
+            sface.push_back(itb->first);
+            sface.push_back(itb->second[k]);
         }
-        
-        tria0.clear();
-        tria00.clear();
-        tria1.clear();
-        tria11.clear();
-        quad.clear();
+    }
+    TriKeyMap::iterator itt;
+    for(itt=tria_ref_map.begin();itt!=tria_ref_map.end();itt++)
+    {
+        stri.insert(stri.end(),itt->first.begin(),itt->first.end());
+        stri.push_back(itt->second);
+    }
+    QuadKeyMap::iterator itq;
+    for(itq=quad_ref_map.begin();itq!=quad_ref_map.end();itq++)
+    {
+        squad.insert(squad.end(),itq->first.begin(),itq->first.end());
+        squad.push_back(itq->second);
+    }
+    std::map<int,int>::iterator itn;
+    for(itn=node_ref_map.begin();itn!=node_ref_map.end();itn++)
+    {
+        snode.push_back(itn->first);
+        snode.push_back(itn->second);
+    }
+    
+    std::vector<int> rface = GatherEntriesOnRoot(sface, 2, comm);
+    std::vector<int> rtri  = GatherEntriesOnRoot(stri,  4, comm);
+    std::vector<int> rquad = GatherEntriesOnRoot(squad, 5, comm);
+    std::vector<int> rnode = GatherEntriesOnRoot(snode, 2, comm);
+    
+    if(world_rank != 0)
+    {
+        return;
+    }
+    
+    // The entries of rank 0 come first, so they are cleared and merged like the others.
+    bnd_face_map.clear();
+    tria_ref_map.clear();
+    quad_ref_map.clear();
+    node_ref_map.clear();
+    tria_ref_map.reserve(rtri.size()/4);
+    quad_ref_map.reserve(rquad.size()/5);
+    for(int k=0;k<rface.size();k+=2)
+    {
+        bnd_face_map[rface[k]].push_back(rface[k+1]);
+    }
+    for(int k=0;k<rtri.size();k+=4)
+    {
+        tria_ref_map.insert(std::make_pair(MakeTriKey(rtri[k],rtri[k+1],rtri[k+2]),rtri[k+3]));
+    }
+    for(int k=0;k<rquad.size();k+=5)
+    {
+        quad_ref_map.insert(std::make_pair(MakeQuadKey(rquad[k],rquad[k+1],rquad[k+2],rquad[k+3]),rquad[k+4]));
+    }
+    for(int k=0;k<rnode.size();k+=2)
+    {
+        node_ref_map.insert(std::make_pair(rnode[k],rnode[k+1]));
     }
 }
 
 
-std::map<int,std::vector<int> > BoundaryMap::getBfaceMap()
+
+
+BoundaryMap* GatherBoundaryMapOnRoot(ParArray<int>* ifn, ParArray<int>* if_ref, MPI_Comm comm)
+{
+    BoundaryMap* bmap = new BoundaryMap(ifn, if_ref, comm);
+    bmap->MergeOnRoot(comm);
+    
+    return bmap;
+}
+
+
+
+
+std::map<int,std::vector<int> >& BoundaryMap::getBfaceMap()
 {
     return bnd_face_map;
 }
 
-std::map<std::set<int>,int> BoundaryMap::getTriaRefMap()
+TriKeyMap& BoundaryMap::getTriaRefMap()
 {
     return tria_ref_map;
 }
 
-std::map<std::set<int>,int> BoundaryMap::getQuadRefMap()
+QuadKeyMap& BoundaryMap::getQuadRefMap()
 {
     return quad_ref_map;
 }
 
-std::map<int,int> BoundaryMap::getNodeRefMap()
+std::map<int,int>& BoundaryMap::getNodeRefMap()
 {
     return node_ref_map;
 }
 
-
@@ -1,4 +1,5 @@
 #include "adapt_array.h"
+#include "adapt_facekey.h"
 
 #ifndef ADAPT_BOUNDARY_H
 #define ADAPT_BOUNDARY_H
@@ -9,15 +10,26 @@ class BoundaryMap {
     public:
         BoundaryMap(){};
         BoundaryMap(Array<int>* ifn, Array<int>* if_ref);
-        std::map<int,std::vector<int> > getBfaceMap();
-        std::map<std::set<int>,int> getTriaRefMap();
-        std::map<std::set<int>,int> getQuadRefMap();
-        std::map<int,int> getNodeRefMap();
+        BoundaryMap(std::map<int,std::vector<int> > &ifn, std::map<int,int> &if_ref);
+        // Map of the rows of ifn/if_ref on this rank, with their global face ids.
+        BoundaryMap(ParArray<int>* ifn, ParArray<int>* if_ref, MPI_Comm comm);
+        std::map<int,std::vector<int> >& getBfaceMap();
+        TriKeyMap& getTriaRefMap();
+        QuadKeyMap& getQuadRefMap();
+        std::map<int,int>& getNodeRefMap();
+        // Merges the entries of the maps of all ranks on rank 0 in rank order; an entry
+        // that is already there keeps its reference. The other ranks keep their own map.
+        void MergeOnRoot(MPI_Comm comm);
     private:
+        void AddFace(int faceid, int* fv, int ref);
         std::map<int,std::vector<int> > bnd_face_map;
-        std::map<std::set<int>,int> tria_ref_map;
-        std::map<std::set<int>,int> quad_ref_map;
+        TriKeyMap tria_ref_map;
+        QuadKeyMap quad_ref_map;
         std::map<int,int> node_ref_map;
 };
 
+// Builds the BoundaryMap of the boundary faces (if_ref != 2) of the distributed face
+// arrays on every rank and merges them on rank 0.
+BoundaryMap* GatherBoundaryMapOnRoot(ParArray<int>* ifn, ParArray<int>* if_ref, MPI_Comm comm);
+
 #endif
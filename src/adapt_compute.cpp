@@ -1,4 +1,6 @@
 #include "adapt_compute.h"
+#include "adapt_meshgeometry.h"
+#include "adapt_parops.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -1028,11 +1030,123 @@ void UnitTestJacobian()
 
 
 
-void ComputeMetric(Partition* Pa, std::vector<double> metric_inputs,
+// Builds the metric of all vertices for the scaling factor f from the eigen decomposition
+// (lam,V) of the vertex Hessians of the nsens sensors, stored sensor after sensor, and
+// returns the local complexity sum_v vol_v*sqrt(det(M_v)). The metrics of the sensors
+// are intersected before the wake blending is applied.
+static double BuildMetric(int nvert, int nsens, const double* lam, const double* V,
+                          const double* scale, const double* vvol,
+                          double f, double hmin, double hmax, double sumvol, double po,
+                          double* Mv, int &anitel)
+{
+    double hwake = 0.02;
+    double lmin  = 1.0/(hmax*hmax);
+    double lmax  = 1.0/(hmin*hmin);
+    double pw    = -1.0/(2.0*po+3.0);
+    
+    int nani = 0;
+    double cmplxty = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:nani,cmplxty)
+    for(int i=0;i<nvert;i++)
+    {
+        double Mani[6];
+        for(int s=0;s<nsens;s++)
+        {
+            int si = s*nvert+i;
+            double eignval[3];
+            for(int k=0;k<3;k++)
+            {
+                eignval[k] = std::min(std::max(f*fabs(lam[si*3+k]),lmin),lmax);
+            }
+            
+            // Rf = V*diag(eignval)*V^T, with V^T the inverse of the orthonormal V.
+            const double* Vi = &V[si*9];
+            const int rc[6][2] = {{0,0},{0,1},{0,2},{1,1},{1,2},{2,2}};
+            double detRf = std::pow(eignval[0]*eignval[1]*eignval[2],pw);
+            double Ms[6];
+            for(int k=0;k<6;k++)
+            {
+                int r = rc[k][0];
+                int c = rc[k][1];
+                double Rf = Vi[r*3+0]*eignval[0]*Vi[c*3+0]
+                           +Vi[r*3+1]*eignval[1]*Vi[c*3+1]
+                           +Vi[r*3+2]*eignval[2]*Vi[c*3+2];
+                Ms[k] = sumvol*detRf*Rf;
+            }
+            if(s == 0)
+            {
+                std::copy(Ms,Ms+6,Mani);
+            }
+            else
+            {
+                MetricIntersect(Mani,Ms,Mani);
+            }
+        }
+        
+        double wi = 0.0;
+        double wa = 1.0;
+        if(scale[i]<1.0)
+        {
+            wi = 1.0-scale[i];
+            wa = scale[i];
+            nani++;
+        }
+        double hiso = hwake;
+        
+        double* M = &Mv[i*6];
+        M[0] = wa*Mani[0]+wi/(hiso*hiso);
+        M[1] = wa*Mani[1];
+        M[2] = wa*Mani[2];
+        M[3] = wa*Mani[3]+wi/(hiso*hiso);
+        M[4] = wa*Mani[4];
+        M[5] = wa*Mani[5]+wi/(hiso*hiso);
+        
+        double detM = M[0]*(M[3]*M[5]-M[4]*M[4])
+                     -M[1]*(M[1]*M[5]-M[2]*M[4])
+                     +M[2]*(M[1]*M[4]-M[2]*M[3]);
+        cmplxty = cmplxty + vvol[i]*sqrt(fabs(detM));
+    }
+    anitel = nani;
+    return cmplxty;
+}
+
+
+
+
+// Returns the local complexity sum_v vol_v*sqrt(det(M_v)) of the metric Mv.
+static double MetricComplexity(int nvert, const double* vvol, const double* Mv)
+{
+    double cmplxty = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:cmplxty)
+    for(int i=0;i<nvert;i++)
+    {
+        const double* M = &Mv[i*6];
+        double detM = M[0]*(M[3]*M[5]-M[4]*M[4])
+                     -M[1]*(M[1]*M[5]-M[2]*M[4])
+                     +M[2]*(M[1]*M[4]-M[2]*M[3]);
+        cmplxty = cmplxty + vvol[i]*sqrt(fabs(detM));
+    }
+    return cmplxty;
+}
+
+
+
+// Computes the metric from the vertex Hessians of one or more sensors in Hess_vfs, which
+// all have the same vertex ordering; the result, the intersection of the metrics of the
+// sensors, replaces the Hessian in Hess_vfs[0]. scale[i] holds the wake scaling
+// variable of vertex i in the same ordering. If Ntarget > 0 the scaling
+// factor f is not taken from metric_inputs[3] but determined by bisection such that
+// the complexity sum_v vol_v*sqrt(det(M_v)), summed over all ranks, which estimates
+// the number of vertices of the adapted mesh, is within 2% of Ntarget.
+// The metric is graded with GradateMetric(hgrad) at the end. Since the gradation
+// only refines the metric, f is then corrected and the metric rebuilt and graded
+// again until the graded complexity is within 2% of Ntarget as well.
+void ComputeMetric(Partition* Pa, Mesh_Geometry* geom, std::vector<double> metric_inputs,
                    MPI_Comm comm,
-                   std::map<int,Array<double>* > scale_vm,
-                   std::map<int,Array<double>* > &Hess_vm,
-                   double sumvol, double po)
+                   double* scale,
+                   std::vector<TensorField*> Hess_vfs,
+                   double sumvol, double po, double Ntarget,
+                   SharedVertexMap* svm, double hgrad)
 {
     int size;
     MPI_Comm_size(comm, &size);
@@ -1046,157 +1160,277 @@ void ComputeMetric(Partition* Pa, std::vector<double> metric_inputs,
     double f            = metric_inputs[3];
     //+++++++++++++++++++++++++++++++++++++++++++
     //+++++++++++++++++++++++++++++++++++++++++++
-    double* Hmet = new double[9];
-
-    std::map<int,Array<double>*>::iterator itm;
-    int i = 0;
-    double fiso = 0.01;
-    double Lambdamax,Lambdamin;
-    std::vector<int> eignval(3);
-    double hwake = 0.02;
+    
+    TensorField* Hess_vf = Hess_vfs[0];
+    int nsens = Hess_vfs.size();
+    int nvert = Hess_vf->getN();
+    std::vector<double> vvol(nvert);
+    for(int i=0;i<nvert;i++)
+    {
+        vvol[i]  = geom->getVertVolume(Hess_vf->gid[i]);
+    }
+    
+    std::vector<double> lam(nsens*nvert*3);
+    std::vector<double> V(nsens*nvert*9);
+    for(int s=0;s<nsens;s++)
+    {
+        SymEig3_Batch(nvert,Hess_vfs[s]->data,&lam[s*nvert*3],&V[s*nvert*9]);
+    }
+    
     int anitel = 0;
-    for(itm=Hess_vm.begin();itm!=Hess_vm.end();itm++)
+    double cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                                 f,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+    double cmplxty_red = 0.0;
+    MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
+    
+    if(Ntarget > 0.0)
     {
-        int glob_vid = itm->first;
-//        if(scale_vm[glob_vid]->getVal(0,0)<0.0)
-//        {
-//            std::cout << "Mach " << scale_vm[glob_vid]->getVal(0,0) << std::endl;
-//
-//        }
-        
-        Hmet[0] = Hess_vm[glob_vid]->getVal(0,0);
-        Hmet[1] = Hess_vm[glob_vid]->getVal(1,0);
-        Hmet[2] = Hess_vm[glob_vid]->getVal(2,0);
-
-        Hmet[3] = Hess_vm[glob_vid]->getVal(1,0);
-        Hmet[4] = Hess_vm[glob_vid]->getVal(3,0);
-        Hmet[5] = Hess_vm[glob_vid]->getVal(4,0);
-
-        Hmet[6] = Hess_vm[glob_vid]->getVal(2,0);
-        Hmet[7] = Hess_vm[glob_vid]->getVal(4,0);
-        Hmet[8] = Hess_vm[glob_vid]->getVal(5,0);
+        double tol = 0.02;
+        int maxit  = 60;
+        int it     = 0;
         
-        //delete Hess_vm[glob_vid];
+        // Bracket the target by doubling/halving f; the complexity does not decrease with f.
+        double flo = f, fhi = f;
+        double clo = cmplxty_red, chi = cmplxty_red;
+        while(chi < Ntarget && it < maxit)
+        {
+            flo = fhi; clo = chi;
+            fhi = 2.0*fhi;
+            cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                                  fhi,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+            MPI_Allreduce(&cmplxty, &chi, 1, MPI_DOUBLE, MPI_SUM, comm);
+            it++;
+        }
+        while(clo > Ntarget && it < maxit)
+        {
+            fhi = flo; chi = clo;
+            flo = 0.5*flo;
+            cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                                  flo,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+            MPI_Allreduce(&cmplxty, &clo, 1, MPI_DOUBLE, MPI_SUM, comm);
+            it++;
+        }
         
-        double * WR = new double[3];
-        double * WI = new double[3];
-        double * V  = new double[3*3];
-        double * iV = new double[3*3];
-        double* WRn = new double[3];
-
-        Array<double>* DR  = new Array<double>(3,3);
-        Array<double>* UR  = new Array<double>(3,3);
-        for(int j=0;j<3;j++)
+        // Bisection on log(f).
+        f = fhi;
+        cmplxty_red = chi;
+        if(fabs(clo-Ntarget) < fabs(chi-Ntarget))
         {
-            WR[j]  = 0.0;
-            WRn[j] = 0.0;
-            WI[j]  = 0.0;
-
-            for(int k=0;k<3;k++)
+            f = flo;
+            cmplxty_red = clo;
+        }
+        while(fabs(cmplxty_red-Ntarget) > tol*Ntarget && it < maxit && flo < fhi)
+        {
+            f = sqrt(flo*fhi);
+            cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                                  f,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+            MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
+            if(cmplxty_red < Ntarget)
             {
-                DR->setVal(j,k,0.0);
-                V[j*3+k] = 0.0;
-                iV[j*3+k] = 0.0;
+                flo = f;
             }
+            else
+            {
+                fhi = f;
+            }
+            it++;
         }
         
-        Eig* eig = ComputeEigenDecomp(3, Hmet);
-        
-        eignval[0] =  std::min(std::max(f*fabs(eig->Dre[0]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
-        eignval[1] =  std::min(std::max(f*fabs(eig->Dre[1]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
-        eignval[2] =  std::min(std::max(f*fabs(eig->Dre[2]),1.0/(hmax*hmax)),1.0/(hmin*hmin));
-        
-        Lambdamax = *std::max_element(eignval.begin(),eignval.end());
-        Lambdamin = *std::min_element(eignval.begin(),eignval.end());
+        // Make sure the metric in Hess_vf belongs to the final f.
+        cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                              f,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+        GradateMetric(Pa, svm, Hess_vf, hgrad, 100, comm);
+        cmplxty = MetricComplexity(nvert,vvol.data(),Hess_vf->data);
+        MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
         
-        DR->setVal(0,0,eignval[0]);DR->setVal(0,1,0.0);DR->setVal(0,1,0.0);
-        DR->setVal(1,0,0.0);DR->setVal(1,1,eignval[1]);DR->setVal(1,2,0.0);
-        DR->setVal(2,0,0.0);DR->setVal(2,1,0.0);DR->setVal(2,2,eignval[2]);
-        UR->setVal(0,0,eig->V[0]);UR->setVal(0,1,eig->V[1]);UR->setVal(0,2,eig->V[2]);
-        UR->setVal(1,0,eig->V[3]);UR->setVal(1,1,eig->V[4]);UR->setVal(1,2,eig->V[5]);
-        UR->setVal(2,0,eig->V[6]);UR->setVal(2,1,eig->V[7]);UR->setVal(2,2,eig->V[8]);
-
-        Array<double>* iVR = MatInv(UR);
-        Array<double>* Rs = MatMul(UR,DR);
-        Array<double>* Rf = MatMul(Rs,iVR);
-        
-        double detRf = Rf->getVal(0,0)*(Rf->getVal(1,1)*Rf->getVal(2,2)-Rf->getVal(2,1)*Rf->getVal(1,2))
-                      -Rf->getVal(0,1)*(Rf->getVal(1,0)*Rf->getVal(2,2)-Rf->getVal(2,0)*Rf->getVal(1,2))
-                      +Rf->getVal(0,2)*(Rf->getVal(1,0)*Rf->getVal(2,1)-Rf->getVal(2,0)*Rf->getVal(1,1));
-        
-        
-        double pow = -1.0/(2.0*po+3.0);
-        double eigRat = Lambdamin/Lambdamax;
-        
-        detRf = std::pow(detRf,pow);
-        Array<double>* Habs  = new Array<double>(3,3);
-
-        if(scale_vm[glob_vid]->getVal(0,0)<1.0)
+        // Away from the hmin/hmax bounds the complexity scales with f^(3*po/(2*po+3)).
+        double ef = 3.0*po/(2.0*po+3.0);
+        int git   = 0;
+        while(fabs(cmplxty_red-Ntarget) > tol*Ntarget && git < 10)
         {
-            double wi    = 1.0-scale_vm[glob_vid]->getVal(0,0);
-            double wa    = scale_vm[glob_vid]->getVal(0,0);
-            double hiso  = hwake;//(Lambdamax-hwake)*scale_vm[glob_vid]->getVal(0,0)+hwake;
-            
-            Habs->setVal(0,0,wi/(hiso*hiso)+wa*sumvol*detRf*Rf->getVal(0,0));
-            Habs->setVal(0,1,wa*sumvol*detRf*Rf->getVal(0,1));
-            Habs->setVal(0,2,wa*sumvol*detRf*Rf->getVal(0,2));
-            
-            Habs->setVal(1,0,wa*sumvol*detRf*Rf->getVal(1,0));
-            Habs->setVal(1,1,wi/(hiso*hiso)+wa*sumvol*detRf*Rf->getVal(1,1));
-            Habs->setVal(1,2,wa*sumvol*detRf*Rf->getVal(1,2));
-
-            Habs->setVal(2,0,wa*sumvol*detRf*Rf->getVal(2,0));
-            Habs->setVal(2,1,wa*sumvol*detRf*Rf->getVal(2,1));
-            Habs->setVal(2,2,wi/(hiso*hiso)+wa*sumvol*detRf*Rf->getVal(2,2));
-            
-            anitel++;
+            f = f*std::pow(Ntarget/cmplxty_red,1.0/ef);
+            cmplxty = BuildMetric(nvert,nsens,lam.data(),V.data(),scale,vvol.data(),
+                                  f,hmin,hmax,sumvol,po,Hess_vf->data,anitel);
+            GradateMetric(Pa, svm, Hess_vf, hgrad, 100, comm);
+            cmplxty = MetricComplexity(nvert,vvol.data(),Hess_vf->data);
+            MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
+            git++;
         }
-        else
+        it = it+git;
+        
+        if(rank == 0)
         {
-            Habs->setVal(0,0,sumvol*detRf*Rf->getVal(0,0));
-            Habs->setVal(0,1,sumvol*detRf*Rf->getVal(0,1));
-            Habs->setVal(0,2,sumvol*detRf*Rf->getVal(0,2));
-            
-            Habs->setVal(1,0,sumvol*detRf*Rf->getVal(1,0));
-            Habs->setVal(1,1,sumvol*detRf*Rf->getVal(1,1));
-            Habs->setVal(1,2,sumvol*detRf*Rf->getVal(1,2));
-
-            Habs->setVal(2,0,sumvol*detRf*Rf->getVal(2,0));
-            Habs->setVal(2,1,sumvol*detRf*Rf->getVal(2,1));
-            Habs->setVal(2,2,sumvol*detRf*Rf->getVal(2,2));
+            std::cout << "Scaling factor f = " << f << " for the target complexity " << Ntarget << " (" << it << " iterations)." << std::endl;
+            if(fabs(cmplxty_red-Ntarget) > tol*Ntarget)
+            {
+                std::cout << "Warning: the target complexity could not be reached within the hmin/hmax bounds." << std::endl;
+            }
         }
-        
-        
-        
-
-        
-        
-        Hess_vm[glob_vid]=Habs;
-        
-        delete Rf;
-        delete DR;
-        delete UR;
-        delete Rs;
-        //delete Rf;
-
-        delete[] iV;
-        delete[] V;
-        delete[] WR;
-        delete[] WI;
-        i++;
     }
+    else
+    {
+        GradateMetric(Pa, svm, Hess_vf, hgrad, 100, comm);
+        cmplxty = MetricComplexity(nvert,vvol.data(),Hess_vf->data);
+        MPI_Allreduce(&cmplxty, &cmplxty_red, 1, MPI_DOUBLE, MPI_SUM, comm);
+    }
+    
     int anitel_red;
     MPI_Allreduce(&anitel, &anitel_red, 1, MPI_INT, MPI_SUM, comm);
     if(rank == 0)
     {
 
     std::cout << "anitel_red " << anitel_red << std::endl;
+    std::cout << "metric complexity " << cmplxty_red << std::endl;
 
     }
-    delete[] Hmet;
 }
 
 
+
+static void MetricIntersect_Reduce(double* acc, const double* M)
+{
+    MetricIntersect(acc,M,acc);
+}
+
+
+
+// Anisotropic size gradation of the vertex metric over the mesh edges. The metric at
+// p grown along the edge pq, (1+l_p(pq)*ln(hgrad))^(-2)*M_p, is intersected with M_q.
+// Every iteration updates all vertices from the previous values (Jacobi) and then
+// intersects the copies of the partition boundary vertices on their owner, until no
+// metric changes anymore on any rank. svm is the shared vertex map of the vertices of Mv.
+void GradateMetric(Partition* Pa, SharedVertexMap* svm, TensorField* Mv, double hgrad, int maxit, MPI_Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+    // Get the rank of the process
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    
+    if(hgrad <= 1.0)
+    {
+        return;
+    }
+    
+    std::vector<Vert*> LocalVs              = Pa->getLocalVerts();
+    std::map<int,int> gV2lV                = Pa->getGlobalVert2LocalVert();
+    std::map<int,std::vector<int> > gE2gV  = Pa->getGlobElem2GlobVerts();
+    std::vector<int> Loc_Elem              = Pa->getLocElem();
+    
+    int nvert = Mv->getN();
+    std::map<int,int> gv2idx;
+    for(int i=0;i<nvert;i++)
+    {
+        gv2idx[Mv->gid[i]] = i;
+    }
+    
+    // Edges of the local elements (tetrahedron, pyramid, prism, hexahedron).
+    const int tet_e[6][2]  = {{0,1},{1,2},{2,0},{0,3},{1,3},{2,3}};
+    const int pyr_e[8][2]  = {{0,1},{1,2},{2,3},{3,0},{0,4},{1,4},{2,4},{3,4}};
+    const int pri_e[9][2]  = {{0,1},{1,2},{2,0},{3,4},{4,5},{5,3},{0,3},{1,4},{2,5}};
+    const int hex_e[12][2] = {{0,1},{1,2},{2,3},{3,0},{4,5},{5,6},{6,7},{7,4},{0,4},{1,5},{2,6},{3,7}};
+    
+    std::vector<std::vector<int> > adj(nvert);
+    for(int i=0;i<Loc_Elem.size();i++)
+    {
+        const std::vector<int>& gvs = gE2gV.at(Loc_Elem[i]);
+        int nv = gvs.size();
+        const int (*ed)[2] = hex_e;
+        int ne = 12;
+        if(nv == 4){ed = tet_e;ne = 6;}
+        if(nv == 5){ed = pyr_e;ne = 8;}
+        if(nv == 6){ed = pri_e;ne = 9;}
+        for(int e=0;e<ne;e++)
+        {
+            int p = gv2idx.at(gvs[ed[e][0]]);
+            int q = gv2idx.at(gvs[ed[e][1]]);
+            adj[p].push_back(q);
+            adj[q].push_back(p);
+        }
+    }
+    std::vector<int> adj_offset(nvert+1,0);
+    std::vector<int> adj_ids;
+    for(int i=0;i<nvert;i++)
+    {
+        std::sort(adj[i].begin(),adj[i].end());
+        adj[i].erase(std::unique(adj[i].begin(),adj[i].end()),adj[i].end());
+        adj_ids.insert(adj_ids.end(),adj[i].begin(),adj[i].end());
+        adj_offset[i+1] = adj_ids.size();
+    }
+    adj.clear();
+    
+    std::vector<double> xyz(nvert*3);
+    for(int i=0;i<nvert;i++)
+    {
+        Vert* v = LocalVs[gV2lV.at(Mv->gid[i])];
+        xyz[i*3+0] = v->x;
+        xyz[i*3+1] = v->y;
+        xyz[i*3+2] = v->z;
+    }
+    
+    double lnb = log(hgrad);
+    double tol = 1.0e-3;
+    std::vector<double> Mold(nvert*6);
+    int it = 0;
+    int nchanged_glob = 1;
+    while(nchanged_glob > 0 && it < maxit)
+    {
+        std::copy(Mv->data,Mv->data+nvert*6,Mold.begin());
+        
+#pragma omp parallel for schedule(dynamic,256)
+        for(int q=0;q<nvert;q++)
+        {
+            double* Mq = Mv->getTensor(q);
+            for(int k=adj_offset[q];k<adj_offset[q+1];k++)
+            {
+                int p = adj_ids[k];
+                const double* Mp = &Mold[p*6];
+                double ex = xyz[q*3+0]-xyz[p*3+0];
+                double ey = xyz[q*3+1]-xyz[p*3+1];
+                double ez = xyz[q*3+2]-xyz[p*3+2];
+                double l2 = Mp[0]*ex*ex+Mp[3]*ey*ey+Mp[5]*ez*ez
+                           +2.0*(Mp[1]*ex*ey+Mp[2]*ex*ez+Mp[4]*ey*ez);
+                double eta = 1.0+sqrt(fabs(l2))*lnb;
+                eta = 1.0/(eta*eta);
+                double Mpq[6];
+                for(int l=0;l<6;l++)
+                {
+                    Mpq[l] = eta*Mp[l];
+                }
+                MetricIntersect(Mq,Mpq,Mq);
+            }
+        }
+        
+        ReduceSharedVertexData(svm, Mv->data, 6, MetricIntersect_Reduce, comm);
+        
+        int nchanged = 0;
+#pragma omp parallel for schedule(static) reduction(+:nchanged)
+        for(int i=0;i<nvert;i++)
+        {
+            double dM = 0.0;
+            double nM = 0.0;
+            for(int l=0;l<6;l++)
+            {
+                dM = dM+(Mv->data[i*6+l]-Mold[i*6+l])*(Mv->data[i*6+l]-Mold[i*6+l]);
+                nM = nM+Mold[i*6+l]*Mold[i*6+l];
+            }
+            if(dM > tol*tol*nM)
+            {
+                nchanged++;
+            }
+        }
+        MPI_Allreduce(&nchanged, &nchanged_glob, 1, MPI_INT, MPI_SUM, comm);
+        it++;
+    }
+    
+    if(rank == 0)
+    {
+        std::cout << "Metric gradation with hgrad = " << hgrad << " finished after " << it << " iterations." << std::endl;
+    }
+}
+
+
+
 Array<double>* ComputeFaceValues(Partition* P, Array<double>* U, MPI_Comm comm)
 {
     int nface, start, end, rank, size;
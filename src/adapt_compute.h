@@ -7,6 +7,8 @@
 #ifndef ADAPT_COMPUTE_H
 #define ADAPT_COMPUTE_H
 
+class Mesh_Geometry;
+
 
 void NegateVec3D(Vec3D* a);
 
@@ -66,10 +68,13 @@ double* ComputeVolumeCellsReducedToVerts(Array<double>* xcn, Array<int>* ien);
 
 void UnitTestJacobian();
 
-void ComputeMetric(Partition* Pa, std::vector<double> metric_inputs, MPI_Comm comm,
-                   std::map<int,Array<double>* > scale_vm,
-                   std::map<int,Array<double>* > &Hess_vm,
-                   double sumvol, double po);
+void ComputeMetric(Partition* Pa, Mesh_Geometry* geom, std::vector<double> metric_inputs, MPI_Comm comm,
+                   double* scale,
+                   std::vector<TensorField*> Hess_vfs,
+                   double sumvol, double po, double Ntarget,
+                   SharedVertexMap* svm, double hgrad);
+
+void GradateMetric(Partition* Pa, SharedVertexMap* svm, TensorField* Mv, double hgrad, int maxit, MPI_Comm comm);
 
 Array<double>* ComputeFaceValues(Partition* P, Array<double>* U, MPI_Comm comm);
 
@@ -38,6 +38,52 @@ struct ParVar
     int* offsets;
 };
 
+// Communication pattern for the vertices that appear on more than one rank. Every
+// shared vertex is owned by the rank that reads it from xcn. The entries
+// send_idx[send_offsets[r]..send_offsets[r]+send_counts[r]-1] are the local indices of the
+// shared vertices owned by rank r. The owner receives them in the same order and
+// recv_slot maps each received entry onto one of its nowned shared vertices.
+struct SharedVertexMap
+{
+    std::vector<int> send_counts;
+    std::vector<int> send_offsets;
+    std::vector<int> send_idx;
+    std::vector<int> recv_counts;
+    std::vector<int> recv_offsets;
+    std::vector<int> recv_slot;
+    int nowned;
+};
+
+// Two-level layout of a communicator. node holds the ranks that share a node and
+// leaders the lowest rank of every node (MPI_COMM_NULL on the other ranks); both keep the
+// rank order of the parent, so its rank 0 is rank 0 in both. A leader lists the parent
+// ranks of its node in node_members and rank 0 those of every node in members: node l holds
+// members[member_offsets[l]..member_offsets[l+1]-1].
+struct NodeComm
+{
+    MPI_Comm node;
+    MPI_Comm leaders;
+    std::vector<int> node_members;
+    std::vector<int> members;
+    std::vector<int> member_offsets;
+};
+
+// Tetrahedral/prismatic mesh distributed over the ranks in 0-based global vertex ids.
+// Every rank holds the coordinates of the vertices it owns (vgid, xcn) together with a
+// part of the elements and boundary faces, which need not refer to owned vertices only.
+struct DistributedMesh
+{
+    int nVertGlob;
+    std::vector<int> vgid;
+    std::vector<double> xcn;
+    std::vector<int> tetra;
+    std::vector<int> prism;
+    std::vector<int> tria;
+    std::vector<int> tria_ref;
+    std::vector<int> quad;
+    std::vector<int> quad_ref;
+};
+
 struct ParArrayOnRoot
 {
     int size;
@@ -89,6 +135,45 @@ public:
 };
 
 
+
+// Symmetric 3x3 tensors (Hessians, metrics) of n entities stored contiguously as
+// [xx,xy,xz,yy,yz,zz] per entity. gid holds the global id of entity i. The field owns its
+// arrays, so it cannot be copied.
+class TensorField {
+    public:
+        int n;
+        int* gid;
+        double* data;
+        TensorField()
+        {
+            n    = 0;
+            gid  = NULL;
+            data = NULL;
+        }
+        TensorField(int nent)
+        {
+            n    = nent;
+            gid  = new int[n];
+            data = new double[n*6];
+        }
+        TensorField(const TensorField&) = delete;
+        TensorField& operator=(const TensorField&) = delete;
+        ~TensorField()
+        {
+            delete[] gid;
+            delete[] data;
+        }
+        int getN()
+        {
+            return n;
+        }
+        double* getTensor(int i)
+        {
+            return &data[i*6];
+        }
+};
+
+
 struct Vert
 {
     double x=0.0;
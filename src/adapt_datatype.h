@@ -1,4 +1,5 @@
 #include "adapt_array.h"
+#include "adapt_facekey.h"
 
 #ifndef ADAPT_DATATYPE_H
 #define ADAPT_DATATYPE_H
@@ -32,8 +33,8 @@ struct US3D{
     ParArray<int>* ife;
     ParArray<int>* if_ref;
     
-    std::map<std::set<int>,int> tria_ref_map;
-    std::map<std::set<int>,int> quad_ref_map;
+    TriKeyMap tria_ref_map;
+    QuadKeyMap quad_ref_map;
     std::map<int,int> vert_ref_map;
     
     ParArray<double>* interior;
@@ -0,0 +1,263 @@
+#include "adapt.h"
+#include <array>
+
+#ifndef ADAPT_FACEKEY_H
+#define ADAPT_FACEKEY_H
+
+// Keys of triangles and quads by their sorted vertex ids, so that a face has the same key
+// for every orientation and starting vertex. They replace std::set<int> keys, which need
+// one allocation per vertex.
+typedef std::array<int,3> TriKey;
+typedef std::array<int,4> QuadKey;
+
+inline TriKey MakeTriKey(int v0, int v1, int v2)
+{
+    TriKey k = {{v0,v1,v2}};
+    if(k[0]>k[1]) std::swap(k[0],k[1]);
+    if(k[1]>k[2]) std::swap(k[1],k[2]);
+    if(k[0]>k[1]) std::swap(k[0],k[1]);
+    return k;
+}
+
+inline QuadKey MakeQuadKey(int v0, int v1, int v2, int v3)
+{
+    QuadKey k = {{v0,v1,v2,v3}};
+    if(k[0]>k[1]) std::swap(k[0],k[1]);
+    if(k[2]>k[3]) std::swap(k[2],k[3]);
+    if(k[0]>k[2]) std::swap(k[0],k[2]);
+    if(k[1]>k[3]) std::swap(k[1],k[3]);
+    if(k[1]>k[2]) std::swap(k[1],k[2]);
+    return k;
+}
+
+// Mixes the vertex ids of a key one after the other with a 64-bit multiply-xorshift.
+struct FaceKeyHash
+{
+    template<std::size_t N>
+    std::size_t operator()(const std::array<int,N>& k) const
+    {
+        uint64_t h = 0x9E3779B97F4A7C15ULL;
+        for(std::size_t i=0;i<N;i++)
+        {
+            h = (h^uint32_t(k[i]))*0xBF58476D1CE4E5B9ULL;
+            h = h^(h>>31);
+        }
+        return std::size_t(h);
+    }
+};
+
+// Open-addressing hash map with linear probing. The entries live in one array, so inserting
+// a key does not allocate, and erase shifts the entries that follow back into the gap
+// instead of leaving tombstones. The interface follows std::map as far as it is used here;
+// iteration visits the entries in slot order.
+template<typename K, typename V, typename H = FaceKeyHash>
+class FlatKeyMap
+{
+    public:
+        typedef std::pair<K,V> value_type;
+        class iterator
+        {
+            public:
+                iterator(){}
+                iterator(FlatKeyMap* m, std::size_t s) : map(m), slot(s)
+                {
+                    while(slot < map->used.size() && !map->used[slot])
+                    {
+                        slot++;
+                    }
+                }
+                value_type& operator*() const
+                {
+                    return map->slots[slot];
+                }
+                value_type* operator->() const
+                {
+                    return &map->slots[slot];
+                }
+                iterator& operator++()
+                {
+                    slot++;
+                    while(slot < map->used.size() && !map->used[slot])
+                    {
+                        slot++;
+                    }
+                    return *this;
+                }
+                iterator operator++(int)
+                {
+                    iterator it = *this;
+                    ++(*this);
+                    return it;
+                }
+                bool operator==(const iterator& o) const
+                {
+                    return slot == o.slot;
+                }
+                bool operator!=(const iterator& o) const
+                {
+                    return slot != o.slot;
+                }
+            private:
+                FlatKeyMap* map;
+                std::size_t slot;
+        };
+        
+        FlatKeyMap()
+        {
+            nent = 0;
+            Rehash(16);
+        }
+        iterator begin()
+        {
+            return iterator(this,0);
+        }
+        iterator end()
+        {
+            return iterator(this,used.size());
+        }
+        std::size_t size() const
+        {
+            return nent;
+        }
+        bool empty() const
+        {
+            return nent == 0;
+        }
+        void clear()
+        {
+            nent = 0;
+            Rehash(16);
+        }
+        // Makes room for n entries without rehashing.
+        void reserve(std::size_t n)
+        {
+            std::size_t cap = used.size();
+            while(cap*7 < n*10)
+            {
+                cap = cap*2;
+            }
+            if(cap > used.size())
+            {
+                Rehash(cap);
+            }
+        }
+        iterator find(const K& k)
+        {
+            std::size_t s = Probe(k);
+            return used[s] ? iterator(this,s) : end();
+        }
+        std::size_t count(const K& k)
+        {
+            return used[Probe(k)] ? 1 : 0;
+        }
+        std::pair<iterator,bool> insert(const value_type& kv)
+        {
+            std::size_t s = Probe(kv.first);
+            if(used[s])
+            {
+                return std::make_pair(iterator(this,s),false);
+            }
+            if((nent+1)*10 > used.size()*7)
+            {
+                Rehash(used.size()*2);
+                s = Probe(kv.first);
+            }
+            slots[s] = kv;
+            used[s]  = 1;
+            nent++;
+            return std::make_pair(iterator(this,s),true);
+        }
+        V& operator[](const K& k)
+        {
+            return insert(value_type(k,V())).first->second;
+        }
+        std::size_t erase(const K& k)
+        {
+            std::size_t s = Probe(k);
+            if(!used[s])
+            {
+                return 0;
+            }
+            // Move back every entry of the run after s whose home slot is not in (s,t].
+            std::size_t t = s;
+            while(true)
+            {
+                t = (t+1)&mask;
+                if(!used[t])
+                {
+                    break;
+                }
+                std::size_t home = H()(slots[t].first)&mask;
+                if(((t-home)&mask) >= ((t-s)&mask))
+                {
+                    slots[s] = slots[t];
+                    s = t;
+                }
+            }
+            used[s] = 0;
+            nent--;
+            return 1;
+        }
+        void swap(FlatKeyMap& o)
+        {
+            slots.swap(o.slots);
+            used.swap(o.used);
+            std::swap(nent,o.nent);
+            std::swap(mask,o.mask);
+        }
+    private:
+        std::vector<value_type> slots;
+        std::vector<char> used;
+        std::size_t nent;
+        std::size_t mask;
+        
+        // Slot that holds k, or the empty slot where it would go.
+        std::size_t Probe(const K& k) const
+        {
+            std::size_t s = H()(k)&mask;
+            while(used[s] && !(slots[s].first == k))
+            {
+                s = (s+1)&mask;
+            }
+            return s;
+        }
+        // cap has to be a power of two.
+        void Rehash(std::size_t cap)
+        {
+            std::vector<value_type> old_slots;
+            std::vector<char> old_used;
+            old_slots.swap(slots);
+            old_used.swap(used);
+            slots.resize(cap);
+            used.assign(cap,0);
+            mask = cap-1;
+            for(std::size_t i=0;i<old_used.size();i++)
+            {
+                if(old_used[i])
+                {
+                    std::size_t s = Probe(old_slots[i].first);
+                    slots[s] = old_slots[i];
+                    used[s]  = 1;
+                }
+            }
+        }
+};
+
+// Set version of FlatKeyMap; iterators point at pairs whose first member is the key.
+template<typename K, typename H = FaceKeyHash>
+class FlatKeySet : public FlatKeyMap<K,char,H>
+{
+    public:
+        using FlatKeyMap<K,char,H>::insert;
+        std::pair<typename FlatKeyMap<K,char,H>::iterator,bool> insert(const K& k)
+        {
+            return FlatKeyMap<K,char,H>::insert(std::make_pair(k,char(0)));
+        }
+};
+
+typedef FlatKeyMap<TriKey,int> TriKeyMap;
+typedef FlatKeyMap<QuadKey,int> QuadKeyMap;
+typedef FlatKeySet<TriKey> TriKeySet;
+typedef FlatKeySet<QuadKey> QuadKeySet;
+
+#endif
@@ -28,2312 +28,786 @@ std::vector<double> ReadMetricInputs(const char* fn_metric)
 
 
 
-void WriteUS3DGridFromMMG_itN(MMG5_pMesh mmgMesh, MMG5_pSol mmgSol, US3D* us3d)
+// The BL prisms built in main.cpp have the top vertices 3,5,4 over the bottom vertices 0,1,2;
+// the prisms in MMG's own numbering are turned into that layout by swapping vertices 4 and 5.
+DistributedMesh* GetDistributedMeshFromMMG(MMG5_pMesh mmgMesh, int mmg_prisms, MPI_Comm comm)
 {
-    std::map<int,std::vector<int> > ref2bface;
-    std::map<int,std::vector<int> > ref2bqface;
-    std::set<set<int> > bfaces;
-    std::set<set<int> > bqfaces;
-    std::map<set<int>,int > btfaces_Ref;
-    std::map<set<int>,int > bqfaces_Ref;
-    std::set<int>face;
-    std::set<int> bcrefs;
-    int wr = 0;
-    
-    int nVerts = mmgMesh->np;
-    int nTet = mmgMesh->ne;
-    int nPrism = mmgMesh->nprism;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
     
-    for(int i=1;i<=mmgMesh->nt;i++)
+    DistributedMesh* dm = new DistributedMesh;
+    dm->nVertGlob = 0;
+    if(world_rank == 0)
     {
-        if(mmgMesh->tria[i].ref>0 && mmgMesh->tria[i].ref!=20)// -1 is the tag for internal shell.
+        dm->nVertGlob = mmgMesh->np;
+        dm->vgid.resize(mmgMesh->np);
+        dm->xcn.resize(3*mmgMesh->np);
+        for(int i=0;i<mmgMesh->np;i++)
         {
-            
-            ref2bface[mmgMesh->tria[i].ref].push_back(i);
-            face.insert(mmgMesh->tria[i].v[0]);
-            face.insert(mmgMesh->tria[i].v[1]);
-            face.insert(mmgMesh->tria[i].v[2]);
-            
-            if(btfaces_Ref.find(face)==btfaces_Ref.end())
-            {
-                btfaces_Ref[face] = mmgMesh->tria[i].ref;
-            }
-            
-            bfaces.insert(face);
-            if(bcrefs.find(mmgMesh->tria[i].ref)==bcrefs.end())
-            {
-                bcrefs.insert(mmgMesh->tria[i].ref);
-            }
-            face.clear();
+            dm->vgid[i]    = i;
+            dm->xcn[i*3+0] = mmgMesh->point[i+1].c[0];
+            dm->xcn[i*3+1] = mmgMesh->point[i+1].c[1];
+            dm->xcn[i*3+2] = mmgMesh->point[i+1].c[2];
         }
-    }
-    
-    for(int i=1;i<=mmgMesh->nquad;i++)
-    {
-        if(mmgMesh->quadra[i].ref>0 && mmgMesh->quadra[i].ref!=2)// -1 is the tag for internal shell.
+        dm->tetra.resize(4*mmgMesh->ne);
+        for(int i=0;i<mmgMesh->ne;i++)
         {
-            
-            ref2bqface[mmgMesh->quadra[i].ref].push_back(i);
-            face.insert(mmgMesh->quadra[i].v[0]);
-            face.insert(mmgMesh->quadra[i].v[1]);
-            face.insert(mmgMesh->quadra[i].v[2]);
-            face.insert(mmgMesh->quadra[i].v[3]);
-            
-            if(bqfaces_Ref.find(face)==bqfaces_Ref.end())
-            {
-                bqfaces_Ref[face] = mmgMesh->quadra[i].ref;
-            }
-            
-            bqfaces.insert(face);
-            if(bcrefs.find(mmgMesh->quadra[i].ref)==bcrefs.end())
+            for(int s=0;s<4;s++)
             {
-                bcrefs.insert(mmgMesh->quadra[i].ref);
+                dm->tetra[i*4+s] = mmgMesh->tetra[i+1].v[s]-1;
             }
-            face.clear();
         }
-    }
-    
-    
-    //std::map<int,std::vector<int> > bnd_map = bnd_face_map;
-    std::map<int,std::vector<int> >::iterator bnd_m;
-    std::map<int,int> bnd_Ntri;
-    std::map<int,int> bnd_Nquad;
-    int i=0;
-    std::set<int>::iterator refit;
-    
-    for(refit=bcrefs.begin();refit!=bcrefs.end();refit++)
-    {
-        int ref_inq = *refit;
-        
-        if(ref2bface.find(ref_inq)==ref2bface.end())
+        int perm[6] = {0,1,2,3,4,5};
+        if(mmg_prisms)
         {
-            bnd_Ntri[ref_inq]=0;
+            perm[4] = 5;
+            perm[5] = 4;
         }
-        else
+        dm->prism.resize(6*mmgMesh->nprism);
+        for(int i=0;i<mmgMesh->nprism;i++)
         {
-            bnd_Ntri[ref_inq]=ref2bface[ref_inq].size();
+            for(int s=0;s<6;s++)
+            {
+                dm->prism[i*6+s] = mmgMesh->prism[i+1].v[perm[s]]-1;
+            }
         }
-        
-        
-        if(ref2bqface.find(ref_inq)==ref2bqface.end())
+        // Reference 20 marks the triangles on the BL shell and 2 the quads inside the BL mesh.
+        for(int i=1;i<=mmgMesh->nt;i++)
         {
-            bnd_Nquad[ref_inq]=0;
+            if(mmgMesh->tria[i].ref>0 && mmgMesh->tria[i].ref!=20)
+            {
+                for(int s=0;s<3;s++)
+                {
+                    dm->tria.push_back(mmgMesh->tria[i].v[s]-1);
+                }
+                dm->tria_ref.push_back(mmgMesh->tria[i].ref);
+            }
         }
-        else
+        for(int i=1;i<=mmgMesh->nquad;i++)
         {
-            bnd_Nquad[ref_inq]=ref2bqface[ref_inq].size();
+            if(mmgMesh->quadra[i].ref>0 && mmgMesh->quadra[i].ref!=2)
+            {
+                for(int s=0;s<4;s++)
+                {
+                    dm->quad.push_back(mmgMesh->quadra[i].v[s]-1);
+                }
+                dm->quad_ref.push_back(mmgMesh->quadra[i].ref);
+            }
         }
     }
+    MPI_Bcast(&dm->nVertGlob, 1, MPI_INT, 0, comm);
     
-    std::map<int,std::vector<std::vector<int> > > bctrias;
-    std::map<int,std::vector<std::vector<int> > > bcquads;
-
-    Array<double>* xcn_mmg = new Array<double>(mmgMesh->np,3);
-    for(int i=0;i<mmgMesh->np;i++)
-    {
-        xcn_mmg->setVal(i,0,mmgMesh->point[i+1].c[0]);
-        xcn_mmg->setVal(i,1,mmgMesh->point[i+1].c[1]);
-        xcn_mmg->setVal(i,2,mmgMesh->point[i+1].c[2]);
-    }
-    
-    std::cout<<"-- Writing in HDF5 format..."<<std::endl;
-    hid_t ret;
-    //Output the new grid.h5 which has the new vertices and ifn map.
-    //===================================================================
-    //===================================================================
-    //===================================================================
-    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
-    plist_id               = H5P_DEFAULT;
-    //H5Pset_fapl_mpio(plist_id, comm, info);
-    hid_t file_id = H5Fcreate("grid_madam.h5", H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
-    H5Pclose(plist_id);
-    hid_t status;
-    hid_t att_space;
-    hid_t attr_id;
-    
-    hsize_t dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    hid_t type =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type, 14);
-    ret = H5Tset_strpad(type,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (file_id, "filetype", type, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri[] = "US3D Grid File";
-    status = H5Awrite(attr_id, type, &stri);
-    H5Aclose(attr_id);
-    
-    hsize_t dimsf_att2 = 1;
-    att_space = H5Screate_simple(1, &dimsf_att2, NULL);
-    hid_t type2 =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type2, 5);
-    ret = H5Tset_strpad(type2,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (file_id, "filevers", type2, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri2[] = "1.1.8";
-    status = H5Awrite(attr_id, type2, &stri2);
-    H5Aclose(attr_id);
-    
-    //====================================================================================
-    // Add xcn map to the grid.h5 file
-    //====================================================================================
-    hsize_t     dimsf[2];
-    hsize_t    count[2];              // hyperslab selection parameters
-    hsize_t    offset[2];
-    dimsf[0] = xcn_mmg->getNrow();
-    dimsf[1] = xcn_mmg->getNcol();
-    hid_t filespace = H5Screate_simple(2, dimsf, NULL);
+    return dm;
+}
 
-    hid_t dset_id = H5Dcreate(file_id, "xcn", H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    hid_t memspace = H5Screate_simple(2, count, NULL);
 
-    filespace = H5Dget_space(dset_id);
-    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
 
-    status = H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, memspace, filespace, plist_id, xcn_mmg->data);
-    delete xcn_mmg;
-    //====================================================================================
-    
-    std::map<std::set<int>, int> qfacemap;
-    std::map<std::set<int>, int>  facemap;
-    std::set<std::set<int> > faces;
-    std::set<std::set<int> > qfaces;
-    std::map<int,std::vector<int> > face2node;
-    std::set<int> face0;
-    std::set<int> face1;
-    std::set<int> face2;
-    std::set<int> face3;
-    std::set<int> qface0;
-    std::set<int> qface1;
-    std::set<int> qface2;
-    
-    
-    int fid = 0;
-    int vid0,vid1,vid2,vid3;
-    std::map<int,int> lh;
-    std::map<int,int> rh;
-    
-    std::map<int,int> Nlh;
-    std::map<int,int> Nrh;
-    
-    int of = 0;
-    int fset_cnt = 0;
-    Array<int>* adapt_iet = new Array<int>(mmgMesh->ne+mmgMesh->nprism,1);
-    // local face2vert_map for a tet in mmg  {1,2,3}, {0,3,2}, {0,1,3}, {0,2,1}
-    int bf = 0;
-    int bq = 0;
-    std::cout << "-- Constructing the new face-2-node and face-2-element map..."<<std::endl;
-    int orient0;
-    
-    for(int i=1;i<=mmgMesh->ne;i++)
-    {
-        adapt_iet->setVal(i-1,0,2); // Element type = 2 since we are dealing with tetrahedra.
-        
-        face0.insert(mmgMesh->tetra[i].v[1]);
-        face0.insert(mmgMesh->tetra[i].v[2]);
-        face0.insert(mmgMesh->tetra[i].v[3]);
-        if(faces.count(face0) != 1 )
-        {
-            faces.insert(face0);
-            facemap[face0]=fid;
-            lh[fid] = i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face0]] = i-1;
-            faces.erase(face0);
-            facemap.erase(face0);
-        }
-        
-        face1.insert(mmgMesh->tetra[i].v[0]);
-        face1.insert(mmgMesh->tetra[i].v[2]);
-        face1.insert(mmgMesh->tetra[i].v[3]);
-        if(faces.count(face1) != 1)
-        {
-            faces.insert(face1);
-            facemap[face1]=fid;
-            lh[fid] = i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face1]] = i-1;
-            faces.erase(face1);
-            facemap.erase(face1);
-        }
-        
-        
-        
-        
-        face2.insert(mmgMesh->tetra[i].v[0]);
-        face2.insert(mmgMesh->tetra[i].v[3]);
-        face2.insert(mmgMesh->tetra[i].v[1]);
-        if( faces.count(face2) != 1)
-        {
-            faces.insert(face2);
-            facemap[face2]=fid;
-            lh[fid] = i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face2]] = i-1;
-            faces.erase(face2);
-            facemap.erase(face2);
-        }
 
-        
-        
-        face3.insert(mmgMesh->tetra[i].v[0]);
-        face3.insert(mmgMesh->tetra[i].v[2]);
-        face3.insert(mmgMesh->tetra[i].v[1]);
-        if( faces.count(face3) != 1)
-        {
-            faces.insert(face3);
-            facemap[face3]=fid;
-            lh[fid] = i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face3]] = i-1;
-            faces.erase(face3);
-            facemap.erase(face3);
-        }
-    
-        face0.clear();
-        face1.clear();
-        face2.clear();
-        face3.clear();
-        
-    }
-    
-
-    // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-    int qfid  = 0;
-    int fnew  = 0;
-    int fiold = 0;
+void WriteUS3DGridFromMMG(MMG5_pMesh mmgMesh, US3D* us3d, int mmg_prisms, int deflate, MPI_Comm comm)
+{
+    DistributedMesh* dm = GetDistributedMeshFromMMG(mmgMesh, mmg_prisms, comm);
+    WriteUS3DGridInParallel(dm, us3d, deflate, comm);
+    delete dm;
+}
 
-    for(int i=1;i<=mmgMesh->nprism;i++)
-    {
-        adapt_iet->setVal(mmgMesh->ne+i-1,0,6); // Element type = 6 since we are dealing with prisms.
-  
-        face0.insert(mmgMesh->prism[i].v[0]);
-        face0.insert(mmgMesh->prism[i].v[2]);
-        face0.insert(mmgMesh->prism[i].v[1]);
-        if(faces.count(face0) != 1 )
-        {
-            faces.insert(face0);
-            facemap[face0]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face0]] = mmgMesh->ne+i-1;
-            faces.erase(face0);
-            facemap.erase(face0);
-        }
-        
-        
-        face1.insert(mmgMesh->prism[i].v[3]);
-        face1.insert(mmgMesh->prism[i].v[4]);
-        face1.insert(mmgMesh->prism[i].v[5]);
-        if(faces.count(face1) != 1)
-        {
-            faces.insert(face1);
-            facemap[face1]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face1]]  = mmgMesh->ne+i-1;
-            faces.erase(face1);
-            facemap.erase(face1);
-        }
-        
-        
-        
-        // Quad faces //
-        qface0.insert(mmgMesh->prism[i].v[0]);
-        qface0.insert(mmgMesh->prism[i].v[3]);
-        qface0.insert(mmgMesh->prism[i].v[4]);
-        qface0.insert(mmgMesh->prism[i].v[1]);
-        if( qfaces.count(qface0) != 1)
-        {
-            qfaces.insert(qface0);
-            qfacemap[qface0]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[qfacemap[qface0]]  = mmgMesh->ne+i-1;
-            qfaces.erase(qface0);
-            qfacemap.erase(qface0);
-        }
 
-        
-        
-        
-        qface1.insert(mmgMesh->prism[i].v[1]);
-        qface1.insert(mmgMesh->prism[i].v[4]);
-        qface1.insert(mmgMesh->prism[i].v[5]);
-        qface1.insert(mmgMesh->prism[i].v[2]);
-        if( qfaces.count(qface1) != 1)
-        {
-            qfaces.insert(qface1);
-            qfacemap[qface1]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[qfacemap[qface1]]  = mmgMesh->ne+i-1;
-            qfaces.erase(qface1);
-            qfacemap.erase(qface1);
-        }
-        
-        qface2.insert(mmgMesh->prism[i].v[0]);//1
-        qface2.insert(mmgMesh->prism[i].v[2]);//2
-        qface2.insert(mmgMesh->prism[i].v[5]);//5
-        qface2.insert(mmgMesh->prism[i].v[3]);//4
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
 
-        if( qfaces.count(qface2) != 1)
-        {
-            qfaces.insert(qface2);
-            qfacemap[qface2]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[qfacemap[qface2]] = mmgMesh->ne+i-1;
-            qfaces.erase(qface2);
-            qfacemap.erase(qface2);
-        }
-        
-        face0.clear();
-        face1.clear();
-        qface0.clear();
-        qface1.clear();
-        qface2.clear();
-         
-    }
-    
-    //====================================================================================
-    //====================================================================================
-    dimsf[0] = adapt_iet->getNrow();
-    dimsf[1] = adapt_iet->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
 
-    dset_id = H5Dcreate(file_id, "iet", H5T_NATIVE_INT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace = H5Screate_simple(2, count, NULL);
 
-    filespace = H5Dget_space(dset_id);
-    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_iet->data);
-    delete adapt_iet;
-    //====================================================================================
-    //====================================================================================
-
-    std::cout << "AND WE ARE DONE COUNTING " << std::endl;
-    
-    int ftot = 0;
-    std::map<int,int> new2old;
-//
-    std::map<int,int>::iterator itm;
-    int it;
-    for(itm=lh.begin();itm!=lh.end();itm++)
+// Returns the narrowest integer file type that holds the ids up to maxval.
+static hid_t IntegerFileType(gidx_t maxval)
+{
+    if(maxval > std::numeric_limits<int>::max())
     {
-        it = itm->first;
-        if(rh.find(it)!=rh.end())
-        {
-            new2old[it] = ftot;
-            ftot++;
-        }
+        return H5T_STD_I64LE;
     }
-    
-    std::cout << "AND WE ARE DONE DETERMINING THE ORDER" << std::endl;
-    std::cout << "Starting creating massive array" << std::endl;
+    return H5T_STD_I32LE;
+}
 
-    Array<int>* adapt_ifn = new Array<int>(fid,8);
-    std::cout << "Finished creating massive array" << std::endl;
 
-    faces.clear();
-    qfaces.clear();
-    facemap.clear();
-    qfacemap.clear();
-    
-    fid = 0;
-    int idx = 0;
-    std::map<std::set<int>,int> bctFace2lh;
-    std::map<std::set<int>,int> bcqFace2lh;
 
-    for(int i=1;i<=mmgMesh->ne;i++)
-    {
-        //adapt_iet->setVal(i-1,0,2); // Element type = 2 since we are dealing with tetrahedra.
-        
-        face0.insert(mmgMesh->tetra[i].v[1]);
-        face0.insert(mmgMesh->tetra[i].v[2]);
-        face0.insert(mmgMesh->tetra[i].v[3]);
-        if(faces.count(face0) != 1 )
-        {
-            faces.insert(face0);
-                    
-            if(bfaces.find(face0)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face0];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->tetra[i].v[1];
-                bctria[1] = mmgMesh->tetra[i].v[2];
-                bctria[2] = mmgMesh->tetra[i].v[3];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face0]=lh[fid];
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[1]);
-                adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[2]);
-                adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[3]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            
-            fid++;
-        }
-        else
-        {
-            faces.erase(face0);
-        }
-        
-        
-        
-        
-        face1.insert(mmgMesh->tetra[i].v[0]);
-        face1.insert(mmgMesh->tetra[i].v[2]);
-        face1.insert(mmgMesh->tetra[i].v[3]);
-        if(faces.count(face1) != 1)
-        {
-            faces.insert(face1);
-            if(bfaces.find(face1)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face1];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->tetra[i].v[0];
-                bctria[1] = mmgMesh->tetra[i].v[3];
-                bctria[2] = mmgMesh->tetra[i].v[2];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face1]=lh[fid];
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[3]);
-                adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[2]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            
-            fid++;
-        }
-        else
-        {
-            faces.erase(face1);
-        }
-        
-        
-        
-        
-        
-        face2.insert(mmgMesh->tetra[i].v[0]);
-        face2.insert(mmgMesh->tetra[i].v[3]);
-        face2.insert(mmgMesh->tetra[i].v[1]);
-        if( faces.count(face2) != 1)
-        {
-            faces.insert(face2);
-        
-            if(bfaces.find(face2)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face2];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->tetra[i].v[0];
-                bctria[1] = mmgMesh->tetra[i].v[1];
-                bctria[2] = mmgMesh->tetra[i].v[3];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face2]=lh[fid];
-
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[1]);
-                adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[3]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            
-            fid++;
-        }
-        else
-        {
-            faces.erase(face2);
-        }
-        
-        
-        
-        
-        
 
-        face3.insert(mmgMesh->tetra[i].v[0]);
-        face3.insert(mmgMesh->tetra[i].v[2]);
-        face3.insert(mmgMesh->tetra[i].v[1]);
-        
-        if( faces.count(face3) != 1)
-        {
-            faces.insert(face3);
-            
-            if(bfaces.find(face3)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face3];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->tetra[i].v[0];
-                bctria[1] = mmgMesh->tetra[i].v[2];
-                bctria[2] = mmgMesh->tetra[i].v[1];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face3]=lh[fid];
-
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[2]);
-                adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[1]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            fid++;
-        }
-        else
-        {
-            faces.erase(face3);
-        }
-    
-        face0.clear();
-        face1.clear();
-        face2.clear();
-        face3.clear();
-        
-    }
-    
-    
-    // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-    for(int i=1;i<=mmgMesh->nprism;i++)
+// Creates the nrow x ncol dataset name in loc_id. With deflate (1-9) the dataset is chunked
+// and compressed with the shuffle and deflate filters, otherwise it is contiguous.
+static void CreateDataSet(hid_t loc_id, const char* name, hid_t type, hsize_t nrow, hsize_t ncol, int deflate)
+{
+    hsize_t dimsf[2] = {nrow, ncol};
+    hid_t filespace = H5Screate_simple(2, dimsf, NULL);
+    hid_t dcpl_id   = H5Pcreate(H5P_DATASET_CREATE);
+    if(deflate > 0 && nrow > 0)
     {
-        //adapt_iet->setVal(mmgMesh->ne+i-1,0,6); // Element type = 6 since we are dealing with prisms.
-  
-        face0.insert(mmgMesh->prism[i].v[0]);
-        face0.insert(mmgMesh->prism[i].v[2]);
-        face0.insert(mmgMesh->prism[i].v[1]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-        if(faces.count(face0) != 1 )
-        {
-            faces.insert(face0);
-            facemap[face0]=fid;
-            
-            if(bfaces.find(face0)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face0];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->prism[i].v[0];
-                bctria[1] = mmgMesh->prism[i].v[1];
-                bctria[2] = mmgMesh->prism[i].v[2];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face0]=lh[fid];
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[1]);
-                adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[2]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            
-            fid++;
-            
-        }
-        else
-        {
-            faces.erase(face0);
-        }
-        
-        
-        
-        
-        
-        face1.insert(mmgMesh->prism[i].v[3]);
-        face1.insert(mmgMesh->prism[i].v[4]);
-        face1.insert(mmgMesh->prism[i].v[5]);
-        if(faces.count(face1) != 1)
-        {
-            faces.insert(face1);
-            
-            facemap[face1]=fid;
-            if(bfaces.find(face1)!=bfaces.end())
-            {
-                int refe = btfaces_Ref[face1];
-                std::vector<int> bctria(3);
-                bctria[0] = mmgMesh->prism[i].v[3];
-                bctria[1] = mmgMesh->prism[i].v[5];
-                bctria[2] = mmgMesh->prism[i].v[4];
-                bctrias[refe].push_back(bctria);
-                bctFace2lh[face1]=lh[fid];
-                bf++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,3);
-                adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[3]);
-                adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[5]);
-                adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[4]);
-                adapt_ifn->setVal(idx,4,0);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            fid++;
-        }
-        else
-        {
-            faces.erase(face1);
-        }
-        
-        
-        
-        
-        
-        // Quad faces //
-        qface0.insert(mmgMesh->prism[i].v[0]);
-        qface0.insert(mmgMesh->prism[i].v[3]);
-        qface0.insert(mmgMesh->prism[i].v[4]);
-        qface0.insert(mmgMesh->prism[i].v[1]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-        if( qfaces.count(qface0) != 1)
-        {
-            qfaces.insert(qface0);
-            
-            if(bqfaces.find(qface0)!=bqfaces.end())
-            {
-                int refe = bqfaces_Ref[qface0];
-                std::vector<int> bcquad(4);
-                bcquad[0] = mmgMesh->prism[i].v[0];
-                bcquad[1] = mmgMesh->prism[i].v[3];
-                bcquad[2] = mmgMesh->prism[i].v[4];
-                bcquad[3] = mmgMesh->prism[i].v[1];
-                bcquads[refe].push_back(bcquad);
-                bcqFace2lh[qface0]=lh[fid];
-                bq++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,4);
-                adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[3]);
-                adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[4]);
-                adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[1]);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            
-            fid++;
-            
-        }
-        else
-        {
-            qfaces.erase(qface0);
-        }
+        hsize_t chunk[2] = {std::min(nrow,hsize_t(65536)), ncol};
+        H5Pset_chunk(dcpl_id, 2, chunk);
+        H5Pset_shuffle(dcpl_id);
+        H5Pset_deflate(dcpl_id, deflate);
+    }
+    hid_t dset_id = H5Dcreate(loc_id, name, type, filespace, H5P_DEFAULT, dcpl_id, H5P_DEFAULT);
+    H5Dclose(dset_id);
+    H5Pclose(dcpl_id);
+    H5Sclose(filespace);
+}
 
-        
-        
-        
-        qface1.insert(mmgMesh->prism[i].v[1]);
-        qface1.insert(mmgMesh->prism[i].v[4]);
-        qface1.insert(mmgMesh->prism[i].v[5]);
-        qface1.insert(mmgMesh->prism[i].v[2]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
 
-        if( qfaces.count(qface1) != 1)
-        {
-            qfaces.insert(qface1);
-            
-            if(bqfaces.find(qface1)!=bqfaces.end())
-            {
-                int refe = bqfaces_Ref[qface1];
-                std::vector<int> bcquad(4);
-                bcquad[0] = mmgMesh->prism[i].v[1];
-                bcquad[1] = mmgMesh->prism[i].v[4];
-                bcquad[2] = mmgMesh->prism[i].v[5];
-                bcquad[3] = mmgMesh->prism[i].v[2];
-                bcquads[refe].push_back(bcquad);
-                bcqFace2lh[qface1]=lh[fid];
-                bq++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,4);
-                adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[1]);
-                adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[4]);
-                adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[5]);
-                adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[2]);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-           
-            fid++;
-           
-        }
-        else
-        {
-            qfaces.erase(qface1);
-        }
-        
-        qface2.insert(mmgMesh->prism[i].v[0]);//1
-        qface2.insert(mmgMesh->prism[i].v[2]);//2
-        qface2.insert(mmgMesh->prism[i].v[5]);//5
-        qface2.insert(mmgMesh->prism[i].v[3]);//4
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
 
-        if( qfaces.count(qface2) != 1)
-        {
-            qfaces.insert(qface2);
-            qfacemap[qface2]=fid;
-            if(bqfaces.find(qface2)!=bqfaces.end())
-            {
-                int refe = bqfaces_Ref[qface2];
-                std::vector<int> bcquad(4);
-                bcquad[0] = mmgMesh->prism[i].v[0];
-                bcquad[1] = mmgMesh->prism[i].v[2];
-                bcquad[2] = mmgMesh->prism[i].v[5];
-                bcquad[3] = mmgMesh->prism[i].v[3];
-                bcquads[refe].push_back(bcquad);
-                bcqFace2lh[qface2]=lh[fid];
-                bq++;
-            }
-            else
-            {
-                idx = new2old[fid];
-                adapt_ifn->setVal(idx,0,4);
-                adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[2]);
-                adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[5]);
-                adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[3]);
-                adapt_ifn->setVal(idx,5,rh[fid]+1);
-                adapt_ifn->setVal(idx,6,lh[fid]+1);
-                adapt_ifn->setVal(idx,7,2);
-                //idx++;
-            }
-            fid++;
-        }
-        else
-        {
-            qfaces.erase(qface2);
-        }
-        
-        face0.clear();
-        face1.clear();
-        qface0.clear();
-        qface1.clear();
-        qface2.clear();
-         
-    }
-    
-    
-    
-    faces.clear();
-    qfaces.clear();
-    
-    
-    
-    //====================================================================================
-    //====================================================================================
-    //MMG3D_Free_allSols(mmgMesh,&mmgSol);
-    MMG3D_Free_all(MMG5_ARG_start,
-                   MMG5_ARG_ppMesh,&mmgMesh,MMG5_ARG_ppSols,&mmgSol,
-                   MMG5_ARG_end);
-    //====================================================================================
-    //====================================================================================
-    
-    
-    
-    int bc_id = 0;
-    int gaa   = 0;
-    int typef3 = 0;
-    int typef4 = 0;
-    
-    std::cout << "-- Adding the interior faces to the new ifn array... face2node.size() -> " << face2node.size() << " " << lh.size() << " " << rh.size() <<std::endl;
-    int ty=0;
-    
 
-    std::map<int,std::vector<int> >::iterator it_bref;
-    int faceid;
-    std::set<int> iface;
-    int nbound = 0;
-    int fa=0;
-    std::cout << "-- Adding the boundary faces to the new ifn array..."<<std::endl;
-    std::map<int,std::vector<std::vector<int> > >::iterator iterbc;
-    int t = ftot;
-    int lhi;
-    for(iterbc=bctrias.begin();iterbc!=bctrias.end();iterbc++)
-    {
-        int bnd_id     = iterbc->first;
-        int Ntris      = iterbc->second.size();
-        int Nquads     = bcquads[bnd_id].size();
-        std::cout << "bnd ref test = " << bnd_id << " " << Ntris << " " << Nquads << std::endl;
-    }
-    
-    for(iterbc=bctrias.begin();iterbc!=bctrias.end();iterbc++)
-    {
-        int bnd_id     = iterbc->first;
-        int Ntris      = iterbc->second.size();
-        int Nquads     = bcquads[bnd_id].size();
-                
-        for(int q=0;q<Ntris;q++)
-        {
-            //faceid = ref2bface[bnd_id][q];
-            adapt_ifn->setVal(t,0,3);
-            adapt_ifn->setVal(t,1,iterbc->second[q][0]);
-            adapt_ifn->setVal(t,2,iterbc->second[q][1]);
-            adapt_ifn->setVal(t,3,iterbc->second[q][2]);
-            adapt_ifn->setVal(t,4,0);
-            iface.insert(iterbc->second[q][0]);
-            iface.insert(iterbc->second[q][1]);
-            iface.insert(iterbc->second[q][2]);
-            lhi = bctFace2lh[iface];
-            adapt_ifn->setVal(t,5,0);
-            adapt_ifn->setVal(t,6,lhi+1);
-            adapt_ifn->setVal(t,7,bnd_id);
-            iface.clear();
-            t++;
-        }
-        for(int q=0;q<Nquads;q++)
-        {
-            //faceid = ref2bqface[bnd_id][q];
-            adapt_ifn->setVal(t,0,4);
-            adapt_ifn->setVal(t,1,bcquads[bnd_id][q][0]);
-            adapt_ifn->setVal(t,2,bcquads[bnd_id][q][1]);
-            adapt_ifn->setVal(t,3,bcquads[bnd_id][q][2]);
-            adapt_ifn->setVal(t,4,bcquads[bnd_id][q][3]);
-            iface.insert(bcquads[bnd_id][q][0]);
-            iface.insert(bcquads[bnd_id][q][1]);
-            iface.insert(bcquads[bnd_id][q][2]);
-            iface.insert(bcquads[bnd_id][q][3]);
-            lhi = bcqFace2lh[iface];
-            adapt_ifn->setVal(t,5,0);
-            adapt_ifn->setVal(t,6,lhi+1);
-            adapt_ifn->setVal(t,7,bnd_id);
-            iface.clear();
-            t++;
-        }
-    }
-    
-    
-    
-    int nbo = bcrefs.size();
-    std::cout << "-- Constructing the zdefs array..."<<std::endl;
-    Array<int>* adapt_zdefs = new Array<int>(3+nbo,7);
-    std::cout << "faces.size()+qfaces.size()-bfaces.size()-bqfaces.size() " << faces.size() << " " << qfaces.size() << " " << bfaces.size() << " " << bqfaces.size() << std::endl;
-    // Collect node data (10) . Starting index-ending index Nodes
-    adapt_zdefs->setVal(0,0,10);
-    adapt_zdefs->setVal(0,1,-1);
-    adapt_zdefs->setVal(0,2,1);
-    adapt_zdefs->setVal(0,3,1);
-    adapt_zdefs->setVal(0,4,nVerts);
-    adapt_zdefs->setVal(0,5,us3d->zdefs->getVal(0,5));
-    adapt_zdefs->setVal(0,6,us3d->zdefs->getVal(0,6));
-    // Collect element data (12) . Starting index-ending index Element
-    adapt_zdefs->setVal(1,0,12);
-    adapt_zdefs->setVal(1,1,-1);
-    adapt_zdefs->setVal(1,2,2);
-    adapt_zdefs->setVal(1,3,1);
-    adapt_zdefs->setVal(1,4,nTet+nPrism);
-    adapt_zdefs->setVal(1,5,us3d->zdefs->getVal(1,5));
-    adapt_zdefs->setVal(1,6,2);
-    // Collect internal face data (13) . Starting index-ending index internal face.
-    adapt_zdefs->setVal(2,0,13);
-    adapt_zdefs->setVal(2,1,-1);
-    adapt_zdefs->setVal(2,2, 3);
-    adapt_zdefs->setVal(2,3, 1);
-    adapt_zdefs->setVal(2,4,lh.size()-bfaces.size()-bqfaces.size());
-    adapt_zdefs->setVal(2,5,us3d->zdefs->getVal(2,5));
-    adapt_zdefs->setVal(2,6,2);
-    // Collect boundary face data (13) . Starting index-ending index boundary face for each boundary ID.
-    int q  = 1;
-    int nb = 0;
-    int face_start = lh.size()-bfaces.size()-bqfaces.size()+1;
-    int face_end;
-    std::set<int>::iterator itr;
-    for(itr=bcrefs.begin();itr!=bcrefs.end();itr++)
+// Writes the rows [row_offset,row_offset+nrow) of the 2D dataset dset_id.
+static void WriteRowsToDataSet(hid_t dset_id, hid_t memtype, hsize_t row_offset, hsize_t nrow, hsize_t ncol, const void* data)
+{
+    if(nrow == 0)
     {
-        int bnd_ref = *itr;
-        face_end = face_start+bnd_Ntri[bnd_ref]+bnd_Nquad[bnd_ref]-1;
-        adapt_zdefs->setVal(3+nb,0,13);
-        adapt_zdefs->setVal(3+nb,1,-1);
-        adapt_zdefs->setVal(3+nb,2,3+q);
-        adapt_zdefs->setVal(3+nb,3,face_start);
-        adapt_zdefs->setVal(3+nb,4,face_end);
-        adapt_zdefs->setVal(3+nb,5,bnd_ref);
-        adapt_zdefs->setVal(3+nb,6,2);
-        //std::cout << "us3d->zdefs->getVal(3+nb,5) " << us3d->zdefs->getVal(3+nb,5) << std::endl;
-        face_start = face_end+1;
-        //std::cout << "nb  = " << nb << " " << ref2bface.size() << " " << ref2bqface.size() << std::endl;
-        nb++;
-        q++;
+        return;
     }
-    
-    //std::cout << "elements = " << " prisms->" << mmgMesh->nprism << " tetrahedra->" << mmgMesh->ne << std::endl;
-    std::cout << "lh vs rh = " << " " << lh.size() << " " << rh.size() << std::endl;
-    //std::cout << "-- sizingf -> " << lh.size() << " " << rh.size() << " " << t << " " << ty <<std::endl;
-
-    
-    
-    //====================================================================================
-    // Add ifn map to the grid.h5 file
-    //====================================================================================
-    
-    dimsf[0] = adapt_ifn->getNrow();
-    dimsf[1] = adapt_ifn->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
-    
-    dset_id = H5Dcreate(file_id, "ifn", H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);             // hyperslab selection parameters
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace = H5Screate_simple(2, count, NULL);
-
-    filespace = H5Dget_space(dset_id);
+    hsize_t count[2]  = {nrow, ncol};
+    hsize_t offset[2] = {row_offset, 0};
+    hid_t memspace  = H5Screate_simple(2, count, NULL);
+    hid_t filespace = H5Dget_space(dset_id);
     H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_ifn->data);
-    delete adapt_ifn;
-
-    
-    //====================================================================================
-
-    hid_t group_info_id  = H5Gcreate(file_id, "info", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-
-    hsize_t dimsf_att3 = 1;
-    att_space = H5Screate_simple(1, &dimsf_att3, NULL);
-    hid_t type3 =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type3, 10);
-    ret = H5Tset_strpad(type3,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (group_info_id, "date", type3, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri3[] = "27-05-1987";
-    status = H5Awrite(attr_id, type3, &stri3);
-    H5Aclose(attr_id);
-    
-    hid_t group_grid_id  = H5Gcreate(group_info_id, "grid", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-    dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    attr_id   = H5Acreate (group_grid_id, "nc", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    int value = nTet+nPrism;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "nf", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = lh.size();
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "ng", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = bfaces.size()+bqfaces.size();
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "nn", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = nVerts;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    
-    
-    
-    // Create group;
-    //====================================================================================
-    hid_t group_zones_id  = H5Gcreate(file_id, "zones", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-    // Add attribute to group:
-    //====================================================================================
-    dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    attr_id   = H5Acreate (group_zones_id, "nz", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = 3+nbo;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    //====================================================================================
-    
-    
-    // Add dataset to group:
-    //====================================================================================
-    dimsf[0] = adapt_zdefs->getNrow();
-    dimsf[1] = adapt_zdefs->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
-    hid_t dset_zdefs_id = H5Dcreate(group_zones_id, "zdefs", H5T_NATIVE_INT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    
-    count[0]  = dimsf[0];
-    count[1]  = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace  = H5Screate_simple(2, count, NULL);
-    filespace = H5Dget_space(dset_zdefs_id);
-    
-    //H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_zdefs_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_zdefs->data);
-    //====================================================================================
-    
-    dimsf_att = us3d->znames->getNrow();
-    filespace = H5Screate_simple(1, &dimsf_att, NULL);
-    type =  H5Tcopy (H5T_C_S1);
-    ret  = H5Tset_size (type, 20);
-    ret  = H5Tset_strpad(type, H5T_STR_SPACEPAD);
-    hid_t dset_znames_id = H5Dcreate(group_zones_id, "znames", type, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    
+    H5Dwrite(dset_id, memtype, memspace, filespace, H5P_DEFAULT, data);
     H5Sclose(filespace);
-    
-    hsize_t cnt = us3d->znames->getNrow();
-    //std::cout << " us3d->znames->getNrow()  " << cnt << std::endl;
-    memspace  = H5Screate_simple(1, &cnt, NULL);
-    filespace = H5Dget_space(dset_znames_id);
-    
-    //H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-    
-    status = H5Dwrite(dset_znames_id, type, memspace, filespace, plist_id, us3d->znames->data);
-
-    PlotBoundaryData(us3d->znames,adapt_zdefs);
-    
-//    delete xcn_mmg;
-//    delete adapt_zdefs;
-//    qfacemap.clear();
-//    facemap.clear();
-//    faces.clear();
-//    qfaces.clear();
-//    face2node.clear();
-//    lh.clear();
-//    rh.clear();
-//    Nlh.clear();
-//    Nrh.clear();
-//    bctrias.clear();
-//    bcquads.clear();
+    H5Sclose(memspace);
 }
 
 
-void WriteUS3DGridFromMMG_it0(MMG5_pMesh mmgMesh,MMG5_pSol mmgSol, US3D* us3d)
+
+
+void WriteUS3DGridInParallel(DistributedMesh* dm, US3D* us3d, int deflate, MPI_Comm comm)
 {
-    std::map<int,std::vector<int> > ref2bface;
-    std::map<int,std::vector<int> > ref2bqface;
-    std::set<set<int> > bfaces;
-    std::set<set<int> > bqfaces;
-    std::map<set<int>,int > btfaces_Ref;
-    std::map<set<int>,int > bqfaces_Ref;
-    std::set<int> face;
-    std::set<int> bcrefs;
-    int wr = 0;
-    
-    int nVerts = mmgMesh->np;
-    int nTet = mmgMesh->ne;
-    int nPrism = mmgMesh->nprism;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    int nTet   = dm->tetra.size()/4;
+    int nPrism = dm->prism.size()/6;
+    int nElem  = nTet+nPrism;
+    gidx_t nElem_g   = nElem;
+    gidx_t el_offset = 0;
+    MPI_Exscan(&nElem_g, &el_offset, 1, MPI_GIDX, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        el_offset = 0;
+    }
+    gidx_t nElemGlob = 0;
+    MPI_Allreduce(&nElem_g, &nElemGlob, 1, MPI_GIDX, MPI_SUM, comm);
+    // The element and face ids are int in the face records and in ien/ief.
+    if(nElemGlob > std::numeric_limits<int>::max())
+    {
+        if(world_rank == 0)
+        {
+            std::cout << "Error :: " << nElemGlob << " elements is more than WriteUS3DGridInParallel can number with int ids." << std::endl;
+        }
+        MPI_Abort(comm, 1);
+    }
     
-    for(int i=1;i<=mmgMesh->nt;i++)
+    // Face records [sorted key(4), nv, nodes(4), element, ref] are sent to the rank given by
+    // the lowest vertex of the face, where the two sides of every face meet. Boundary faces
+    // have element -1; for the element faces the last entry is the face number in the element.
+    const int NR = 11;
+    // local face2vert_map for a tet in mmg  {1,2,3}, {0,3,2}, {0,1,3}, {0,2,1}
+    int tet_faces[4][3] = {{1,2,3},{0,3,2},{0,1,3},{0,2,1}};
+    // face2vert_map for the BL prisms, as they are set up in main.cpp.
+    int prism_tris[2][3]  = {{0,1,2},{3,4,5}};
+    int prism_quads[3][4] = {{0,2,4,3},{1,5,4,2},{0,3,5,1}};
+    
+    std::vector<std::vector<int> > send(world_size);
+    int rec[NR];
+    int fv[4];
+    for(int e=0;e<nElem;e++)
     {
-        if(mmgMesh->tria[i].ref>0 && mmgMesh->tria[i].ref!=20)// -1 is the tag for internal shell.
+        int nf = (e<nTet) ? 4 : 5;
+        for(int f=0;f<nf;f++)
         {
-            ref2bface[mmgMesh->tria[i].ref].push_back(i);
-            face.insert(mmgMesh->tria[i].v[0]);
-            face.insert(mmgMesh->tria[i].v[1]);
-            face.insert(mmgMesh->tria[i].v[2]);
-            
-            if(btfaces_Ref.find(face)==btfaces_Ref.end())
+            int nv = 3;
+            if(e<nTet)
             {
-                btfaces_Ref[face] = mmgMesh->tria[i].ref;
+                for(int s=0;s<3;s++)
+                {
+                    fv[s] = dm->tetra[gidx_t(e)*4+tet_faces[f][s]];
+                }
             }
-            
-            bfaces.insert(face);
-            if(bcrefs.find(mmgMesh->tria[i].ref)==bcrefs.end())
+            else if(f<2)
+            {
+                for(int s=0;s<3;s++)
+                {
+                    fv[s] = dm->prism[gidx_t(e-nTet)*6+prism_tris[f][s]];
+                }
+            }
+            else
+            {
+                nv = 4;
+                for(int s=0;s<4;s++)
+                {
+                    fv[s] = dm->prism[gidx_t(e-nTet)*6+prism_quads[f-2][s]];
+                }
+            }
+            for(int s=0;s<4;s++)
             {
-                bcrefs.insert(mmgMesh->tria[i].ref);
+                rec[s]   = (s<nv) ? fv[s] : -1;
+                rec[5+s] = (s<nv) ? fv[s] : -1;
             }
-            face.clear();
+            std::sort(rec,rec+nv);
+            rec[4]  = nv;
+            rec[9]  = int(el_offset+e);
+            rec[10] = f;
+            send[rec[0]%world_size].insert(send[rec[0]%world_size].end(),rec,rec+NR);
         }
     }
-    
-    for(int i=1;i<=mmgMesh->nquad;i++)
+    int nbt = dm->tria_ref.size();
+    int nbq = dm->quad_ref.size();
+    for(int f=0;f<nbt+nbq;f++)
     {
-        if(mmgMesh->quadra[i].ref>0 && mmgMesh->quadra[i].ref!=2)// -1 is the tag for internal shell.
+        int nv = (f<nbt) ? 3 : 4;
+        for(int s=0;s<4;s++)
         {
-            ref2bqface[mmgMesh->quadra[i].ref].push_back(i);
-            
-            face.insert(mmgMesh->quadra[i].v[0]);
-            face.insert(mmgMesh->quadra[i].v[1]);
-            face.insert(mmgMesh->quadra[i].v[2]);
-            face.insert(mmgMesh->quadra[i].v[3]);
-            
-            if(bqfaces_Ref.find(face)==bqfaces_Ref.end())
+            if(s<nv)
             {
-                bqfaces_Ref[face] = mmgMesh->quadra[i].ref;
+                rec[s] = (f<nbt) ? dm->tria[gidx_t(f)*3+s] : dm->quad[gidx_t(f-nbt)*4+s];
             }
-            
-            
-            bqfaces.insert(face);
-            if(bcrefs.find(mmgMesh->quadra[i].ref)==bcrefs.end())
+            else
             {
-                bcrefs.insert(mmgMesh->quadra[i].ref);
+                rec[s] = -1;
             }
-            face.clear();
+            rec[5+s] = rec[s];
         }
+        std::sort(rec,rec+nv);
+        rec[4]  = nv;
+        rec[9]  = -1;
+        rec[10] = (f<nbt) ? dm->tria_ref[f] : dm->quad_ref[f-nbt];
+        send[rec[0]%world_size].insert(send[rec[0]%world_size].end(),rec,rec+NR);
     }
     
-    
-    std::map<int,int> bnd_Ntri;
-    std::map<int,int> bnd_Nquad;
-    int i=0;
-    std::set<int>::iterator refit;
-    
-    for(refit=bcrefs.begin();refit!=bcrefs.end();refit++)
+    std::vector<int> scnt(world_size), soff(world_size), rcnt(world_size), roff(world_size);
+    std::vector<int> sbuf;
+    for(int r=0;r<world_size;r++)
     {
-        int ref_inq = *refit;
-        
-        if(ref2bface.find(ref_inq)==ref2bface.end())
-        {
-            bnd_Ntri[ref_inq]=0;
-        }
-        else
-        {
-            bnd_Ntri[ref_inq]=ref2bface[ref_inq].size();
-        }
-        
-        
-        if(ref2bqface.find(ref_inq)==ref2bqface.end())
-        {
-            bnd_Nquad[ref_inq]=0;
-        }
-        else
-        {
-            bnd_Nquad[ref_inq]=ref2bqface[ref_inq].size();
-        }
+        scnt[r] = send[r].size()/NR;
+        soff[r] = sbuf.size()/NR;
+        sbuf.insert(sbuf.end(),send[r].begin(),send[r].end());
+        std::vector<int>().swap(send[r]);
     }
-    
-    std::map<int,std::vector<std::vector<int> > > bctrias;
-    std::map<int,std::vector<std::vector<int> > > bcquads;
-    
-    Array<double>* xcn_mmg = new Array<double>(mmgMesh->np,3);
-    for(int i=0;i<mmgMesh->np;i++)
+    sbuf.resize(sbuf.size()+NR);
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    roff[0] = 0;
+    for(int r=1;r<world_size;r++)
     {
-        xcn_mmg->setVal(i,0,mmgMesh->point[i+1].c[0]);
-        xcn_mmg->setVal(i,1,mmgMesh->point[i+1].c[1]);
-        xcn_mmg->setVal(i,2,mmgMesh->point[i+1].c[2]);
+        roff[r] = roff[r-1]+rcnt[r-1];
     }
-    
-    std::cout<<"-- Writing in HDF5 format..."<<std::endl;
-    hid_t ret;
-    //Output the new grid.h5 which has the new vertices and ifn map.
-    //===================================================================
-    //===================================================================
-    //===================================================================
-    hid_t plist_id = H5Pcreate(H5P_FILE_ACCESS);
-    plist_id               = H5P_DEFAULT;
-    //H5Pset_fapl_mpio(plist_id, comm, info);
-    hid_t file_id = H5Fcreate("grid_madam.h5", H5F_ACC_TRUNC, H5P_DEFAULT, plist_id);
-    H5Pclose(plist_id);
-    hid_t status;
-    hid_t att_space;
-    hid_t attr_id;
-    
-    hsize_t dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    hid_t type =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type, 14);
-    ret = H5Tset_strpad(type,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (file_id, "filetype", type, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri[] = "US3D Grid File";
-    status = H5Awrite(attr_id, type, &stri);
-    H5Aclose(attr_id);
-    
-    hsize_t dimsf_att2 = 1;
-    att_space = H5Screate_simple(1, &dimsf_att2, NULL);
-    hid_t type2 =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type2, 5);
-    ret = H5Tset_strpad(type2,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (file_id, "filevers", type2, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri2[] = "1.1.8";
-    status = H5Awrite(attr_id, type2, &stri2);
-    H5Aclose(attr_id);
-    
-    //====================================================================================
-    // Add xcn map to the grid.h5 file
-    //====================================================================================
-    hsize_t     dimsf[2];
-    hsize_t    count[2];              // hyperslab selection parameters
-    hsize_t    offset[2];
-    dimsf[0] = xcn_mmg->getNrow();
-    dimsf[1] = xcn_mmg->getNcol();
-    hid_t filespace = H5Screate_simple(2, dimsf, NULL);
-
-    hid_t dset_id = H5Dcreate(file_id, "xcn", H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    hid_t memspace = H5Screate_simple(2, count, NULL);
-
-    filespace = H5Dget_space(dset_id);
-    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_id, H5T_NATIVE_DOUBLE, memspace, filespace, plist_id, xcn_mmg->data);
-    delete xcn_mmg;
-    //====================================================================================
-    
-    std::map<std::set<int>, int> qfacemap;
-    std::map<std::set<int>, int>  facemap;
-    std::set<std::set<int> > faces;
-    std::set<std::set<int> > qfaces;
-    std::set<int> face0;
-    std::set<int> face1;
-    std::set<int> face2;
-    std::set<int> face3;
-    std::set<int> qface0;
-    std::set<int> qface1;
-    std::set<int> qface2;
-    int fid = 0;
-    int vid0,vid1,vid2,vid3;
-    std::map<int,int> lh;
-    std::map<int,int> rh;
-    
-    std::map<int,int> Nlh;
-    std::map<int,int> Nrh;
-    
-    int of = 0;
-    int fset_cnt = 0;
-    Array<int>* adapt_iet = new Array<int>(nTet+nPrism,1);
-    // local face2vert_map for a tet in mmg  {1,2,3}, {0,3,2}, {0,1,3}, {0,2,1}
-    int bf = 0;
-    int bq = 0;
-    std::cout << "-- Constructing the new face-2-node and face-2-element map..."<<std::endl;
-
-    for(int i=1;i<=mmgMesh->ne;i++)
+    // The records are sent as one datatype, so the counts are numbers of faces.
+    MPI_Datatype rec_type;
+    MPI_Type_contiguous(NR, MPI_INT, &rec_type);
+    MPI_Type_commit(&rec_type);
+    int nrec = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rbuf((gidx_t(nrec)+1)*NR);
+    MPI_Alltoallv(&sbuf[0], &scnt[0], &soff[0], rec_type,
+                  &rbuf[0], &rcnt[0], &roff[0], rec_type, comm);
+    MPI_Type_free(&rec_type);
+    std::vector<int>().swap(sbuf);
+    
+    // The lowest vertex of the records on this rank is world_rank plus a multiple of
+    // world_size, so one counting pass over it puts the records in buckets of the faces
+    // around a vertex. Only these small buckets need a comparison sort.
+    const int* R = &rbuf[0];
+    int nbucket = dm->nVertGlob/world_size+1;
+    std::vector<int> bucket_off(nbucket+1,0);
+    for(int i=0;i<nrec;i++)
     {
-        adapt_iet->setVal(i-1,0,2); // Element type = 2 since we are dealing with tetrahedra.
-        
-        face0.insert(mmgMesh->tetra[i].v[1]);
-        face0.insert(mmgMesh->tetra[i].v[2]);
-        face0.insert(mmgMesh->tetra[i].v[3]);
-        
-        if(faces.count(face0) != 1 )
+        bucket_off[R[gidx_t(i)*NR]/world_size+1]++;
+    }
+    for(int b=0;b<nbucket;b++)
+    {
+        bucket_off[b+1] = bucket_off[b+1]+bucket_off[b];
+    }
+    // The record offsets are gidx_t, since nrec*NR can go beyond the int range.
+    std::vector<gidx_t> order(nrec);
+    std::vector<int> bucket_pos(bucket_off.begin(),bucket_off.end()-1);
+    for(int i=0;i<nrec;i++)
+    {
+        order[bucket_pos[R[gidx_t(i)*NR]/world_size]++] = i;
+    }
+    std::vector<int>().swap(bucket_pos);
+#pragma omp parallel for schedule(dynamic,1024)
+    for(int b=0;b<nbucket;b++)
+    {
+        std::sort(order.begin()+bucket_off[b],order.begin()+bucket_off[b+1],[R](gidx_t a, gidx_t c)
         {
-            faces.insert(face0);
-            facemap[face0]=fid;
-            lh[fid] = i-1;
-            fid++;
-        }
-        else
+            for(int s=1;s<4;s++)
+            {
+                if(R[a*NR+s] != R[c*NR+s])
+                {
+                    return R[a*NR+s] < R[c*NR+s];
+                }
+            }
+            return R[a*NR+9] > R[c*NR+9];
+        });
+    }
+    
+    // Equal keys are adjacent now: two elements make an interior face, one element and a
+    // boundary face make a boundary face. The left element is the one with the lower id.
+    // fel_int/fel_bnd keep [lh, face in lh, rh, face in rh] and [lh, face in lh] per row.
+    std::vector<int> ifn_int;
+    std::map<int,std::vector<int> > ifn_bnd;
+    std::vector<int> fel_int;
+    std::map<int,std::vector<int> > fel_bnd;
+    int nunmatched = 0;
+    int i = 0;
+    while(i<nrec)
+    {
+        int j = i+1;
+        while(j<nrec && std::equal(R+order[i]*NR,R+order[i]*NR+4,R+order[j]*NR))
         {
-            rh[facemap[face0]] = i-1;
-            faces.erase(face0);
-            facemap.erase(face0);
+            j++;
         }
-        
-        face1.insert(mmgMesh->tetra[i].v[0]);
-        face1.insert(mmgMesh->tetra[i].v[2]);
-        face1.insert(mmgMesh->tetra[i].v[3]);
-        
-        if(faces.count(face1) != 1)
+        std::vector<gidx_t> els;
+        int ref = 0;
+        int has_ref = 0;
+        for(int k=i;k<j;k++)
         {
-            faces.insert(face1);
-            facemap[face1]=fid;
-            lh[fid] = i-1;
-            fid++;
+            if(R[order[k]*NR+9] >= 0)
+            {
+                els.push_back(order[k]);
+            }
+            else
+            {
+                ref     = R[order[k]*NR+10];
+                has_ref = 1;
+            }
         }
-        else
+        if(els.size() == 0)
         {
-            rh[facemap[face1]] = i-1;
-            faces.erase(face1);
-            facemap.erase(face1);
+            i = j;
+            continue;
         }
-        
-        face2.insert(mmgMesh->tetra[i].v[0]);
-        face2.insert(mmgMesh->tetra[i].v[3]);
-        face2.insert(mmgMesh->tetra[i].v[1]);
-        
-        
-        
-        
-        if( faces.count(face2) != 1)
+        if(els.size() > 2)
         {
-            faces.insert(face2);
-            facemap[face2]=fid;
-            lh[fid] = i-1;
-            fid++;
+            std::cout << "Error :: face shared by " << els.size() << " elements in WriteUS3DGridInParallel." << std::endl;
         }
-        else
+        gidx_t lh = els[els.size()-1];
+        const int* L = R+lh*NR;
+        int row[8];
+        row[0] = L[4];
+        for(int s=0;s<4;s++)
         {
-            rh[facemap[face2]] = i-1;
-            faces.erase(face2);
-            facemap.erase(face2);
+            row[1+s] = (L[5+s] >= 0) ? L[5+s]+1 : 0;
         }
-
-        face3.insert(mmgMesh->tetra[i].v[0]);
-        face3.insert(mmgMesh->tetra[i].v[2]);
-        face3.insert(mmgMesh->tetra[i].v[1]);
-        
-        
-        if( faces.count(face3) != 1)
+        if(els.size() >= 2)
         {
-            faces.insert(face3);
-            facemap[face3]=fid;
-            lh[fid] = i-1;
-            fid++;
+            const int* RH = R+els[els.size()-2]*NR;
+            row[5] = RH[9]+1;
+            row[6] = L[9]+1;
+            row[7] = 2;
+            ifn_int.insert(ifn_int.end(),row,row+8);
+            int fel[4] = {L[9],L[10],RH[9],RH[10]};
+            fel_int.insert(fel_int.end(),fel,fel+4);
         }
         else
         {
-            rh[facemap[face3]] = i-1;
-            faces.erase(face3);
-            facemap.erase(face3);
-        }
-    
-        face0.clear();
-        face1.clear();
-        face2.clear();
-        face3.clear();
-        
+            if(!has_ref)
+            {
+                nunmatched++;
+            }
+            row[5] = 0;
+            row[6] = L[9]+1;
+            row[7] = ref;
+            ifn_bnd[ref].insert(ifn_bnd[ref].end(),row,row+8);
+            fel_bnd[ref].push_back(L[9]);
+            fel_bnd[ref].push_back(L[10]);
+        }
+        i = j;
     }
+    std::vector<int>().swap(rbuf);
     
-    
-
-    // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-
-    for(int i=1;i<=mmgMesh->nprism;i++)
+    int nunmatched_tot = 0;
+    MPI_Allreduce(&nunmatched, &nunmatched_tot, 1, MPI_INT, MPI_SUM, comm);
+    if(world_rank == 0 && nunmatched_tot > 0)
     {
-        adapt_iet->setVal(mmgMesh->ne+i-1,0,6); // Element type = 6 since we are dealing with prisms.
-               // std::cout  << "Prism ["<<i<<"]=" << mmgMesh->prism[i].v[0] << " " << mmgMesh->prism[i].v[1] << " " << mmgMesh->prism[i].v[2] << " " << mmgMesh->prism[i].v[3] << " " << mmgMesh->prism[i].v[4] << " " << mmgMesh->prism[i].v[5] << std::endl;
-  
-        face0.insert(mmgMesh->prism[i].v[0]);
-        face0.insert(mmgMesh->prism[i].v[2]);
-        face0.insert(mmgMesh->prism[i].v[1]);
-        
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
+        std::cout << "Error :: " << nunmatched_tot << " faces with a single element and no boundary face are written with reference 0." << std::endl;
+    }
     
-        if(faces.count(face0) != 1 )
-        {
-            faces.insert(face0);
-            facemap[face0]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face0]] = mmgMesh->ne+i-1;
-            faces.erase(face0);
-            facemap.erase(face0);
-        }
-        
-        
-        face1.insert(mmgMesh->prism[i].v[3]);
-        face1.insert(mmgMesh->prism[i].v[4]);
-        face1.insert(mmgMesh->prism[i].v[5]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-        
-        
-        if(faces.count(face1) != 1)
-        {
-            faces.insert(face1);
-            facemap[face1]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[facemap[face1]]  = mmgMesh->ne+i-1;
-            faces.erase(face1);
-            facemap.erase(face1);
-        }
-        
-        // Quad faces //
-        qface0.insert(mmgMesh->prism[i].v[0]);
-        qface0.insert(mmgMesh->prism[i].v[2]);
-        qface0.insert(mmgMesh->prism[i].v[4]);
-        qface0.insert(mmgMesh->prism[i].v[3]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-        if( qfaces.count(qface0) != 1)
-        {
-            qfaces.insert(qface0);
-            qfacemap[qface0]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
-        }
-        else
-        {
-            rh[qfacemap[qface0]]  = mmgMesh->ne+i-1;
-            qfaces.erase(qface0);
-            qfacemap.erase(qface0);
-        }
-
-        qface1.insert(mmgMesh->prism[i].v[1]);
-        qface1.insert(mmgMesh->prism[i].v[5]);
-        qface1.insert(mmgMesh->prism[i].v[4]);
-        qface1.insert(mmgMesh->prism[i].v[2]);
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-        if( qfaces.count(qface1) != 1)
+    // All ranks agree on the boundary references and on the face offsets per zone.
+    std::vector<int> lrefs;
+    std::map<int,std::vector<int> >::iterator itb;
+    for(itb=ifn_bnd.begin();itb!=ifn_bnd.end();itb++)
+    {
+        lrefs.push_back(itb->first);
+    }
+    int nlrefs = lrefs.size();
+    std::vector<int> nrefs_r(world_size), rref_off(world_size,0);
+    MPI_Allgather(&nlrefs, 1, MPI_INT, &nrefs_r[0], 1, MPI_INT, comm);
+    for(int r=1;r<world_size;r++)
+    {
+        rref_off[r] = rref_off[r-1]+nrefs_r[r-1];
+    }
+    std::vector<int> allrefs(rref_off[world_size-1]+nrefs_r[world_size-1]+1);
+    lrefs.push_back(0);
+    MPI_Allgatherv(&lrefs[0], nlrefs, MPI_INT, &allrefs[0], &nrefs_r[0], &rref_off[0], MPI_INT, comm);
+    std::set<int> bcrefs(allrefs.begin(),allrefs.begin()+rref_off[world_size-1]+nrefs_r[world_size-1]);
+    std::vector<int> refs(bcrefs.begin(),bcrefs.end());
+    int nbo = refs.size();
+    
+    std::vector<gidx_t> nzone(nbo+1,0), zone_off(nbo+1,0), zone_tot(nbo+1,0);
+    nzone[0] = ifn_int.size()/8;
+    for(int q=0;q<nbo;q++)
+    {
+        if(ifn_bnd.find(refs[q])!=ifn_bnd.end())
         {
-            qfaces.insert(qface1);
-            qfacemap[qface1]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
+            nzone[q+1] = ifn_bnd[refs[q]].size()/8;
         }
-        else
+    }
+    MPI_Exscan(&nzone[0], &zone_off[0], nbo+1, MPI_GIDX, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        std::fill(zone_off.begin(),zone_off.end(),0);
+    }
+    MPI_Allreduce(&nzone[0], &zone_tot[0], nbo+1, MPI_GIDX, MPI_SUM, comm);
+    std::vector<gidx_t> zone_start(nbo+1,0);
+    for(int q=1;q<=nbo;q++)
+    {
+        zone_start[q] = zone_start[q-1]+zone_tot[q-1];
+    }
+    gidx_t nFaceGlob = zone_start[nbo]+zone_tot[nbo];
+    if(nFaceGlob > std::numeric_limits<int>::max())
+    {
+        if(world_rank == 0)
         {
-
-            rh[qfacemap[qface1]]  = mmgMesh->ne+i-1;
-            qfaces.erase(qface1);
-            qfacemap.erase(qface1);
+            std::cout << "Error :: " << nFaceGlob << " faces is more than WriteUS3DGridInParallel can number with int ids." << std::endl;
         }
-        
-        qface2.insert(mmgMesh->prism[i].v[0]);//1
-        qface2.insert(mmgMesh->prism[i].v[3]);//2
-        qface2.insert(mmgMesh->prism[i].v[5]);//5
-        qface2.insert(mmgMesh->prism[i].v[1]);//4
-        // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-        if( qfaces.count(qface2) != 1)
+        MPI_Abort(comm, 1);
+    }
+    
+    // Connectivity for conn_madam.h5. The face ids are 1-based and signed in ief, positive
+    // for the left element. Across a boundary face the neighbour is the ghost cell
+    // nElemGlob+(face id-number of interior faces), as in US3D. The [element, face in the
+    // element, signed face id, neighbour] records go to the rank that owns the element;
+    // the neighbour is 0 for the boundary faces and the ghost id is added on that rank,
+    // since it can go beyond the int range.
+    std::vector<gidx_t> el_offsets(world_size);
+    MPI_Allgather(&el_offset, 1, MPI_GIDX, &el_offsets[0], 1, MPI_GIDX, comm);
+    const int NE = 4;
+    std::vector<std::vector<int> > esend(world_size);
+    std::vector<gidx_t> ife_int(2*nzone[0]+1);
+    std::vector<std::vector<gidx_t> > ife_bnd(nbo);
+    for(int k=0;k<nzone[0];k++)
+    {
+        int F  = int(zone_off[0]+k+1);
+        int lh = fel_int[gidx_t(k)*4+0];
+        int rh = fel_int[gidx_t(k)*4+2];
+        int erec[2*NE] = {lh,fel_int[gidx_t(k)*4+1],F,rh+1,rh,fel_int[gidx_t(k)*4+3],-F,lh+1};
+        for(int h=0;h<2;h++)
         {
-            qfaces.insert(qface2);
-            qfacemap[qface2]=fid;
-            lh[fid] = mmgMesh->ne+i-1;
-            fid++;
+            int dest = std::upper_bound(&el_offsets[0],&el_offsets[0]+world_size,erec[h*NE])-&el_offsets[0]-1;
+            esend[dest].insert(esend[dest].end(),erec+h*NE,erec+h*NE+NE);
         }
-        else
+        ife_int[gidx_t(k)*2+0] = lh+1;
+        ife_int[gidx_t(k)*2+1] = rh+1;
+    }
+    for(int q=0;q<nbo;q++)
+    {
+        for(int k=0;k<nzone[q+1];k++)
         {
-
-            rh[qfacemap[qface2]] = mmgMesh->ne+i-1;
-            qfaces.erase(qface2);
-            qfacemap.erase(qface2);
+            int F     = int(zone_start[q+1]+zone_off[q+1]+k+1);
+            int lh    = fel_bnd[refs[q]][gidx_t(k)*2+0];
+            gidx_t ghost = nElemGlob+F-zone_tot[0];
+            int erec[NE] = {lh,fel_bnd[refs[q]][gidx_t(k)*2+1],F,0};
+            int dest = std::upper_bound(&el_offsets[0],&el_offsets[0]+world_size,lh)-&el_offsets[0]-1;
+            esend[dest].insert(esend[dest].end(),erec,erec+NE);
+            ife_bnd[q].push_back(lh+1);
+            ife_bnd[q].push_back(ghost);
         }
-        
-        face0.clear();
-        face1.clear();
-        qface0.clear();
-        qface1.clear();
-        qface2.clear();
-         
     }
+    std::vector<int>().swap(fel_int);
+    fel_bnd.clear();
     
-    //====================================================================================
-    //====================================================================================
-    dimsf[0] = adapt_iet->getNrow();
-    dimsf[1] = adapt_iet->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
-
-    dset_id = H5Dcreate(file_id, "iet", H5T_NATIVE_INT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace = H5Screate_simple(2, count, NULL);
-
-    filespace = H5Dget_space(dset_id);
-    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_iet->data);
-    delete adapt_iet;
-    //====================================================================================
-    //====================================================================================
-
-    std::cout << "AND WE ARE DONE COUNTING " << std::endl;
-    
-    int ftot = 0;
-    std::map<int,int> new2old;
-//
-    std::map<int,int>::iterator itm;
-    int it;
-    for(itm=lh.begin();itm!=lh.end();itm++)
+    std::vector<int> esbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        scnt[r] = esend[r].size()/NE;
+        soff[r] = esbuf.size()/NE;
+        esbuf.insert(esbuf.end(),esend[r].begin(),esend[r].end());
+        std::vector<int>().swap(esend[r]);
+    }
+    esbuf.resize(esbuf.size()+NE);
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    for(int r=1;r<world_size;r++)
     {
-        it = itm->first;
-        if(rh.find(it)!=rh.end())
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    MPI_Datatype erec_type;
+    MPI_Type_contiguous(NE, MPI_INT, &erec_type);
+    MPI_Type_commit(&erec_type);
+    int nerec = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> erbuf((gidx_t(nerec)+1)*NE);
+    MPI_Alltoallv(&esbuf[0], &scnt[0], &soff[0], erec_type,
+                  &erbuf[0], &rcnt[0], &roff[0], erec_type, comm);
+    MPI_Type_free(&erec_type);
+    std::vector<int>().swap(esbuf);
+    
+    // ien holds up to 8 vertices and ief/iee up to 6 faces per element after the count.
+    // On the MMG path rank 0 holds all elements, so the sizes and offsets are gidx_t.
+    std::vector<int> ien(gidx_t(nElem)*9+1,0), ief(gidx_t(nElem)*7+1,0);
+    std::vector<gidx_t> iee(gidx_t(nElem)*7+1,0);
+    for(int e=0;e<nElem;e++)
+    {
+        gidx_t e9 = gidx_t(e)*9;
+        gidx_t e7 = gidx_t(e)*7;
+        int nv = (e<nTet) ? 4 : 6;
+        ien[e9] = nv;
+        for(int s=0;s<nv;s++)
         {
-            new2old[it] = ftot;
-            ftot++;
+            ien[e9+1+s] = (e<nTet) ? dm->tetra[gidx_t(e)*4+s]+1 : dm->prism[gidx_t(e-nTet)*6+s]+1;
         }
+        ief[e7] = (e<nTet) ? 4 : 5;
+        iee[e7] = ief[e7];
+    }
+    for(int k=0;k<nerec;k++)
+    {
+        const int* E = &erbuf[gidx_t(k)*NE];
+        gidx_t e7 = (E[0]-el_offset)*7;
+        int f = E[1];
+        ief[e7+1+f] = E[2];
+        iee[e7+1+f] = (E[3] > 0) ? E[3] : nElemGlob+E[2]-zone_tot[0];
+    }
+    std::vector<int>().swap(erbuf);
+    
+    // The vertices go to the rank of their block in xcn.
+    int nVerts = dm->nVertGlob;
+    ParallelState* v_pstate = new ParallelState(nVerts,comm);
+    gidx_t* v_offsets = v_pstate->getOffsets();
+    std::vector<std::vector<double> > vsend(world_size);
+    std::vector<int> vscnt(world_size,0), vsoff(world_size,0), vrcnt(world_size), vroff(world_size,0);
+    for(int v=0;v<dm->vgid.size();v++)
+    {
+        int dest = std::upper_bound(v_offsets,v_offsets+world_size,dm->vgid[v])-v_offsets-1;
+        vsend[dest].push_back(dm->vgid[v]);
+        vsend[dest].insert(vsend[dest].end(),&dm->xcn[gidx_t(v)*3],&dm->xcn[gidx_t(v)*3]+3);
+    }
+    std::vector<double> vsbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        vscnt[r] = vsend[r].size();
+        vsoff[r] = vsbuf.size();
+        vsbuf.insert(vsbuf.end(),vsend[r].begin(),vsend[r].end());
+    }
+    vsbuf.push_back(0.0);
+    MPI_Alltoall(&vscnt[0], 1, MPI_INT, &vrcnt[0], 1, MPI_INT, comm);
+    for(int r=1;r<world_size;r++)
+    {
+        vroff[r] = vroff[r-1]+vrcnt[r-1];
+    }
+    std::vector<double> vrbuf(vroff[world_size-1]+vrcnt[world_size-1]+1);
+    MPI_Alltoallv(&vsbuf[0], &vscnt[0], &vsoff[0], MPI_DOUBLE,
+                  &vrbuf[0], &vrcnt[0], &vroff[0], MPI_DOUBLE, comm);
+    int nv_loc = v_pstate->getNloc(world_rank);
+    int v0     = int(v_offsets[world_rank]);
+    std::vector<double> xcn_blk(nv_loc*3+1,0.0);
+    for(int k=0;k<(vroff[world_size-1]+vrcnt[world_size-1])/4;k++)
+    {
+        int lv = int(vrbuf[k*4])-v0;
+        xcn_blk[lv*3+0] = vrbuf[k*4+1];
+        xcn_blk[lv*3+1] = vrbuf[k*4+2];
+        xcn_blk[lv*3+2] = vrbuf[k*4+3];
     }
     
-    std::cout << "AND WE ARE DONE DETERMINING THE ORDER" << std::endl;
-    std::cout << "Starting creating massive array" << std::endl;
-
-    Array<int>* adapt_ifn = new Array<int>(fid,8);
-    std::cout << "Finished creating massive array" << std::endl;
-
-    faces.clear();
-    qfaces.clear();
-    facemap.clear();
-    qfacemap.clear();
-    
-    fid = 0;
-    int idx = 0;
-    std::map<std::set<int>,int> bctFace2lh;
-    std::map<std::set<int>,int> bcqFace2lh;
-     for(int i=1;i<=mmgMesh->ne;i++)
-     {
-         //adapt_iet->setVal(i-1,0,2); // Element type = 2 since we are dealing with tetrahedra.
-         
-         face0.insert(mmgMesh->tetra[i].v[1]);
-         face0.insert(mmgMesh->tetra[i].v[2]);
-         face0.insert(mmgMesh->tetra[i].v[3]);
-         
-         if(faces.count(face0) != 1 )
-         {
-             faces.insert(face0);
-             //facemap[face0]=fid;
-
-             if(bfaces.find(face0)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face0];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->tetra[i].v[1];
-                 bctria[1] = mmgMesh->tetra[i].v[2];
-                 bctria[2] = mmgMesh->tetra[i].v[3];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face0]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[1]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[2]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[3]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             fid++;
-         }
-         else
-         {
-             faces.erase(face0);
-         }
-         
-         face1.insert(mmgMesh->tetra[i].v[0]);
-         face1.insert(mmgMesh->tetra[i].v[2]);
-         face1.insert(mmgMesh->tetra[i].v[3]);
-         
-         if(faces.count(face1) != 1)
-         {
-             faces.insert(face1);
-             //facemap[face1]=fid;
-
-             if(bfaces.find(face1)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face1];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->tetra[i].v[0];
-                 bctria[1] = mmgMesh->tetra[i].v[3];
-                 bctria[2] = mmgMesh->tetra[i].v[2];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face1]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[3]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[2]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             
-             fid++;
-         }
-         else
-         {
-             faces.erase(face1);
-         }
-         
-         
-         face2.insert(mmgMesh->tetra[i].v[0]);
-         face2.insert(mmgMesh->tetra[i].v[3]);
-         face2.insert(mmgMesh->tetra[i].v[1]);
-         
-         
-         
-         
-         if( faces.count(face2) != 1)
-         {
-             faces.insert(face2);
-             //facemap[face2]=fid;
-
-             if(bfaces.find(face2)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face2];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->tetra[i].v[0];
-                 bctria[1] = mmgMesh->tetra[i].v[1];
-                 bctria[2] = mmgMesh->tetra[i].v[3];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face2]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[1]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[3]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-                         
-             fid++;
-         }
-         else
-         {
-             faces.erase(face2);
-         }
-         
-         face3.insert(mmgMesh->tetra[i].v[0]);
-         face3.insert(mmgMesh->tetra[i].v[2]);
-         face3.insert(mmgMesh->tetra[i].v[1]);
-         
-         
-         if( faces.count(face3) != 1)
-         {
-             faces.insert(face3);
-             
-             //facemap[face3]=fid;
-             
-             if(bfaces.find(face3)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face3];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->tetra[i].v[0];
-                 bctria[1] = mmgMesh->tetra[i].v[2];
-                 bctria[2] = mmgMesh->tetra[i].v[1];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face3]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->tetra[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->tetra[i].v[2]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->tetra[i].v[1]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             fid++;
-         }
-         else
-         {
-             faces.erase(face3);
-         }
-         
-         
-         face0.clear();
-         face1.clear();
-         face2.clear();
-         face3.clear();
-         
-     }
-     
-     
-
-     for(int i=1;i<=mmgMesh->nprism;i++)
-     {
-         //adapt_iet->setVal(mmgMesh->ne+i-1,0,6); // Element type = 6 since we are dealing with prisms.
-                // std::cout  << "Prism ["<<i<<"]=" << mmgMesh->prism[i].v[0] << " " << mmgMesh->prism[i].v[1] << " " << mmgMesh->prism[i].v[2] << " " << mmgMesh->prism[i].v[3] << " " << mmgMesh->prism[i].v[4] << " " << mmgMesh->prism[i].v[5] << std::endl;
-   
-         face0.insert(mmgMesh->prism[i].v[0]);
-         face0.insert(mmgMesh->prism[i].v[2]);
-         face0.insert(mmgMesh->prism[i].v[1]);
-         
-         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-     
-         if(faces.count(face0) != 1 )
-         {
-             faces.insert(face0);
-             //facemap[face0]=fid;
-             if(bfaces.find(face0)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face0];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->prism[i].v[0];
-                 bctria[1] = mmgMesh->prism[i].v[1];
-                 bctria[2] = mmgMesh->prism[i].v[2];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face0]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[1]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[2]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             
-             fid++;
-
-         }
-         else
-         {
-             faces.erase(face0);
-         }
-         
-         face1.insert(mmgMesh->prism[i].v[3]);
-         face1.insert(mmgMesh->prism[i].v[4]);
-         face1.insert(mmgMesh->prism[i].v[5]);
-         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-         
-         
-         if(faces.count(face1) != 1)
-         {
-             faces.insert(face1);
-             //facemap[face1]=fid;
-             if(bfaces.find(face1)!=bfaces.end())
-             {
-                 int refe = btfaces_Ref[face1];
-                 std::vector<int> bctria(3);
-                 bctria[0] = mmgMesh->prism[i].v[3];
-                 bctria[1] = mmgMesh->prism[i].v[5];
-                 bctria[2] = mmgMesh->prism[i].v[4];
-                 bctrias[refe].push_back(bctria);
-                 bctFace2lh[face1]=lh[fid];
-                 bf++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,3);
-                 adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[3]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[4]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[5]);
-                 adapt_ifn->setVal(idx,4,0);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             
-             fid++;
-         }
-         else
-         {
-             faces.erase(face1);
-         }
-         
-         // Quad faces //
-         qface0.insert(mmgMesh->prism[i].v[0]);
-         qface0.insert(mmgMesh->prism[i].v[2]);
-         qface0.insert(mmgMesh->prism[i].v[4]);
-         qface0.insert(mmgMesh->prism[i].v[3]);
-         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-         if( qfaces.count(qface0) != 1)
-         {
-             qfaces.insert(qface0);
-             //qfacemap[qface0]=fid;
-             if(bqfaces.find(qface0)!=bqfaces.end())
-             {
-                 int refe = bqfaces_Ref[qface0];
-                 std::vector<int> bcquad(4);
-                 bcquad[0] = mmgMesh->prism[i].v[0];
-                 bcquad[1] = mmgMesh->prism[i].v[2];
-                 bcquad[2] = mmgMesh->prism[i].v[4];
-                 bcquad[3] = mmgMesh->prism[i].v[3];
-                 bcquads[refe].push_back(bcquad);
-                 bcqFace2lh[qface0]=lh[fid];
-                 bq++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,4);
-                 adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[2]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[4]);
-                 adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[3]);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             
-             fid++;
-         }
-         else
-         {
-             qfaces.erase(qface0);
-         }
-
-         qface1.insert(mmgMesh->prism[i].v[1]);
-         qface1.insert(mmgMesh->prism[i].v[5]);
-         qface1.insert(mmgMesh->prism[i].v[4]);
-         qface1.insert(mmgMesh->prism[i].v[2]);
-         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-         if( qfaces.count(qface1) != 1)
-         {
-             qfaces.insert(qface1);
-             //qfacemap[qface1]=fid;
-             if(bqfaces.find(qface1)!=bqfaces.end())
-             {
-                 int refe = bqfaces_Ref[qface1];
-                 std::vector<int> bcquad(4);
-                 bcquad[0] = mmgMesh->prism[i].v[1];
-                 bcquad[1] = mmgMesh->prism[i].v[5];
-                 bcquad[2] = mmgMesh->prism[i].v[4];
-                 bcquad[3] = mmgMesh->prism[i].v[2];
-                 bcquads[refe].push_back(bcquad);
-                 bcqFace2lh[qface1]=lh[fid];
-                 bq++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,4);
-                 adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[1]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[5]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[4]);
-                 adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[2]);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             fid++;
-
-         }
-         else
-         {
-             qfaces.erase(qface1);
-         }
-         
-         
-         qface2.insert(mmgMesh->prism[i].v[0]);//1
-         qface2.insert(mmgMesh->prism[i].v[3]);//2
-         qface2.insert(mmgMesh->prism[i].v[5]);//5
-         qface2.insert(mmgMesh->prism[i].v[1]);//4
-         // local face2vert_map for a prism in mmg {0,1,2,0},{3,5,4,3},{1,4,5,2},{0,2,5,3},{0,3,4,1} };
-
-         if( qfaces.count(qface2) != 1)
-         {
-             qfaces.insert(qface2);
-             //qfacemap[qface2]=fid;
-             if(bqfaces.find(qface2)!=bqfaces.end())
-             {
-                 int refe = bqfaces_Ref[qface2];
-                 std::vector<int> bcquad(4);
-                 bcquad[0] = mmgMesh->prism[i].v[0];
-                 bcquad[1] = mmgMesh->prism[i].v[3];
-                 bcquad[2] = mmgMesh->prism[i].v[5];
-                 bcquad[3] = mmgMesh->prism[i].v[1];
-                 bcquads[refe].push_back(bcquad);
-                 bcqFace2lh[qface2]=lh[fid];
-                 bq++;
-             }
-             else
-             {
-                 idx = new2old[fid];
-                 adapt_ifn->setVal(idx,0,4);
-                 adapt_ifn->setVal(idx,1,mmgMesh->prism[i].v[0]);
-                 adapt_ifn->setVal(idx,2,mmgMesh->prism[i].v[3]);
-                 adapt_ifn->setVal(idx,3,mmgMesh->prism[i].v[5]);
-                 adapt_ifn->setVal(idx,4,mmgMesh->prism[i].v[1]);
-                 adapt_ifn->setVal(idx,5,rh[fid]+1);
-                 adapt_ifn->setVal(idx,6,lh[fid]+1);
-                 adapt_ifn->setVal(idx,7,2);
-                 //idx++;
-             }
-             
-             fid++;
-         }
-         else
-         {
-             qfaces.erase(qface2);
-         }
-         
-         face0.clear();
-         face1.clear();
-         qface0.clear();
-         qface1.clear();
-         qface2.clear();
-          
-     }
-     
-     
-     
-     
-    faces.clear();
-    qfaces.clear();
-    
-    
-    //====================================================================================
-    //====================================================================================
-    //MMG3D_Free_allSols(mmgMesh,&mmgSol);
-    MMG3D_Free_all(MMG5_ARG_start,
-                   MMG5_ARG_ppMesh,&mmgMesh,MMG5_ARG_ppSols,&mmgSol,
-                   MMG5_ARG_end);
-    //====================================================================================
-    //====================================================================================
-    Array<int>* zdefs = us3d->zdefs;
-    int bc_id = 0;
-    int gaa   = 0;
-    int typef3 = 0;
-    int typef4 = 0;
-    
-    std::cout << "-- Adding the interior faces to the new ifn array... face2node.size() -> " << " " << lh.size() << " " << rh.size() <<std::endl;
-    int ty=0;
-    int counte;
-
+    std::vector<int> iet(nElem+1);
+    for(int e=0;e<nElem;e++)
+    {
+        iet[e] = (e<nTet) ? 2 : 6; // 2 for tetrahedra, 6 for prisms.
+    }
     
-
-    std::map<int,std::vector<int> >::iterator it_bref;
-    int faceid;
-    std::set<int> iface;
-    int nbound = 0;
-    int fa=0;
-    std::cout << "-- Adding the boundary faces to the new ifn array..."<<std::endl;
-    std::map<int,std::vector<std::vector<int> > >::iterator iterbc;
-    int t = ftot;
-    for(iterbc=bctrias.begin();iterbc!=bctrias.end();iterbc++)
+    // HDF5 is used by one rank at a time: rank 0 creates the file and the datasets and the
+    // other ranks add their rows in rank order.
+    if(world_rank == 0)
     {
-        int bnd_id     = iterbc->first;
-        int Ntris      = iterbc->second.size();
-        int Nquads     = bcquads[bnd_id].size();
-        std::cout << "bnd ref test = " << bnd_id << " " << Ntris << " " << Nquads << std::endl;
+        std::cout<<"-- Writing in HDF5 format..."<<std::endl;
+        hid_t file_id = H5Fcreate("grid_madam.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        
+        hsize_t dimsf_att = 1;
+        hid_t att_space = H5Screate_simple(1, &dimsf_att, NULL);
+        hid_t type =  H5Tcopy (H5T_C_S1);
+        H5Tset_size (type, 14);
+        H5Tset_strpad(type,H5T_STR_SPACEPAD);
+        hid_t attr_id = H5Acreate (file_id, "filetype", type, att_space, H5P_DEFAULT, H5P_DEFAULT);
+        char stri[] = "US3D Grid File";
+        H5Awrite(attr_id, type, &stri);
+        H5Aclose(attr_id);
+        hid_t type2 =  H5Tcopy (H5T_C_S1);
+        H5Tset_size (type2, 5);
+        H5Tset_strpad(type2,H5T_STR_SPACEPAD);
+        attr_id = H5Acreate (file_id, "filevers", type2, att_space, H5P_DEFAULT, H5P_DEFAULT);
+        char stri2[] = "1.1.8";
+        H5Awrite(attr_id, type2, &stri2);
+        H5Aclose(attr_id);
+        
+        // The integer datasets are stored as int32 unless their largest id needs int64.
+        gidx_t nghost = nFaceGlob-zone_tot[0];
+        CreateDataSet(file_id, "xcn", H5T_NATIVE_DOUBLE, nVerts, 3, deflate);
+        CreateDataSet(file_id, "iet", IntegerFileType(6), nElemGlob, 1, deflate);
+        CreateDataSet(file_id, "ifn", IntegerFileType(std::max(gidx_t(nVerts),nElemGlob)), nFaceGlob, 8, deflate);
+        H5Fclose(file_id);
+        
+        // conn_madam.h5 has the connectivity that ReadUS3DData reads from the conn file.
+        file_id = H5Fcreate("conn_madam.h5", H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        CreateDataSet(file_id, "ien", IntegerFileType(nVerts), nElemGlob, 9, deflate);
+        CreateDataSet(file_id, "ief", IntegerFileType(nFaceGlob), nElemGlob, 7, deflate);
+        CreateDataSet(file_id, "iee", IntegerFileType(nElemGlob+nghost), nElemGlob, 7, deflate);
+        CreateDataSet(file_id, "ife", IntegerFileType(nElemGlob+nghost), nFaceGlob, 2, deflate);
+        H5Fclose(file_id);
     }
-    int lhi;
-    for(iterbc=bctrias.begin();iterbc!=bctrias.end();iterbc++)
+    
+    for(int r=0;r<world_size;r++)
     {
-        int bnd_id     = iterbc->first;
-        int Ntris      = iterbc->second.size();
-        int Nquads     = bcquads[bnd_id].size();
-        
-        //std::cout << "bnd ref = " << bnd_id << " " << Ntris << " " << Nquads << std::endl;
-        
-        for(int q=0;q<Ntris;q++)
-        {
-            //faceid = ref2bface[bnd_id][q];
-            adapt_ifn->setVal(t,0,3);
-            adapt_ifn->setVal(t,1,iterbc->second[q][0]);
-            adapt_ifn->setVal(t,2,iterbc->second[q][1]);
-            adapt_ifn->setVal(t,3,iterbc->second[q][2]);
-            adapt_ifn->setVal(t,4,0);
-            iface.insert(iterbc->second[q][0]);
-            iface.insert(iterbc->second[q][1]);
-            iface.insert(iterbc->second[q][2]);
-            
-            //std::cout << "3 bc row = " << t << " " << mmgMesh->tria[faceid].v[0] << " " << mmgMesh->tria[faceid].v[1] << " " << mmgMesh->tria[faceid].v[2] << std::endl;
-
-            //fid=facemap[iface];
-            lhi = bctFace2lh[iface];
-            adapt_ifn->setVal(t,5,0);
-            adapt_ifn->setVal(t,6,lhi+1);
-            //adapt_ifn->setVal(t,7,us3d->zdefs->getVal(3+bnd_id-1,5));
-            adapt_ifn->setVal(t,7,bnd_id);
-
-            iface.clear();
-            t++;
-        }
-        for(int q=0;q<Nquads;q++)
-        {
-            //faceid = ref2bqface[bnd_id][q];
-            adapt_ifn->setVal(t,0,4);
-            adapt_ifn->setVal(t,1,bcquads[bnd_id][q][0]);
-            adapt_ifn->setVal(t,2,bcquads[bnd_id][q][1]);
-            adapt_ifn->setVal(t,3,bcquads[bnd_id][q][2]);
-            adapt_ifn->setVal(t,4,bcquads[bnd_id][q][3]);
-            iface.insert(bcquads[bnd_id][q][0]);
-            iface.insert(bcquads[bnd_id][q][1]);
-            iface.insert(bcquads[bnd_id][q][2]);
-            iface.insert(bcquads[bnd_id][q][3]);
-                        
-            //fid=qfacemap[iface];
-            lhi = bcqFace2lh[iface];
-            adapt_ifn->setVal(t,5,0);
-            adapt_ifn->setVal(t,6,lhi+1);
-            adapt_ifn->setVal(t,7,bnd_id);
-            iface.clear();
+        if(world_rank == r)
+        {
+            hid_t file_id = H5Fopen("grid_madam.h5", H5F_ACC_RDWR, H5P_DEFAULT);
+            hid_t dset_id = H5Dopen(file_id, "xcn", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_DOUBLE, v0, nv_loc, 3, &xcn_blk[0]);
+            H5Dclose(dset_id);
+            dset_id = H5Dopen(file_id, "iet", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT, el_offset, nElem, 1, &iet[0]);
+            H5Dclose(dset_id);
+            dset_id = H5Dopen(file_id, "ifn", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT, zone_off[0], nzone[0], 8, &ifn_int[0]);
+            for(int q=0;q<nbo;q++)
+            {
+                if(nzone[q+1] > 0)
+                {
+                    WriteRowsToDataSet(dset_id, H5T_NATIVE_INT, zone_start[q+1]+zone_off[q+1], nzone[q+1], 8, &ifn_bnd[refs[q]][0]);
+                }
+            }
+            H5Dclose(dset_id);
+            H5Fclose(file_id);
             
-            t++;
+            file_id = H5Fopen("conn_madam.h5", H5F_ACC_RDWR, H5P_DEFAULT);
+            dset_id = H5Dopen(file_id, "ien", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT, el_offset, nElem, 9, &ien[0]);
+            H5Dclose(dset_id);
+            dset_id = H5Dopen(file_id, "ief", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT, el_offset, nElem, 7, &ief[0]);
+            H5Dclose(dset_id);
+            dset_id = H5Dopen(file_id, "iee", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT64, el_offset, nElem, 7, &iee[0]);
+            H5Dclose(dset_id);
+            dset_id = H5Dopen(file_id, "ife", H5P_DEFAULT);
+            WriteRowsToDataSet(dset_id, H5T_NATIVE_INT64, zone_off[0], nzone[0], 2, &ife_int[0]);
+            for(int q=0;q<nbo;q++)
+            {
+                if(nzone[q+1] > 0)
+                {
+                    WriteRowsToDataSet(dset_id, H5T_NATIVE_INT64, zone_start[q+1]+zone_off[q+1], nzone[q+1], 2, &ife_bnd[q][0]);
+                }
+            }
+            H5Dclose(dset_id);
+            H5Fclose(file_id);
         }
+        MPI_Barrier(comm);
     }
     
-    //std::cout << "-- sizing2 -> " << lh.size() << " " << rh.size() << " " << t << " " << ty <<std::endl;
-    
-
-    int nbo = bcrefs.size();
-    std::cout << "-- Constructing the zdefs array..."<<std::endl;
-    Array<int>* adapt_zdefs = new Array<int>(3+nbo,7);
-    std::cout << "faces.size()+qfaces.size()-bfaces.size()-bqfaces.size() " << faces.size() << " " << qfaces.size() << " " << bfaces.size() << " " << bqfaces.size() << std::endl;
-    // Collect node data (10) . Starting index-ending index Nodes
-    adapt_zdefs->setVal(0,0,10);
-    adapt_zdefs->setVal(0,1,-1);
-    adapt_zdefs->setVal(0,2,1);
-    adapt_zdefs->setVal(0,3,1);
-    adapt_zdefs->setVal(0,4,nVerts);
-    adapt_zdefs->setVal(0,5,us3d->zdefs->getVal(0,5));
-    adapt_zdefs->setVal(0,6,us3d->zdefs->getVal(0,6));
-    // Collect element data (12) . Starting index-ending index Element
-    adapt_zdefs->setVal(1,0,12);
-    adapt_zdefs->setVal(1,1,-1);
-    adapt_zdefs->setVal(1,2,2);
-    adapt_zdefs->setVal(1,3,1);
-    adapt_zdefs->setVal(1,4,nTet+nPrism);
-    adapt_zdefs->setVal(1,5,us3d->zdefs->getVal(1,5));
-    adapt_zdefs->setVal(1,6,2);
-    // Collect internal face data (13) . Starting index-ending index internal face.
-    adapt_zdefs->setVal(2,0,13);
-    adapt_zdefs->setVal(2,1,-1);
-    adapt_zdefs->setVal(2,2, 3);
-    adapt_zdefs->setVal(2,3, 1);
-    adapt_zdefs->setVal(2,4,lh.size()-bfaces.size()-bqfaces.size());
-    adapt_zdefs->setVal(2,5,us3d->zdefs->getVal(2,5));
-    adapt_zdefs->setVal(2,6,2);
-    // Collect boundary face data (13) . Starting index-ending index boundary face for each boundary ID.
-    int q  = 1;
-    int nb = 0;
-    int face_start = lh.size()-bfaces.size()-bqfaces.size()+1;
-    int face_end;
-    std::set<int>::iterator itr;
-    for(itr=bcrefs.begin();itr!=bcrefs.end();itr++)
+    // The grid info and the zones are added by rank 0.
+    if(world_rank == 0)
     {
-        int bnd_ref = *itr;
-        face_end = face_start+bnd_Ntri[bnd_ref]+bnd_Nquad[bnd_ref]-1;
-        adapt_zdefs->setVal(3+nb,0,13);
-        adapt_zdefs->setVal(3+nb,1,-1);
-        adapt_zdefs->setVal(3+nb,2,3+q);
-        adapt_zdefs->setVal(3+nb,3,face_start);
-        adapt_zdefs->setVal(3+nb,4,face_end);
-        adapt_zdefs->setVal(3+nb,5,bnd_ref);
-        adapt_zdefs->setVal(3+nb,6,2);
-        //std::cout << "us3d->zdefs->getVal(3+nb,5) " << us3d->zdefs->getVal(3+nb,5) << std::endl;
-        face_start = face_end+1;
-        //std::cout << "nb  = " << nb << " " << ref2bface.size() << " " << ref2bqface.size() << std::endl;
-        nb++;
-        q++;
+        hid_t file_id = H5Fopen("grid_madam.h5", H5F_ACC_RDWR, H5P_DEFAULT);
+        
+        Array<int>* adapt_zdefs = new Array<int>(3+nbo,7);
+        // Collect node data (10) . Starting index-ending index Nodes
+        adapt_zdefs->setVal(0,0,10);
+        adapt_zdefs->setVal(0,1,-1);
+        adapt_zdefs->setVal(0,2,1);
+        adapt_zdefs->setVal(0,3,1);
+        adapt_zdefs->setVal(0,4,nVerts);
+        adapt_zdefs->setVal(0,5,us3d->zdefs->getVal(0,5));
+        adapt_zdefs->setVal(0,6,us3d->zdefs->getVal(0,6));
+        // Collect element data (12) . Starting index-ending index Element
+        adapt_zdefs->setVal(1,0,12);
+        adapt_zdefs->setVal(1,1,-1);
+        adapt_zdefs->setVal(1,2,2);
+        adapt_zdefs->setVal(1,3,1);
+        adapt_zdefs->setVal(1,4,int(nElemGlob));
+        adapt_zdefs->setVal(1,5,us3d->zdefs->getVal(1,5));
+        adapt_zdefs->setVal(1,6,2);
+        // Collect internal face data (13) . Starting index-ending index internal face.
+        adapt_zdefs->setVal(2,0,13);
+        adapt_zdefs->setVal(2,1,-1);
+        adapt_zdefs->setVal(2,2, 3);
+        adapt_zdefs->setVal(2,3, 1);
+        adapt_zdefs->setVal(2,4,int(zone_tot[0]));
+        adapt_zdefs->setVal(2,5,us3d->zdefs->getVal(2,5));
+        adapt_zdefs->setVal(2,6,2);
+        // Collect boundary face data (13) . Starting index-ending index boundary face for each boundary ID.
+        for(int q=0;q<nbo;q++)
+        {
+            adapt_zdefs->setVal(3+q,0,13);
+            adapt_zdefs->setVal(3+q,1,-1);
+            adapt_zdefs->setVal(3+q,2,4+q);
+            adapt_zdefs->setVal(3+q,3,int(zone_start[q+1]+1));
+            adapt_zdefs->setVal(3+q,4,int(zone_start[q+1]+zone_tot[q+1]));
+            adapt_zdefs->setVal(3+q,5,refs[q]);
+            adapt_zdefs->setVal(3+q,6,2);
+        }
+        
+        hid_t group_info_id  = H5Gcreate(file_id, "info", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+        hsize_t dimsf_att = 1;
+        hid_t att_space = H5Screate_simple(1, &dimsf_att, NULL);
+        hid_t type3 =  H5Tcopy (H5T_C_S1);
+        H5Tset_size (type3, 10);
+        H5Tset_strpad(type3,H5T_STR_SPACEPAD);
+        hid_t attr_id = H5Acreate (group_info_id, "date", type3, att_space, H5P_DEFAULT, H5P_DEFAULT);
+        char stri3[] = "27-05-1987";
+        H5Awrite(attr_id, type3, &stri3);
+        H5Aclose(attr_id);
+        
+        hid_t group_grid_id  = H5Gcreate(group_info_id, "grid", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+        int values[4] = {int(nElemGlob), int(nFaceGlob), int(nFaceGlob-zone_tot[0]), nVerts};
+        const char* names[4] = {"nc","nf","ng","nn"};
+        for(int k=0;k<4;k++)
+        {
+            attr_id = H5Acreate (group_grid_id, names[k], H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
+            H5Awrite(attr_id, H5T_NATIVE_INT, &values[k]);
+            H5Aclose(attr_id);
+        }
+        
+        hid_t group_zones_id  = H5Gcreate(file_id, "zones", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
+        attr_id = H5Acreate (group_zones_id, "nz", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
+        int value = 3+nbo;
+        H5Awrite(attr_id, H5T_NATIVE_INT, &value);
+        H5Aclose(attr_id);
+        
+        hsize_t dimsf[2];
+        dimsf[0] = adapt_zdefs->getNrow();
+        dimsf[1] = adapt_zdefs->getNcol();
+        hid_t filespace = H5Screate_simple(2, dimsf, NULL);
+        hid_t dset_zdefs_id = H5Dcreate(group_zones_id, "zdefs", H5T_NATIVE_INT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Dwrite(dset_zdefs_id, H5T_NATIVE_INT, H5S_ALL, H5S_ALL, H5P_DEFAULT, adapt_zdefs->data);
+        H5Dclose(dset_zdefs_id);
+        H5Sclose(filespace);
+        
+        dimsf_att = us3d->znames->getNrow();
+        filespace = H5Screate_simple(1, &dimsf_att, NULL);
+        hid_t type = H5Tcopy (H5T_C_S1);
+        H5Tset_size (type, 20);
+        H5Tset_strpad(type, H5T_STR_SPACEPAD);
+        hid_t dset_znames_id = H5Dcreate(group_zones_id, "znames", type, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        H5Dwrite(dset_znames_id, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, us3d->znames->data);
+        H5Dclose(dset_znames_id);
+        H5Sclose(filespace);
+        
+        H5Gclose(group_grid_id);
+        H5Gclose(group_info_id);
+        H5Gclose(group_zones_id);
+        H5Fclose(file_id);
+        
+        PlotBoundaryData(us3d->znames,adapt_zdefs);
+        delete adapt_zdefs;
     }
     
-    //std::cout << "elements = " << " " << mmgMesh->nprism << " " << mmgMesh->ne << std::endl;
-    std::cout << "lh vs rh = " << " " << lh.size() << " " << rh.size() << std::endl;
-    //std::cout << "-- sizingf -> " << lh.size() << " " << rh.size() << " " << t << " " << ty <<std::endl;
-
-    
-    
-    //====================================================================================
-    // Add ifn map to the grid.h5 file
-    //====================================================================================
-    
-    dimsf[0] = adapt_ifn->getNrow();
-    dimsf[1] = adapt_ifn->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
-    
-    dset_id = H5Dcreate(file_id, "ifn", H5T_NATIVE_DOUBLE, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);             // hyperslab selection parameters
-    count[0] = dimsf[0];
-    count[1] = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace = H5Screate_simple(2, count, NULL);
-
-    filespace = H5Dget_space(dset_id);
-    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_ifn->data);
-    
-    delete adapt_ifn;
-    
-    //====================================================================================
-
-    hid_t group_info_id  = H5Gcreate(file_id, "info", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-
-    hsize_t dimsf_att3 = 1;
-    att_space = H5Screate_simple(1, &dimsf_att3, NULL);
-    hid_t type3 =  H5Tcopy (H5T_C_S1);
-    ret = H5Tset_size (type3, 10);
-    ret = H5Tset_strpad(type3,H5T_STR_SPACEPAD);
-    attr_id   = H5Acreate (group_info_id, "date", type3, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    char stri3[] = "27-05-1987";
-    status = H5Awrite(attr_id, type3, &stri3);
-    H5Aclose(attr_id);
-    
-    hid_t group_grid_id  = H5Gcreate(group_info_id, "grid", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-    dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    attr_id   = H5Acreate (group_grid_id, "nc", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    int value = nTet+nPrism;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "nf", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = lh.size();
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "ng", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = bfaces.size()+bqfaces.size();
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    attr_id   = H5Acreate (group_grid_id, "nn", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = nVerts;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    
-    
-    
-    
-    // Create group;
-    //====================================================================================
-    hid_t group_zones_id  = H5Gcreate(file_id, "zones", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT );
-    // Add attribute to group:
-    //====================================================================================
-    dimsf_att = 1;
-    att_space = H5Screate_simple(1, &dimsf_att, NULL);
-    attr_id   = H5Acreate (group_zones_id, "nz", H5T_STD_I32BE, att_space, H5P_DEFAULT, H5P_DEFAULT);
-    value = 3+nbo;
-    status = H5Awrite(attr_id, H5T_NATIVE_INT, &value);
-    H5Aclose(attr_id);
-    //====================================================================================
-    
-    
-    // Add dataset to group:
-    //====================================================================================
-    dimsf[0] = adapt_zdefs->getNrow();
-    dimsf[1] = adapt_zdefs->getNcol();
-    filespace = H5Screate_simple(2, dimsf, NULL);
-    hid_t dset_zdefs_id = H5Dcreate(group_zones_id, "zdefs", H5T_NATIVE_INT, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    H5Sclose(filespace);
-    
-    count[0]  = dimsf[0];
-    count[1]  = dimsf[1];
-    offset[0] = 0;
-    offset[1] = 0;
-    memspace  = H5Screate_simple(2, count, NULL);
-    filespace = H5Dget_space(dset_zdefs_id);
-    
-    //H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL, count, NULL);
-
-    status = H5Dwrite(dset_zdefs_id, H5T_NATIVE_INT, memspace, filespace, plist_id, adapt_zdefs->data);
-    //====================================================================================
-    
-    dimsf_att = us3d->znames->getNrow();
-    filespace = H5Screate_simple(1, &dimsf_att, NULL);
-    type =  H5Tcopy (H5T_C_S1);
-    ret  = H5Tset_size (type, 20);
-    ret  = H5Tset_strpad(type, H5T_STR_SPACEPAD);
-    hid_t dset_znames_id = H5Dcreate(group_zones_id, "znames", type, filespace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
-    
-    H5Sclose(filespace);
-    
-    hsize_t cnt = us3d->znames->getNrow();
-    memspace  = H5Screate_simple(1, &cnt, NULL);
-    filespace = H5Dget_space(dset_znames_id);
-    
-    
-    status = H5Dwrite(dset_znames_id, type, memspace, filespace, plist_id, us3d->znames->data);
-
-    PlotBoundaryData(us3d->znames,adapt_zdefs);
-    
-    delete adapt_zdefs;
-    qfacemap.clear();
-    facemap.clear();
-    faces.clear();
-    qfaces.clear();
-    lh.clear();
-    rh.clear();
-    Nlh.clear();
-    Nrh.clear();
-    bctrias.clear();
-    bcquads.clear();
-    
+    delete v_pstate;
 }
 
 
 
 
-
-
-
 //US3D* ReadUS3DData(const char* fn_conn, const char* fn_grid, const char* fn_data, MPI_Comm comm, MPI_Info info)
 //{
 //    int size;
@@ -2627,6 +1101,44 @@ void WriteUS3DGridFromMMG_it0(MMG5_pMesh mmgMesh,MMG5_pSol mmgSol, US3D* us3d)
 //}
 
 
+ParArray<int>* ReadIntDataSetFromFileInParallel(const char* file_name, const char* dataset_name, MPI_Comm comm, MPI_Info info)
+{
+    hid_t file_id = H5Fopen(file_name, H5F_ACC_RDONLY, H5P_DEFAULT);
+    hid_t dset_id = H5Dopen(file_id, dataset_name, H5P_DEFAULT);
+    hid_t type_id = H5Dget_type(dset_id);
+    int is_int64  = (H5Tget_class(type_id) == H5T_INTEGER && H5Tget_size(type_id) > sizeof(int));
+    H5Tclose(type_id);
+    H5Dclose(dset_id);
+    H5Fclose(file_id);
+    
+    // int32 and the older double datasets are converted by HDF5 while reading.
+    if(!is_int64)
+    {
+        return ReadDataSetFromFileInParallel<int>(file_name,dataset_name,comm,info);
+    }
+    
+    ParArray<gidx_t>* PA64 = ReadDataSetFromFileInParallel<gidx_t>(file_name,dataset_name,comm,info);
+    int nloc = PA64->getNrow();
+    int ncol = PA64->getNcol();
+    ParArray<int>* PA = new ParArray<int>(PA64->getNglob(),ncol,comm);
+    for(gidx_t i=0;i<gidx_t(nloc)*ncol;i++)
+    {
+        gidx_t val = PA64->data[i];
+        if(val > std::numeric_limits<int>::max() || val < std::numeric_limits<int>::min())
+        {
+            std::cout << "Error :: " << dataset_name << " in " << file_name << " has the id " << val << " which does not fit in an int." << std::endl;
+            MPI_Abort(comm, 1);
+        }
+        PA->data[i] = int(val);
+    }
+    delete PA64;
+    
+    return PA;
+}
+
+
+
+
 US3D* ReadUS3DData(const char* fn_conn, const char* fn_grid, const char* fn_data, int readFromStats, MPI_Comm comm, MPI_Info info)
 {
     int size;
@@ -2637,12 +1149,12 @@ US3D* ReadUS3DData(const char* fn_conn, const char* fn_grid, const char* fn_data
     US3D* us3d = new US3D;
     ParArray<double>* xcn = ReadDataSetFromFileInParallel<double>(fn_grid,"xcn",comm,info);
     //std::cout << "Reading from :: " << fn_conn << std::endl;
-    ParArray<int>* ien = ReadDataSetFromFileInParallel<int>(fn_conn,"ien",comm,info);
-    ParArray<int>* ief = ReadDataSetFromFileInParallel<int>(fn_conn,"ief",comm,info);
-    ParArray<int>* iee = ReadDataSetFromFileInParallel<int>(fn_conn,"iee",comm,info);
-    ParArray<int>* iet = ReadDataSetFromFileInParallel<int>(fn_grid,"iet",comm,info);
-    ParArray<int>* ifn = ReadDataSetFromFileInParallel<int>(fn_grid,"ifn",comm,info);
-    ParArray<int>* ife = ReadDataSetFromFileInParallel<int>(fn_conn,"ife",comm,info);
+    ParArray<int>* ien = ReadIntDataSetFromFileInParallel(fn_conn,"ien",comm,info);
+    ParArray<int>* ief = ReadIntDataSetFromFileInParallel(fn_conn,"ief",comm,info);
+    ParArray<int>* iee = ReadIntDataSetFromFileInParallel(fn_conn,"iee",comm,info);
+    ParArray<int>* iet = ReadIntDataSetFromFileInParallel(fn_grid,"iet",comm,info);
+    ParArray<int>* ifn = ReadIntDataSetFromFileInParallel(fn_grid,"ifn",comm,info);
+    ParArray<int>* ife = ReadIntDataSetFromFileInParallel(fn_conn,"ife",comm,info);
 
     
     int Nel = ien->getNglob();
@@ -1,6 +1,7 @@
 #include "adapt.h"
 #include "adapt_array.h"
 #include "adapt_datatype.h"
+#include "adapt_datastruct.h"
 #ifndef ADAPT_IO_H
 #define ADAPT_IO_H
 
@@ -22,6 +23,11 @@ inline hid_t hid_from_type(const char &)
     return H5T_STRING;
 }
 
+inline hid_t hid_from_type(const gidx_t &)
+{
+    return H5T_NATIVE_INT64;
+}
+
 template <typename T>
 inline hid_t hid_from_type() {
     return hid_from_type(T());
@@ -368,13 +374,22 @@ ParArray<T>* ReadDataSetFromFileInParallel(const char* file_name, const char* da
     
     hsize_t dims[ndims];
     H5Sget_simple_extent_dims(dspace, dims, NULL);
-    int nrow                = dims[0];
+    gidx_t nrow             = dims[0];
     int ncol                = dims[1];
-    int N                   = nrow;
-    int nloc                = int(N/size) + ( rank < N%size );
+    gidx_t N                = nrow;
+    // The rows are numbered with int ids throughout.
+    if(N > std::numeric_limits<int>::max())
+    {
+        if(rank == 0)
+        {
+            std::cout << "Error :: " << dataset_name << " in " << file_name << " has " << N << " rows, more than the " << std::numeric_limits<int>::max() << " that an int id can address." << std::endl;
+        }
+        MPI_Abort(comm, 1);
+    }
+    int nloc                = int(N/size + ( rank < N%size ));
     //  compute offset of rows for each proc;
-    int offset              = rank*int(N/size) + MIN(rank, N%size);
-    ParArray<T>* PA         = new ParArray<T>(N,ncol,comm);
+    gidx_t offset           = rank*(N/size) + MIN(gidx_t(rank), N%size);
+    ParArray<T>* PA         = new ParArray<T>(int(N),ncol,comm);
     //ParArray<T>* parA     = new ParArray<T>(N,ncol,comm);
     //ParallelState* pstate = parA->getParallelState();
     
@@ -628,12 +643,30 @@ std::vector<double> ReadMetricInputs(const char* fn_metric);
 
 
 
-void WriteUS3DGridFromMMG_it0(MMG5_pMesh mmgMesh,MMG5_pSol mmgSol, US3D* us3d);
+// Returns the mesh of MMG on rank 0 as a DistributedMesh; the other ranks get an empty one.
+// With mmg_prisms the prisms follow the MMG numbering (vertex i+3 over vertex i), otherwise
+// the layout of the BL prisms of main.cpp. Triangles with reference 20 (BL shell) and quads
+// with reference 2 are left out.
+DistributedMesh* GetDistributedMeshFromMMG(MMG5_pMesh mmgMesh, int mmg_prisms, MPI_Comm comm);
 
-void WriteUS3DGridFromMMG_itN(MMG5_pMesh mmgMesh,MMG5_pSol mmgSol, US3D* us3d);
+// Writes the mesh of MMG on rank 0 to grid_madam.h5 through WriteUS3DGridInParallel, so the
+// faces are found by sorting instead of by face maps. Collective on comm.
+void WriteUS3DGridFromMMG(MMG5_pMesh mmgMesh, US3D* us3d, int mmg_prisms, int deflate, MPI_Comm comm);
+
+// Writes the distributed mesh dm to grid_madam.h5 with every rank contributing its own
+// elements, faces and block of vertices. The faces are paired on the rank of their lowest
+// vertex, so no rank needs the whole mesh. The ien, ief, iee and ife tables of the new
+// mesh go to conn_madam.h5, so it can be read back with ReadUS3DData. The integer datasets
+// are int32, or int64 if their ids need it; deflate > 0 compresses all datasets with that
+// deflate level.
+void WriteUS3DGridInParallel(DistributedMesh* dm, US3D* us3d, int deflate, MPI_Comm comm);
 
 //US3D* ReadUS3DData(const char* fn_conn, const char* fn_grid, const char* fn_data, MPI_Comm comm, MPI_Info info);
 
+// Reads an integer dataset as int whether it is stored as int32, int64 or double. Aborts if
+// an int64 value does not fit in an int.
+ParArray<int>* ReadIntDataSetFromFileInParallel(const char* file_name, const char* dataset_name, MPI_Comm comm, MPI_Info info);
+
 US3D* ReadUS3DData(const char* fn_conn, const char* fn_grid, const char* fn_data, int ReadFromStats, MPI_Comm comm, MPI_Info info);
 
 
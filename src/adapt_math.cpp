@@ -72,6 +72,38 @@ Array<double>* SolveQR(double* A, int m, int n, Array<double>* b)
 }
 
 
+// Solves the least-squares problem A*X=B for nrhs right-hand sides at once.
+// A (m x n) and B (m x nrhs) are stored column-major. A is factored only once
+// so that all right-hand sides share the same QR decomposition.
+Array<double>* SolveQR_MultiRHS(double* A, int m, int n, double* B, int nrhs)
+{
+    double tau[n];
+    double* B_copy = new double[m*nrhs];
+    for(int i=0;i<m*nrhs;i++)
+    {
+        B_copy[i] = B[i];
+    }
+    
+    geqrf(m, n, A, m, tau);
+    
+    ormqr('L', 'T', m, nrhs, n, A, m, tau, B_copy, m);
+    
+    trtrs('U', 'N', 'N', n, nrhs, A, m, B_copy, m);
+    
+    Array<double>* out = new Array<double>(n,nrhs);
+    for(int q=0;q<nrhs;q++)
+    {
+        for(int i=0;i<n;i++)
+        {
+            out->setVal(i,q,B_copy[q*m+i]);
+        }
+    }
+    
+    delete[] B_copy;
+    return out;
+}
+
+
 
 Eig* ComputeEigenDecomp(int n, double * A)
 {
@@ -112,6 +144,159 @@ Eig* ComputeEigenDecomp(int n, double * A)
     return eig;
 }
 
+// Eigen decomposition of a symmetric 3x3 matrix stored as H = [xx,xy,xz,yy,yz,zz]
+// using cyclic Jacobi rotations. On return lam holds the eigenvalues and the columns
+// of V (row-major) the orthonormal eigenvectors, so that the inverse of V is its transpose.
+void SymEig3(const double* H, double* lam, double* V)
+{
+    double a[3][3] = {{H[0],H[1],H[2]},
+                      {H[1],H[3],H[4]},
+                      {H[2],H[4],H[5]}};
+    for(int i=0;i<3;i++)
+    {
+        for(int j=0;j<3;j++)
+        {
+            V[i*3+j] = (i==j) ? 1.0 : 0.0;
+        }
+    }
+    
+    const int pq[3][2] = {{0,1},{0,2},{1,2}};
+    for(int sweep=0;sweep<16;sweep++)
+    {
+        double off  = a[0][1]*a[0][1]+a[0][2]*a[0][2]+a[1][2]*a[1][2];
+        double diag = a[0][0]*a[0][0]+a[1][1]*a[1][1]+a[2][2]*a[2][2];
+        if(off <= 1.0e-32*diag || off == 0.0)
+        {
+            break;
+        }
+        for(int r=0;r<3;r++)
+        {
+            int p = pq[r][0];
+            int q = pq[r][1];
+            if(a[p][q] == 0.0)
+            {
+                continue;
+            }
+            double theta = (a[q][q]-a[p][p])/(2.0*a[p][q]);
+            double t     = 1.0/(fabs(theta)+sqrt(theta*theta+1.0));
+            if(theta < 0.0)
+            {
+                t = -t;
+            }
+            double c = 1.0/sqrt(t*t+1.0);
+            double s = t*c;
+            for(int k=0;k<3;k++)
+            {
+                double akp = a[k][p];
+                double akq = a[k][q];
+                a[k][p] = c*akp-s*akq;
+                a[k][q] = s*akp+c*akq;
+            }
+            for(int k=0;k<3;k++)
+            {
+                double apk = a[p][k];
+                double aqk = a[q][k];
+                a[p][k] = c*apk-s*aqk;
+                a[q][k] = s*apk+c*aqk;
+            }
+            for(int k=0;k<3;k++)
+            {
+                double vkp = V[k*3+p];
+                double vkq = V[k*3+q];
+                V[k*3+p] = c*vkp-s*vkq;
+                V[k*3+q] = s*vkp+c*vkq;
+            }
+        }
+    }
+    lam[0] = a[0][0];
+    lam[1] = a[1][1];
+    lam[2] = a[2][2];
+}
+
+
+
+// Batched version of SymEig3 for n packed matrices H[i*6..i*6+5]; the eigenvalues
+// are returned in lam[i*3..] and the eigenvectors in V[i*9..].
+void SymEig3_Batch(int n, const double* H, double* lam, double* V)
+{
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<n;i++)
+    {
+        SymEig3(&H[i*6],&lam[i*3],&V[i*9]);
+    }
+}
+
+
+
+// Packs V*diag(d)*V^T into [xx,xy,xz,yy,yz,zz].
+static void SymFromEig3(const double* d, const double* V, double* S)
+{
+    const int rc[6][2] = {{0,0},{0,1},{0,2},{1,1},{1,2},{2,2}};
+    for(int k=0;k<6;k++)
+    {
+        int r = rc[k][0];
+        int c = rc[k][1];
+        S[k] = V[r*3+0]*d[0]*V[c*3+0]
+              +V[r*3+1]*d[1]*V[c*3+1]
+              +V[r*3+2]*d[2]*V[c*3+2];
+    }
+}
+
+
+
+// Computes S*A*S for the packed symmetric matrices S and A.
+static void SymSandwich3(const double* S, const double* A, double* B)
+{
+    double s[9] = {S[0],S[1],S[2],S[1],S[3],S[4],S[2],S[4],S[5]};
+    double a[9] = {A[0],A[1],A[2],A[1],A[3],A[4],A[2],A[4],A[5]};
+    double t[9];
+    for(int r=0;r<3;r++)
+    {
+        for(int c=0;c<3;c++)
+        {
+            t[r*3+c] = s[r*3+0]*a[0*3+c]+s[r*3+1]*a[1*3+c]+s[r*3+2]*a[2*3+c];
+        }
+    }
+    const int rc[6][2] = {{0,0},{0,1},{0,2},{1,1},{1,2},{2,2}};
+    for(int k=0;k<6;k++)
+    {
+        int r = rc[k][0];
+        int c = rc[k][1];
+        B[k] = t[r*3+0]*s[0*3+c]+t[r*3+1]*s[1*3+c]+t[r*3+2]*s[2*3+c];
+    }
+}
+
+
+
+// Intersection of the packed metrics M1 and M2 by simultaneous reduction: in the basis
+// in which M1 is the identity M2 is diagonalized and the largest of both eigenvalues
+// (smallest size) is kept in each direction. M may alias M1 or M2.
+void MetricIntersect(const double* M1, const double* M2, double* M)
+{
+    double lam[3], V[9], s[3], is[3];
+    SymEig3(M1,lam,V);
+    for(int k=0;k<3;k++)
+    {
+        s[k]  = sqrt(std::max(lam[k],1.0e-300));
+        is[k] = 1.0/s[k];
+    }
+    double Mh[6], iMh[6];
+    SymFromEig3(s,V,Mh);
+    SymFromEig3(is,V,iMh);
+    
+    double A[6], mu[3], W[9], B[6];
+    SymSandwich3(iMh,M2,A);
+    SymEig3(A,mu,W);
+    for(int k=0;k<3;k++)
+    {
+        mu[k] = std::max(mu[k],1.0);
+    }
+    SymFromEig3(mu,W,B);
+    SymSandwich3(Mh,B,M);
+}
+
+
+
 SVD* ComputeSVD(int M, int N, double * A)
 {
     SVD* svd = new SVD;
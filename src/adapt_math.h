@@ -116,6 +116,8 @@ int trtrs(char uplo, char trans, char diag, int n, int nrhs, double* A, int lda,
 
 Array<double>* SolveQR(double* A, int m, int n, Array<double>* b);
 
+Array<double>* SolveQR_MultiRHS(double* A, int m, int n, double* B, int nrhs);
+
 void EigenDecomp(int n, double * A,  double * WR, double * WI, double * V, double * iV );
 
 bool isDiagonalMatrix(Array<double>* Msq);
@@ -124,6 +126,12 @@ Array<double>* MatInv(Array<double>* A);
 
 Eig* ComputeEigenDecomp(int n, double * A);
 
+void SymEig3(const double* H, double* lam, double* V);
+
+void SymEig3_Batch(int n, const double* H, double* lam, double* V);
+
+void MetricIntersect(const double* M1, const double* M2, double* M);
+
 SVD* ComputeSVD(int M, int N, double * A);
 
 void UnitTestSVD();
@@ -131,4 +139,100 @@ void UnitTestSVD();
 void UnitTestEigenDecomp();
 
 
+// Number of elements that are solved together by SolveLSQ3_Batch.
+#define LSQ_BATCH 8
+
+// Solves LSQ_BATCH least-squares problems A*X=B of size (M x 3) at once using an
+// unrolled Householder QR. The data of the elements is interleaved so that the
+// loop over the batch maps onto SIMD lanes:
+//    A[(j*M+i)*LSQ_BATCH+l]  entry (i,j) of the stencil matrix of element l,
+//    B[(q*M+i)*LSQ_BATCH+l]  entry i of right-hand side q of element l,
+//    X[(q*3+j)*LSQ_BATCH+l]  component j of solution q of element l.
+template<int M>
+inline void SolveLSQ3_Batch(const double* A, const double* B, int nrhs, double* X)
+{
+    #pragma omp simd
+    for(int l=0;l<LSQ_BATCH;l++)
+    {
+        double a[3][M];
+        double rd[3];
+        double beta[3];
+        double b[M];
+        
+        for(int j=0;j<3;j++)
+        {
+            for(int i=0;i<M;i++)
+            {
+                a[j][i] = A[(j*M+i)*LSQ_BATCH+l];
+            }
+        }
+        
+        // Householder vectors are stored in the lower part of a, the
+        // diagonal of R in rd and the off-diagonal entries R(k,j) in a[j][k].
+        for(int k=0;k<3;k++)
+        {
+            double nrm2 = 0.0;
+            for(int i=k;i<M;i++)
+            {
+                nrm2 = nrm2 + a[k][i]*a[k][i];
+            }
+            double alpha = -copysign(sqrt(nrm2),a[k][k]);
+            a[k][k]      = a[k][k]-alpha;
+            
+            double vnrm2 = 0.0;
+            for(int i=k;i<M;i++)
+            {
+                vnrm2 = vnrm2 + a[k][i]*a[k][i];
+            }
+            beta[k] = (vnrm2 > 0.0) ? 2.0/vnrm2 : 0.0;
+            rd[k]   = alpha;
+            
+            for(int j=k+1;j<3;j++)
+            {
+                double s = 0.0;
+                for(int i=k;i<M;i++)
+                {
+                    s = s + a[k][i]*a[j][i];
+                }
+                s = beta[k]*s;
+                for(int i=k;i<M;i++)
+                {
+                    a[j][i] = a[j][i] - s*a[k][i];
+                }
+            }
+        }
+        
+        for(int q=0;q<nrhs;q++)
+        {
+            for(int i=0;i<M;i++)
+            {
+                b[i] = B[(q*M+i)*LSQ_BATCH+l];
+            }
+            
+            for(int k=0;k<3;k++)
+            {
+                double s = 0.0;
+                for(int i=k;i<M;i++)
+                {
+                    s = s + a[k][i]*b[i];
+                }
+                s = beta[k]*s;
+                for(int i=k;i<M;i++)
+                {
+                    b[i] = b[i] - s*a[k][i];
+                }
+            }
+            
+            double x2 = b[2]/rd[2];
+            double x1 = (b[1]-a[2][1]*x2)/rd[1];
+            double x0 = (b[0]-a[1][0]*x1-a[2][0]*x2)/rd[0];
+            
+            X[(q*3+0)*LSQ_BATCH+l] = x0;
+            X[(q*3+1)*LSQ_BATCH+l] = x1;
+            X[(q*3+2)*LSQ_BATCH+l] = x2;
+        }
+    }
+}
+
+
 #endif
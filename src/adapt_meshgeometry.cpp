@@ -0,0 +1,254 @@
+#include "adapt_meshgeometry.h"
+
+Mesh_Geometry::Mesh_Geometry(Partition* Pa, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    std::vector<Vert*> LocalVs             = Pa->getLocalVerts();
+    std::map<int,std::vector<int> > gE2lV = Pa->getGlobElem2LocVerts();
+    std::vector<int> Loc_Elem             = Pa->getLocElem();
+    std::vector<int> LocAndAdj_Elem       = Pa->getLocAndAdjElem();
+    std::map<int,int> LocElem2Nf          = Pa->getLocElem2Nf();
+    gV2lV                                 = Pa->getGlobalVert2LocalVert();
+
+    i_part_map* ifn_part_map   = Pa->getIFNpartmap();
+    i_part_map* ief_part_map   = Pa->getIEFpartmap();
+    i_part_map* if_Nv_part_map = Pa->getIF_Nvpartmap();
+
+    // The local elements get the indices 0..nLocElem-1, the halo elements follow.
+    std::vector<int> Elem = Loc_Elem;
+    for(int i=0;i<Loc_Elem.size();i++)
+    {
+        gE2idx[Loc_Elem[i]] = i;
+    }
+    for(int i=0;i<LocAndAdj_Elem.size();i++)
+    {
+        if(gE2idx.find(LocAndAdj_Elem[i])==gE2idx.end())
+        {
+            gE2idx[LocAndAdj_Elem[i]] = Elem.size();
+            Elem.push_back(LocAndAdj_Elem[i]);
+        }
+    }
+    nLocElem = Loc_Elem.size();
+    nElem    = Elem.size();
+
+    elem_cc     = new double[nElem*3];
+    elem_vol    = new double[nElem];
+    face_offset = new int[nLocElem+1];
+
+    face_offset[0] = 0;
+    for(int i=0;i<nLocElem;i++)
+    {
+        face_offset[i+1] = face_offset[i]+LocElem2Nf[Elem[i]];
+    }
+    int nFace = face_offset[nLocElem];
+    face_cc   = new double[nFace*3];
+    face_n    = new double[nFace*3];
+    face_area = new double[nFace];
+
+    // Centroids and volumes of the local and halo elements.
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<nElem;i++)
+    {
+        const std::vector<int>& lvids = gE2lV.at(Elem[i]);
+        int nv = lvids.size();
+        double P[8*3];
+        double cx = 0.0, cy = 0.0, cz = 0.0;
+        for(int k=0;k<nv;k++)
+        {
+            P[k*3+0] = LocalVs[lvids[k]]->x;
+            P[k*3+1] = LocalVs[lvids[k]]->y;
+            P[k*3+2] = LocalVs[lvids[k]]->z;
+            cx = cx+P[k*3+0];
+            cy = cy+P[k*3+1];
+            cz = cz+P[k*3+2];
+        }
+        elem_cc[i*3+0] = cx/nv;
+        elem_cc[i*3+1] = cy/nv;
+        elem_cc[i*3+2] = cz/nv;
+
+        double vol = 0.0;
+        if(nv == 8)
+        {
+            vol = ComputeVolumeHexCell(P);
+        }
+        if(nv == 4)
+        {
+            vol = ComputeVolumeTetCell(P);
+        }
+        if(nv == 6)
+        {
+            vol = ComputeVolumePrismCell(P);
+        }
+        if(nv == 5)
+        {
+            // Pyramid: split the base (0,1,2,3) along 0-2 into two tetrahedra with apex 4.
+            double T[4*3];
+            int tets[2][4] = {{0,1,2,4},{0,2,3,4}};
+            for(int s=0;s<2;s++)
+            {
+                for(int k=0;k<4;k++)
+                {
+                    T[k*3+0] = P[tets[s][k]*3+0];
+                    T[k*3+1] = P[tets[s][k]*3+1];
+                    T[k*3+2] = P[tets[s][k]*3+2];
+                }
+                vol = vol+ComputeVolumeTetCell(T);
+            }
+        }
+        elem_vol[i] = vol;
+    }
+
+    // Face centers, outward unit normals and areas of the faces of the local elements.
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<nLocElem;i++)
+    {
+        int gEl = Elem[i];
+        const std::vector<int>& faces = ief_part_map->i_map.at(gEl);
+
+        for(int t=0;t<face_offset[i+1]-face_offset[i];t++)
+        {
+            int k      = face_offset[i]+t;
+            int fid    = faces[t];
+            int NvPerF = if_Nv_part_map->i_map.at(fid)[0];
+            const std::vector<int>& fvrts = ifn_part_map->i_map.at(fid);
+            double F[4*3];
+            double fx = 0.0, fy = 0.0, fz = 0.0;
+
+            for(int r=0;r<NvPerF;r++)
+            {
+                int lvid = gV2lV.at(fvrts[r]);
+                F[r*3+0] = LocalVs[lvid]->x;
+                F[r*3+1] = LocalVs[lvid]->y;
+                F[r*3+2] = LocalVs[lvid]->z;
+                fx = fx+F[r*3+0];
+                fy = fy+F[r*3+1];
+                fz = fz+F[r*3+2];
+            }
+            face_cc[k*3+0] = fx/NvPerF;
+            face_cc[k*3+1] = fy/NvPerF;
+            face_cc[k*3+2] = fz/NvPerF;
+
+            Vec3D v0, v1;
+            v0.c0 = F[1*3+0]-F[0*3+0];
+            v0.c1 = F[1*3+1]-F[0*3+1];
+            v0.c2 = F[1*3+2]-F[0*3+2];
+
+            v1.c0 = F[(NvPerF-1)*3+0]-F[0*3+0];
+            v1.c1 = F[(NvPerF-1)*3+1]-F[0*3+1];
+            v1.c2 = F[(NvPerF-1)*3+2]-F[0*3+2];
+
+            Vec3D* n0 = ComputeSurfaceNormal(&v0,&v1);
+
+            double orient = (face_cc[k*3+0]-elem_cc[i*3+0])*n0->c0
+                           +(face_cc[k*3+1]-elem_cc[i*3+1])*n0->c1
+                           +(face_cc[k*3+2]-elem_cc[i*3+2])*n0->c2;
+            if(orient<0.0)
+            {
+                NegateVec3D(n0);
+            }
+
+            face_n[k*3+0] = n0->c0;
+            face_n[k*3+1] = n0->c1;
+            face_n[k*3+2] = n0->c2;
+
+            if(NvPerF == 3)
+            {
+                face_area[k] = ComputeTriSurfaceArea(F);
+            }
+            else
+            {
+                face_area[k] = ComputeQuadSurfaceArea(F);
+            }
+
+            delete n0;
+        }
+    }
+
+    // Vertex volumes from the local elements only.
+    vert_vol.resize(LocalVs.size(),0.0);
+    double vol_loc = 0.0;
+    for(int i=0;i<nLocElem;i++)
+    {
+        const std::vector<int>& lvids = gE2lV.at(Elem[i]);
+        int nv = lvids.size();
+        for(int k=0;k<nv;k++)
+        {
+            vert_vol[lvids[k]] = vert_vol[lvids[k]]+elem_vol[i]/nv;
+        }
+        vol_loc = vol_loc+elem_vol[i];
+    }
+
+    tot_vol = 0.0;
+    MPI_Allreduce(&vol_loc, &tot_vol, 1, MPI_DOUBLE, MPI_SUM, comm);
+}
+
+
+
+
+Mesh_Geometry::~Mesh_Geometry()
+{
+    delete[] elem_cc;
+    delete[] elem_vol;
+    delete[] face_offset;
+    delete[] face_cc;
+    delete[] face_n;
+    delete[] face_area;
+}
+
+
+
+
+int Mesh_Geometry::getNElem()
+{
+    return nElem;
+}
+int Mesh_Geometry::getNLocElem()
+{
+    return nLocElem;
+}
+int Mesh_Geometry::getElemIndex(int gEl)
+{
+    return gE2idx.at(gEl);
+}
+double* Mesh_Geometry::getElemCentroids()
+{
+    return elem_cc;
+}
+double* Mesh_Geometry::getElemVolumes()
+{
+    return elem_vol;
+}
+int* Mesh_Geometry::getFaceOffsets()
+{
+    return face_offset;
+}
+double* Mesh_Geometry::getFaceCenters()
+{
+    return face_cc;
+}
+double* Mesh_Geometry::getFaceNormals()
+{
+    return face_n;
+}
+double* Mesh_Geometry::getFaceAreas()
+{
+    return face_area;
+}
+double Mesh_Geometry::getVertVolume(int gv)
+{
+    std::map<int,int>::iterator it = gV2lV.find(gv);
+    if(it == gV2lV.end())
+    {
+        return 0.0;
+    }
+    return vert_vol[it->second];
+}
+double Mesh_Geometry::getTotalVolume()
+{
+    return tot_vol;
+}
@@ -0,0 +1,61 @@
+#include "adapt_partition.h"
+#include "adapt_compute.h"
+#include "adapt_geometry.h"
+
+#ifndef ADAPT_MESHGEOMETRY_H
+#define ADAPT_MESHGEOMETRY_H
+
+// Geometry of the partitioned mesh computed once after partitioning and shared
+// by the gradient reconstruction, Mesh_Topology and ComputeMetric.
+// Elements (local first, then the adjacent/halo elements) are numbered
+// 0..nElem-1 following Partition::getLocAndAdjElem(). The faces of the local
+// element with index i are stored in the slots face_offset[i]..face_offset[i+1]-1
+// in the same order as the iee/ief maps. Face normals are unit vectors that point
+// out of the element. The vertex volumes are the element volumes distributed
+// equally over the vertices of the local elements, so that summing them over all
+// ranks gives the total volume. The geometry owns its arrays, so it cannot be copied.
+class Mesh_Geometry {
+    public:
+        Mesh_Geometry()
+        {
+            nElem       = 0;
+            nLocElem    = 0;
+            elem_cc     = NULL;
+            elem_vol    = NULL;
+            face_offset = NULL;
+            face_cc     = NULL;
+            face_n      = NULL;
+            face_area   = NULL;
+            tot_vol     = 0.0;
+        }
+        Mesh_Geometry(Partition* Pa, MPI_Comm comm);
+        Mesh_Geometry(const Mesh_Geometry&) = delete;
+        Mesh_Geometry& operator=(const Mesh_Geometry&) = delete;
+        ~Mesh_Geometry();
+        int getNElem();
+        int getNLocElem();
+        int getElemIndex(int gEl);
+        double* getElemCentroids();
+        double* getElemVolumes();
+        int* getFaceOffsets();
+        double* getFaceCenters();
+        double* getFaceNormals();
+        double* getFaceAreas();
+        double getVertVolume(int gv);
+        double getTotalVolume();
+    private:
+        int nElem;
+        int nLocElem;
+        std::map<int,int> gE2idx;
+        std::map<int,int> gV2lV;
+        double* elem_cc;
+        double* elem_vol;
+        int* face_offset;
+        double* face_cc;
+        double* face_n;
+        double* face_area;
+        std::vector<double> vert_vol;
+        double tot_vol;
+};
+
+#endif
@@ -0,0 +1,160 @@
+#include "adapt_parmmg.h"
+
+PMMG_pParMesh InitParMMGMeshOnPartition(Partition* P, Mesh_Geometry* geom, TensorField* mv,
+                                        BLShellInfo* BLshell, std::set<int>& shell_faces, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    SubdomainMesh* sm = BuildSubdomainMeshOnPartition(P, geom, mv, BLshell, shell_faces, 0, comm);
+    std::vector<int>& lv2gv = sm->gid;
+    std::vector<int>& tets  = sm->tets;
+    std::vector<int>& tris  = sm->tris;
+    std::vector<int>& tri_ref = sm->tri_ref;
+    int np = lv2gv.size();
+    int ne = tets.size()/4;
+    int nt = tri_ref.size();
+
+    std::vector<int> vref(np+1,0);
+    std::vector<int> tet1(4*ne+1);
+    std::vector<int> tet_ref(ne+1,0);
+    std::vector<int> tri1(3*nt+1);
+    for(int e=0;e<4*ne;e++)
+    {
+        tet1[e] = tets[e]+1;
+    }
+    for(int f=0;f<3*nt;f++)
+    {
+        tri1[f] = tris[f]+1;
+        if(tri_ref[f/3] == BLShellFaceRef)
+        {
+            vref[tris[f]] = lv2gv[tris[f]]+1;
+        }
+    }
+
+    if(ne == 0)
+    {
+        std::cout << "Warning :: rank " << world_rank << " has no elements outside of the boundary layer mesh." << std::endl;
+    }
+
+    PMMG_pParMesh parmesh = NULL;
+    PMMG_Init_parMesh(PMMG_ARG_start,
+                      PMMG_ARG_ppParMesh,&parmesh,
+                      PMMG_ARG_pMesh,PMMG_ARG_pMet,
+                      PMMG_ARG_dim,3,PMMG_ARG_MPIComm,comm,
+                      PMMG_ARG_end);
+
+    if ( PMMG_Set_meshSize(parmesh,np,ne,0,nt,0,0) != 1 ) exit(EXIT_FAILURE);
+    if ( PMMG_Set_vertices(parmesh,&sm->xyz[0],&vref[0]) != 1 ) exit(EXIT_FAILURE);
+    if ( PMMG_Set_tetrahedra(parmesh,&tet1[0],&tet_ref[0]) != 1 ) exit(EXIT_FAILURE);
+    if ( PMMG_Set_triangles(parmesh,&tri1[0],&tri_ref[0]) != 1 ) exit(EXIT_FAILURE);
+    for(int f=0;f<nt;f++)
+    {
+        if(tri_ref[f] == BLShellFaceRef)
+        {
+            if ( PMMG_Set_requiredTriangle(parmesh,f+1) != 1 ) exit(EXIT_FAILURE);
+        }
+    }
+    if ( PMMG_Set_metSize(parmesh,MMG5_Vertex,np,MMG5_Tensor) != 1 ) exit(EXIT_FAILURE);
+    if ( PMMG_Set_tensorMets(parmesh,&sm->met[0]) != 1 ) exit(EXIT_FAILURE);
+
+    // The vertices on the partition interfaces are passed through node communicators
+    // that list them in increasing global id on both sides.
+    std::vector<int> ogid;
+    std::vector<int> olv;
+    for(int v=0;v<np;v++)
+    {
+        if(lv2gv[v] != -1)
+        {
+            ogid.push_back(lv2gv[v]);
+            olv.push_back(v);
+        }
+    }
+    ogid.push_back(0);
+    std::map<int,std::vector<int> > shared = ComputeSharedVertexRanks(P->getXcnParallelState(), &ogid[0], olv.size(), comm);
+
+    if ( !PMMG_Set_iparameter(parmesh,PMMG_IPARAM_APImode,PMMG_APIDISTRIB_nodes) ) exit(EXIT_FAILURE);
+    if ( !PMMG_Set_numberOfNodeCommunicators(parmesh,shared.size()) ) exit(EXIT_FAILURE);
+    int icomm = 0;
+    std::map<int,std::vector<int> >::iterator its;
+    for(its=shared.begin();its!=shared.end();its++)
+    {
+        int nitem = its->second.size();
+        std::vector<int> local(nitem);
+        std::vector<int> global(nitem);
+        for(int q=0;q<nitem;q++)
+        {
+            local[q]  = olv[its->second[q]]+1;
+            global[q] = ogid[its->second[q]]+1;
+        }
+        if ( !PMMG_Set_ithNodeCommunicatorSize(parmesh,icomm,its->first,nitem) ) exit(EXIT_FAILURE);
+        if ( !PMMG_Set_ithNodeCommunicator_nodes(parmesh,icomm,&local[0],&global[0],0) ) exit(EXIT_FAILURE);
+        icomm++;
+    }
+
+    delete sm;
+
+    return parmesh;
+}
+
+
+
+
+DistributedMesh* GetDistributedMeshFromParMMG(PMMG_pParMesh parmesh, Mesh_Topology_BL* mesh_topo_bl,
+                                              BLShellInfo* BLshell, ParallelState* xcn_pstate, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    int np,ne,nprism,nt,nquad,na;
+    PMMG_Get_meshSize(parmesh,&np,&ne,&nprism,&nt,&nquad,&na);
+
+    std::vector<double> xyz(3*np+1);
+    std::vector<int> vref(np+1), corner(np+1), req(np+1);
+    std::vector<int> glo(np+1), owner(np+1);
+    std::vector<int> tets(4*ne+1), tet_ref(ne+1), tet_req(ne+1);
+    std::vector<int> tris(3*nt+1), tri_ref(nt+1), tri_req(nt+1);
+    PMMG_Get_vertices(parmesh,&xyz[0],&vref[0],&corner[0],&req[0]);
+    PMMG_Get_verticesGloNum(parmesh,&glo[0],&owner[0]);
+    PMMG_Get_tetrahedra(parmesh,&tets[0],&tet_ref[0],&tet_req[0]);
+    PMMG_Get_triangles(parmesh,&tris[0],&tri_ref[0],&tri_req[0]);
+
+    // The vertices of the required shell triangles carry their old global id+1.
+    SubdomainMesh* sm = new SubdomainMesh;
+    std::vector<int> owned(np), shell_gid(np);
+    int nglo_loc = 0;
+    for(int v=0;v<np;v++)
+    {
+        nglo_loc     = std::max(nglo_loc,glo[v]);
+        owned[v]     = (owner[v] == world_rank);
+        shell_gid[v] = (req[v] && vref[v] > 0) ? vref[v]-1 : -1;
+        sm->gid.push_back(glo[v]-1);
+    }
+    xyz.resize(3*np);
+    sm->xyz = xyz;
+    int nglo = 0;
+    MPI_Allreduce(&nglo_loc, &nglo, 1, MPI_INT, MPI_MAX, comm);
+    for(int e=0;e<4*ne;e++)
+    {
+        sm->tets.push_back(tets[e]-1);
+    }
+    for(int f=0;f<nt;f++)
+    {
+        for(int s=0;s<3;s++)
+        {
+            sm->tris.push_back(tris[f*3+s]-1);
+        }
+        sm->tri_ref.push_back(tri_ref[f]);
+    }
+
+    DistributedMesh* dm = GetDistributedMeshFromSubdomain(sm, owned, shell_gid, nglo, mesh_topo_bl, BLshell, xcn_pstate, comm);
+    delete sm;
+
+    return dm;
+}
@@ -0,0 +1,23 @@
+#include "adapt.h"
+#include "adapt_datastruct.h"
+#include "adapt_partition.h"
+#include "adapt_meshgeometry.h"
+#include "adapt_bltopology.h"
+#include "adapt_parops.h"
+#include "adapt_subdomain.h"
+
+#ifndef ADAPT_PARMMG_H
+#define ADAPT_PARMMG_H
+
+// Hands the tetrahedra of BuildSubdomainMeshOnPartition to ParMMG together with the metric
+// mv and the node communicators. The faces in shell_faces become required triangles with
+// reference BLShellFaceRef whose vertices carry their global id+1 as reference.
+PMMG_pParMesh InitParMMGMeshOnPartition(Partition* P, Mesh_Geometry* geom, TensorField* mv,
+                                        BLShellInfo* BLshell, std::set<int>& shell_faces, MPI_Comm comm);
+
+// Returns the adapted tetrahedra of ParMMG and the BL prisms of this rank in one global
+// vertex numbering, see GetDistributedMeshFromSubdomain.
+DistributedMesh* GetDistributedMeshFromParMMG(PMMG_pParMesh parmesh, Mesh_Topology_BL* mesh_topo_bl,
+                                              BLShellInfo* BLshell, ParallelState* xcn_pstate, MPI_Comm comm);
+
+#endif
@@ -1,6 +1,6 @@
 #include "adapt_parops.h"
 
-Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<int,Array<double>*> mv_map, MPI_Comm comm)
+Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, TensorField* mv, MPI_Comm comm)
 {
     int world_size;
     MPI_Comm_size(comm, &world_size);
@@ -13,100 +13,120 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
     Domain* pDom = P->getPartitionDomain();
     std::map<int,std::vector<int> > v2e = pDom->vert2elem;
 
-    std::map<int,Array<double>* >::iterator grit;
-    Array<int>* lE2gE = new Array<int>(mv_map.size(),1);
-    Array<double>* mv = new Array<double>(mv_map.size(),6);
-    i = 0;
-    for(grit=mv_map.begin();grit!=mv_map.end();grit++)
+    // Every vertex of mv is sent to rank 0 once. The owner of its xcn block picks the lowest
+    // rank that holds it, which sends the metric to the block owner. The blocks are then
+    // complete and in global id order, so rank 0 places them by the xcn offsets.
+    ParallelState* xcn_pstate = P->getXcnParallelState();
+    gidx_t* xcn_offs = xcn_pstate->getOffsets();
+    int nmv = mv->getN();
+    std::vector<int> dest(nmv);
+    std::vector<int> scnt(world_size,0), soff(world_size,0), rcnt(world_size,0), roff(world_size,0);
+    for(i=0;i<nmv;i++)
     {
-        //std::cout << "(rowxcol) =(" << grit->second->getNrow() << " " << grit->second->getNcol() << ") -> " << grit->second->getVal(0,0) << " " << grit->second->getVal(0,1) << " " << grit->second->getVal(0,2) << " " << grit->second->getVal(1,0) << " " << grit->second->getVal(1,1) << " " << grit->second->getVal(1,2) << " " << grit->second->getVal(2,0)  << " " << grit->second->getVal(2,1) << " " << grit->second->getVal(2,2) << std::endl;
-        
-        lE2gE->setVal(i,0,grit->first);
-        mv->setVal(i,0,grit->second->getVal(0,0));
-        mv->setVal(i,1,grit->second->getVal(0,1));
-        mv->setVal(i,2,grit->second->getVal(0,2));
-        mv->setVal(i,3,grit->second->getVal(1,1));
-        mv->setVal(i,4,grit->second->getVal(1,2));
-        mv->setVal(i,5,grit->second->getVal(2,2));
-        i++;
+        dest[i] = std::upper_bound(xcn_offs,xcn_offs+world_size,mv->gid[i])-xcn_offs-1;
+        scnt[dest[i]]++;
+    }
+    for(i=1;i<world_size;i++)
+    {
+        soff[i] = soff[i-1]+scnt[i-1];
+    }
+    std::vector<int> sidx(nmv+1), sgid(nmv+1);
+    std::vector<int> pos = soff;
+    for(i=0;i<nmv;i++)
+    {
+        sidx[pos[dest[i]]] = i;
+        sgid[pos[dest[i]]] = mv->gid[i];
+        pos[dest[i]]++;
     }
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    for(i=1;i<world_size;i++)
+    {
+        roff[i] = roff[i-1]+rcnt[i-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rgid(nrecv+1);
+    MPI_Alltoallv(&sgid[0], &scnt[0], &soff[0], MPI_INT,
+                  &rgid[0], &rcnt[0], &roff[0], MPI_INT, comm);
     
-    int* lid_nlocs      = new int[world_size];
-    int* red_lid_nlocs  = new int[world_size];
-    int* lid_offsets    = new int[world_size];
-
-    int* mv_nlocs      = new int[world_size];
-    int* red_mv_nlocs  = new int[world_size];
-    int* mv_offsets    = new int[world_size];
-
-
+    int nblock = xcn_pstate->getNlocs()[world_rank];
+    std::vector<char> seen(nblock,0);
+    std::vector<int> rflag(nrecv+1,0);
+    std::vector<int> slot;
+    std::vector<int> mcnt(world_size,0), moff(world_size,0);
+    for(i=0;i<world_size;i++)
+    {
+        for(int k=roff[i];k<roff[i]+rcnt[i];k++)
+        {
+            int b = rgid[k]-xcn_offs[world_rank];
+            if(seen[b] == 0)
+            {
+                seen[b]  = 1;
+                rflag[k] = 1;
+                slot.push_back(b);
+                mcnt[i]++;
+            }
+        }
+    }
+    std::vector<int> sflag(nmv+1,0);
+    MPI_Alltoallv(&rflag[0], &rcnt[0], &roff[0], MPI_INT,
+                  &sflag[0], &scnt[0], &soff[0], MPI_INT, comm);
     
+    std::vector<double> smet;
+    std::vector<int> smcnt(world_size,0), smoff(world_size,0);
     for(i=0;i<world_size;i++)
     {
-        lid_nlocs[i] = 0;
-        mv_nlocs[i]  = 0;
-        
-        if(i==world_rank)
+        smoff[i] = smet.size();
+        for(int k=soff[i];k<soff[i]+scnt[i];k++)
         {
-            lid_nlocs[i] = mv->getNrow();
-            mv_nlocs[i]  = mv->getNrow()*6;
+            if(sflag[k] == 1)
+            {
+                double* M = mv->getTensor(sidx[k]);
+                smet.insert(smet.end(),M,M+6);
+            }
         }
-        else
+        smcnt[i] = smet.size()-smoff[i];
+    }
+    for(i=0;i<world_size;i++)
+    {
+        mcnt[i] = mcnt[i]*6;
+        if(i>0)
         {
-            lid_nlocs[i] = 0;
-            mv_nlocs[i]  = 0;
+            moff[i] = moff[i-1]+mcnt[i-1];
         }
     }
-
-    MPI_Allreduce(mv_nlocs, red_mv_nlocs, world_size, MPI_INT, MPI_SUM, comm);
-    MPI_Allreduce(lid_nlocs, red_lid_nlocs, world_size, MPI_INT, MPI_SUM, comm);
-    
-    int offset_lid = 0;
-    int offset_mv  = 0;
+    smet.push_back(0);
+    std::vector<double> rmet(slot.size()*6+1);
+    MPI_Alltoallv(&smet[0], &smcnt[0], &smoff[0], MPI_DOUBLE,
+                  &rmet[0], &mcnt[0], &moff[0], MPI_DOUBLE, comm);
     
-    for(i=0;i<world_size;i++)
+    std::vector<double> mv_block(nblock*6+1,0.0);
+    for(int k=0;k<slot.size();k++)
     {
-        lid_offsets[i] = offset_lid;
-        offset_lid = offset_lid+red_lid_nlocs[i];
-        
-        mv_offsets[i] = offset_mv;
-        offset_mv = offset_mv+red_mv_nlocs[i];
+        for(j=0;j<6;j++)
+        {
+            mv_block[slot[k]*6+j] = rmet[k*6+j];
+        }
     }
-
-    Array<int>*  lE2gE_g;
-    Array<double>*  mv_g;
-
-    int n_glob_lid = offset_lid;
-
+    
+    Array<double>* Mg;
     if(world_rank == 0)
     {
-        lE2gE_g   = new Array<int>(n_glob_lid,1);
-        mv_g      = new Array<double>(n_glob_lid,6);
+        Mg = new Array<double>(us3d->xcn->getNglob(),6);
     }
     else
     {
-        lE2gE_g   = new Array<int>(1,1);
-        mv_g      = new Array<double>(1,1);
+        Mg = new Array<double>(1,1);
+    }
+    int* mg_nlocs   = new int[world_size];
+    int* mg_offsets = new int[world_size];
+    for(i=0;i<world_size;i++)
+    {
+        mg_nlocs[i]   = xcn_pstate->getNlocs()[i];
+        mg_offsets[i] = xcn_offs[i];
     }
-    int ncol_lid = 1;
-    MPI_Gatherv(&lE2gE->data[0],
-                lE2gE->getNrow()*ncol_lid,
-                MPI_INT,
-                &lE2gE_g->data[0],
-                red_lid_nlocs,
-                lid_offsets,
-                MPI_INT, 0, comm);
-
-    int ncol_mv = 6;
-    MPI_Gatherv(&mv->data[0],
-                mv->getNrow()*ncol_mv,
-                MPI_DOUBLE,
-                &mv_g->data[0],
-                red_mv_nlocs,
-                mv_offsets,
-                MPI_DOUBLE, 0, comm);
-    
-    
+    GatherRowsOnRoot(&mv_block[0], nblock, 6, &Mg->data[0], mg_nlocs, mg_offsets, comm);
+    delete[] mg_nlocs;
+    delete[] mg_offsets;
     
     
     Array<double>* xcn_g;
@@ -117,7 +137,6 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
     
     int nvg   = us3d->xcn->getNglob();
     int nElem = us3d->ien->getNglob();
-    ParallelState* xcn_pstate = P->getXcnParallelState();
     ParallelState* ien_pstate = P->getIenParallelState();
     if(world_rank == 0)
     {
@@ -146,40 +165,20 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
     
     for(int i=0;i<world_size;i++)
     {
-        xcn_nlocs[i]   = xcn_pstate->getNlocs()[i]*3;
-        xcn_offsets[i] = xcn_pstate->getOffsets()[i]*3;
+        xcn_nlocs[i]   = xcn_pstate->getNlocs()[i];
+        xcn_offsets[i] = xcn_pstate->getOffsets()[i];
 
-        ien_nlocs[i]   = ien_pstate->getNlocs()[i]*8;
-        ien_offsets[i] = ien_pstate->getOffsets()[i]*8;
+        ien_nlocs[i]   = ien_pstate->getNlocs()[i];
+        ien_offsets[i] = ien_pstate->getOffsets()[i];
         
-        iet_nlocs[i]   = ien_pstate->getNlocs()[i]*1;
-        iet_offsets[i] = ien_pstate->getOffsets()[i]*1;
-    }
-
-    MPI_Gatherv(&us3d->xcn->data[0],
-                us3d->xcn->getNrow()*3,
-                MPI_DOUBLE,
-                &xcn_g->data[0],
-                xcn_nlocs,
-                xcn_offsets,
-                MPI_DOUBLE, 0, comm);
-
-
-    MPI_Gatherv(&us3d->ien->data[0],
-                us3d->ien->getNrow()*8,
-                MPI_INT,
-                &ien_g->data[0],
-                ien_nlocs,
-                ien_offsets,
-                MPI_INT, 0, comm);
-    
-    MPI_Gatherv(&us3d->iet->data[0],
-                us3d->iet->getNrow()*1,
-                MPI_INT,
-                &iet_g->data[0],
-                iet_nlocs,
-                iet_offsets,
-                MPI_INT, 0, comm);
+        iet_nlocs[i]   = ien_pstate->getNlocs()[i];
+        iet_offsets[i] = ien_pstate->getOffsets()[i];
+    }
+
+    // The counts and offsets are in rows, so they do not overflow for large meshes.
+    GatherRowsOnRoot(&us3d->xcn->data[0], us3d->xcn->getNrow(), 3, &xcn_g->data[0], xcn_nlocs, xcn_offsets, comm);
+    GatherRowsOnRoot(&us3d->ien->data[0], us3d->ien->getNrow(), 8, &ien_g->data[0], ien_nlocs, ien_offsets, comm);
+    GatherRowsOnRoot(&us3d->iet->data[0], us3d->iet->getNrow(), 1, &iet_g->data[0], iet_nlocs, iet_offsets, comm);
     
     int NtetLoc = us3d->elTypes->getVal(0,0);
 //    int NprismLoc = us3d->elTypes->getVal(1,0);
@@ -196,25 +195,8 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
 //    MPI_Reduce(&NhexLoc,   &Nhexes,    1, MPI_INT, MPI_SUM, 0,  comm);
     //std::cout << "RANK = " << NtetLoc << " " << Ntetras << std::endl;
 
-    Array<double>* Mg;
-    Array<int>* tel;
-    
     if(world_rank == 0)
     {
-        Mg  = new Array<double>(us3d->xcn->getNglob(),6);
-        
-        for(int u=0;u<n_glob_lid;u++)
-        {
-            int gvid     = lE2gE_g->getVal(u,0);
-            Mg->setVal(gvid,0,mv_g->getVal(u,0));
-            Mg->setVal(gvid,1,mv_g->getVal(u,1));
-            Mg->setVal(gvid,2,mv_g->getVal(u,2));
-            Mg->setVal(gvid,3,mv_g->getVal(u,3));
-            Mg->setVal(gvid,4,mv_g->getVal(u,4));
-            Mg->setVal(gvid,5,mv_g->getVal(u,5));
-        }
-        
-        
 //        std::string filename = "MetricRoot.dat";
 //        std::ofstream myfile;
 //        myfile.open(filename);
@@ -265,19 +247,11 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
 //        myfile3.close();
         
     }
-    else
-    {
-        Mg = new Array<double>(1,1);
-    }
 
     delete xcn_g;
     delete ien_g;
     delete iet_g;
     //delete pDom;
-    delete lE2gE_g;
-    delete mv_g;
-    delete lE2gE;
-    delete mv;
     
     delete[] iet_nlocs;
     delete[] iet_offsets;
@@ -285,14 +259,454 @@ Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<in
     delete[] ien_offsets;
     delete[] xcn_nlocs;
     delete[] xcn_offsets;
-    delete[] mv_nlocs;
-    delete[] red_mv_nlocs;
-    delete[] mv_offsets;
     
     return Mg;
 }
 
 
+SharedVertexMap* ComputeSharedVertexMap(ParallelState* xcn_pstate, int* gid, int n, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    gidx_t* xcn_offsets = xcn_pstate->getOffsets();
+    
+    // Send all vertex ids to their owner, grouped per owner rank.
+    std::vector<int> owner(n);
+    std::vector<int> cnt(world_size,0);
+    for(int i=0;i<n;i++)
+    {
+        owner[i] = std::upper_bound(xcn_offsets,xcn_offsets+world_size,gid[i])-xcn_offsets-1;
+        cnt[owner[i]]++;
+    }
+    std::vector<int> off(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        off[r] = off[r-1]+cnt[r-1];
+    }
+    std::vector<int> idx(n+1);
+    std::vector<int> sgid(n+1);
+    std::vector<int> pos = off;
+    for(int i=0;i<n;i++)
+    {
+        idx[pos[owner[i]]]  = i;
+        sgid[pos[owner[i]]] = gid[i];
+        pos[owner[i]]++;
+    }
+    
+    std::vector<int> rcnt(world_size,0);
+    MPI_Alltoall(&cnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    std::vector<int> roff(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rgid(nrecv+1);
+    MPI_Alltoallv(&sgid[0], &cnt[0], &off[0], MPI_INT,
+                  &rgid[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    
+    // The owner flags the vertices it received from more than one rank.
+    std::map<int,int> nholders;
+    for(int k=0;k<nrecv;k++)
+    {
+        nholders[rgid[k]]++;
+    }
+    std::vector<int> rflag(nrecv+1,0);
+    for(int k=0;k<nrecv;k++)
+    {
+        rflag[k] = (nholders[rgid[k]]>1) ? 1 : 0;
+    }
+    std::vector<int> sflag(n+1,0);
+    MPI_Alltoallv(&rflag[0], &rcnt[0], &roff[0], MPI_INT,
+                  &sflag[0], &cnt[0], &off[0], MPI_INT, comm);
+    
+    // Keep only the shared vertices on both sides, in the same order.
+    SharedVertexMap* svm = new SharedVertexMap;
+    svm->send_counts.resize(world_size,0);
+    svm->send_offsets.resize(world_size,0);
+    svm->recv_counts.resize(world_size,0);
+    svm->recv_offsets.resize(world_size,0);
+    for(int r=0;r<world_size;r++)
+    {
+        svm->send_offsets[r] = svm->send_idx.size();
+        for(int k=off[r];k<off[r]+cnt[r];k++)
+        {
+            if(sflag[k] == 1)
+            {
+                svm->send_idx.push_back(idx[k]);
+            }
+        }
+        svm->send_counts[r] = svm->send_idx.size()-svm->send_offsets[r];
+    }
+    
+    std::map<int,int> gid2slot;
+    for(int r=0;r<world_size;r++)
+    {
+        svm->recv_offsets[r] = svm->recv_slot.size();
+        for(int k=roff[r];k<roff[r]+rcnt[r];k++)
+        {
+            if(rflag[k] == 1)
+            {
+                if(gid2slot.find(rgid[k])==gid2slot.end())
+                {
+                    int slot = gid2slot.size();
+                    gid2slot[rgid[k]] = slot;
+                }
+                svm->recv_slot.push_back(gid2slot[rgid[k]]);
+            }
+        }
+        svm->recv_counts[r] = svm->recv_slot.size()-svm->recv_offsets[r];
+    }
+    svm->nowned = gid2slot.size();
+    
+    return svm;
+}
+
+
+// For every other rank that holds some of the n vertices gid as well, returns the local
+// indices of the vertices in common sorted by global id, so that both sides list them in
+// the same order. The vertex owners (as in ComputeSharedVertexMap) collect the holders.
+std::map<int,std::vector<int> > ComputeSharedVertexRanks(ParallelState* xcn_pstate, int* gid, int n, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    gidx_t* xcn_offsets = xcn_pstate->getOffsets();
+    
+    std::vector<int> owner(n);
+    std::vector<int> cnt(world_size,0);
+    for(int i=0;i<n;i++)
+    {
+        owner[i] = std::upper_bound(xcn_offsets,xcn_offsets+world_size,gid[i])-xcn_offsets-1;
+        cnt[owner[i]]++;
+    }
+    std::vector<int> off(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        off[r] = off[r-1]+cnt[r-1];
+    }
+    std::vector<int> idx(n+1);
+    std::vector<int> sgid(n+1);
+    std::vector<int> pos = off;
+    for(int i=0;i<n;i++)
+    {
+        idx[pos[owner[i]]]  = i;
+        sgid[pos[owner[i]]] = gid[i];
+        pos[owner[i]]++;
+    }
+    
+    std::vector<int> rcnt(world_size,0);
+    MPI_Alltoall(&cnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    std::vector<int> roff(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rgid(nrecv+1);
+    MPI_Alltoallv(&sgid[0], &cnt[0], &off[0], MPI_INT,
+                  &rgid[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    
+    std::map<int,std::vector<int> > holders;
+    for(int r=0;r<world_size;r++)
+    {
+        for(int k=roff[r];k<roff[r]+rcnt[r];k++)
+        {
+            holders[rgid[k]].push_back(r);
+        }
+    }
+    
+    // Every received vertex is answered with the number of holders followed by the holders.
+    std::vector<int> rlen(nrecv+1,0);
+    std::vector<int> ans_cnt(world_size,0);
+    for(int r=0;r<world_size;r++)
+    {
+        for(int k=roff[r];k<roff[r]+rcnt[r];k++)
+        {
+            rlen[k]    = holders[rgid[k]].size();
+            ans_cnt[r] = ans_cnt[r]+rlen[k];
+        }
+    }
+    std::vector<int> slen(n+1,0);
+    MPI_Alltoallv(&rlen[0], &rcnt[0], &roff[0], MPI_INT,
+                  &slen[0], &cnt[0], &off[0], MPI_INT, comm);
+    
+    std::vector<int> ans_off(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        ans_off[r] = ans_off[r-1]+ans_cnt[r-1];
+    }
+    std::vector<int> ans(ans_off[world_size-1]+ans_cnt[world_size-1]+1);
+    int a = 0;
+    for(int k=0;k<nrecv;k++)
+    {
+        std::vector<int>& h = holders[rgid[k]];
+        for(int q=0;q<h.size();q++)
+        {
+            ans[a] = h[q];
+            a++;
+        }
+    }
+    std::vector<int> hcnt(world_size,0);
+    for(int r=0;r<world_size;r++)
+    {
+        for(int k=off[r];k<off[r]+cnt[r];k++)
+        {
+            hcnt[r] = hcnt[r]+slen[k];
+        }
+    }
+    std::vector<int> hoff(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        hoff[r] = hoff[r-1]+hcnt[r-1];
+    }
+    std::vector<int> hrecv(hoff[world_size-1]+hcnt[world_size-1]+1);
+    MPI_Alltoallv(&ans[0], &ans_cnt[0], &ans_off[0], MPI_INT,
+                  &hrecv[0], &hcnt[0], &hoff[0], MPI_INT, comm);
+    
+    std::map<int,std::vector<std::pair<int,int> > > common;
+    int hk = 0;
+    for(int k=0;k<n;k++)
+    {
+        for(int q=0;q<slen[k];q++)
+        {
+            if(hrecv[hk] != world_rank)
+            {
+                common[hrecv[hk]].push_back(std::make_pair(sgid[k],idx[k]));
+            }
+            hk++;
+        }
+    }
+    
+    std::map<int,std::vector<int> > shared;
+    std::map<int,std::vector<std::pair<int,int> > >::iterator itc;
+    for(itc=common.begin();itc!=common.end();itc++)
+    {
+        std::sort(itc->second.begin(),itc->second.end());
+        std::vector<int>& lst = shared[itc->first];
+        for(int q=0;q<itc->second.size();q++)
+        {
+            lst.push_back(itc->second[q].second);
+        }
+    }
+    
+    return shared;
+}
+
+
+// Averages the element data U[e](offset..offset+nvar-1) to the n vertices gid of the
+// partition, weighted with the element volumes if vol is given. Only the elements owned
+// by a rank contribute to its partial sums; the partial sums of the vertices shared with
+// other ranks are added up by the vertex owner (in rank order) which returns the result
+// to all ranks holding the vertex. Unlike ReduceStateVecToAllVertices the result does not
+// depend on which halo elements are available and so not on the number of ranks.
+// Uv[i*nvar+l] holds the average of variable l at vertex gid[i].
+void ReduceElementDataToVertices(Partition* P, SharedVertexMap* svm, int n, int* gid,
+                                 std::map<int,Array<double>* > &U, int offset, int nvar,
+                                 std::map<int,double>* vol, double* Uv, MPI_Comm comm)
+{
+    std::map<int,std::vector<int> > gV2gE = P->getGlobVert2GlobElem();
+    std::map<int,int> LocElem2Nv          = P->getLocElem2Nv();
+    
+    int m = nvar+1;
+    std::vector<double> part(n*m+1);
+    
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<n;i++)
+    {
+        std::vector<int> elems;
+        const std::vector<int>& vel = gV2gE.at(gid[i]);
+        for(int q=0;q<vel.size();q++)
+        {
+            if(LocElem2Nv.find(vel[q])!=LocElem2Nv.end())
+            {
+                elems.push_back(vel[q]);
+            }
+        }
+        std::sort(elems.begin(),elems.end());
+        elems.erase(std::unique(elems.begin(),elems.end()),elems.end());
+        
+        double* p = &part[i*m];
+        for(int l=0;l<m;l++)
+        {
+            p[l] = 0.0;
+        }
+        for(int q=0;q<elems.size();q++)
+        {
+            double w = (vol == NULL) ? 1.0 : vol->at(elems[q]);
+            Array<double>* Ue = U.at(elems[q]);
+            for(int l=0;l<nvar;l++)
+            {
+                p[l] = p[l] + w*Ue->getVal(offset+l,0);
+            }
+            p[nvar] = p[nvar] + w;
+        }
+    }
+    
+    ReduceSharedVertexData(svm, &part[0], m,
+                           [m](double* acc, const double* val)
+                           {
+                               for(int l=0;l<m;l++)
+                               {
+                                   acc[l] = acc[l]+val[l];
+                               }
+                           }, comm);
+    
+#pragma omp parallel for schedule(static)
+    for(int i=0;i<n;i++)
+    {
+        for(int l=0;l<nvar;l++)
+        {
+            Uv[i*nvar+l] = part[i*m+l]/part[i*m+nvar];
+        }
+    }
+}
+
+
+
+NodeComm* SplitNodeComm(MPI_Comm comm)
+{
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    NodeComm* nc = new NodeComm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, world_rank, MPI_INFO_NULL, &nc->node);
+    int node_rank;
+    MPI_Comm_rank(nc->node, &node_rank);
+    int node_size;
+    MPI_Comm_size(nc->node, &node_size);
+    MPI_Comm_split(comm, (node_rank == 0) ? 0 : MPI_UNDEFINED, world_rank, &nc->leaders);
+    
+    nc->node_members.resize(node_size);
+    MPI_Gather(&world_rank, 1, MPI_INT, &nc->node_members[0], 1, MPI_INT, 0, nc->node);
+    if(nc->leaders != MPI_COMM_NULL)
+    {
+        int nleaders;
+        MPI_Comm_size(nc->leaders, &nleaders);
+        std::vector<int> sizes(nleaders);
+        MPI_Gather(&node_size, 1, MPI_INT, &sizes[0], 1, MPI_INT, 0, nc->leaders);
+        nc->member_offsets.resize(nleaders+1,0);
+        for(int l=0;l<nleaders;l++)
+        {
+            nc->member_offsets[l+1] = nc->member_offsets[l]+sizes[l];
+        }
+        nc->members.resize(nc->member_offsets[nleaders]+1);
+        MPI_Gatherv(&nc->node_members[0], node_size, MPI_INT,
+                    &nc->members[0], &sizes[0], &nc->member_offsets[0], MPI_INT, 0, nc->leaders);
+    }
+    
+    return nc;
+}
+
+
+
+
+void FreeNodeComm(NodeComm* nc)
+{
+    MPI_Comm_free(&nc->node);
+    if(nc->leaders != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&nc->leaders);
+    }
+    delete nc;
+}
+
+
+
+// Returns the rows of the element array U, which is distributed over the ranks in the
+// same way as ien (ien_pstate), for the global element ids in gids. Row i of the
+// result belongs to gids[i]. This allows to bring additional element data to the
+// partition after it has been created.
+Array<double>* GetElementDataOnPartition(ParallelState* ien_pstate, Array<double>* U, std::vector<int> gids, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    gidx_t* ien_offsets = ien_pstate->getOffsets();
+    int ncol = U->getNcol();
+    int n    = gids.size();
+    
+    std::vector<int> owner(n);
+    std::vector<int> cnt(world_size,0);
+    for(int i=0;i<n;i++)
+    {
+        owner[i] = std::upper_bound(ien_offsets,ien_offsets+world_size,gids[i])-ien_offsets-1;
+        cnt[owner[i]]++;
+    }
+    std::vector<int> off(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        off[r] = off[r-1]+cnt[r-1];
+    }
+    std::vector<int> idx(n+1);
+    std::vector<int> sgid(n+1);
+    std::vector<int> pos = off;
+    for(int i=0;i<n;i++)
+    {
+        idx[pos[owner[i]]]  = i;
+        sgid[pos[owner[i]]] = gids[i];
+        pos[owner[i]]++;
+    }
+    
+    std::vector<int> rcnt(world_size,0);
+    MPI_Alltoall(&cnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    std::vector<int> roff(world_size,0);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rgid(nrecv+1);
+    MPI_Alltoallv(&sgid[0], &cnt[0], &off[0], MPI_INT,
+                  &rgid[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    
+    // Answer the requests with the rows of U.
+    int ien_o = ien_offsets[world_rank];
+    std::vector<double> rval(nrecv*ncol+1);
+    for(int k=0;k<nrecv;k++)
+    {
+        for(int c=0;c<ncol;c++)
+        {
+            rval[k*ncol+c] = U->getVal(rgid[k]-ien_o,c);
+        }
+    }
+    
+    std::vector<int> scnt_v(world_size), soff_v(world_size), rcnt_v(world_size), roff_v(world_size);
+    for(int r=0;r<world_size;r++)
+    {
+        scnt_v[r] = cnt[r]*ncol;
+        soff_v[r] = off[r]*ncol;
+        rcnt_v[r] = rcnt[r]*ncol;
+        roff_v[r] = roff[r]*ncol;
+    }
+    std::vector<double> sval(n*ncol+1);
+    MPI_Alltoallv(&rval[0], &rcnt_v[0], &roff_v[0], MPI_DOUBLE,
+                  &sval[0], &scnt_v[0], &soff_v[0], MPI_DOUBLE, comm);
+    
+    Array<double>* Up = new Array<double>(n,ncol);
+    for(int k=0;k<n;k++)
+    {
+        for(int c=0;c<ncol;c++)
+        {
+            Up->setVal(idx[k],c,sval[k*ncol+c]);
+        }
+    }
+    
+    return Up;
+}
+
+
 Mesh* ReduceMeshToRoot(ParArray<int>* ien,
                        ParArray<int>* ief,
                        ParArray<double>* xcn,
@@ -367,12 +781,12 @@ Mesh* ReduceMeshToRoot(ParArray<int>* ien,
         
         if(i==world_rank)
         {
-            ien_nlocs[i] = ien->getNrow()*8;
-            ief_nlocs[i] = ief->getNrow()*6;
-            xcn_nlocs[i] = xcn->getNrow()*3;
-            ifn_nlocs[i] = ifn->getNrow()*4;
-            ife_nlocs[i] = ife->getNrow()*2;
-            if_ref_nlocs[i] = ifn->getNrow()*1;
+            ien_nlocs[i] = ien->getNrow();
+            ief_nlocs[i] = ief->getNrow();
+            xcn_nlocs[i] = xcn->getNrow();
+            ifn_nlocs[i] = ifn->getNrow();
+            ife_nlocs[i] = ife->getNrow();
+            if_ref_nlocs[i] = ifn->getNrow();
         }
         else
         {
@@ -416,53 +830,12 @@ Mesh* ReduceMeshToRoot(ParArray<int>* ien,
         if_ref_o = if_ref_o + red_if_ref_nlocs[i];
     }
 
-    MPI_Gatherv(&xcn->data[0],
-                xcn->getNrow()*3,
-                MPI_DOUBLE,
-                &xcn_g->data[0],
-                red_xcn_nlocs,
-                xcn_offsets,
-                MPI_DOUBLE, 0, comm);
-
-    MPI_Gatherv(&ief->data[0],
-                ief->getNrow()*6,
-                MPI_INT,
-                &ief_g->data[0],
-                red_ief_nlocs,
-                ief_offsets,
-                MPI_INT, 0, comm);
-
-    MPI_Gatherv(&ien->data[0],
-                ien->getNrow()*8,
-                MPI_INT,
-                &ien_g->data[0],
-                red_ien_nlocs,
-                ien_offsets,
-                MPI_INT, 0, comm);
-
-    MPI_Gatherv(&ifn->data[0],
-                ifn->getNrow()*4,
-                MPI_INT,
-                &ifn_g->data[0],
-                red_ifn_nlocs,
-                ifn_offsets,
-                MPI_INT, 0, comm);
-
-    MPI_Gatherv(&if_ref->data[0],
-                if_ref->getNrow()*1,
-                MPI_INT,
-                &if_ref_g->data[0],
-                red_if_ref_nlocs,
-                if_ref_offsets,
-                MPI_INT, 0, comm);
-
-    MPI_Gatherv(&ife->data[0],
-                ife->getNrow()*2,
-                MPI_INT,
-                &ife_g->data[0],
-                red_ife_nlocs,
-                ife_offsets,
-                MPI_INT, 0, comm);
+    GatherRowsOnRoot(&xcn->data[0],    xcn->getNrow(),    3, &xcn_g->data[0],    red_xcn_nlocs,    xcn_offsets,    comm);
+    GatherRowsOnRoot(&ief->data[0],    ief->getNrow(),    6, &ief_g->data[0],    red_ief_nlocs,    ief_offsets,    comm);
+    GatherRowsOnRoot(&ien->data[0],    ien->getNrow(),    8, &ien_g->data[0],    red_ien_nlocs,    ien_offsets,    comm);
+    GatherRowsOnRoot(&ifn->data[0],    ifn->getNrow(),    4, &ifn_g->data[0],    red_ifn_nlocs,    ifn_offsets,    comm);
+    GatherRowsOnRoot(&if_ref->data[0], if_ref->getNrow(), 1, &if_ref_g->data[0], red_if_ref_nlocs, if_ref_offsets, comm);
+    GatherRowsOnRoot(&ife->data[0],    ife->getNrow(),    2, &ife_g->data[0],    red_ife_nlocs,    ife_offsets,    comm);
     
     us3d_root->xcn      = xcn_g;
     us3d_root->ief      = ief_g;
@@ -546,8 +919,8 @@ std::map<int,std::vector<int> > GatherElementsOnRoot(std::map<int,std::vector<in
         {
             lid_tet_nlocs[i] = Ate.size();
             lid_pri_nlocs[i] = Apr.size();
-            ien_tet_nlocs[i] = Ate.size()*4;
-            ien_pri_nlocs[i] = Apr.size()*6;
+            ien_tet_nlocs[i] = Ate.size();
+            ien_pri_nlocs[i] = Apr.size();
         }
         else
         {
@@ -604,38 +977,10 @@ std::map<int,std::vector<int> > GatherElementsOnRoot(std::map<int,std::vector<in
         ien_pri_g   = new Array<int>(1,1);
     }
     
-    int ncol_lid = 1;
-    MPI_Gatherv(&lE2gE_tet->data[0],
-                lE2gE_tet->getNrow()*1,
-                MPI_INT,
-                &lE2gE_tet_g->data[0],
-                red_lid_tet_nlocs,
-                lid_tet_offsets,
-                MPI_INT, 0, comm);
-//
-    MPI_Gatherv(&lE2gE_pri->data[0],
-                lE2gE_pri->getNrow()*1,
-                MPI_INT,
-                &lE2gE_pri_g->data[0],
-                red_lid_pri_nlocs,
-                lid_pri_offsets,
-                MPI_INT, 0, comm);
-//
-    MPI_Gatherv(&ien_tet->data[0],
-                ien_tet->getNrow()*4,
-                MPI_INT,
-                &ien_tet_g->data[0],
-                red_ien_tet_nlocs,
-                ien_tet_offsets,
-                MPI_INT, 0, comm);
-
-    MPI_Gatherv(&ien_pri->data[0],
-                ien_pri->getNrow()*6,
-                MPI_INT,
-                &ien_pri_g->data[0],
-                red_ien_pri_nlocs,
-                ien_pri_offsets,
-                MPI_INT, 0, comm);
+    GatherRowsOnRoot(&lE2gE_tet->data[0], lE2gE_tet->getNrow(), 1, &lE2gE_tet_g->data[0], red_lid_tet_nlocs, lid_tet_offsets, comm);
+    GatherRowsOnRoot(&lE2gE_pri->data[0], lE2gE_pri->getNrow(), 1, &lE2gE_pri_g->data[0], red_lid_pri_nlocs, lid_pri_offsets, comm);
+    GatherRowsOnRoot(&ien_tet->data[0],   ien_tet->getNrow(),   4, &ien_tet_g->data[0],   red_ien_tet_nlocs, ien_tet_offsets, comm);
+    GatherRowsOnRoot(&ien_pri->data[0],   ien_pri->getNrow(),   6, &ien_pri_g->data[0],   red_ien_pri_nlocs, ien_pri_offsets, comm);
 
 
 
@@ -21,11 +21,175 @@ inline MPI_Datatype get_mpi_datatype(const double &)
     return MPI_DOUBLE;
 }
 
+inline MPI_Datatype get_mpi_datatype(const char &)
+{
+    return MPI_CHAR;
+}
+
+inline MPI_Datatype get_mpi_datatype(const gidx_t &)
+{
+    return MPI_GIDX;
+}
+
 template <typename T>
 inline MPI_Datatype get_mpi_datatype() {
     return get_mpi_datatype(T());
 }
 
+// Sends send[r] to rank r and returns the data received from all ranks in rank order.
+template<typename T>
+std::vector<T> ExchangeVectors(std::vector<std::vector<T> >& send, MPI_Datatype type, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+
+    std::vector<int> scnt(world_size), soff(world_size), rcnt(world_size), roff(world_size,0);
+    std::vector<T> sbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        scnt[r] = send[r].size();
+        soff[r] = sbuf.size();
+        sbuf.insert(sbuf.end(),send[r].begin(),send[r].end());
+    }
+    sbuf.push_back(T());
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<T> rbuf(nrecv+1);
+    MPI_Alltoallv(&sbuf[0], &scnt[0], &soff[0], type,
+                  &rbuf[0], &rcnt[0], &roff[0], type, comm);
+    rbuf.pop_back();
+    return rbuf;
+}
+
+
+NodeComm* SplitNodeComm(MPI_Comm comm);
+
+void FreeNodeComm(NodeComm* nc);
+
+// Gathers the rows of an nrow x ncol table on rank 0, where rank r sends nlocs[r] rows that
+// land at row offsets[r]. A row is sent as one contiguous datatype, so the counts stay below
+// 2^31 as long as the number of rows does, whatever the number of entries. Rank 0 may pass
+// MPI_IN_PLACE as sendbuf when its rows are already in recvbuf. Single-level MPI_Gatherv.
+template<typename T>
+void GatherRowsOnRootFlat(T* sendbuf, int nrow, int ncol, T* recvbuf, int* nlocs, int* offsets, MPI_Comm comm)
+{
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(ncol, get_mpi_datatype<T>(), &row_type);
+    MPI_Type_commit(&row_type);
+    
+    MPI_Gatherv(sendbuf, nrow, row_type,
+                recvbuf, nlocs, offsets, row_type, 0, comm);
+    
+    MPI_Type_free(&row_type);
+}
+
+// Same as GatherRowsOnRootFlat, in two levels: the rows of a node are packed on its leader
+// first and every leader then sends one message to rank 0, which receives it in place
+// through an indexed datatype. Rank 0 only talks to the other node leaders.
+template<typename T>
+void GatherRowsOnRoot(T* sendbuf, int nrow, int ncol, T* recvbuf, int* nlocs, int* offsets, MPI_Comm comm)
+{
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+    
+    NodeComm* nc = SplitNodeComm(comm);
+    int node_size;
+    MPI_Comm_size(nc->node, &node_size);
+    int node_rank;
+    MPI_Comm_rank(nc->node, &node_rank);
+    
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(ncol, get_mpi_datatype<T>(), &row_type);
+    MPI_Type_commit(&row_type);
+    
+    // The leaders take the counts from their node, only rank 0 needs nlocs and offsets.
+    std::vector<int>& node_ranks = nc->node_members;
+    std::vector<int> ncnt(node_size,0), noff(node_size,0);
+    MPI_Gather(&nrow, 1, MPI_INT, &ncnt[0], 1, MPI_INT, 0, nc->node);
+    int npack = 0;
+    for(int i=0;i<node_size && node_rank==0;i++)
+    {
+        noff[i] = (world_rank == 0) ? offsets[node_ranks[i]] : npack;
+        npack   = npack+ncnt[i];
+    }
+    
+    // Rank 0 receives the rows of its own node in place, the other leaders pack them.
+    std::vector<T> pack;
+    T* nodebuf = recvbuf;
+    if(node_rank == 0 && world_rank != 0)
+    {
+        pack.resize(gidx_t(npack)*ncol+1);
+        nodebuf = &pack[0];
+    }
+    MPI_Gatherv(sendbuf, nrow, row_type,
+                nodebuf, &ncnt[0], &noff[0], row_type, 0, nc->node);
+    
+    if(nc->leaders != MPI_COMM_NULL)
+    {
+        int nleaders;
+        MPI_Comm_size(nc->leaders, &nleaders);
+        if(world_rank == 0)
+        {
+            std::vector<MPI_Request> reqs(nleaders);
+            std::vector<MPI_Datatype> types(nleaders);
+            for(int l=1;l<nleaders;l++)
+            {
+                int nm = nc->member_offsets[l+1]-nc->member_offsets[l];
+                std::vector<int> blen(nm), disp(nm);
+                for(int i=0;i<nm;i++)
+                {
+                    blen[i] = nlocs[nc->members[nc->member_offsets[l]+i]];
+                    disp[i] = offsets[nc->members[nc->member_offsets[l]+i]];
+                }
+                MPI_Type_indexed(nm, &blen[0], &disp[0], row_type, &types[l]);
+                MPI_Type_commit(&types[l]);
+                MPI_Irecv(recvbuf, 1, types[l], l, 0, nc->leaders, &reqs[l]);
+            }
+            if(nleaders > 1)
+            {
+                MPI_Waitall(nleaders-1, &reqs[1], MPI_STATUSES_IGNORE);
+            }
+            for(int l=1;l<nleaders;l++)
+            {
+                MPI_Type_free(&types[l]);
+            }
+        }
+        else
+        {
+            MPI_Send(nodebuf, npack, row_type, 0, 0, nc->leaders);
+        }
+    }
+    
+    MPI_Type_free(&row_type);
+    FreeNodeComm(nc);
+}
+
+// Broadcasts nrow x ncol rows from rank 0 over the node leaders first and then within
+// every node, the reverse path of GatherRowsOnRoot.
+template<typename T>
+void BcastRowsFromRoot(T* buf, int nrow, int ncol, MPI_Comm comm)
+{
+    NodeComm* nc = SplitNodeComm(comm);
+    
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(ncol, get_mpi_datatype<T>(), &row_type);
+    MPI_Type_commit(&row_type);
+    
+    if(nc->leaders != MPI_COMM_NULL)
+    {
+        MPI_Bcast(buf, nrow, row_type, 0, nc->leaders);
+    }
+    MPI_Bcast(buf, nrow, row_type, 0, nc->node);
+    
+    MPI_Type_free(&row_type);
+    FreeNodeComm(nc);
+}
+
 template<typename T>
 Array<T>* GatherArrayOnRoot(Array<T>* A,MPI_Comm comm, MPI_Info info)
 {
@@ -37,8 +201,6 @@ Array<T>* GatherArrayOnRoot(Array<T>* A,MPI_Comm comm, MPI_Info info)
     int rank;
     MPI_Comm_rank(comm, &rank);
     
-    MPI_Datatype mpi_dtype = get_mpi_datatype<T>();
-    
     int nglob = 0;
     int ncol  = A->getNcol();
     Array<T>* gA;
@@ -53,14 +215,14 @@ Array<T>* GatherArrayOnRoot(Array<T>* A,MPI_Comm comm, MPI_Info info)
         
         if(i==rank)
         {
-            G_nlocs[i] = A->getNrow()*A->getNcol();
+            G_nlocs[i] = A->getNrow();
         }
         else
         {
             G_nlocs[i] = 0;
         }
     }
-    MPI_Allreduce(G_nlocs, red_G_nlocs, size, mpi_dtype, MPI_SUM, comm);
+    MPI_Allreduce(G_nlocs, red_G_nlocs, size, MPI_INT, MPI_SUM, comm);
 
     int offset = 0;
     for(int i=0;i<size;i++)
@@ -69,7 +231,6 @@ Array<T>* GatherArrayOnRoot(Array<T>* A,MPI_Comm comm, MPI_Info info)
         offset       = offset+red_G_nlocs[i];
         nglob        = nglob+red_G_nlocs[i];
     }
-    nglob = nglob/A->getNcol();
     
     if(rank == 0)
     {
@@ -80,19 +241,103 @@ Array<T>* GatherArrayOnRoot(Array<T>* A,MPI_Comm comm, MPI_Info info)
         gA = new Array<T>(1,1);
     }
     
-    MPI_Gatherv(&A->data[0],
-                A->getNrow()*ncol,
-                MPI_INT,
-                &gA->data[0],
-                red_G_nlocs,
-                G_offsets,
-                MPI_INT, 0, comm);
+    GatherRowsOnRoot(&A->data[0], A->getNrow(), ncol, &gA->data[0], red_G_nlocs, G_offsets, comm);
+    
+    delete[] G_nlocs;
+    delete[] red_G_nlocs;
+    delete[] G_offsets;
     
     return gA;
 }
 
 
-Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, std::map<int,Array<double>*> mv_map, MPI_Comm comm);
+Array<double>* GetOptimizedMMG3DMeshOnRoot(Partition* P, US3D* us3d, TensorField* mv, MPI_Comm comm);
+
+
+SharedVertexMap* ComputeSharedVertexMap(ParallelState* xcn_pstate, int* gid, int n, MPI_Comm comm);
+
+
+std::map<int,std::vector<int> > ComputeSharedVertexRanks(ParallelState* xcn_pstate, int* gid, int n, MPI_Comm comm);
+
+
+Array<double>* GetElementDataOnPartition(ParallelState* ien_pstate, Array<double>* U, std::vector<int> gids, MPI_Comm comm);
+
+
+void ReduceElementDataToVertices(Partition* P, SharedVertexMap* svm, int n, int* gid,
+                                 std::map<int,Array<double>* > &U, int offset, int nvar,
+                                 std::map<int,double>* vol, double* Uv, MPI_Comm comm);
+
+
+// Combines the copies of the shared vertex values U[i*nvar..i*nvar+nvar-1] on their
+// owner with reduce(acc,val) and sends the result back, so that all ranks end up
+// with identical values. The copies are combined in rank order.
+template<typename F>
+void ReduceSharedVertexData(SharedVertexMap* svm, double* U, int nvar, F reduce, MPI_Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+    
+    std::vector<int> scnt(size), soff(size), rcnt(size), roff(size);
+    for(int i=0;i<size;i++)
+    {
+        scnt[i] = svm->send_counts[i]*nvar;
+        soff[i] = svm->send_offsets[i]*nvar;
+        rcnt[i] = svm->recv_counts[i]*nvar;
+        roff[i] = svm->recv_offsets[i]*nvar;
+    }
+    int nsend = svm->send_idx.size();
+    int nrecv = svm->recv_slot.size();
+    
+    std::vector<double> sbuf(nsend*nvar+1);
+    std::vector<double> rbuf(nrecv*nvar+1);
+    for(int k=0;k<nsend;k++)
+    {
+        for(int l=0;l<nvar;l++)
+        {
+            sbuf[k*nvar+l] = U[svm->send_idx[k]*nvar+l];
+        }
+    }
+    
+    MPI_Alltoallv(&sbuf[0], &scnt[0], &soff[0], MPI_DOUBLE,
+                  &rbuf[0], &rcnt[0], &roff[0], MPI_DOUBLE, comm);
+    
+    std::vector<double> acc(svm->nowned*nvar+1);
+    std::vector<char> set(svm->nowned,0);
+    for(int k=0;k<nrecv;k++)
+    {
+        int s = svm->recv_slot[k];
+        if(set[s] == 0)
+        {
+            for(int l=0;l<nvar;l++)
+            {
+                acc[s*nvar+l] = rbuf[k*nvar+l];
+            }
+            set[s] = 1;
+        }
+        else
+        {
+            reduce(&acc[s*nvar],&rbuf[k*nvar]);
+        }
+    }
+    for(int k=0;k<nrecv;k++)
+    {
+        for(int l=0;l<nvar;l++)
+        {
+            rbuf[k*nvar+l] = acc[svm->recv_slot[k]*nvar+l];
+        }
+    }
+    
+    MPI_Alltoallv(&rbuf[0], &rcnt[0], &roff[0], MPI_DOUBLE,
+                  &sbuf[0], &scnt[0], &soff[0], MPI_DOUBLE, comm);
+    
+    for(int k=0;k<nsend;k++)
+    {
+        for(int l=0;l<nvar;l++)
+        {
+            U[svm->send_idx[k]*nvar+l] = sbuf[k*nvar+l];
+        }
+    }
+}
 
 
 Mesh* ReduceMeshToRoot(ParArray<int>* ien,
@@ -6,24 +6,26 @@
 
 
 
+// Row distribution of a global array of N rows. The offsets and N are gidx_t, the
+// local counts int.
 class ParallelState {
    public:
-    ParallelState(int N, MPI_Comm c);
-    int* getOffsets( void );
+    ParallelState(gidx_t N, MPI_Comm c);
+    gidx_t* getOffsets( void );
     int* getNlocs( void );
     int getNloc( int rank );
-    int getOffset (int rank );
-    int getNel( void );
+    gidx_t getOffset (int rank );
+    gidx_t getNel( void );
     
       
    private:
-      int Nel;
+      gidx_t Nel;
       MPI_Comm comm;
-      int* offsets;
+      gidx_t* offsets;
       int* nlocs;
 };
 
-inline ParallelState::ParallelState(int N, MPI_Comm c)
+inline ParallelState::ParallelState(gidx_t N, MPI_Comm c)
 {
     Nel  = N;
     comm = c;
@@ -34,38 +36,19 @@ inline ParallelState::ParallelState(int N, MPI_Comm c)
     // Get the rank of the process;
     int rank;
     MPI_Comm_rank(comm, &rank);
-    int nloc             = int(N/size) + ( rank < N%size );
+    int nloc             = int(N/size + ( rank < N%size ));
     //  compute offset of rows for each proc;
-    int offset           = rank*int(N/size) + MIN(rank, N%size);
+    gidx_t offset        = rank*(N/size) + MIN(gidx_t(rank), N%size);
      
-    int* proc_nlocs                 = new int[size];
-    int* proc_offset                = new int[size];
     nlocs                           = new int[size];
-    offsets                         = new int[size];
-    //std::cout << offset << std::endl;
-    for(int i=0;i<size;i++)
-    {
-        nlocs[i]   = 0;
-        offsets[i] = 0;
-         
-        if(i==rank)
-        {
-            proc_nlocs[i]  = nloc;
-            proc_offset[i] = offset;
-        }
-        else
-        {
-            proc_nlocs[i]  = 0;
-            proc_offset[i] = 0;
-        }
-    }
-     
-    MPI_Allreduce(proc_nlocs,  nlocs,   size, MPI_INT, MPI_SUM, comm);
-    MPI_Allreduce(proc_offset, offsets, size, MPI_INT, MPI_SUM, comm);
+    offsets                         = new gidx_t[size];
+    
+    MPI_Allgather(&nloc,   1, MPI_INT,  nlocs,   1, MPI_INT,  comm);
+    MPI_Allgather(&offset, 1, MPI_GIDX, offsets, 1, MPI_GIDX, comm);
      
 }// This is the constructor
 
-inline int* ParallelState::getOffsets( void )
+inline gidx_t* ParallelState::getOffsets( void )
 {
     return offsets;
 }
@@ -75,7 +58,7 @@ inline int* ParallelState::getNlocs( void )
     return nlocs;
 }
 
-inline int ParallelState::getOffset( int rank )
+inline gidx_t ParallelState::getOffset( int rank )
 {
     return offsets[rank];
 }
@@ -86,7 +69,7 @@ inline int ParallelState::getNloc( int rank )
     return nloc;
 }
 
-inline int ParallelState::getNel( void )
+inline gidx_t ParallelState::getNel( void )
 {
   return Nel;
 }
@@ -276,11 +276,13 @@ void Partition::DeterminePartitionLayout(ParArray<int>* ien, ParallelState_Parme
 //    xadj = xadj_par;
 //    adjcny = adjncy_par;
     
+    // The element offsets fit an int since the element ids do.
+    std::vector<int> ien_displs(ien_pstate->getOffsets(),ien_pstate->getOffsets()+size);
     MPI_Allgatherv(&part->data[0],
                    nloc, MPI_INT,
                    &part_global->data[0],
                    ien_pstate->getNlocs(),
-                   ien_pstate->getOffsets(),
+                   &ien_displs[0],
                    MPI_INT,comm);
     
     
@@ -3525,7 +3527,7 @@ std::map<int,std::vector<int> > Partition::getGlobElem2GlobVerts()
 }
 std::map<int,std::vector<int> > Partition::getGlobVert2GlobElem()
 {
-    return globElem2globVerts;
+    return globVerts2globElem;
 }
 std::map<int,int> Partition::getGlobalElement2LocalElement()
 {
@@ -443,190 +443,233 @@ std::map<int,Array<double>* > ComputedUdx_LSQ_Vrt_US3D(Partition* Pa, std::map<i
 
 
 
+// Convenience version that builds the geometry cache of the partition itself.
 std::map<int,Array<double>* > ComputedUdx_LSQ_US3D(Partition* Pa, std::map<int,Array<double>* > U, Array<double>* ghost, MPI_Comm comm)
+{
+    Mesh_Geometry* geom = new Mesh_Geometry(Pa, comm);
+    std::map<int,Array<double>* > dudx_map = ComputedUdx_LSQ_US3D_Vec(Pa, geom, U, 1, ghost, comm);
+    delete geom;
+    return dudx_map;
+}
+
+
+
+// Solves the stencils of the elements in el (indices into the local element
+// list) that all have M neighbours in batches of LSQ_BATCH elements. A and B hold
+// the column-major stencil matrices (M x 3) and right-hand sides (M x nvar) of
+// all local elements, starting at offA[e] and offB[e]. The batches are
+// distributed over the threads and each result is written to its own slot in res.
+template<int M>
+void SolveLSQStencilsInBatches(std::vector<int>& el, double* A, int* offA, double* B, int* offB, int nvar, std::vector<Array<double>* >& res)
+{
+    int nel      = el.size();
+    int nbatches = (nel+LSQ_BATCH-1)/LSQ_BATCH;
+    
+#pragma omp parallel
+    {
+        double* Ab = new double[3*M*LSQ_BATCH];
+        double* Bb = new double[nvar*M*LSQ_BATCH];
+        double* Xb = new double[nvar*3*LSQ_BATCH];
+        
+#pragma omp for schedule(static)
+        for(int bt=0;bt<nbatches;bt++)
+        {
+            int e0 = bt*LSQ_BATCH;
+            for(int l=0;l<LSQ_BATCH;l++)
+            {
+                int e = e0+l;
+                // Unused lanes of the last batch get a well-posed dummy system.
+                for(int j=0;j<3;j++)
+                {
+                    for(int i=0;i<M;i++)
+                    {
+                        Ab[(j*M+i)*LSQ_BATCH+l] = (e<nel) ? A[offA[el[e]]+j*M+i] : (i==j ? 1.0 : 0.0);
+                    }
+                }
+                for(int q=0;q<nvar;q++)
+                {
+                    for(int i=0;i<M;i++)
+                    {
+                        Bb[(q*M+i)*LSQ_BATCH+l] = (e<nel) ? B[offB[el[e]]+q*M+i] : 0.0;
+                    }
+                }
+            }
+            
+            SolveLSQ3_Batch<M>(Ab,Bb,nvar,Xb);
+            
+            for(int l=0;l<LSQ_BATCH && e0+l<nel;l++)
+            {
+                Array<double>* dudx = new Array<double>(3*nvar,1);
+                for(int q=0;q<nvar;q++)
+                {
+                    for(int j=0;j<3;j++)
+                    {
+                        dudx->setVal(q*3+j,0,Xb[(q*3+j)*LSQ_BATCH+l]);
+                    }
+                }
+                res[el[e0+l]] = dudx;
+            }
+        }
+        
+        delete[] Ab;
+        delete[] Bb;
+        delete[] Xb;
+    }
+}
+
+
+
+// Reconstructs the gradient of nvar variables at once. U[elID] holds the nvar
+// values of an element as an (nvar,1) state vector (the layout used by
+// AddStateVecForAdjacentElements). The stencil geometry and the QR factorization
+// are computed once per element and applied to all variables. The result for each
+// element is an (3*nvar,1) array ordered as [dU0/dx,dU0/dy,dU0/dz,dU1/dx,...].
+// Stencils of 4, 5 and 6 neighbours (tets, prisms/pyramids, hexes) are collected
+// and solved by the fixed-size batched kernel, any other size falls back to LAPACK.
+// The stencil assembly and the solves are threaded with OpenMP; the shared maps
+// are only read (find/at) inside the parallel regions.
+std::map<int,Array<double>* > ComputedUdx_LSQ_US3D_Vec(Partition* Pa, Mesh_Geometry* geom, std::map<int,Array<double>* > U, int nvar, Array<double>* ghost, MPI_Comm comm)
 {
    int world_size;
    MPI_Comm_size(comm, &world_size);
    // Get the rank of the process
    int world_rank;
    MPI_Comm_rank(comm, &world_rank);
-   std::vector<Vert*> LocalVs             = Pa->getLocalVerts();
-   std::map<int,std::vector<int> > gE2lV = Pa->getGlobElem2LocVerts();
-   std::map<int,std::vector<int> > gE2gF = Pa->getglobElem2globFaces();
-   std::map<int,int> gV2lV               = Pa->getGlobalVert2LocalVert();
-   std::map<int,int> gE2lE               = Pa->getGlobalElement2LocalElement();
    std::vector<int> Loc_Elem             = Pa->getLocElem();
     
    int nLoc_Elem                         = Loc_Elem.size();
     
    int Nel = Pa->getGlobalPartition()->getNrow();
-   i_part_map*  ifn_vec         = Pa->getIFNpartmap();
-   i_part_map* ief_part_map     = Pa->getIEFpartmap();
    i_part_map*  iee_vec         = Pa->getIEEpartmap();
-   i_part_map* if_Nv_part_map   = Pa->getIF_Nvpartmap();
-
-   std::vector<std::vector<double> > iee_dist;
-   std::vector<double> dist;
+    
+   double* elem_cc  = geom->getElemCentroids();
+   double* face_cc  = geom->getFaceCenters();
+   int* face_offset = geom->getFaceOffsets();
 
    std::map<int,Array<double>* > dudx_map;
-   double d;
-   int loc_vid,adjID,elID;
-   int cou = 0;
-   Vert* Vc = new Vert;
-   Vert* Vadj;
-   int lid = 0;
-   double u_ijk, u_po;
-   //Array<double>* dudx = new Array<double>(nLoc_Elem,3);
    std::map<int,int> LocElem2Nf = Pa->getLocElem2Nf();
-   std::map<int,int> LocElem2Nv = Pa->getLocElem2Nv();
+    
+   // Offsets of the stencil of each local element in A_all and b_all.
+   int* offA = new int[nLoc_Elem+1];
+   int* offB = new int[nLoc_Elem+1];
+   offA[0] = 0;
+   offB[0] = 0;
+   for(int i=0;i<nLoc_Elem;i++)
+   {
+       int nadj  = LocElem2Nf[Loc_Elem[i]];
+       offA[i+1] = offA[i]+nadj*3;
+       offB[i+1] = offB[i]+nadj*nvar;
+   }
+   double* A_all = new double[offA[nLoc_Elem]];
+   double* b_all = new double[offB[nLoc_Elem]];
 
+#pragma omp parallel for schedule(static)
    for(int i=0;i<nLoc_Elem;i++)
    {
        int elID  = Loc_Elem[i];
-       int NvPEl = LocElem2Nv[elID];
-       int nadj  = LocElem2Nf[elID];
+       int eidx  = geom->getElemIndex(elID);
+       const std::vector<int>& adj  = iee_vec->i_map.at(elID);
+       const Array<double>* U_ijk   = U.at(elID);
+       int nadj  = (offA[i+1]-offA[i])/3;
+       const double* Vijk = &elem_cc[eidx*3];
        
-       Array<double>* Vrt_T = new Array<double>(3,nadj);
-       Array<double>* Vrt   = new Array<double>(nadj,3);
-       Array<double>* b     = new Array<double>(nadj,1);
-
-       for(int q=0;q<nadj;q++)
+       // A_cm holds the (nadj x 3) stencil matrix and b_cm the (nadj x nvar)
+       // right-hand sides, both stored column-major for LAPACK.
+       double* A_cm = &A_all[offA[i]];
+       double* b_cm = &b_all[offB[i]];
+       
+       for(int t=0;t<nadj;t++)
        {
-           for(int j=0;j<3;j++)
+           int adjID = adj[t];
+           const double* Vadj;
+           
+           // Neighbouring element centroid or, for a boundary face, the face center.
+           if(adjID<Nel)
            {
-               Vrt_T->setVal(j,q,0.0);
-               Vrt->setVal(q,j,0.0);
+               Vadj = &elem_cc[geom->getElemIndex(adjID)*3];
            }
-       }
-       double* Pijk = new double[NvPEl*3];
-       for(int k=0;k<gE2lV[elID].size();k++)
-       {
-           loc_vid     = gE2lV[elID][k];
-           Pijk[k*3+0] = LocalVs[loc_vid]->x;
-           Pijk[k*3+1] = LocalVs[loc_vid]->y;
-           Pijk[k*3+2] = LocalVs[loc_vid]->z;
-       }
-       
-       Vert* Vijk   = ComputeCentroidCoord(Pijk,NvPEl);
-       
-       u_ijk        = U[elID]->getVal(0,0);
-       int t        = 0;
-       
-       for(int j=0;j<nadj;j++)
-       {
-           int adjID = iee_vec->i_map[elID][j];
-           //int NvPAdjEl = LocElem2Nv[adjID];
-           double* Padj = new double[gE2lV[adjID].size()*3];
+           else
+           {
+               Vadj = &face_cc[(face_offset[eidx]+t)*3];
+           }
+           
+           double d = sqrt((Vadj[0]-Vijk[0])*(Vadj[0]-Vijk[0])+
+                           (Vadj[1]-Vijk[1])*(Vadj[1]-Vijk[1])+
+                           (Vadj[2]-Vijk[2])*(Vadj[2]-Vijk[2]));
 
+           A_cm[0*nadj+t] = (1.0/d)*(Vadj[0]-Vijk[0]);
+           A_cm[1*nadj+t] = (1.0/d)*(Vadj[1]-Vijk[1]);
+           A_cm[2*nadj+t] = (1.0/d)*(Vadj[2]-Vijk[2]);
+           
            if(adjID<Nel)
            {
-               
-               u_po = U[adjID]->getVal(0,0);
-    
-               for(int k=0;k<gE2lV[adjID].size();k++)
+               const Array<double>* U_adj = U.at(adjID);
+               for(int q=0;q<nvar;q++)
                {
-                   loc_vid     = gE2lV[adjID][k];
-                   Padj[k*3+0] = LocalVs[loc_vid]->x;
-                   Padj[k*3+1] = LocalVs[loc_vid]->y;
-                   Padj[k*3+2] = LocalVs[loc_vid]->z;
+                   b_cm[q*nadj+t] = (1.0/d)*(U_adj->data[q]-U_ijk->data[q]);
                }
-               
-               Vadj = ComputeCentroidCoord(Padj,gE2lV[adjID].size());
-               
-               d = sqrt((Vadj->x-Vijk->x)*(Vadj->x-Vijk->x)+
-                        (Vadj->y-Vijk->y)*(Vadj->y-Vijk->y)+
-                        (Vadj->z-Vijk->z)*(Vadj->z-Vijk->z));
-
-               Vrt->setVal(t,0,(1.0/d)*(Vadj->x-Vijk->x));
-               Vrt->setVal(t,1,(1.0/d)*(Vadj->y-Vijk->y));
-               Vrt->setVal(t,2,(1.0/d)*(Vadj->z-Vijk->z));
-               
-               b->setVal(t,0,(1.0/d)*(u_po-u_ijk));
-               delete Vadj;
-               dist.push_back(d);
-               t++;
-               
            }
            else
            {
-               //int fid = gE2gF[elID][j];
-               int fid    = ief_part_map->i_map[elID][j];
-               int NvPerF = if_Nv_part_map->i_map[fid][0];
-               //std::cout << "NvPerF " << NvPerF << std::endl;
-               Vc->x = 0.0;
-               Vc->y = 0.0;
-               Vc->z = 0.0;
-               
-               for(int s=0;s<NvPerF;s++)
+               for(int q=0;q<nvar;q++)
                {
-                   //int gvid_o = ifn->getVal(fid,s);
-                   int gvid = ifn_vec->i_map[fid][s];
-                   int lvid = gV2lV[gvid];
-
-                   Vc->x = Vc->x+LocalVs[lvid]->x;
-                   Vc->y = Vc->y+LocalVs[lvid]->y;
-                   Vc->z = Vc->z+LocalVs[lvid]->z;
+                   b_cm[q*nadj+t] = 0.0;
                }
-
-               
-               Vc->x = Vc->x/NvPerF;
-               Vc->y = Vc->y/NvPerF;
-               Vc->z = Vc->z/NvPerF;
-               
-
-               d = sqrt((Vc->x-Vijk->x)*(Vc->x-Vijk->x)+
-                        (Vc->y-Vijk->y)*(Vc->y-Vijk->y)+
-                        (Vc->z-Vijk->z)*(Vc->z-Vijk->z));
-
-               //u_po = ghost->getVal(adjID-Nel,0);
-               //u_po = u_ijk;
-               //u_po = U[elID];
-               //double u_fpo = ghost->getVal(adjID-Nel,0);
-
-               Vrt->setVal(t,0,(1.0/d)*(Vc->x-Vijk->x));
-               Vrt->setVal(t,1,(1.0/d)*(Vc->y-Vijk->y));
-               Vrt->setVal(t,2,(1.0/d)*(Vc->z-Vijk->z));
-               
-//               if(isnan(Vrt->getVal(t,0)) || isnan(Vrt->getVal(t,1)) || isnan(Vrt->getVal(t,2)))
-//               {
-//                   std::cout << "Vc = (" << Vc->x << ", " << Vc->y << ", " << Vc->z << ") " << std::endl;
-//               }
-               
-               b->setVal(t,0,(1.0/d)*(0.0));
-               t++;
-               //dist.push_back(d);
            }
-           
-           delete[] Padj;
-           
-      }
+       }
+   }
+    
+   // Stencils collected per size (index nadj-4) for the batched solve.
+   std::vector<std::vector<int> > bucket_el(3);
+   std::vector<int> other_el;
+   for(int i=0;i<nLoc_Elem;i++)
+   {
+       int nadj = (offA[i+1]-offA[i])/3;
+       if(nadj>=4 && nadj<=6)
+       {
+           bucket_el[nadj-4].push_back(i);
+       }
+       else
+       {
+           other_el.push_back(i);
+       }
+   }
+    
+   std::vector<Array<double>* > res(nLoc_Elem);
+    
+   SolveLSQStencilsInBatches<4>(bucket_el[0],A_all,offA,b_all,offB,nvar,res);
+   SolveLSQStencilsInBatches<5>(bucket_el[1],A_all,offA,b_all,offB,nvar,res);
+   SolveLSQStencilsInBatches<6>(bucket_el[2],A_all,offA,b_all,offB,nvar,res);
+    
+#pragma omp parallel for schedule(static)
+   for(size_t k=0;k<other_el.size();k++)
+   {
+       int i    = other_el[k];
+       int nadj = (offA[i+1]-offA[i])/3;
+       Array<double>* x    = SolveQR_MultiRHS(&A_all[offA[i]],nadj,3,&b_all[offB[i]],nvar);
+       Array<double>* dudx = new Array<double>(3*nvar,1);
        
-      double* A_cm = new double[nadj*3];
-      for(int s=0;s<nadj;s++)
-      {
-          for(int j=0;j<3;j++)
-          {
-              A_cm[j*nadj+s] = Vrt->getVal(s,j);
-          }
-      }
+       for(int q=0;q<nvar;q++)
+       {
+           dudx->setVal(q*3+0,0,x->getVal(0,q));
+           dudx->setVal(q*3+1,0,x->getVal(1,q));
+           dudx->setVal(q*3+2,0,x->getVal(2,q));
+       }
        
-       Array<double>* x = SolveQR(A_cm,nadj,3,b);
-
-       //std::cout << x->getVal(0,0) << " " <<  x->getVal(1,0) << " " << x->getVal(2,0) << std::endl;
+       res[i] = dudx;
        
-       dudx_map[elID] = x;
-       delete[] A_cm;
-       //delete x;
-       delete[] Pijk;
-       delete Vrt_T;
-       delete Vrt;
-       delete b;
-
-       //iee_dist.push_back(dist);
-       //dist.clear();
+       delete x;
    }
     
-    delete Vc;
+   for(int i=0;i<nLoc_Elem;i++)
+   {
+       dudx_map[Loc_Elem[i]] = res[i];
+   }
+    
+   delete[] offA;
+   delete[] offB;
+   delete[] A_all;
+   delete[] b_all;
     
    return dudx_map;
 }
@@ -678,6 +721,15 @@ std::map<int,Array<double>* >  ComputedUdx_MGG(Partition* Pa, std::map<int,doubl
         gu_c_old->setVal(i,2,1.0);
     }
     
+    // One output array per local element, allocated up front so that the
+    // threaded sweep only writes into existing entries.
+    std::vector<Array<double>* > gudxi_l(nLoc_Elem);
+    for(int i=0;i<nLoc_Elem;i++)
+    {
+        gudxi_l[i] = new Array<double>(3,1);
+        gudxi[Loc_Elem[i]] = gudxi_l[i];
+    }
+    
     std::cout << "Computing the MGG " << std::endl;
     std::map<int,vector<Vec3D*> > normals   = meshTopo->getNormals();
     std::map<int,vector<Vec3D*> > rvector   = meshTopo->getRvectors();
@@ -717,92 +769,88 @@ std::map<int,Array<double>* >  ComputedUdx_MGG(Partition* Pa, std::map<int,doubl
         L2normy = 0.0;
         L2normz = 0.0;
         
+        // The element loop is threaded; the maps are only read inside the loop
+        // and the new gradients are copied into gu_c_*_m afterwards, so every
+        // sweep uses the gradients of the previous iteration.
+#pragma omp parallel for schedule(static) reduction(+:L2normx,L2normy,L2normz)
         for(int i=0;i<nLoc_Elem;i++)
         {
-             gEl        = Loc_Elem[i];
-             lid        = i;
-             int nadj   = LocElem2Nf[gEl];
+             int gEl    = Loc_Elem[i];
+             int lid    = i;
+             int nadj   = LocElem2Nf.at(gEl);
+             double u_nb, gu_nb_vx, gu_nb_vy, gu_nb_vz;
 
-             u_c = U[gEl];
+             double u_c = U.at(gEl);
              
-             gu_c_vx = gu_c_x->getVal(lid,0);
-             gu_c_vy = gu_c_y->getVal(lid,0);
-             gu_c_vz = gu_c_z->getVal(lid,0);
-
-             sum_phix = 0.0;
-             sum_phiy = 0.0;
-             sum_phiz = 0.0;
-             if(rvector[gEl].size()!=nadj || dxfxc[gEl].size()!=nadj)
+             double gu_c_vx = gu_c_x->getVal(lid,0);
+             double gu_c_vy = gu_c_y->getVal(lid,0);
+             double gu_c_vz = gu_c_z->getVal(lid,0);
+
+             double sum_phix = 0.0;
+             double sum_phiy = 0.0;
+             double sum_phiz = 0.0;
+            
+             const std::vector<Vec3D*>& nj_el  = normals.at(gEl);
+             const std::vector<Vec3D*>& rj_el  = rvector.at(gEl);
+             const std::vector<Vec3D*>& dx_el  = dxfxc.at(gEl);
+             const std::vector<double>& dS_el  = dS.at(gEl);
+             const std::vector<double>& dr_el  = dr.at(gEl);
+             const std::vector<int>& adj       = iee_vec->i_map.at(gEl);
+            
+             if(rj_el.size()!=nadj || dx_el.size()!=nadj)
              {
                  std::cout << "Huge error " << std::endl;
              }
              for(int j=0;j<nadj;j++)
              {
-                 adjID   = iee_vec->i_map[gEl][j];
+                 int adjID   = adj[j];
                  
                  if(adjID<Nel)
                  {
-                     //l_adjid = gE2lE[adjID];
-                     gu_nb_vx = gu_c_x_m[adjID];
-                     gu_nb_vy = gu_c_y_m[adjID];
-                     gu_nb_vz = gu_c_z_m[adjID];
-                     
-//                   gu_nb_vx = dUdxi_p_bnd[adjID][0];//dUdx_p_bnd[adjID];
-//                   gu_nb_vy = dUdxi_p_bnd[adjID][1];//dUdy_p_bnd[adjID];
-//                   gu_nb_vz = dUdxi_p_bnd[adjID][2];//dUdz_p_bnd[adjID];
+                     gu_nb_vx = gu_c_x_m.at(adjID);
+                     gu_nb_vy = gu_c_y_m.at(adjID);
+                     gu_nb_vz = gu_c_z_m.at(adjID);
                      
-                     u_nb = U[adjID];
+                     u_nb = U.at(adjID);
                  }
                  else
                  {
                      u_nb     = ghost->getVal(adjID-Nel,0);
                      //u_nb     = U[gEl];
-                     gu_nb_vx = gu_c_x->getVal(lid,0);
-                     gu_nb_vy = gu_c_y->getVal(lid,0);
-                     gu_nb_vz = gu_c_z->getVal(lid,0);
-//
-//                     u_nb     = 0.0;
-//                     gu_nb_vx = 0.0;
-//                     gu_nb_vy = 0.0;
-//                     gu_nb_vz = 0.0;
-                     
+                     gu_nb_vx = gu_c_vx;
+                     gu_nb_vy = gu_c_vy;
+                     gu_nb_vz = gu_c_vz;
                  }
                  
-                 nj          = normals[gEl][j];
-                 rj          = rvector[gEl][j];
+                 Vec3D* nj   = nj_el[j];
+                 Vec3D* rj   = rj_el[j];
                  
                  double alpha = DotVec3D(nj,rj);
 
-                 Vec3D* nf_m_arf = new Vec3D;
+                 Vec3D nf_m_arf;
 
-                 nf_m_arf->c0=nj->c0-alpha*rj->c0;
-                 nf_m_arf->c1=nj->c1-alpha*rj->c1;
-                 nf_m_arf->c2=nj->c2-alpha*rj->c2;
+                 nf_m_arf.c0=nj->c0-alpha*rj->c0;
+                 nf_m_arf.c1=nj->c1-alpha*rj->c1;
+                 nf_m_arf.c2=nj->c2-alpha*rj->c2;
 
-                 dphi_dn = alpha * (u_nb - u_c)/dr[gEl][j] +  0.5 * ((gu_nb_vx + gu_c_vx) * nf_m_arf->c0
-                                                                  +  (gu_nb_vy + gu_c_vy) * nf_m_arf->c1
-                                                                  +  (gu_nb_vz + gu_c_vz) * nf_m_arf->c2);
-                 
-                 sum_phix = sum_phix+dphi_dn*dxfxc[gEl][j]->c0*dS[gEl][j];
-                 sum_phiy = sum_phiy+dphi_dn*dxfxc[gEl][j]->c1*dS[gEl][j];
-                 sum_phiz = sum_phiz+dphi_dn*dxfxc[gEl][j]->c2*dS[gEl][j];
+                 double dphi_dn = alpha * (u_nb - u_c)/dr_el[j] +  0.5 * ((gu_nb_vx + gu_c_vx) * nf_m_arf.c0
+                                                                       +  (gu_nb_vy + gu_c_vy) * nf_m_arf.c1
+                                                                       +  (gu_nb_vz + gu_c_vz) * nf_m_arf.c2);
                  
-                 delete nf_m_arf;
+                 sum_phix = sum_phix+dphi_dn*dx_el[j]->c0*dS_el[j];
+                 sum_phiy = sum_phiy+dphi_dn*dx_el[j]->c1*dS_el[j];
+                 sum_phiz = sum_phiz+dphi_dn*dx_el[j]->c2*dS_el[j];
              }
              
-             Vol = vol[gEl];
+             double Vol = vol.at(gEl);
              
-             gu_c_old->setVal(i,0,gu_c_x->getVal(i,0));
-             gu_c_old->setVal(i,1,gu_c_y->getVal(i,0));
-             gu_c_old->setVal(i,2,gu_c_z->getVal(i,0));
+             gu_c_old->setVal(i,0,gu_c_vx);
+             gu_c_old->setVal(i,1,gu_c_vy);
+             gu_c_old->setVal(i,2,gu_c_vz);
              
              gu_c_x->setVal(i,0,1.0/Vol*sum_phix);
              gu_c_y->setVal(i,0,1.0/Vol*sum_phiy);
              gu_c_z->setVal(i,0,1.0/Vol*sum_phiz);
-             
-             gu_c_x_m[gEl] = 1.0/Vol*sum_phix;
-             gu_c_y_m[gEl] = 1.0/Vol*sum_phiy;
-             gu_c_z_m[gEl] = 1.0/Vol*sum_phiz;
 
              L2normx = L2normx+ sqrt((gu_c_x->getVal(i,0)-gu_c_old->getVal(i,0))*(gu_c_x->getVal(i,0)-gu_c_old->getVal(i,0)));
 
@@ -810,12 +858,18 @@ std::map<int,Array<double>* >  ComputedUdx_MGG(Partition* Pa, std::map<int,doubl
 
              L2normz = L2normz+ sqrt((gu_c_z->getVal(i,0)-gu_c_old->getVal(i,2))*(gu_c_z->getVal(i,0)-gu_c_old->getVal(i,2)));
             
-            gudxi[gEl] = new Array<double>(3,1);
-            gudxi[gEl]->setVal(0,0,1.0/Vol*sum_phix);
-            gudxi[gEl]->setVal(1,0,1.0/Vol*sum_phiy);
-            gudxi[gEl]->setVal(2,0,1.0/Vol*sum_phiz);
+             gudxi_l[i]->setVal(0,0,1.0/Vol*sum_phix);
+             gudxi_l[i]->setVal(1,0,1.0/Vol*sum_phiy);
+             gudxi_l[i]->setVal(2,0,1.0/Vol*sum_phiz);
          }
         
+        for(int i=0;i<nLoc_Elem;i++)
+        {
+            gu_c_x_m[Loc_Elem[i]] = gu_c_x->getVal(i,0);
+            gu_c_y_m[Loc_Elem[i]] = gu_c_y->getVal(i,0);
+            gu_c_z_m[Loc_Elem[i]] = gu_c_z->getVal(i,0);
+        }
+        
 //        dUdx_p_bnd.clear();
 //        dUdy_p_bnd.clear();
 //        dUdz_p_bnd.clear();
@@ -849,3 +903,334 @@ std::map<int,Array<double>* >  ComputedUdx_MGG(Partition* Pa, std::map<int,doubl
     return gudxi;
 }
 
+
+
+
+// Completes the vertex patches of the local elements across the partition boundary.
+// The elements around each vertex are collected on the rank that owns the vertex in the
+// xcn distribution and sent back to all ranks that reference it. The centroids and values
+// [cx,cy,cz,u(nvar)] of the patch elements that are not in U are fetched from their owners
+// and stored in far. Returns the complete vertex to element map of the local vertices.
+static std::map<int,std::vector<int> > GetVertexPatchHalo(Partition* Pa, Mesh_Geometry* geom, std::map<int,Array<double>* >& U, int nvar, std::map<int,std::vector<double> >& far, MPI_Comm comm)
+{
+   int world_size;
+   MPI_Comm_size(comm, &world_size);
+   // Get the rank of the process
+   int world_rank;
+   MPI_Comm_rank(comm, &world_rank);
+   std::map<int,std::vector<int> > gE2gV  = Pa->getGlobElem2GlobVerts();
+   std::vector<int> Loc_Elem              = Pa->getLocElem();
+   Array<int>* part_global                = Pa->getGlobalPartition();
+   gidx_t* xcn_offsets                    = Pa->getXcnParallelState()->getOffsets();
+   double* elem_cc                        = geom->getElemCentroids();
+   
+   // Send [v,elem,rank] for every vertex of the local elements to the owner of the vertex.
+   std::vector<std::vector<int> > send(world_size);
+   for(int i=0;i<Loc_Elem.size();i++)
+   {
+       const std::vector<int>& vrts = gE2gV.at(Loc_Elem[i]);
+       for(int k=0;k<vrts.size();k++)
+       {
+           int dest = std::upper_bound(xcn_offsets,xcn_offsets+world_size,vrts[k])-xcn_offsets-1;
+           send[dest].push_back(vrts[k]);
+           send[dest].push_back(Loc_Elem[i]);
+           send[dest].push_back(world_rank);
+       }
+   }
+   std::vector<int> recv = ExchangeVectors(send, MPI_INT, comm);
+   
+   std::map<int,std::vector<int> > v2e;
+   std::map<int,std::set<int> > v2r;
+   for(int i=0;i<recv.size();i+=3)
+   {
+       v2e[recv[i]].push_back(recv[i+1]);
+       v2r[recv[i]].insert(recv[i+2]);
+   }
+   
+   // Send [v,n,elem_1..elem_n] back to all ranks that reference the vertex.
+   for(int r=0;r<world_size;r++)
+   {
+       send[r].clear();
+   }
+   std::map<int,std::vector<int> >::iterator itv;
+   for(itv=v2e.begin();itv!=v2e.end();itv++)
+   {
+       std::set<int>& ranks = v2r[itv->first];
+       std::set<int>::iterator itr;
+       for(itr=ranks.begin();itr!=ranks.end();itr++)
+       {
+           send[*itr].push_back(itv->first);
+           send[*itr].push_back(itv->second.size());
+           send[*itr].insert(send[*itr].end(),itv->second.begin(),itv->second.end());
+       }
+   }
+   recv = ExchangeVectors(send, MPI_INT, comm);
+   
+   std::map<int,std::vector<int> > gV2gE;
+   std::set<int> missing;
+   int p = 0;
+   while(p<recv.size())
+   {
+       int v = recv[p];
+       int n = recv[p+1];
+       gV2gE[v].assign(recv.begin()+p+2,recv.begin()+p+2+n);
+       for(int k=0;k<n;k++)
+       {
+           if(U.find(recv[p+2+k])==U.end())
+           {
+               missing.insert(recv[p+2+k]);
+           }
+       }
+       p = p+2+n;
+   }
+   
+   // Request [elem,rank] from the owners of the missing elements.
+   for(int r=0;r<world_size;r++)
+   {
+       send[r].clear();
+   }
+   std::set<int>::iterator itm;
+   for(itm=missing.begin();itm!=missing.end();itm++)
+   {
+       int dest = part_global->getVal(*itm,0);
+       send[dest].push_back(*itm);
+       send[dest].push_back(world_rank);
+   }
+   recv = ExchangeVectors(send, MPI_INT, comm);
+   
+   std::vector<std::vector<double> > sendd(world_size);
+   for(int i=0;i<recv.size();i+=2)
+   {
+       int elID = recv[i];
+       int dest = recv[i+1];
+       const double* Vc = &elem_cc[geom->getElemIndex(elID)*3];
+       Array<double>* u = U.at(elID);
+       sendd[dest].push_back(elID);
+       sendd[dest].push_back(Vc[0]);
+       sendd[dest].push_back(Vc[1]);
+       sendd[dest].push_back(Vc[2]);
+       for(int v=0;v<nvar;v++)
+       {
+           sendd[dest].push_back(u->getVal(v,0));
+       }
+   }
+   std::vector<double> recvd = ExchangeVectors(sendd, MPI_DOUBLE, comm);
+   
+   for(int i=0;i<recvd.size();i+=4+nvar)
+   {
+       far[int(recvd[i])].assign(recvd.begin()+i+1,recvd.begin()+i+4+nvar);
+   }
+   
+   return gV2gE;
+}
+
+
+
+
+// Reconstructs the gradient and the Hessian of U in a single sweep by fitting
+//    u(x) = c0 + g.dx + 1/2 dx^T H dx
+// (10 coefficients) in the least-squares sense over the vertex-patch stencil of
+// each element, i.e. all elements that share a vertex with it. The patch elements
+// beyond the face halo are fetched from their owners by GetVertexPatchHalo.
+// Boundary faces are added to the stencil with a zero-gradient value like in
+// ComputedUdx_LSQ_US3D. The coordinates are scaled by the stencil radius to keep
+// the system well conditioned. All nvar variables in U share the factorization of
+// the fit. The result for each element is an (9*nvar,1) array holding for each
+// variable [dU/dx,dU/dy,dU/dz,Hxx,Hxy,Hxz,Hyy,Hyz,Hzz] at rows var*9..var*9+8.
+// Elements whose stencil has fewer than 10 points only get a linear fit (zero Hessian).
+std::map<int,Array<double>* > ComputeHessian_LSQ_US3D(Partition* Pa, Mesh_Geometry* geom, std::map<int,Array<double>* > U, int nvar, Array<double>* ghost, MPI_Comm comm)
+{
+   int world_size;
+   MPI_Comm_size(comm, &world_size);
+   // Get the rank of the process
+   int world_rank;
+   MPI_Comm_rank(comm, &world_rank);
+   std::map<int,std::vector<int> > gE2gV  = Pa->getGlobElem2GlobVerts();
+   std::vector<int> Loc_Elem              = Pa->getLocElem();
+   std::map<int,int> LocElem2Nf           = Pa->getLocElem2Nf();
+   
+   std::map<int,std::vector<double> > far;
+   std::map<int,std::vector<int> > gV2gE  = GetVertexPatchHalo(Pa, geom, U, nvar, far, comm);
+    
+   int nLoc_Elem = Loc_Elem.size();
+   int Nel       = Pa->getGlobalPartition()->getNrow();
+    
+   i_part_map* iee_vec        = Pa->getIEEpartmap();
+    
+   double* elem_cc  = geom->getElemCentroids();
+   double* face_cc  = geom->getFaceCenters();
+   int* face_offset = geom->getFaceOffsets();
+    
+   std::vector<Array<double>* > res(nLoc_Elem);
+   int nlinear = 0;
+    
+#pragma omp parallel for schedule(dynamic,64) reduction(+:nlinear)
+   for(int i=0;i<nLoc_Elem;i++)
+   {
+       int elID = Loc_Elem[i];
+       int eidx     = geom->getElemIndex(elID);
+       Array<double>* u_ijk = U.at(elID);
+       const double* Vijk = &elem_cc[eidx*3];
+       
+       // Collect the vertex patch of the element.
+       std::vector<int> patch;
+       const std::vector<int>& vrts = gE2gV.at(elID);
+       for(int k=0;k<vrts.size();k++)
+       {
+           const std::vector<int>& vel = gV2gE.at(vrts[k]);
+           for(int q=0;q<vel.size();q++)
+           {
+               if(vel[q]!=elID)
+               {
+                   patch.push_back(vel[q]);
+               }
+           }
+       }
+       std::sort(patch.begin(),patch.end());
+       patch.erase(std::unique(patch.begin(),patch.end()),patch.end());
+       
+       // Stencil points relative to the centroid and their values.
+       std::vector<double> dx;
+       std::vector<double> du;
+       for(int k=0;k<patch.size();k++)
+       {
+           if(U.find(patch[k])!=U.end())
+           {
+               const double* Vadj = &elem_cc[geom->getElemIndex(patch[k])*3];
+               dx.push_back(Vadj[0]-Vijk[0]);
+               dx.push_back(Vadj[1]-Vijk[1]);
+               dx.push_back(Vadj[2]-Vijk[2]);
+               Array<double>* u_adj = U.at(patch[k]);
+               for(int v=0;v<nvar;v++)
+               {
+                   du.push_back(u_adj->getVal(v,0));
+               }
+           }
+           else
+           {
+               const std::vector<double>& f = far.at(patch[k]);
+               dx.push_back(f[0]-Vijk[0]);
+               dx.push_back(f[1]-Vijk[1]);
+               dx.push_back(f[2]-Vijk[2]);
+               for(int v=0;v<nvar;v++)
+               {
+                   du.push_back(f[3+v]);
+               }
+           }
+       }
+       
+       const std::vector<int>& adj = iee_vec->i_map.at(elID);
+       for(int t=0;t<LocElem2Nf.at(elID);t++)
+       {
+           if(adj[t]>=Nel)
+           {
+               const double* Vc = &face_cc[(face_offset[eidx]+t)*3];
+               dx.push_back(Vc[0]-Vijk[0]);
+               dx.push_back(Vc[1]-Vijk[1]);
+               dx.push_back(Vc[2]-Vijk[2]);
+               for(int v=0;v<nvar;v++)
+               {
+                   du.push_back(u_ijk->getVal(v,0));
+               }
+           }
+       }
+       
+       int npts = dx.size()/3;
+       double h = 0.0;
+       for(int k=0;k<npts;k++)
+       {
+           h = std::max(h,sqrt(dx[k*3+0]*dx[k*3+0]+dx[k*3+1]*dx[k*3+1]+dx[k*3+2]*dx[k*3+2]));
+       }
+       
+       Array<double>* gH = new Array<double>(9*nvar,1);
+       for(int k=0;k<9*nvar;k++)
+       {
+           gH->setVal(k,0,0.0);
+       }
+       
+       // The element itself is the first row of the system, which makes the
+       // constant c0 a free coefficient of the fit.
+       int m  = npts+1;
+       int nc = (m>=10) ? 10 : 4;
+       double* A_cm = new double[m*nc];
+       double* b    = new double[m*nvar];
+       
+       A_cm[0] = 1.0;
+       for(int j=1;j<nc;j++)
+       {
+           A_cm[j*m] = 0.0;
+       }
+       for(int v=0;v<nvar;v++)
+       {
+           b[v*m] = u_ijk->getVal(v,0);
+       }
+       
+       for(int k=0;k<npts;k++)
+       {
+           double x = dx[k*3+0]/h;
+           double y = dx[k*3+1]/h;
+           double z = dx[k*3+2]/h;
+           int r    = k+1;
+           
+           A_cm[0*m+r] = 1.0;
+           A_cm[1*m+r] = x;
+           A_cm[2*m+r] = y;
+           A_cm[3*m+r] = z;
+           if(nc == 10)
+           {
+               A_cm[4*m+r] = 0.5*x*x;
+               A_cm[5*m+r] = x*y;
+               A_cm[6*m+r] = x*z;
+               A_cm[7*m+r] = 0.5*y*y;
+               A_cm[8*m+r] = y*z;
+               A_cm[9*m+r] = 0.5*z*z;
+           }
+           for(int v=0;v<nvar;v++)
+           {
+               b[v*m+r] = du[k*nvar+v];
+           }
+       }
+       
+       Array<double>* c = SolveQR_MultiRHS(A_cm,m,nc,b,nvar);
+       
+       for(int v=0;v<nvar;v++)
+       {
+           for(int k=0;k<3;k++)
+           {
+               gH->setVal(v*9+k,0,c->getVal(1+k,v)/h);
+           }
+           if(nc == 10)
+           {
+               for(int k=0;k<6;k++)
+               {
+                   gH->setVal(v*9+3+k,0,c->getVal(4+k,v)/(h*h));
+               }
+           }
+       }
+       if(nc != 10)
+       {
+           nlinear++;
+       }
+       
+       res[i] = gH;
+       
+       delete c;
+       delete[] A_cm;
+       delete[] b;
+   }
+    
+   std::map<int,Array<double>* > gH_map;
+   for(int i=0;i<nLoc_Elem;i++)
+   {
+       gH_map[Loc_Elem[i]] = res[i];
+   }
+    
+   int nlinear_glob = 0;
+   MPI_Allreduce(&nlinear, &nlinear_glob, 1, MPI_INT, MPI_SUM, comm);
+   if(world_rank == 0 && nlinear_glob > 0)
+   {
+       std::cout << "Number of elements with a linear fit only in ComputeHessian_LSQ_US3D: " << nlinear_glob << std::endl;
+   }
+    
+   return gH_map;
+}
@@ -2,6 +2,8 @@
 #include "adapt_math.h"
 #include "adapt_compute.h"
 #include "adapt_topology.h"
+#include "adapt_meshgeometry.h"
+#include "adapt_parops.h"
 
 #ifndef ADAPT_RECONGRAD_H
 #define ADAPT_RECONGRAD_H
@@ -24,6 +26,10 @@ std::map<int,Array<double>* > ComputedUdx_LSQ_Vrt_US3D(Partition* Pa, std::map<i
 
 std::map<int,Array<double>* >  ComputedUdx_LSQ_US3D(Partition* Pa, std::map<int,Array<double>* > U, Array<double>* ghost, MPI_Comm comm);
 
+std::map<int,Array<double>* >  ComputedUdx_LSQ_US3D_Vec(Partition* Pa, Mesh_Geometry* geom, std::map<int,Array<double>* > U, int nvar, Array<double>* ghost, MPI_Comm comm);
+
+std::map<int,Array<double>* >  ComputeHessian_LSQ_US3D(Partition* Pa, Mesh_Geometry* geom, std::map<int,Array<double>* > U, int nvar, Array<double>* ghost, MPI_Comm comm);
+
 std::map<int,Array<double>* > ComputedUdx_MGG(Partition* Pa, std::map<int,double> U,
                                Mesh_Topology* meshTopo, Array<double>* ghost, MPI_Comm comm);
 #endif
@@ -0,0 +1,854 @@
+#include "adapt_subdomain.h"
+
+// local face2vert_map for a tet in mmg  {1,2,3}, {0,3,2}, {0,1,3}, {0,2,1}
+static const int tet_faces[4][3] = {{1,2,3},{0,3,2},{0,1,3},{0,2,1}};
+
+
+
+
+
+SubdomainMesh* BuildSubdomainMeshOnPartition(Partition* P, Mesh_Geometry* geom, TensorField* mv,
+                                             BLShellInfo* BLshell, std::set<int>& shell_faces,
+                                             int freeze_interfaces, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    std::vector<int> Loc_Elem              = P->getLocElem();
+    std::vector<Vert*> LocalVs             = P->getLocalVerts();
+    std::map<int,int> gV2lV                = P->getGlobalVert2LocalVert();
+    std::map<int,std::vector<int> > gE2gV  = P->getGlobElem2GlobVerts();
+    i_part_map* iee_part_map    = P->getIEEpartmap();
+    i_part_map* ief_part_map    = P->getIEFpartmap();
+    i_part_map* ifn_part_map    = P->getIFNpartmap();
+    i_part_map* if_Nv_part_map  = P->getIF_Nvpartmap();
+    i_part_map* if_ref_part_map = P->getIFREFpartmap();
+    Array<int>* part_global     = P->getGlobalPartition();
+    int Nel                     = part_global->getNrow();
+    double* elem_cc             = geom->getElemCentroids();
+
+    std::map<int,int> gv2mv;
+    for(int i=0;i<mv->n;i++)
+    {
+        gv2mv[mv->gid[i]] = i;
+    }
+
+    // Vertices of the tetrahedra; lv2gv is -1 for the centroids.
+    std::map<int,int> gv2lv;
+    std::vector<int> lv2gv;
+    std::vector<double> xyz;
+    std::vector<double> met;
+    std::vector<int> tets;
+    std::vector<int> tris;
+    std::vector<int> tri_ref;
+
+    for(int i=0;i<Loc_Elem.size();i++)
+    {
+        int gEl = Loc_Elem[i];
+        if(BLshell != NULL && BLshell->elements_set.find(gEl)!=BLshell->elements_set.end())
+        {
+            continue;
+        }
+
+        const std::vector<int>& nodes = gE2gV.at(gEl);
+        std::vector<int> ln(nodes.size());
+        for(int k=0;k<nodes.size();k++)
+        {
+            int gv = nodes[k];
+            if(gv2lv.find(gv)==gv2lv.end())
+            {
+                gv2lv[gv] = lv2gv.size();
+                lv2gv.push_back(gv);
+                Vert* V = LocalVs[gV2lV[gv]];
+                xyz.push_back(V->x);
+                xyz.push_back(V->y);
+                xyz.push_back(V->z);
+                double* M = mv->getTensor(gv2mv.at(gv));
+                met.insert(met.end(),M,M+6);
+            }
+            ln[k] = gv2lv[gv];
+        }
+
+        int c = -1;
+        if(nodes.size() == 4)
+        {
+            tets.insert(tets.end(),ln.begin(),ln.end());
+        }
+        else
+        {
+            // The metric of the centroid is the average of the metric at the element vertices.
+            c = lv2gv.size();
+            lv2gv.push_back(-1);
+            int ei = geom->getElemIndex(gEl);
+            xyz.push_back(elem_cc[ei*3+0]);
+            xyz.push_back(elem_cc[ei*3+1]);
+            xyz.push_back(elem_cc[ei*3+2]);
+            double Mc[6] = {0.0,0.0,0.0,0.0,0.0,0.0};
+            for(int k=0;k<ln.size();k++)
+            {
+                for(int s=0;s<6;s++)
+                {
+                    Mc[s] = Mc[s]+met[ln[k]*6+s]/ln.size();
+                }
+            }
+            met.insert(met.end(),Mc,Mc+6);
+        }
+
+        const std::vector<int>& faces = ief_part_map->i_map.at(gEl);
+        for(int t=0;t<faces.size();t++)
+        {
+            int fid    = faces[t];
+            int NvPerF = if_Nv_part_map->i_map.at(fid)[0];
+            const std::vector<int>& fv = ifn_part_map->i_map.at(fid);
+
+            int ftris[2][3];
+            int nftri = 1;
+            if(NvPerF == 3)
+            {
+                ftris[0][0] = fv[0]; ftris[0][1] = fv[1]; ftris[0][2] = fv[2];
+            }
+            else
+            {
+                SplitQuadAtLowestVertex(&fv[0], ftris);
+                nftri = 2;
+            }
+
+            int ref = if_ref_part_map->i_map.at(fid)[0];
+            if(shell_faces.find(fid)!=shell_faces.end())
+            {
+                ref = BLShellFaceRef;
+            }
+            else if(freeze_interfaces && ref == 2)
+            {
+                int adj = iee_part_map->i_map.at(gEl)[t];
+                if(adj<Nel && part_global->getVal(adj,0) != world_rank)
+                {
+                    ref = PartitionFaceRef;
+                }
+            }
+
+            for(int s=0;s<nftri;s++)
+            {
+                if(c != -1)
+                {
+                    tets.push_back(gv2lv[ftris[s][0]]);
+                    tets.push_back(gv2lv[ftris[s][1]]);
+                    tets.push_back(gv2lv[ftris[s][2]]);
+                    tets.push_back(c);
+                }
+                if(ref != 2)
+                {
+                    tris.push_back(gv2lv[ftris[s][0]]);
+                    tris.push_back(gv2lv[ftris[s][1]]);
+                    tris.push_back(gv2lv[ftris[s][2]]);
+                    tri_ref.push_back(ref);
+                }
+            }
+        }
+    }
+
+    int ne = tets.size()/4;
+
+    // MMG expects positively oriented tetrahedra.
+    for(int e=0;e<ne;e++)
+    {
+        double* p0 = &xyz[tets[e*4+0]*3];
+        double* p1 = &xyz[tets[e*4+1]*3];
+        double* p2 = &xyz[tets[e*4+2]*3];
+        double* p3 = &xyz[tets[e*4+3]*3];
+        double a[3], b[3], d[3];
+        for(int s=0;s<3;s++)
+        {
+            a[s] = p1[s]-p0[s];
+            b[s] = p2[s]-p0[s];
+            d[s] = p3[s]-p0[s];
+        }
+        double det = a[0]*(b[1]*d[2]-b[2]*d[1])
+                    -a[1]*(b[0]*d[2]-b[2]*d[0])
+                    +a[2]*(b[0]*d[1]-b[1]*d[0]);
+        if(det<0.0)
+        {
+            std::swap(tets[e*4+1],tets[e*4+2]);
+        }
+    }
+
+    SubdomainMesh* sm = new SubdomainMesh;
+    sm->gid     = lv2gv;
+    sm->xyz     = xyz;
+    sm->met     = met;
+    sm->tets    = tets;
+    sm->tris    = tris;
+    sm->tri_ref = tri_ref;
+
+    return sm;
+}
+
+
+
+
+void RemeshSubdomainWithMMG3D(SubdomainMesh* sm, MPI_Comm comm)
+{
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    int np = sm->gid.size();
+    int ne = sm->tets.size()/4;
+    int nt = sm->tri_ref.size();
+    if(ne == 0)
+    {
+        return;
+    }
+
+    // The vertices of the required triangles carry their global id+1 through MMG3D.
+    std::vector<int> vref(np+1,0);
+    std::vector<int> tet1(4*ne+1);
+    std::vector<int> tet_ref(ne+1,0);
+    std::vector<int> tri1(3*nt+1);
+    for(int e=0;e<4*ne;e++)
+    {
+        tet1[e] = sm->tets[e]+1;
+    }
+    for(int f=0;f<3*nt;f++)
+    {
+        tri1[f] = sm->tris[f]+1;
+        if(sm->tri_ref[f/3] == BLShellFaceRef || sm->tri_ref[f/3] == PartitionFaceRef)
+        {
+            vref[sm->tris[f]] = sm->gid[sm->tris[f]]+1;
+        }
+    }
+
+    MMG5_pMesh mmgMesh = NULL;
+    MMG5_pSol mmgSol   = NULL;
+    MMG3D_Init_mesh(MMG5_ARG_start,
+                    MMG5_ARG_ppMesh,&mmgMesh,MMG5_ARG_ppMet,&mmgSol,
+                    MMG5_ARG_end);
+
+    if ( MMG3D_Set_meshSize(mmgMesh,np,ne,0,nt,0,0) != 1 ) exit(EXIT_FAILURE);
+    if ( MMG3D_Set_vertices(mmgMesh,&sm->xyz[0],&vref[0]) != 1 ) exit(EXIT_FAILURE);
+    if ( MMG3D_Set_tetrahedra(mmgMesh,&tet1[0],&tet_ref[0]) != 1 ) exit(EXIT_FAILURE);
+    if(nt > 0)
+    {
+        if ( MMG3D_Set_triangles(mmgMesh,&tri1[0],&sm->tri_ref[0]) != 1 ) exit(EXIT_FAILURE);
+    }
+    for(int f=0;f<nt;f++)
+    {
+        if(sm->tri_ref[f] == BLShellFaceRef || sm->tri_ref[f] == PartitionFaceRef)
+        {
+            if ( MMG3D_Set_requiredTriangle(mmgMesh,f+1) != 1 ) exit(EXIT_FAILURE);
+        }
+    }
+    if ( MMG3D_Set_solSize(mmgMesh,mmgSol,MMG5_Vertex,np,MMG5_Tensor) != 1 ) exit(EXIT_FAILURE);
+    if ( MMG3D_Set_tensorSols(mmgSol,&sm->met[0]) != 1 ) exit(EXIT_FAILURE);
+
+    // The metric is already graded by GradateMetric.
+    if ( MMG3D_Set_dparameter(mmgMesh,mmgSol,MMG3D_DPARAM_hgrad, -1) != 1 )    exit(EXIT_FAILURE);
+    if ( MMG3D_Set_dparameter(mmgMesh,mmgSol,MMG3D_DPARAM_hgradreq, -1) != 1 )    exit(EXIT_FAILURE);
+
+    int ier = MMG3D_mmg3dlib(mmgMesh,mmgSol);
+    if(ier == MMG5_STRONGFAILURE)
+    {
+        std::cout << "Error :: MMG3D failed on the subdomain of rank " << world_rank << "." << std::endl;
+        MPI_Abort(comm, EXIT_FAILURE);
+    }
+
+    int nprism,nquad,na;
+    MMG3D_Get_meshSize(mmgMesh,&np,&ne,&nprism,&nt,&nquad,&na);
+
+    std::vector<int> corner(np+1), req(np+1);
+    std::vector<int> tet_req(ne+1), tri_req(nt+1);
+    vref.resize(np+1);
+    tet1.resize(4*ne+1);
+    tet_ref.resize(ne+1);
+    tri1.resize(3*nt+1);
+    sm->xyz.resize(3*np+1);
+    sm->met.resize(6*np+1);
+    sm->tri_ref.resize(nt+1);
+    MMG3D_Get_vertices(mmgMesh,&sm->xyz[0],&vref[0],&corner[0],&req[0]);
+    MMG3D_Get_tetrahedra(mmgMesh,&tet1[0],&tet_ref[0],&tet_req[0]);
+    MMG3D_Get_triangles(mmgMesh,&tri1[0],&sm->tri_ref[0],&tri_req[0]);
+    MMG3D_Get_tensorSols(mmgSol,&sm->met[0]);
+
+    MMG3D_Free_all(MMG5_ARG_start,
+                   MMG5_ARG_ppMesh,&mmgMesh,MMG5_ARG_ppMet,&mmgSol,
+                   MMG5_ARG_end);
+
+    sm->xyz.resize(3*np);
+    sm->met.resize(6*np);
+    sm->gid.resize(np);
+    for(int v=0;v<np;v++)
+    {
+        sm->gid[v] = (req[v] && vref[v] > 0) ? vref[v]-1 : -1;
+    }
+    sm->tets.resize(4*ne);
+    for(int e=0;e<4*ne;e++)
+    {
+        sm->tets[e] = tet1[e]-1;
+    }
+    std::vector<int> tri_ref = sm->tri_ref;
+    sm->tris.clear();
+    sm->tri_ref.clear();
+    for(int f=0;f<nt;f++)
+    {
+        if(tri_ref[f] != 0)
+        {
+            sm->tris.push_back(tri1[f*3+0]-1);
+            sm->tris.push_back(tri1[f*3+1]-1);
+            sm->tris.push_back(tri1[f*3+2]-1);
+            sm->tri_ref.push_back(tri_ref[f]);
+        }
+    }
+}
+
+
+
+
+int NumberNewSubdomainVertices(SubdomainMesh* sm, int ngid, MPI_Comm comm)
+{
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    int nnew = 0;
+    for(int v=0;v<sm->gid.size();v++)
+    {
+        if(sm->gid[v] == -1)
+        {
+            nnew++;
+        }
+    }
+    int offset = 0;
+    MPI_Exscan(&nnew, &offset, 1, MPI_INT, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        offset = 0;
+    }
+    int nnew_tot = 0;
+    MPI_Allreduce(&nnew, &nnew_tot, 1, MPI_INT, MPI_SUM, comm);
+
+    int n = ngid+offset;
+    for(int v=0;v<sm->gid.size();v++)
+    {
+        if(sm->gid[v] == -1)
+        {
+            sm->gid[v] = n;
+            n++;
+        }
+    }
+
+    return ngid+nnew_tot;
+}
+
+
+
+
+SubdomainMesh* ShiftSubdomainInterfaces(SubdomainMesh* sm, int ngid, int nShift, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    int np = sm->gid.size();
+    int ne = sm->tets.size()/4;
+    int nt = sm->tri_ref.size();
+
+    ParallelState* gid_pstate = new ParallelState(ngid,comm);
+    std::vector<int> gid = sm->gid;
+    gid.push_back(0);
+    std::map<int,std::vector<int> > shared = ComputeSharedVertexRanks(gid_pstate, &gid[0], np, comm);
+    delete gid_pstate;
+
+    // Every layer of tetrahedra around an interface vertex goes to the lowest rank that has it.
+    std::vector<int> vdest(np,world_rank);
+    std::map<int,std::vector<int> >::iterator its;
+    for(its=shared.begin();its!=shared.end();its++)
+    {
+        for(int q=0;q<its->second.size();q++)
+        {
+            vdest[its->second[q]] = std::min(vdest[its->second[q]],its->first);
+        }
+    }
+    std::vector<int> tdest(ne,world_rank);
+    for(int l=0;l<nShift;l++)
+    {
+        for(int e=0;e<ne;e++)
+        {
+            for(int s=0;s<4;s++)
+            {
+                tdest[e] = std::min(tdest[e],vdest[sm->tets[e*4+s]]);
+            }
+        }
+        for(int e=0;e<ne;e++)
+        {
+            for(int s=0;s<4;s++)
+            {
+                vdest[sm->tets[e*4+s]] = std::min(vdest[sm->tets[e*4+s]],tdest[e]);
+            }
+        }
+    }
+
+    // The boundary and shell triangles move with the tetrahedron they bound.
+    TriKeyMap tri2idx;
+    tri2idx.reserve(nt);
+    for(int f=0;f<nt;f++)
+    {
+        if(sm->tri_ref[f] != PartitionFaceRef)
+        {
+            tri2idx[MakeTriKey(sm->tris[f*3+0],sm->tris[f*3+1],sm->tris[f*3+2])] = f;
+        }
+    }
+    std::vector<int> fdest(nt,world_rank);
+    for(int e=0;e<ne;e++)
+    {
+        for(int k=0;k<4;k++)
+        {
+            TriKey key = MakeTriKey(sm->tets[e*4+tet_faces[k][0]],
+                                    sm->tets[e*4+tet_faces[k][1]],
+                                    sm->tets[e*4+tet_faces[k][2]]);
+            TriKeyMap::iterator itf = tri2idx.find(key);
+            if(itf!=tri2idx.end())
+            {
+                fdest[itf->second] = tdest[e];
+            }
+        }
+    }
+
+    std::vector<std::vector<int> > send_tets(world_size);
+    std::vector<std::vector<int> > send_tris(world_size);
+    std::vector<std::vector<double> > send_verts(world_size);
+    std::vector<std::set<int> > dest_verts(world_size);
+    for(int e=0;e<ne;e++)
+    {
+        for(int s=0;s<4;s++)
+        {
+            int v = sm->tets[e*4+s];
+            send_tets[tdest[e]].push_back(sm->gid[v]);
+            dest_verts[tdest[e]].insert(v);
+        }
+    }
+    for(int f=0;f<nt;f++)
+    {
+        if(sm->tri_ref[f] == PartitionFaceRef)
+        {
+            continue;
+        }
+        for(int s=0;s<3;s++)
+        {
+            send_tris[fdest[f]].push_back(sm->gid[sm->tris[f*3+s]]);
+        }
+        send_tris[fdest[f]].push_back(sm->tri_ref[f]);
+    }
+    for(int r=0;r<world_size;r++)
+    {
+        std::set<int>::iterator itv;
+        for(itv=dest_verts[r].begin();itv!=dest_verts[r].end();itv++)
+        {
+            send_verts[r].push_back(sm->gid[*itv]);
+            send_verts[r].insert(send_verts[r].end(),&sm->xyz[*itv*3],&sm->xyz[*itv*3]+3);
+            send_verts[r].insert(send_verts[r].end(),&sm->met[*itv*6],&sm->met[*itv*6]+6);
+        }
+    }
+
+    std::vector<int> rtets     = ExchangeVectors(send_tets, MPI_INT, comm);
+    std::vector<int> rtris     = ExchangeVectors(send_tris, MPI_INT, comm);
+    std::vector<double> rverts = ExchangeVectors(send_verts, MPI_DOUBLE, comm);
+
+    SubdomainMesh* sm_new = new SubdomainMesh;
+    std::map<int,int> gid2lv;
+    for(int k=0;k<rverts.size();k+=10)
+    {
+        int g = int(rverts[k]);
+        if(gid2lv.find(g)==gid2lv.end())
+        {
+            gid2lv[g] = sm_new->gid.size();
+            sm_new->gid.push_back(g);
+            sm_new->xyz.insert(sm_new->xyz.end(),&rverts[k+1],&rverts[k+1]+3);
+            sm_new->met.insert(sm_new->met.end(),&rverts[k+4],&rverts[k+4]+6);
+        }
+    }
+    for(int k=0;k<rtets.size();k++)
+    {
+        sm_new->tets.push_back(gid2lv[rtets[k]]);
+    }
+    TriKeySet bnd_tris;
+    bnd_tris.reserve(rtris.size()/4);
+    for(int k=0;k<rtris.size();k+=4)
+    {
+        for(int s=0;s<3;s++)
+        {
+            sm_new->tris.push_back(gid2lv[rtris[k+s]]);
+        }
+        sm_new->tri_ref.push_back(rtris[k+3]);
+        bnd_tris.insert(MakeTriKey(gid2lv[rtris[k+0]],gid2lv[rtris[k+1]],gid2lv[rtris[k+2]]));
+    }
+
+    // The faces that only one of the received tetrahedra has and that are not on the
+    // boundary are the new partition interfaces; they are added in the order of the tetrahedra.
+    TriKeyMap face2ntet;
+    int ne_new = sm_new->tets.size()/4;
+    face2ntet.reserve(2*ne_new);
+    for(int e=0;e<ne_new;e++)
+    {
+        for(int k=0;k<4;k++)
+        {
+            face2ntet[MakeTriKey(sm_new->tets[e*4+tet_faces[k][0]],
+                                 sm_new->tets[e*4+tet_faces[k][1]],
+                                 sm_new->tets[e*4+tet_faces[k][2]])]++;
+        }
+    }
+    for(int e=0;e<ne_new;e++)
+    {
+        for(int k=0;k<4;k++)
+        {
+            TriKey key = MakeTriKey(sm_new->tets[e*4+tet_faces[k][0]],
+                                    sm_new->tets[e*4+tet_faces[k][1]],
+                                    sm_new->tets[e*4+tet_faces[k][2]]);
+            if(face2ntet[key] != 1 || bnd_tris.find(key)!=bnd_tris.end())
+            {
+                continue;
+            }
+            for(int s=0;s<3;s++)
+            {
+                sm_new->tris.push_back(sm_new->tets[e*4+tet_faces[k][s]]);
+            }
+            sm_new->tri_ref.push_back(PartitionFaceRef);
+        }
+    }
+
+    return sm_new;
+}
+
+
+
+
+int NumberSubdomainVertices(SubdomainMesh* sm, int ngid, std::vector<int>& owned,
+                            std::vector<int>& shell_gid, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    int np = sm->gid.size();
+    int nt = sm->tri_ref.size();
+
+    shell_gid.assign(np,-1);
+    for(int f=0;f<3*nt;f++)
+    {
+        if(sm->tri_ref[f/3] == BLShellFaceRef)
+        {
+            shell_gid[sm->tris[f]] = sm->gid[sm->tris[f]];
+        }
+    }
+
+    ParallelState* gid_pstate = new ParallelState(ngid,comm);
+    std::vector<int> gid = sm->gid;
+    gid.push_back(0);
+    std::map<int,std::vector<int> > shared = ComputeSharedVertexRanks(gid_pstate, &gid[0], np, comm);
+    delete gid_pstate;
+
+    owned.assign(np,1);
+    std::map<int,std::vector<int> >::iterator its;
+    for(its=shared.begin();its!=shared.end();its++)
+    {
+        if(its->first < world_rank)
+        {
+            for(int q=0;q<its->second.size();q++)
+            {
+                owned[its->second[q]] = 0;
+            }
+        }
+    }
+
+    int nown = 0;
+    for(int v=0;v<np;v++)
+    {
+        nown = nown+owned[v];
+    }
+    int offset = 0;
+    MPI_Exscan(&nown, &offset, 1, MPI_INT, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        offset = 0;
+    }
+    int nglo = 0;
+    MPI_Allreduce(&nown, &nglo, 1, MPI_INT, MPI_SUM, comm);
+
+    std::vector<int> new_gid(np,-1);
+    int n = offset;
+    for(int v=0;v<np;v++)
+    {
+        if(owned[v])
+        {
+            new_gid[v] = n;
+            n++;
+        }
+    }
+
+    // Both sides list the shared vertices in the same order, so the owner only sends the
+    // new ids and the others take the entries that are not -1.
+    std::vector<std::vector<int> > send(world_size);
+    for(its=shared.begin();its!=shared.end();its++)
+    {
+        for(int q=0;q<its->second.size();q++)
+        {
+            send[its->first].push_back(new_gid[its->second[q]]);
+        }
+    }
+    std::vector<int> recv = ExchangeVectors(send, MPI_INT, comm);
+    int k = 0;
+    for(its=shared.begin();its!=shared.end();its++)
+    {
+        for(int q=0;q<its->second.size();q++)
+        {
+            if(recv[k] != -1 && !owned[its->second[q]])
+            {
+                new_gid[its->second[q]] = std::max(new_gid[its->second[q]],recv[k]);
+            }
+            k++;
+        }
+    }
+
+    sm->gid = new_gid;
+
+    return nglo;
+}
+
+
+
+
+DistributedMesh* GetDistributedMeshFromSubdomain(SubdomainMesh* sm, std::vector<int>& owned,
+                                                 std::vector<int>& shell_gid, int nglo,
+                                                 Mesh_Topology_BL* mesh_topo_bl, BLShellInfo* BLshell,
+                                                 ParallelState* xcn_pstate, MPI_Comm comm)
+{
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    DistributedMesh* dm = new DistributedMesh;
+
+    int np = sm->gid.size();
+    int nt = sm->tri_ref.size();
+    for(int v=0;v<np;v++)
+    {
+        if(owned[v])
+        {
+            dm->vgid.push_back(sm->gid[v]);
+            dm->xcn.insert(dm->xcn.end(),&sm->xyz[v*3],&sm->xyz[v*3]+3);
+        }
+    }
+    for(int e=0;e<sm->tets.size();e++)
+    {
+        dm->tetra.push_back(sm->gid[sm->tets[e]]);
+    }
+    // The shell triangles become interior faces between the tetrahedra and the prisms.
+    for(int f=0;f<nt;f++)
+    {
+        if(sm->tri_ref[f] > 0 && sm->tri_ref[f] != BLShellFaceRef && sm->tri_ref[f] != PartitionFaceRef)
+        {
+            for(int s=0;s<3;s++)
+            {
+                dm->tria.push_back(sm->gid[sm->tris[f*3+s]]);
+            }
+            dm->tria_ref.push_back(sm->tri_ref[f]);
+        }
+    }
+
+    gidx_t* xcn_offsets = xcn_pstate->getOffsets();
+
+    // The owners of the shell vertices tell the xcn owner of the original vertex its new id.
+    std::vector<std::vector<int> > send_map(world_size);
+    for(int v=0;v<np;v++)
+    {
+        if(shell_gid[v] != -1 && owned[v])
+        {
+            int gv   = shell_gid[v];
+            int dest = std::upper_bound(xcn_offsets,xcn_offsets+world_size,gv)-xcn_offsets-1;
+            send_map[dest].push_back(gv);
+            send_map[dest].push_back(sm->gid[v]);
+        }
+    }
+
+    // The prism vertices are looked up at the xcn owner, which numbers the ones that are
+    // not on the shell after the ParMMG vertices.
+    std::vector<int> bl_verts;
+    if(mesh_topo_bl != NULL)
+    {
+        std::set<int> u_bl_verts;
+        std::map<int,std::vector<std::vector<int> > >::iterator itp;
+        for(itp=mesh_topo_bl->BLlayersPrisms.begin();itp!=mesh_topo_bl->BLlayersPrisms.end();itp++)
+        {
+            for(int p=0;p<itp->second.size();p++)
+            {
+                u_bl_verts.insert(itp->second[p].begin(),itp->second[p].end());
+            }
+        }
+        bl_verts.assign(u_bl_verts.begin(),u_bl_verts.end());
+    }
+    std::vector<std::vector<int> > send_q(world_size);
+    std::vector<std::vector<double> > send_qx(world_size);
+    std::vector<int> qdest(bl_verts.size());
+    for(int i=0;i<bl_verts.size();i++)
+    {
+        int gv   = bl_verts[i];
+        int dest = std::upper_bound(xcn_offsets,xcn_offsets+world_size,gv)-xcn_offsets-1;
+        qdest[i] = dest;
+        send_q[dest].push_back(gv);
+        std::vector<double>& X = BLshell->ColumnXCN[gv];
+        send_qx[dest].insert(send_qx[dest].end(),X.begin(),X.end());
+    }
+
+    std::vector<int> scnt(world_size), soff(world_size), rcnt(world_size), roff(world_size);
+    std::vector<int> sbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        scnt[r] = send_map[r].size();
+        soff[r] = sbuf.size();
+        sbuf.insert(sbuf.end(),send_map[r].begin(),send_map[r].end());
+    }
+    sbuf.push_back(0);
+    MPI_Alltoall(&scnt[0], 1, MPI_INT, &rcnt[0], 1, MPI_INT, comm);
+    roff[0] = 0;
+    for(int r=1;r<world_size;r++)
+    {
+        roff[r] = roff[r-1]+rcnt[r-1];
+    }
+    int nrecv = roff[world_size-1]+rcnt[world_size-1];
+    std::vector<int> rbuf(nrecv+1);
+    MPI_Alltoallv(&sbuf[0], &scnt[0], &soff[0], MPI_INT,
+                  &rbuf[0], &rcnt[0], &roff[0], MPI_INT, comm);
+    std::map<int,int> shell_old2new;
+    for(int k=0;k<nrecv;k+=2)
+    {
+        shell_old2new[rbuf[k]] = rbuf[k+1];
+    }
+
+    std::vector<int> qcnt(world_size), qoff(world_size), rqcnt(world_size), rqoff(world_size);
+    std::vector<int> xcnt(world_size), xoff(world_size), rxcnt(world_size), rxoff(world_size);
+    std::vector<int> qbuf;
+    std::vector<double> qxbuf;
+    for(int r=0;r<world_size;r++)
+    {
+        qcnt[r] = send_q[r].size();
+        qoff[r] = qbuf.size();
+        xcnt[r] = send_qx[r].size();
+        xoff[r] = qxbuf.size();
+        qbuf.insert(qbuf.end(),send_q[r].begin(),send_q[r].end());
+        qxbuf.insert(qxbuf.end(),send_qx[r].begin(),send_qx[r].end());
+    }
+    qbuf.push_back(0);
+    qxbuf.push_back(0.0);
+    MPI_Alltoall(&qcnt[0], 1, MPI_INT, &rqcnt[0], 1, MPI_INT, comm);
+    rqoff[0] = 0;
+    for(int r=1;r<world_size;r++)
+    {
+        rqoff[r] = rqoff[r-1]+rqcnt[r-1];
+    }
+    for(int r=0;r<world_size;r++)
+    {
+        rxcnt[r] = rqcnt[r]*3;
+        rxoff[r] = rqoff[r]*3;
+    }
+    int nq = rqoff[world_size-1]+rqcnt[world_size-1];
+    std::vector<int> rqbuf(nq+1);
+    std::vector<double> rqxbuf(3*nq+1);
+    MPI_Alltoallv(&qbuf[0], &qcnt[0], &qoff[0], MPI_INT,
+                  &rqbuf[0], &rqcnt[0], &rqoff[0], MPI_INT, comm);
+    MPI_Alltoallv(&qxbuf[0], &xcnt[0], &xoff[0], MPI_DOUBLE,
+                  &rqxbuf[0], &rxcnt[0], &rxoff[0], MPI_DOUBLE, comm);
+
+    std::map<int,int> bl_only;
+    for(int k=0;k<nq;k++)
+    {
+        if(shell_old2new.find(rqbuf[k])==shell_old2new.end() && bl_only.find(rqbuf[k])==bl_only.end())
+        {
+            bl_only[rqbuf[k]] = k;
+        }
+    }
+    int nbl = bl_only.size();
+    int bl_offset = 0;
+    MPI_Exscan(&nbl, &bl_offset, 1, MPI_INT, MPI_SUM, comm);
+    if(world_rank == 0)
+    {
+        bl_offset = 0;
+    }
+    int nbl_tot = 0;
+    MPI_Allreduce(&nbl, &nbl_tot, 1, MPI_INT, MPI_SUM, comm);
+
+    int b = 0;
+    std::map<int,int>::iterator itb;
+    for(itb=bl_only.begin();itb!=bl_only.end();itb++)
+    {
+        int gnew = nglo+bl_offset+b;
+        dm->vgid.push_back(gnew);
+        dm->xcn.insert(dm->xcn.end(),&rqxbuf[itb->second*3],&rqxbuf[itb->second*3]+3);
+        shell_old2new[itb->first] = gnew;
+        b++;
+    }
+
+    std::vector<int> ans(nq+1);
+    for(int k=0;k<nq;k++)
+    {
+        ans[k] = shell_old2new[rqbuf[k]];
+    }
+    std::vector<int> qnew(bl_verts.size()+1);
+    MPI_Alltoallv(&ans[0], &rqcnt[0], &rqoff[0], MPI_INT,
+                  &qnew[0], &qcnt[0], &qoff[0], MPI_INT, comm);
+
+    // The answers come back grouped per destination in the order the queries were sent.
+    std::map<int,int> old2new;
+    std::vector<int> pos = qoff;
+    for(int i=0;i<bl_verts.size();i++)
+    {
+        old2new[bl_verts[i]] = qnew[pos[qdest[i]]];
+        pos[qdest[i]]++;
+    }
+
+    if(mesh_topo_bl != NULL)
+    {
+        std::map<int,std::vector<std::vector<int> > >::iterator itp;
+        for(itp=mesh_topo_bl->BLlayersPrisms.begin();itp!=mesh_topo_bl->BLlayersPrisms.end();itp++)
+        {
+            for(int p=0;p<itp->second.size();p++)
+            {
+                for(int s=0;s<6;s++)
+                {
+                    dm->prism.push_back(old2new[itp->second[p][s]]);
+                }
+            }
+        }
+        for(itp=mesh_topo_bl->bcTria.begin();itp!=mesh_topo_bl->bcTria.end();itp++)
+        {
+            for(int p=0;p<itp->second.size();p++)
+            {
+                for(int s=0;s<3;s++)
+                {
+                    dm->tria.push_back(old2new[itp->second[p][s]]);
+                }
+                dm->tria_ref.push_back(itp->first);
+            }
+        }
+        for(itp=mesh_topo_bl->bcQuad.begin();itp!=mesh_topo_bl->bcQuad.end();itp++)
+        {
+            for(int p=0;p<itp->second.size();p++)
+            {
+                for(int s=0;s<4;s++)
+                {
+                    dm->quad.push_back(old2new[itp->second[p][s]]);
+                }
+                dm->quad_ref.push_back(itp->first);
+            }
+        }
+    }
+
+    dm->nVertGlob = nglo+nbl_tot;
+
+    return dm;
+}
@@ -0,0 +1,64 @@
+#include "adapt.h"
+#include "adapt_datastruct.h"
+#include "adapt_partition.h"
+#include "adapt_meshgeometry.h"
+#include "adapt_bltopology.h"
+#include "adapt_parops.h"
+
+#ifndef ADAPT_SUBDOMAIN_H
+#define ADAPT_SUBDOMAIN_H
+
+// Reference of the required triangles between the BL prisms and the tetrahedra.
+const int BLShellFaceRef   = 20;
+// Reference of the required triangles on the partition interfaces.
+const int PartitionFaceRef = 21;
+
+// Tetrahedral mesh of the part of the domain on one rank. The elements and triangles refer
+// to local vertex numbers; gid holds the global id of a vertex or -1 if it has none yet.
+struct SubdomainMesh
+{
+    std::vector<int> gid;
+    std::vector<double> xyz;
+    std::vector<double> met;
+    std::vector<int> tets;
+    std::vector<int> tris;
+    std::vector<int> tri_ref;
+};
+
+// Splits the elements owned by this rank outside of the BL mesh into positively oriented
+// tetrahedra with the metric mv at their vertices. Tetrahedra are kept, the other elements
+// are split around their centroid with the quad faces cut by SplitQuadAtLowestVertex, so
+// the split matches across ranks. The faces in shell_faces get reference BLShellFaceRef and
+// with freeze_interfaces the faces shared with another rank get PartitionFaceRef.
+SubdomainMesh* BuildSubdomainMeshOnPartition(Partition* P, Mesh_Geometry* geom, TensorField* mv,
+                                             BLShellInfo* BLshell, std::set<int>& shell_faces,
+                                             int freeze_interfaces, MPI_Comm comm);
+
+// Adapts sm with serial MMG3D. The triangles with reference BLShellFaceRef and
+// PartitionFaceRef are required, so their vertices keep their global id; the other
+// vertices come back with gid -1.
+void RemeshSubdomainWithMMG3D(SubdomainMesh* sm, MPI_Comm comm);
+
+// Numbers the vertices with gid -1 from ngid on and returns the new number of global ids.
+int NumberNewSubdomainVertices(SubdomainMesh* sm, int ngid, MPI_Comm comm);
+
+// Moves the tetrahedra within nShift layers of a partition interface to the lowest rank
+// that shares the interface, so that the former interfaces end up inside a subdomain.
+// The old PartitionFaceRef triangles are dropped and the new interfaces get them instead.
+SubdomainMesh* ShiftSubdomainInterfaces(SubdomainMesh* sm, int ngid, int nShift, MPI_Comm comm);
+
+// Replaces the global ids (below ngid) by contiguous ones and returns their number. A vertex
+// is owned by the lowest rank that has it; shell_gid keeps the old id of the vertices on the
+// BLShellFaceRef triangles and is -1 for the others.
+int NumberSubdomainVertices(SubdomainMesh* sm, int ngid, std::vector<int>& owned,
+                            std::vector<int>& shell_gid, MPI_Comm comm);
+
+// Returns the tetrahedra of sm and the BL prisms of this rank in one global vertex
+// numbering. The nglo vertices of sm come first; the vertices of the prisms that are not on
+// the shell follow and are owned by the rank that reads them from xcn.
+DistributedMesh* GetDistributedMeshFromSubdomain(SubdomainMesh* sm, std::vector<int>& owned,
+                                                 std::vector<int>& shell_gid, int nglo,
+                                                 Mesh_Topology_BL* mesh_topo_bl, BLShellInfo* BLshell,
+                                                 ParallelState* xcn_pstate, MPI_Comm comm);
+
+#endif
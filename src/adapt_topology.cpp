@@ -2,6 +2,26 @@
 #include "adapt_output.h"
 
 Mesh_Topology::Mesh_Topology(Partition* Pa, MPI_Comm comm)
+{
+    Mesh_Geometry* geom = new Mesh_Geometry(Pa, comm);
+    ComputeTopology(Pa, geom, comm);
+    delete geom;
+}
+
+
+
+
+Mesh_Topology::Mesh_Topology(Partition* Pa, Mesh_Geometry* geom, MPI_Comm comm)
+{
+    ComputeTopology(Pa, geom, comm);
+}
+
+
+
+
+// Volumes, face areas, outward normals and centroid-to-face vectors of the local
+// elements are taken from the geometry cache.
+void Mesh_Topology::ComputeTopology(Partition* Pa, Mesh_Geometry* geom, MPI_Comm comm)
 {
     
     int world_size;
@@ -17,8 +37,6 @@ Mesh_Topology::Mesh_Topology(Partition* Pa, MPI_Comm comm)
     //ifn = ifn_in;
     P = Pa;
     c = comm;
-    Vec3D* v0 = new Vec3D;
-    Vec3D* v1 = new Vec3D;
     
     int Nel = Pa->getGlobalPartition()->getNrow();
     
@@ -26,70 +44,64 @@ Mesh_Topology::Mesh_Topology(Partition* Pa, MPI_Comm comm)
     // Get the rank of the process
     MPI_Comm_rank(comm, &rank);
     
-    std::map<int,std::vector<int> > gE2lV = Pa->getGlobElem2LocVerts();
-    std::vector<Vert*> locVerts  = Pa->getLocalVerts();
     std::map<int,std::vector<int> > gE2gV = Pa->getGlobElem2GlobVerts();
 
     std::vector<int> Loc_Elem             = Pa->getLocElem();
     int nLocElem                          = Loc_Elem.size();
-    std::map<int,int> gV2lV               = Pa->getGlobalVert2LocalVert();
         
-    i_part_map* ifn_part_map    = Pa->getIFNpartmap();
-    i_part_map* ief_part_map    = Pa->getIEFpartmap();
     i_part_map* iee_part_map    = Pa->getIEEpartmap();
-    i_part_map* if_Nv_part_map  = Pa->getIF_Nvpartmap();
     
-    std::vector<int> vijkIDs;
     std::map<int,int> LocElem2Nv = P->getLocElem2Nv();
-    int tel     = 0;
-    std::vector<Vert*> face;
     std::map<int,int> LocElem2Nf = Pa->getLocElem2Nf();
-    double volume = 0.0;
+    
+    // Create the entries of all local elements up front so that the threaded
+    // loop below only reads the shared maps and writes into its own entries.
     for(int i=0;i<nLocElem;i++)
     {
         int gEl = Loc_Elem[i];
-        int NvEl = LocElem2Nv[gEl];
-        vijkIDs = gE2lV[gEl];
-        double* Pijk = new double[NvEl*3];
-
-        for(int k=0;k<vijkIDs.size();k++)
-        {
-           loc_vid     = vijkIDs[k];
-           Pijk[k*3+0] = locVerts[loc_vid]->x;
-           Pijk[k*3+1] = locVerts[loc_vid]->y;
-           Pijk[k*3+2] = locVerts[loc_vid]->z;
-        }
-
-        Vert* Vijk     = ComputeCentroidCoord(Pijk, vijkIDs.size());
+        Vol[gEl] = 0.0;
+        dS[gEl];
+        normals[gEl];
+        dxfxc[gEl];
+        E2V_scheme[gEl];
+    }
+    
+    double* elem_cc   = geom->getElemCentroids();
+    double* elem_vol  = geom->getElemVolumes();
+    double* face_cc   = geom->getFaceCenters();
+    double* face_n    = geom->getFaceNormals();
+    double* face_area = geom->getFaceAreas();
+    int* face_offset  = geom->getFaceOffsets();
+    
+#pragma omp parallel for schedule(dynamic,64)
+    for(int i=0;i<nLocElem;i++)
+    {
+        int gEl  = Loc_Elem[i];
+        int eidx = geom->getElemIndex(gEl);
+        const std::vector<int>& adj = iee_part_map->i_map.at(gEl);
         
-        int NfPEl      = LocElem2Nf[gEl];
-
-        if(NfPEl == 6)
-        {
-            volume  = ComputeVolumeHexCell(Pijk);
-        }
-        if(NfPEl == 4)
-        {
-            volume  = ComputeVolumeTetCell(Pijk);
-        }
-        if(NfPEl == 5)
-        {
-            volume  = ComputeVolumePrismCell(Pijk);
-        }
+        int NfPEl      = LocElem2Nf.at(gEl);
+        
+        std::vector<double>& dS_el      = dS.find(gEl)->second;
+        std::vector<Vec3D*>& normals_el = normals.find(gEl)->second;
+        std::vector<Vec3D*>& dxfxc_el   = dxfxc.find(gEl)->second;
         
-        Vol[gEl] = volume;
+        Vol.find(gEl)->second = elem_vol[eidx];
         std::set<int> vs;
         std::vector<int> vrts;
         
         for(int s=0;s<NfPEl;s++)
         {
-            int adjID = iee_part_map->i_map[gEl][s];
-            int Nvadj = LocElem2Nv[adjID];
+            int adjID = adj[s];
             if(adjID<Nel)
             {
+                // LocElem2Nv only holds the local elements, so the vertices of
+                // halo neighbours are not part of the scheme.
+                std::map<int,int>::const_iterator nv_it = LocElem2Nv.find(adjID);
+                int Nvadj = (nv_it!=LocElem2Nv.end()) ? nv_it->second : 0;
                 for(int k=0;k<Nvadj;k++)
                 {
-                   int gV = gE2gV[adjID][k];
+                   int gV = gE2gV.at(adjID)[k];
                    if(vs.find(gV)==vs.end())
                    {
                      vs.insert(gV);
@@ -97,117 +109,25 @@ Mesh_Topology::Mesh_Topology(Partition* Pa, MPI_Comm comm)
                    }
                 }
                 
-                int faceid = ief_part_map->i_map[gEl][s];
-                Vert* Vface = new Vert;
-                int NvPerF = if_Nv_part_map->i_map[faceid][0];
-                double* F = new double[NvPerF*3];
+                int k = face_offset[eidx]+s;
                 
-                for(int r=0;r<NvPerF;r++)
-                {
-                    int gvid = ifn_part_map->i_map[faceid][r];
-                    int lvid = gV2lV[gvid];
-                    
-                    //vert2ref[gvid] = ref;
-                    //ref2vert[ref].push_back(gvid);
-
-                    Vert* V = new Vert;
-                    V->x    = locVerts[lvid]->x;
-                    V->y    = locVerts[lvid]->y;
-                    V->z    = locVerts[lvid]->z;
-                    
-                    F[r*3+0] = V->x;
-                    F[r*3+1] = V->y;
-                    F[r*3+2] = V->z;
-                    
-                    Vface->x = Vface->x+locVerts[lvid]->x;
-                    Vface->y = Vface->y+locVerts[lvid]->y;
-                    Vface->z = Vface->z+locVerts[lvid]->z;
-
-                    face.push_back(V);
-                }
+                Vec3D* r0 = new Vec3D;
+                r0->c0 = face_cc[k*3+0]-elem_cc[eidx*3+0];
+                r0->c1 = face_cc[k*3+1]-elem_cc[eidx*3+1];
+                r0->c2 = face_cc[k*3+2]-elem_cc[eidx*3+2];
                 
-                if(NvPerF==3) // triangle
-                {
-                    Vface->x = Vface->x/NvPerF;
-                    Vface->y = Vface->y/NvPerF;
-                    Vface->z = Vface->z/NvPerF;
-                    
-                    Vec3D* r0 = new Vec3D;
-                    //double Lr = ComputeEdgeLength(Vface,Vijk);
-
-                    r0->c0 = (Vface->x-Vijk->x);///Lr;
-                    r0->c1 = (Vface->y-Vijk->y);///Lr;
-                    r0->c2 = (Vface->z-Vijk->z);///Lr;
-                    
-                    v0->c0 = face[1]->x-face[0]->x;
-                    v0->c1 = face[1]->y-face[0]->y;
-                    v0->c2 = face[1]->z-face[0]->z;
-
-                    v1->c0 = face[2]->x-face[0]->x;
-                    v1->c1 = face[2]->y-face[0]->y;
-                    v1->c2 = face[2]->z-face[0]->z;
-                    
-                    Vec3D* n0 = ComputeSurfaceNormal(v0,v1);
-                    orient0   = DotVec3D(r0,n0);
-                    
-                    if(orient0<0.0)
-                    {
-                        NegateVec3D(n0);
-                    }
-                    
-                    ds0 = ComputeTriSurfaceArea(F);
-                    dS[gEl].push_back(ds0);
-                    normals[gEl].push_back(n0);
-                    dxfxc[gEl].push_back(r0);
-                    
-                }
-                if(NvPerF==4) // quad
-                {
-                    Vface->x = Vface->x/NvPerF;
-                    Vface->y = Vface->y/NvPerF;
-                    Vface->z = Vface->z/NvPerF;
-                    
-                    Vec3D* r0 = new Vec3D;
-                    r0->c0 = (Vface->x-Vijk->x);///Lr
-                    r0->c1 = (Vface->y-Vijk->y);///Lr
-                    r0->c2 = (Vface->z-Vijk->z);///Lr
-                    
-                    v0->c0 = face[1]->x-face[0]->x;
-                    v0->c1 = face[1]->y-face[0]->y;
-                    v0->c2 = face[1]->z-face[0]->z;
-
-                    v1->c0 = face[3]->x-face[0]->x;
-                    v1->c1 = face[3]->y-face[0]->y;
-                    v1->c2 = face[3]->z-face[0]->z;
-                    
-                    Vec3D* n0 = ComputeSurfaceNormal(v0,v1);
-                    orient0   = DotVec3D(r0,n0);
-                    
-                    if(orient0<0.0)
-                    {
-                        NegateVec3D(n0);
-                    }
-
-                    ds0 = ComputeQuadSurfaceArea(F);
-                    dS[gEl].push_back(ds0);
-                    normals[gEl].push_back(n0);
-                    dxfxc[gEl].push_back(r0);
-                    
-                }
+                Vec3D* n0 = new Vec3D;
+                n0->c0 = face_n[k*3+0];
+                n0->c1 = face_n[k*3+1];
+                n0->c2 = face_n[k*3+2];
                 
-                delete Vface;
-                delete[] F;
-                face.clear();
+                dS_el.push_back(face_area[k]);
+                normals_el.push_back(n0);
+                dxfxc_el.push_back(r0);
             }
-            
-            
-            
-       
         }
         vs.clear();
-        E2V_scheme[gEl] = vrts;
-        delete[] Pijk;
-        vijkIDs.clear();
+        E2V_scheme.find(gEl)->second = vrts;
         
 //        tel = 0;
 //
@@ -333,9 +253,6 @@ Mesh_Topology::Mesh_Topology(Partition* Pa, MPI_Comm comm)
 //    LocElem2Nv.clear();
 //    LocElem2Nf.clear();
     
-    delete v0;
-    delete v1;
-    
 }
 
 
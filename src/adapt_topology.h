@@ -2,6 +2,7 @@
 #include "adapt_partition.h"
 #include "adapt_geometry.h"
 #include "adapt_compute.h"
+#include "adapt_meshgeometry.h"
 
 #ifndef ADAPT_TOPOLOGY_H
 #define ADAPT_TOPOLOGY_H
@@ -21,6 +22,7 @@ class Mesh_Topology {
     public:
         Mesh_Topology(){};
         Mesh_Topology(Partition* Pa, MPI_Comm comm);
+        Mesh_Topology(Partition* Pa, Mesh_Geometry* geom, MPI_Comm comm);
         void DetermineBoundaryLayerElements(Partition* Pa, Array<int>* ife_in, int nLayer, int bID, MPI_Comm comm);
         std::map<int,std::vector<int> > getScheme_E2V();
         std::map<int,vector<Vec3D*> > getNormals();
@@ -39,6 +41,7 @@ class Mesh_Topology {
         std::map<int,std::vector<int> > getRef2Vert();
         Mesh_Topology_BL* getBLMeshTopology();
     private:
+        void ComputeTopology(Partition* Pa, Mesh_Geometry* geom, MPI_Comm comm);
         Array<double>* cc;
         std::map<int,vector<Vec3D*> > normals;
         std::map<int,vector<Vec3D*> > rvector;
@@ -556,13 +556,12 @@ int main(int argc, char** argv)
     
     std::cout << "we here now 7" << std::endl;
 
+    MMG5_pMesh mmgMesh_hyb = NULL;
+    MMG5_pSol mmgSol_hyb   = NULL;
     if(world_rank == 0)
     {
         
         
-        MMG5_pMesh mmgMesh_hyb = NULL;
-        MMG5_pSol mmgSol_hyb   = NULL;
-        
         MMG3D_Init_mesh(MMG5_ARG_start,
         MMG5_ARG_ppMesh,&mmgMesh_hyb,MMG5_ARG_ppMet,&mmgSol_hyb,
         MMG5_ARG_end);
@@ -570,8 +569,8 @@ int main(int argc, char** argv)
         BoundaryMap* bmap = new BoundaryMap(us3dRoot->ifn, us3dRoot->if_ref);
         
         std::map<int,std::vector<int> > bnd_face_map = bmap->getBfaceMap();
-        std::map<std::set<int>,int> tria_ref_map     = bmap->getTriaRefMap();
-        std::map<std::set<int>,int> quad_ref_map     = bmap->getQuadRefMap();
+        TriKeyMap& tria_ref_map                       = bmap->getTriaRefMap();
+        QuadKeyMap& quad_ref_map                      = bmap->getQuadRefMap();
         std::map<int,int> vert_ref_map               = bmap->getNodeRefMap();
         
         std::map<int,std::vector<int> > bndTriVol;
@@ -607,10 +606,7 @@ int main(int argc, char** argv)
                 int gv4 = ienit->second[5];
                 int gv5 = ienit->second[4];
                 
-                std::set<int> tria0;
-                tria0.insert(gv0);
-                tria0.insert(gv1);
-                tria0.insert(gv2);
+                TriKey tria0 = MakeTriKey(gv0,gv1,gv2);
                 if(tria_ref_map.find(tria0)!=tria_ref_map.end())
                 {
                     refer = tria_ref_map[tria0];
@@ -624,10 +620,7 @@ int main(int argc, char** argv)
                     tt++;
                 }
 
-                std::set<int> tria1;
-                tria1.insert(gv3);
-                tria1.insert(gv5);
-                tria1.insert(gv4);
+                TriKey tria1 = MakeTriKey(gv3,gv5,gv4);
                 if(tria_ref_map.find(tria1)!=tria_ref_map.end())
                 {
                     refer = tria_ref_map[tria1];
@@ -641,11 +634,7 @@ int main(int argc, char** argv)
                     tt++;
                 }
                 
-                std::set<int> quad0;
-                quad0.insert(gv0);
-                quad0.insert(gv3);
-                quad0.insert(gv4);
-                quad0.insert(gv1);
+                QuadKey quad0 = MakeQuadKey(gv0,gv3,gv4,gv1);
                 if(quad_ref_map.find(quad0)!=quad_ref_map.end())
                 {
                     refer = quad_ref_map[quad0];
@@ -660,11 +649,7 @@ int main(int argc, char** argv)
                 }
                 
                 
-                std::set<int> quad1;
-                quad1.insert(gv1);
-                quad1.insert(gv4);
-                quad1.insert(gv5);
-                quad1.insert(gv2);
+                QuadKey quad1 = MakeQuadKey(gv1,gv4,gv5,gv2);
                 if(quad_ref_map.find(quad1)!=quad_ref_map.end())
                 {
                     refer = quad_ref_map[quad1];
@@ -679,11 +664,7 @@ int main(int argc, char** argv)
                 }
                 
                 
-                std::set<int> quad2;
-                quad2.insert(gv0);
-                quad2.insert(gv2);
-                quad2.insert(gv5);
-                quad2.insert(gv3);
+                QuadKey quad2 = MakeQuadKey(gv0,gv2,gv5,gv3);
                 if(quad_ref_map.find(quad2)!=quad_ref_map.end())
                 {
                     refer = quad_ref_map[quad2];
@@ -697,11 +678,6 @@ int main(int argc, char** argv)
                     qt++;
                 }
                 
-                tria0.clear();
-                tria1.clear();
-                quad0.clear();
-                quad1.clear();
-                quad2.clear();
 
             }
             
@@ -713,11 +689,8 @@ int main(int argc, char** argv)
                 int gv2 = ienit->second[2];
                 int gv3 = ienit->second[3];
    
-                std::set<int> tria0;
                 
-                tria0.insert(gv0);
-                tria0.insert(gv2);
-                tria0.insert(gv1);
+                TriKey tria0 = MakeTriKey(gv0,gv2,gv1);
                 
                 if(tria_ref_map.find(tria0)!=tria_ref_map.end())
                 {
@@ -735,11 +708,8 @@ int main(int argc, char** argv)
                     }
                     tt++;
                 }
-                std::set<int> tria1;
                     
-                tria1.insert(gv1);
-                tria1.insert(gv2);
-                tria1.insert(gv3);
+                TriKey tria1 = MakeTriKey(gv1,gv2,gv3);
                 
                 if(tria_ref_map.find(tria1)!=tria_ref_map.end())
                 {
@@ -758,11 +728,8 @@ int main(int argc, char** argv)
                     tt++;
                 }
                 
-                std::set<int> tria2;
                 
-                tria2.insert(gv0);
-                tria2.insert(gv3);
-                tria2.insert(gv2);
+                TriKey tria2 = MakeTriKey(gv0,gv3,gv2);
                 
                 if(tria_ref_map.find(tria2)!=tria_ref_map.end())
                 {
@@ -781,11 +748,8 @@ int main(int argc, char** argv)
                     tt++;
                 }
                 
-                std::set<int> tria3;
                                            
-                tria3.insert(gv0);
-                tria3.insert(gv1);
-                tria3.insert(gv3);
+                TriKey tria3 = MakeTriKey(gv0,gv1,gv3);
                 
                 if(tria_ref_map.find(tria3)!=tria_ref_map.end())
                 {
@@ -804,10 +768,6 @@ int main(int argc, char** argv)
                     tt++;
                 }
                 
-                tria0.clear();
-                tria1.clear();
-                tria2.clear();
-                tria3.clear();
             }
         }
         
@@ -1043,8 +1003,6 @@ int main(int argc, char** argv)
         std::cout<<"Started writing the adapted tetrahedra mesh in ---> OuterVolume.dat"<<std::endl;
          OutputMesh_MMG_Slice(mmgMesh_TETCOPY,0,mmgMesh_TETCOPY->ne,"OuterVolume.dat");
         std::cout<<"Finished writing the adapted tetrahedra mesh in ---> OuterVolume.dat"<<std::endl;
-        
-        WriteUS3DGridFromMMG_itN(mmgMesh_hyb, mmgSol_hyb, us3d);
         /**/
         
         
@@ -1054,6 +1012,14 @@ int main(int argc, char** argv)
     }
     /**/
     
+    WriteUS3DGridFromMMG(mmgMesh_hyb, us3d, 1, 0, comm);
+    if(world_rank == 0)
+    {
+        MMG3D_Free_all(MMG5_ARG_start,
+                       MMG5_ARG_ppMesh,&mmgMesh_hyb,MMG5_ARG_ppSols,&mmgSol_hyb,
+                       MMG5_ARG_end);
+    }
+    
 
     MPI_Finalize();
     
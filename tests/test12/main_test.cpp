@@ -0,0 +1,200 @@
+#include "../../src/adapt_recongrad.h"
+#include "../../src/adapt_io.h"
+#include "../../src/adapt_parops.h"
+#include <iomanip>
+
+
+// Builds the least-squares stencil of element elID in the same way as
+// ComputedUdx_LSQ_US3D_Vec and solves it with SolveQR (LAPACK).
+Array<double>* ReferenceGradient(Partition* P, std::map<int,Array<double>* >& U, int elID)
+{
+    std::vector<Vert*> LocalVs             = P->getLocalVerts();
+    std::map<int,std::vector<int> > gE2lV = P->getGlobElem2LocVerts();
+    std::map<int,int> gV2lV               = P->getGlobalVert2LocalVert();
+    std::map<int,int> LocElem2Nf          = P->getLocElem2Nf();
+    i_part_map* ifn_vec        = P->getIFNpartmap();
+    i_part_map* ief_part_map   = P->getIEFpartmap();
+    i_part_map* iee_vec        = P->getIEEpartmap();
+    i_part_map* if_Nv_part_map = P->getIF_Nvpartmap();
+    int Nel  = P->getGlobalPartition()->getNrow();
+    int nadj = LocElem2Nf[elID];
+
+    double* Pijk = new double[gE2lV[elID].size()*3];
+    for(int k=0;k<gE2lV[elID].size();k++)
+    {
+        Pijk[k*3+0] = LocalVs[gE2lV[elID][k]]->x;
+        Pijk[k*3+1] = LocalVs[gE2lV[elID][k]]->y;
+        Pijk[k*3+2] = LocalVs[gE2lV[elID][k]]->z;
+    }
+    Vert* Vijk = ComputeCentroidCoord(Pijk,gE2lV[elID].size());
+
+    double* A_cm = new double[nadj*3];
+    Array<double>* b = new Array<double>(nadj,1);
+
+    for(int t=0;t<nadj;t++)
+    {
+        int adjID = iee_vec->i_map[elID][t];
+        Vert* Vn;
+        double du = 0.0;
+        if(adjID<Nel)
+        {
+            double* Padj = new double[gE2lV[adjID].size()*3];
+            for(int k=0;k<gE2lV[adjID].size();k++)
+            {
+                Padj[k*3+0] = LocalVs[gE2lV[adjID][k]]->x;
+                Padj[k*3+1] = LocalVs[gE2lV[adjID][k]]->y;
+                Padj[k*3+2] = LocalVs[gE2lV[adjID][k]]->z;
+            }
+            Vn = ComputeCentroidCoord(Padj,gE2lV[adjID].size());
+            du = U[adjID]->getVal(0,0)-U[elID]->getVal(0,0);
+            delete[] Padj;
+        }
+        else
+        {
+            int fid    = ief_part_map->i_map[elID][t];
+            int NvPerF = if_Nv_part_map->i_map[fid][0];
+            Vn = new Vert;
+            Vn->x = 0.0;Vn->y = 0.0;Vn->z = 0.0;
+            for(int s=0;s<NvPerF;s++)
+            {
+                int lvid = gV2lV[ifn_vec->i_map[fid][s]];
+                Vn->x = Vn->x+LocalVs[lvid]->x/NvPerF;
+                Vn->y = Vn->y+LocalVs[lvid]->y/NvPerF;
+                Vn->z = Vn->z+LocalVs[lvid]->z/NvPerF;
+            }
+        }
+
+        double d = sqrt((Vn->x-Vijk->x)*(Vn->x-Vijk->x)+
+                        (Vn->y-Vijk->y)*(Vn->y-Vijk->y)+
+                        (Vn->z-Vijk->z)*(Vn->z-Vijk->z));
+
+        A_cm[0*nadj+t] = (Vn->x-Vijk->x)/d;
+        A_cm[1*nadj+t] = (Vn->y-Vijk->y)/d;
+        A_cm[2*nadj+t] = (Vn->z-Vijk->z)/d;
+        b->setVal(t,0,du/d);
+
+        delete Vn;
+    }
+
+    Array<double>* x = SolveQR(A_cm,nadj,3,b);
+
+    delete Vijk;
+    delete[] Pijk;
+    delete[] A_cm;
+    delete b;
+
+    return x;
+}
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+    MPI_Info info = MPI_INFO_NULL;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    // test1 uses the hexahedral mesh, test6 the hybrid (tetrahedra+prisms) mesh.
+    const char* fn_grid="../test_mesh/cylinder_hex/grid.h5";
+    const char* fn_conn="../test_mesh/cylinder_hex/conn.h5";
+    const char* fn_data="../test_mesh/cylinder_hex/data.h5";
+
+    if(argc>1 && strcmp(argv[1],"hybrid")==0)
+    {
+        fn_grid="../test_mesh/cylinder_hybrid/grid.h5";
+        fn_conn="../test_mesh/cylinder_hybrid/conn.h5";
+        fn_data="../test_mesh/cylinder_hybrid/data.h5";
+    }
+
+    US3D* us3d = ReadUS3DData(fn_conn,fn_grid,fn_data,0,comm,info);
+
+    int Nel_part = us3d->ien->getNrow();
+    int varia    = 4;
+
+    Array<double>* Ui = new Array<double>(Nel_part,1);
+    for(int i=0;i<Nel_part;i++)
+    {
+        Ui->setVal(i,0,us3d->interior->getVal(i,varia));
+    }
+
+    ParallelState* ien_pstate               = new ParallelState(us3d->ien->getNglob(),comm);
+    ParallelState* ife_pstate               = new ParallelState(us3d->ifn->getNglob(),comm);
+    ParallelState_Parmetis* parmetis_pstate = new ParallelState_Parmetis(us3d->ien,us3d->elTypes,us3d->ie_Nv,comm);
+    ParallelState* xcn_pstate               = new ParallelState(us3d->xcn->getNglob(),comm);
+
+    Partition* P = new Partition(us3d->ien, us3d->iee, us3d->ief, us3d->ie_Nv , us3d->ie_Nf,
+                                 us3d->ifn, us3d->ife, us3d->if_ref, us3d->if_Nv,
+                                 parmetis_pstate, ien_pstate, ife_pstate,
+                                 us3d->xcn, xcn_pstate, Ui, comm);
+
+    std::vector<int> LocElem   = P->getLocElem();
+    std::vector<double> Uvaria = P->getLocElemVaria();
+    std::map<int,Array<double>*> U_map;
+    for(int i=0;i<LocElem.size();i++)
+    {
+        Array<double>* Uarr = new Array<double>(1,1);
+        Uarr->setVal(0,0,Uvaria[i]);
+        U_map[LocElem[i]] = Uarr;
+    }
+
+    P->AddStateVecForAdjacentElements(U_map,1,comm);
+
+    Array<double>* gB = new Array<double>(us3d->ghost->getNrow(),1);
+    for(int i=0;i<us3d->ghost->getNrow();i++)
+    {
+        gB->setVal(i,0,us3d->ghost->getVal(i,varia));
+    }
+
+    clock_t t = clock();
+    std::map<int,Array<double>* > dUdXi = ComputedUdx_LSQ_US3D(P,U_map,gB,comm);
+    double Gtiming = ( std::clock() - t) / (double) CLOCKS_PER_SEC;
+
+    double max_err = 0.0;
+    double max_ref = 0.0;
+    double Rtiming = 0.0;
+    for(int i=0;i<LocElem.size();i++)
+    {
+        int elID = LocElem[i];
+        t = clock();
+        Array<double>* x = ReferenceGradient(P,U_map,elID);
+        Rtiming = Rtiming + ( std::clock() - t) / (double) CLOCKS_PER_SEC;
+        for(int j=0;j<3;j++)
+        {
+            max_err = std::max(max_err,fabs(x->getVal(j,0)-dUdXi[elID]->getVal(j,0)));
+            max_ref = std::max(max_ref,fabs(x->getVal(j,0)));
+        }
+        delete x;
+    }
+
+    double max_err_glob = 0.0;
+    double max_ref_glob = 0.0;
+    double Gmax_time    = 0.0;
+    double Rmax_time    = 0.0;
+    MPI_Allreduce(&max_err, &max_err_glob, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&max_ref, &max_ref_glob, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&Gtiming, &Gmax_time, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&Rtiming, &Rmax_time, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    if(world_rank == 0)
+    {
+        std::cout << "Timing gradient reconstruction (batched kernel)... " << Gmax_time << std::endl;
+        std::cout << "Timing stencil assembly + SolveQR (reference)...   " << Rmax_time << std::endl;
+        std::cout << "Max difference with SolveQR = " << std::setprecision(16) << max_err_glob << " (max |dU/dx| = " << max_ref_glob << ")" << std::endl;
+        if(max_err_glob <= 1.0e-10*std::max(1.0,max_ref_glob))
+        {
+            std::cout << "TEST PASSED" << std::endl;
+        }
+        else
+        {
+            std::cout << "TEST FAILED" << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+
+}
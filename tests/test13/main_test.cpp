@@ -0,0 +1,111 @@
+#include "../../src/adapt_parops.h"
+
+
+// Value of entry (row,col) of the synthetic connectivity table.
+char EntryValue(gidx_t row, int col)
+{
+    return char((row*8+col)%127);
+}
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    // 2^28+1 rows of 8 entries, like ien, give 2^31+8 entries. One byte per entry keeps the
+    // table on rank 0 at 2 GB.
+    int nrow = 268435457;
+    int ncol = 8;
+    if(argc>1)
+    {
+        nrow = atoi(argv[1]);
+    }
+
+    ParallelState* pstate = new ParallelState(nrow,comm);
+    int nloc   = pstate->getNloc(world_rank);
+    int offset = pstate->getOffset(world_rank);
+    gidx_t nentries = gidx_t(nrow)*ncol;
+
+    // Rank 0 writes its rows directly into the gathered table.
+    Array<char>* A;
+    Array<char>* A_g;
+    char* sendbuf;
+    if(world_rank == 0)
+    {
+        A_g = new Array<char>(nrow,ncol);
+        A   = NULL;
+        for(int i=0;i<nloc;i++)
+        {
+            for(int j=0;j<ncol;j++)
+            {
+                A_g->setVal(i,j,EntryValue(i,j));
+            }
+        }
+        sendbuf = (char*)MPI_IN_PLACE;
+    }
+    else
+    {
+        A_g = NULL;
+        A   = new Array<char>(nloc,ncol);
+        for(int i=0;i<nloc;i++)
+        {
+            for(int j=0;j<ncol;j++)
+            {
+                A->setVal(i,j,EntryValue(gidx_t(offset)+i,j));
+            }
+        }
+        sendbuf = &A->data[0];
+    }
+
+    std::vector<int> offsets(pstate->getOffsets(),pstate->getOffsets()+world_size);
+    clock_t t = clock();
+    GatherRowsOnRoot(sendbuf, nloc, ncol, (world_rank == 0) ? &A_g->data[0] : NULL,
+                     pstate->getNlocs(), &offsets[0], comm);
+    double Gtiming = ( std::clock() - t) / (double) CLOCKS_PER_SEC;
+
+    if(world_rank == 0)
+    {
+        gidx_t nwrong = 0;
+        for(gidx_t k=0;k<nentries;k++)
+        {
+            if(A_g->data[k] != EntryValue(k/ncol,int(k%ncol)))
+            {
+                nwrong++;
+            }
+        }
+        if(A_g->getVal(nrow-1,ncol-1) != EntryValue(nrow-1,ncol-1))
+        {
+            nwrong++;
+        }
+        std::cout << "Gathered " << nentries << " entries (2^31 = " << (gidx_t(1)<<31) << ") in " << Gtiming << " s." << std::endl;
+        std::cout << "Wrong entries = " << nwrong << std::endl;
+        if(nwrong == 0 && nentries > (gidx_t(1)<<31))
+        {
+            std::cout << "TEST PASSED" << std::endl;
+        }
+        else if(nwrong == 0)
+        {
+            std::cout << "TEST PASSED (below 2^31 entries)" << std::endl;
+        }
+        else
+        {
+            std::cout << "TEST FAILED" << std::endl;
+        }
+        delete A_g;
+    }
+    else
+    {
+        delete A;
+    }
+    delete pstate;
+
+    MPI_Finalize();
+
+}
@@ -0,0 +1,138 @@
+#include "../../src/adapt_parops.h"
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    // Many small contributions, as in the root stages with a large number of ranks.
+    int nloc  = 1000;
+    int niter = 10;
+    int ncol  = 6;
+    if(argc>1)
+    {
+        nloc = atoi(argv[1]);
+    }
+    if(argc>2)
+    {
+        niter = atoi(argv[2]);
+    }
+
+    // Rank r sends r%3 rows more than nloc, so the blocks differ in size.
+    std::vector<int> nlocs(world_size), offsets(world_size);
+    int nrow = 0;
+    for(int r=0;r<world_size;r++)
+    {
+        nlocs[r]   = nloc+r%3;
+        offsets[r] = nrow;
+        nrow       = nrow+nlocs[r];
+    }
+    std::vector<double> A(nlocs[world_rank]*ncol);
+    for(int i=0;i<nlocs[world_rank];i++)
+    {
+        for(int j=0;j<ncol;j++)
+        {
+            A[i*ncol+j] = (offsets[world_rank]+i)*ncol+j;
+        }
+    }
+    std::vector<double> G_flat(gidx_t(nrow)*ncol,-1.0);
+    std::vector<double> G_node(gidx_t(nrow)*ncol,-1.0);
+
+    double t_flat = 0.0;
+    double t_node = 0.0;
+    for(int it=0;it<niter;it++)
+    {
+        MPI_Barrier(comm);
+        double t = MPI_Wtime();
+        GatherRowsOnRootFlat(&A[0], nlocs[world_rank], ncol, &G_flat[0], &nlocs[0], &offsets[0], comm);
+        t_flat = t_flat+MPI_Wtime()-t;
+
+        MPI_Barrier(comm);
+        t = MPI_Wtime();
+        GatherRowsOnRoot(&A[0], nlocs[world_rank], ncol, &G_node[0], &nlocs[0], &offsets[0], comm);
+        t_node = t_node+MPI_Wtime()-t;
+    }
+
+    int nwrong = 0;
+    if(world_rank == 0)
+    {
+        for(gidx_t k=0;k<gidx_t(nrow)*ncol;k++)
+        {
+            if(G_flat[k] != k || G_node[k] != k)
+            {
+                nwrong++;
+            }
+        }
+    }
+
+    // Broadcast the gathered table back to all ranks.
+    std::vector<double> B_flat(gidx_t(nrow)*ncol), B_node(gidx_t(nrow)*ncol);
+    double tb_flat = 0.0;
+    double tb_node = 0.0;
+    for(int it=0;it<niter;it++)
+    {
+        if(world_rank == 0)
+        {
+            B_flat = G_flat;
+            B_node = G_node;
+        }
+        MPI_Barrier(comm);
+        double t = MPI_Wtime();
+        MPI_Bcast(&B_flat[0], nrow*ncol, MPI_DOUBLE, 0, comm);
+        tb_flat = tb_flat+MPI_Wtime()-t;
+
+        MPI_Barrier(comm);
+        t = MPI_Wtime();
+        BcastRowsFromRoot(&B_node[0], nrow, ncol, comm);
+        tb_node = tb_node+MPI_Wtime()-t;
+    }
+    for(gidx_t k=0;k<gidx_t(nrow)*ncol;k++)
+    {
+        if(B_flat[k] != k || B_node[k] != k)
+        {
+            nwrong++;
+        }
+    }
+
+    double times[4] = {t_flat,t_node,tb_flat,tb_node};
+    double max_times[4];
+    MPI_Reduce(times, max_times, 4, MPI_DOUBLE, MPI_MAX, 0, comm);
+    int nwrong_tot = 0;
+    MPI_Reduce(&nwrong, &nwrong_tot, 1, MPI_INT, MPI_SUM, 0, comm);
+
+    NodeComm* nc = SplitNodeComm(comm);
+    int nnodes = 0;
+    if(world_rank == 0)
+    {
+        MPI_Comm_size(nc->leaders, &nnodes);
+    }
+    FreeNodeComm(nc);
+
+    if(world_rank == 0)
+    {
+        std::cout << world_size << " ranks on " << nnodes << " node(s), " << nrow << " rows of " << ncol << " doubles, " << niter << " iterations." << std::endl;
+        std::cout << "Gather flat      = " << max_times[0] << " s" << std::endl;
+        std::cout << "Gather two-level = " << max_times[1] << " s" << std::endl;
+        std::cout << "Bcast  flat      = " << max_times[2] << " s" << std::endl;
+        std::cout << "Bcast  two-level = " << max_times[3] << " s" << std::endl;
+        std::cout << "Wrong entries = " << nwrong_tot << std::endl;
+        if(nwrong_tot == 0)
+        {
+            std::cout << "TEST PASSED" << std::endl;
+        }
+        else
+        {
+            std::cout << "TEST FAILED" << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+
+}
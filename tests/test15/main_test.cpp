@@ -0,0 +1,163 @@
+#include "../../src/adapt_facekey.h"
+
+
+// Vertex id of corner (i,j,k) of a grid with n cubes in each direction.
+int GridVert(int i, int j, int k, int n)
+{
+    return (k*(n+1)+j)*(n+1)+i;
+}
+
+// Appends the 4 faces of the 6 tetrahedra of cube (i,j,k). All cubes are split along
+// their 0-7 diagonal, so the split matches across the cube faces.
+void AppendCubeFaces(int i, int j, int k, int n, std::vector<int>& tris)
+{
+    int c[8];
+    for(int b=0;b<8;b++)
+    {
+        c[b] = GridVert(i+(b&1),j+((b>>1)&1),k+((b>>2)&1),n);
+    }
+    int paths[6][2] = {{1,3},{1,5},{2,3},{2,6},{4,5},{4,6}};
+    int tet_faces[4][3] = {{1,2,3},{0,3,2},{0,1,3},{0,2,1}};
+    for(int t=0;t<6;t++)
+    {
+        int tet[4] = {c[0],c[paths[t][0]],c[paths[t][1]],c[7]};
+        for(int f=0;f<4;f++)
+        {
+            for(int s=0;s<3;s++)
+            {
+                tris.push_back(tet[tet_faces[f][s]]);
+            }
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    MPI_Init(NULL, NULL);
+
+    MPI_Comm comm = MPI_COMM_WORLD;
+    int world_size;
+    MPI_Comm_size(comm, &world_size);
+    // Get the rank of the process
+    int world_rank;
+    MPI_Comm_rank(comm, &world_rank);
+
+    long nface      = 1000000;
+    int run_std_map = 1;
+    if(argc>1)
+    {
+        nface = atol(argv[1]);
+    }
+    if(argc>2)
+    {
+        run_std_map = atoi(argv[2]);
+    }
+
+    if(world_rank == 0)
+    {
+        int n = std::max(1,int(pow(nface/24.0,1.0/3.0)+0.5));
+        std::vector<int> tris;
+        tris.reserve(size_t(24*3)*n*n*n);
+        for(int k=0;k<n;k++)
+        {
+            for(int j=0;j<n;j++)
+            {
+                for(int i=0;i<n;i++)
+                {
+                    AppendCubeFaces(i,j,k,n,tris);
+                }
+            }
+        }
+        long nvisit = tris.size()/3;
+        int nbnd    = 2*6*n*n;
+
+        double t = MPI_Wtime();
+        TriKeyMap facemap;
+        facemap.reserve(nvisit/2);
+        int fid = 0;
+        for(long f=0;f<nvisit;f++)
+        {
+            TriKey face = MakeTriKey(tris[f*3+0],tris[f*3+1],tris[f*3+2]);
+            TriKeyMap::iterator itf = facemap.find(face);
+            if(itf == facemap.end())
+            {
+                facemap[face] = fid;
+                fid++;
+            }
+            else
+            {
+                facemap.erase(face);
+            }
+        }
+        double t_flat = MPI_Wtime()-t;
+
+        int nwrong = 0;
+        if(fid != (nvisit+nbnd)/2 || facemap.size() != nbnd)
+        {
+            nwrong++;
+        }
+
+        double t_set = 0.0;
+        if(run_std_map)
+        {
+            t = MPI_Wtime();
+            std::map<std::set<int>,int> facemap_set;
+            std::set<int> face;
+            int fid_set = 0;
+            for(long f=0;f<nvisit;f++)
+            {
+                face.insert(tris[f*3+0]);
+                face.insert(tris[f*3+1]);
+                face.insert(tris[f*3+2]);
+                if(facemap_set.find(face) == facemap_set.end())
+                {
+                    facemap_set[face] = fid_set;
+                    fid_set++;
+                }
+                else
+                {
+                    facemap_set.erase(face);
+                }
+                face.clear();
+            }
+            t_set = MPI_Wtime()-t;
+
+            if(facemap_set.size() != facemap.size())
+            {
+                nwrong++;
+            }
+            std::map<std::set<int>,int>::iterator itm;
+            for(itm=facemap_set.begin();itm!=facemap_set.end();itm++)
+            {
+                std::set<int>::iterator itv = itm->first.begin();
+                int v0 = *itv++;
+                int v1 = *itv++;
+                int v2 = *itv;
+                TriKeyMap::iterator itf = facemap.find(MakeTriKey(v0,v1,v2));
+                if(itf == facemap.end() || itf->second != itm->second)
+                {
+                    nwrong++;
+                }
+            }
+        }
+
+        std::cout << n << "^3 cubes, " << nvisit << " face visits, " << fid << " faces, " << facemap.size() << " boundary faces." << std::endl;
+        if(run_std_map)
+        {
+            std::cout << "std::map<std::set<int>,int> = " << t_set << " s" << std::endl;
+        }
+        std::cout << "TriKeyMap                   = " << t_flat << " s" << std::endl;
+        if(nwrong == 0)
+        {
+            std::cout << "TEST PASSED" << std::endl;
+        }
+        else
+        {
+            std::cout << "TEST FAILED" << std::endl;
+        }
+    }
+
+    MPI_Finalize();
+
+}
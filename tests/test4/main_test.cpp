@@ -82,11 +82,12 @@ int main(int argc, char** argv)
     int* xadj = xadj_par;
     int* adjcny = adjncy_par;
     
+    std::vector<int> ien_displs(ienp_test->getOffsets(),ienp_test->getOffsets()+world_size);
     MPI_Allgatherv(&part->data[0],
                    nloc, MPI_INT,
                    &part_global->data[0],
                    ienp_test->getNlocs(),
-                   ienp_test->getOffsets(),
+                   &ien_displs[0],
                    MPI_INT,comm);
     
     std::map<int,std::vector<int> > elms_to_send_to_ranks;